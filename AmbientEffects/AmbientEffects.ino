@@ -3,6 +3,7 @@
   #include <avr/power.h>
 #endif
 #include <FastLED.h>
+#include <EAHeatField.h>
 
 #define DATA_PIN 8
 
@@ -106,6 +107,11 @@ DEFINE_GRADIENT_PALETTE( heatmap_gp ) {
 
 CRGBPalette16 gPal = heatmap_gp;
 
+HeatField<NUM_LEDS, HeatKernel322, HeatSparksPer10> g_oHeatField(
+	COOLING_MIN,
+	COOLING_MAX,
+	HeatSparksPer10(SPARKING, SPARK_HEAT_MIN, SPARK_HEAT_MAX, SPARK_WIDTH));
+
 
 
 void setup()
@@ -171,49 +177,5 @@ void loop()
 
 void UpdateHeat()
 {
-	//// TEMP_CL - just do random
-	//for( int i = 0; i < NUM_LEDS; i++)
-	//{
-	//	heat[i] = random8(0, 255);
-	//}
-	//return;
-  
-
-	// Cool down every cell a little
-	for(int i = 0; i < NUM_LEDS; i++)
-	{
-		heat[i] = qsub8( heat[i],  random8(COOLING_MIN, COOLING_MAX));
-	}
-	
-	// Save a copy for bluring
- 	// TEMP_CL i think I'm running out of memory
-	//memcpy(prev_heat, heat, NUM_LEDS);
- 
-	// Heat from each cell drifts out
-	//// TEMP_CL - assume there are only 3 for now
-	//heat[0] = (heat[0]*3 + heat[1]*2 + heat[2]) / 6;
-	//heat[1] = (heat[1]*3 + heat[1]*2 + heat[2]*2) / 7;
-	//heat[2] = (heat[2]*3 + heat[1]*2 + heat[0]) / 6;
-	for(int i = 1; i < NUM_LEDS-1; i++)
-	{
-		// TEMP_CL i think I'm running out of memory
-		//heat[i] = (prev_heat[i]*3 + prev_heat[i-1]*2 + prev_heat[i+1]*2) / 7;
-		heat[i] = (heat[i]*3 + heat[i-1]*2 + heat[i+1]*2) / 7;
-	}
-	
-	// Randomly ignite new 'sparks' of heat - per 10 leds
-	for(int i = 0; i < NUM_LEDS / 10; i++) {
-		if( random8() < SPARKING )
-		{
-			int y = random8(0, NUM_LEDS - SPARK_WIDTH);
-
-			byte newHeat = random8(SPARK_HEAT_MIN, SPARK_HEAT_MAX);
-			for(int j = 0; j < SPARK_WIDTH; ++j) {
-				heat[y+j] = qadd8( heat[y+j],  newHeat);
-			}
-			//byte halfHeat = newHeat >> 1;
-			//heat[y-1] = qadd8( heat[y], halfHeat );
-			//heat[y+1] = qadd8( heat[y], halfHeat );
-		}
-	}
+	g_oHeatField.Update(heat);
 }
@@ -19,6 +19,19 @@
 // Fast LED lib
 #include <FastLED.h>
 
+// Shared heat simulation
+#include <EAHeatField.h>
+#include <EAHeatColor.h>
+#include <EALayerCompositor.h>
+#include <EAFrameTracker.h>
+#include <EASignalGraph.h>
+#include <EATouchTrigger.h>
+#include <EAAdcSampler.h>
+
+// EEPROM includes
+#include <EEPROM.h>
+#include <EASettingsStore.h>
+
 // Use Serial to print out debug statements
 #define USE_SERIAL_FOR_DEBUGGING true
 
@@ -32,11 +45,18 @@
 #define SENSOR_PIN_CONTROL A3    // Touch pin to turn the system on and off and adjust things
 #define SENSOR_PIN_TOUCH   A1    // Touchtone pin
 
-// Global tuning for touch
+// Global tuning for touch.  MIN_SENSOR_VALUE and MIN_INPUT_VALUE are where the noise
+// floor and margin start, TouchTrigger adjusts them while it runs.
 #define MIN_SENSOR_VALUE 400
 #define MIN_INPUT_VALUE 10
 #define MIN_CONTROL_ON 500
 
+// Touch sampling.  The ADC takes turns between the two sensor pins and every
+// SENSOR_OVERSAMPLING samples of a pin make one reading, 100 readings a second
+// to go with the 10ms time step in ProcessSignal.
+#define SENSOR_OVERSAMPLING 8
+#define SENSOR_SAMPLE_RATE_HZ (100 * SENSOR_OVERSAMPLING * 2)
+
 // Global tuning for LED heat effect
 #define MAX_HEAT 240 // Don't go above 240
 #define FRAMES_PER_SECOND 120
@@ -57,6 +77,10 @@
 // LEDs
 CRGB g_aLeds[NUM_LEDS];
 
+// Only the part of the strip that changed is sent, and nothing at all while the
+// LEDs are off (see EAFrameTracker.h)
+LedFrameTracker<NUM_LEDS> g_oFrameTracker;
+
 // Heat vars
 byte g_ayHeat[NUM_LEDS];
 byte g_ayLastHeat[NUM_LEDS]; // Used for interp between heat frames
@@ -108,6 +132,7 @@ DEFINE_GRADIENT_PALETTE( g_oHeatGP ) {
 
 // Heat palette
 CRGBPalette256 g_oPalHeat = g_oHeatGP;
+HeatColorMap g_oHeatColor(g_oPalHeat);
 
 
 // Cool white gradiant
@@ -121,6 +146,7 @@ DEFINE_GRADIENT_PALETTE( g_oTouchGP ) {
 
 // Touch palette
 CRGBPalette256 g_oPalTouch = g_oTouchGP;
+HeatColorMap g_oTouchColor(g_oPalTouch);
 
 
 // Touch values
@@ -128,6 +154,14 @@ CRGBPalette256 g_oPalTouch = g_oTouchGP;
 // Heat array for quick touches
 byte g_ayTouchHeat[NUM_LEDS];
 
+// The heat with the touches added on top (see EALayerCompositor.h)
+HeatLayer g_aoLayers[] =
+{
+	HeatLayer(g_ayLastHeat, g_ayHeat, g_oHeatColor, LAYER_BLEND_ADD),
+	HeatLayer(NULL, g_ayTouchHeat, g_oTouchColor, LAYER_BLEND_ADD)
+};
+LayerCompositor g_oCompositor;
+
 // Tuning vars for touch light
 #define TOUCH_TRIGGER_FRAMES 10
 #define MIN_TOUCH_BRIGHTNESS 0.3
@@ -136,111 +170,55 @@ byte g_ayTouchHeat[NUM_LEDS];
 #define TOUCH_SMOOTH_DECAY 0.95
 
 // Tuning vars for singal processing
-static float g_fNode0Exp=0.0;
-static int   g_iNode0Avg=2;
-static float g_fNode1Exp=0.3;
-static int   g_iNode1Avg=10;
 static float g_fDetectThreshold=0.4;
-
-// PC singal processing nodes from "InputGraph" program
-#define MAX_NUM_SAMPLES 30
-
-class ProcessingNode
+static float g_fDetectOffThreshold=0.3;
+
+// Signal processing for the touch input, as a table (see EASignalGraph.h) so it can be
+// changed over Serial and saved in EEPROM without building the sketch again (see
+// RunTouchGraphCommand).  The default is the two nodes from the "InputGraph" program, to
+// the bit: node 0 (a 2 sample box) then node 1 (derivative, 0.3 EMA, 10 sample box and
+// 0.6 scale).
+#define TOUCH_GRAPH_MAX_NODES 8
+struct TouchGraphSettings
 {
-  protected:
-  
-  class ProcessingNode* m_pNodeInput;
-  boolean m_bDerivative;
-  float m_fExponentialSmoothingWeight;
-  int m_iAvgSmoothingNumSamples;
-  float m_fScalingFactor;
-
-  float m_fInput;
-  float m_fProcessingVar;
-  float m_fExponentialSmoothedInput;
-  float m_fAvgSmoothedInput;
-
-  float m_afAvgBuffer[MAX_NUM_SAMPLES];
-  int m_iBufferIndex;
-  float m_fOutput;
-  
-  public:
-  
-  ProcessingNode(class ProcessingNode* pNodeInput, boolean bDerivative, float fExponentialSmoothingWeight, int iAvgSmoothingNumSamples, float fScalingFactor)
-  {
-    m_pNodeInput = pNodeInput;
-    m_bDerivative = bDerivative;
-    m_fExponentialSmoothingWeight = fExponentialSmoothingWeight;
-    m_iAvgSmoothingNumSamples = iAvgSmoothingNumSamples;
-    m_fScalingFactor = fScalingFactor;
-
-    m_iBufferIndex = 0;
-  }
-
-  void UpdateFromInput(int iDeltaTimeMS, float fInput)
-  {
-    if(m_bDerivative)
-    {
-      float fOldInput = m_fInput;
-      m_fInput = fInput;
-      m_fProcessingVar = (m_fInput - fOldInput) / iDeltaTimeMS * 1000.0;
-    }
-    else
-    {
-      m_fProcessingVar = fInput;
-    }
-
-    // Smooth the input using a Exponential moving average
-    if(m_fExponentialSmoothingWeight > 0)
-    {
-      m_fExponentialSmoothedInput = m_fProcessingVar * (1.0 - m_fExponentialSmoothingWeight) + m_fExponentialSmoothedInput * m_fExponentialSmoothingWeight;
-    }
-    else
-    {
-      m_fExponentialSmoothedInput = m_fProcessingVar;
-    }
-
-    // Smooth the input using the last n samples (which have already been smoothed with the Exponential smoothing)
-    if(m_iAvgSmoothingNumSamples > 1)
-    {
-      m_iBufferIndex = (m_iBufferIndex + 1) % m_iAvgSmoothingNumSamples;
-      m_afAvgBuffer[m_iBufferIndex] = m_fExponentialSmoothedInput;
-      m_fAvgSmoothedInput = 0;
-      for(int i = 0; i < m_iAvgSmoothingNumSamples; ++i)
-      {
-        m_fAvgSmoothedInput += m_afAvgBuffer[i];
-      }
-      m_fAvgSmoothedInput /= m_iAvgSmoothingNumSamples;
-    }
-    else
-    {
-      m_fAvgSmoothedInput = m_fExponentialSmoothedInput;
-    }
-
-    // The output is the result of both types of smoothing scaled by the scaling factor
-    m_fOutput = m_fAvgSmoothedInput * m_fScalingFactor;
-  }
-
-  void Update(int iDeltaMS)
-  {
-    UpdateFromInput(iDeltaMS, m_pNodeInput->GetOutput());
-  }
-
-  float GetOutput()
-  {
-    return m_fOutput;
-  }
+	SignalGraphTable<TOUCH_GRAPH_MAX_NODES> oTable;
+	uint8_t yInputNode; // Node with the smoothed input
+	uint8_t yDerivNode; // Node with the smoothed 1st derivative
 };
+const TouchGraphSettings g_oDefaultTouchGraph =
+{
+	{
+		5,
+		{
+			{ SIGNAL_NODE_BOX,        SIGNAL_GRAPH_INPUT, 2,   0 }, // 0 Smoothed input
+			{ SIGNAL_NODE_DERIVATIVE, 0,                  0,   0 },
+			{ SIGNAL_NODE_EMA,        1,                  0.3, 0 },
+			{ SIGNAL_NODE_BOX,        2,                  10,  0 },
+			{ SIGNAL_NODE_SCALE,      3,                  0.6, 0 }  // 4 Smoothed 1st derivative
+		}
+	},
+	0,
+	4
+};
+SignalGraph<TOUCH_GRAPH_MAX_NODES> g_oTouchGraph;
+TouchGraphSettings g_oTouchGraphSettings; // The table g_oTouchGraph is running
+TouchGraphSettings g_oEditTouchGraph;     // The table the Serial commands change
 
-// Signal processing node setup
-ProcessingNode g_oNode0(NULL,     false, g_fNode0Exp, g_iNode0Avg, 1.0); // Input
-ProcessingNode g_oNode1(&g_oNode0, true,  g_fNode1Exp, g_iNode1Avg, 0.6); // 1st derivative
+// Where the touch table is saved (see EASettingsStore.h).  Each time TouchGraphSettings
+// changes, increment this.
+#define TOUCH_GRAPH_SCHEMA_VERSION 1
+#define EEPROM_ADDR_TOUCH_GRAPH 0
+#define EEPROM_TOUCH_GRAPH_BYTES 512
+SettingsStore<TouchGraphSettings, EEPROMClass> g_oTouchGraphStore(EEPROM, EEPROM_ADDR_TOUCH_GRAPH, EEPROM_TOUCH_GRAPH_BYTES, TOUCH_GRAPH_SCHEMA_VERSION);
+
+// Serial command line
+char g_szCommand[64];
+int g_iCommandLength = 0;
 
 // Touch vars
-bool g_bDetectOn = false; // If we are actively detecting a touch. This can be TRUE for multiple frames in a row.
+TouchTrigger g_oTouchTrigger(MIN_SENSOR_VALUE, MIN_INPUT_VALUE, g_fDetectThreshold, g_fDetectOffThreshold);
 bool g_bTriggerNow = false; // This is only true for the first frame of detecting a touch.
 float g_fTriggerVelocity = 0.0; // The velocity (0.0-1.0) of the last touch
-float g_fMaxSmoothedInput = 0.1; // Max of the smoothed input so far which is used to set g_fTriggerVelocity
 
 // Touch light vars
 float g_fTouchBrightness = 0.0; 
@@ -250,8 +228,12 @@ float g_fTouchInput = 0;
 bool g_bLedsOn = true;
 bool g_bLastControlTouched = false;
 
-// Current sensor value
+// Current sensor values
 int g_iSensorValue = 0;
+int g_iControlValue = 0;
+
+// Reads the touch and control pins in the background
+AdcSampler<SENSOR_OVERSAMPLING, 2> g_oSensorSampler;
 
 // Smoothied float value of the sensor
 float g_fSmoothedSensor = 0;
@@ -277,97 +259,196 @@ float ClampF(float fVal, float fMin, float fMax)
 
 
 
-// This reads the input nodes and sets g_bDetectOn, g_bTriggerNow, g_fTriggerVelocity, and g_fMaxSmoothedInput
+// This reads the input nodes and sets g_bTriggerNow and g_fTriggerVelocity
 void ProcessSignal()
 {
   float fRawInput = float(g_iSensorValue) / 1024.0; 
 
-  // This doesn't match the main loop time right now but I'm just keeping the old value from the PC program for now
+  // The readings come 100 a second (see SENSOR_SAMPLE_RATE_HZ) so this matches them
   int iDeltaTimeMS = 10; // We might actually get better more consistent results assuming a fixed timestep as opposed to having two loops (the microcontroller and the PC) that sometimes don't sync well.
   
   // Update nodes
-  g_oNode0.UpdateFromInput(iDeltaTimeMS, fRawInput);
-  g_oNode1.Update(iDeltaTimeMS);
+  g_oTouchGraph.Run(fRawInput, iDeltaTimeMS);
   
   // Simple detection for note on
-  float fSmoothedInput = g_oNode0.GetOutput();
-  float fSmoothedFirstDeriv = g_oNode1.GetOutput();
+  float fSmoothedInput = g_oTouchGraph.GetOutput(g_oTouchGraphSettings.yInputNode);
+  float fSmoothedFirstDeriv = g_oTouchGraph.GetOutput(g_oTouchGraphSettings.yDerivNode);
   
-  g_bTriggerNow = false;
-  boolean bOldDetectOn = g_bDetectOn;
-  g_bDetectOn = fSmoothedFirstDeriv > g_fDetectThreshold;
-  if(!bOldDetectOn && g_bDetectOn)
+  // The trigger keeps track of the peak input so the velocity stays in range over time
+  g_bTriggerNow = g_oTouchTrigger.Update(fSmoothedInput, fSmoothedFirstDeriv);
+  if(g_bTriggerNow)
   {
-    // TODO - Find some way to recalibrate this over time as opposed to restarting the app
-    if(fSmoothedInput > g_fMaxSmoothedInput)
-    {
-      g_fMaxSmoothedInput = fSmoothedInput;
-    }
-  
-    g_fTriggerVelocity = ClampF(fSmoothedInput / (g_fMaxSmoothedInput * 0.9), 0.0, 1.0);
-    g_bTriggerNow = true;
+    g_fTriggerVelocity = g_oTouchTrigger.GetVelocity();
   }
 }
 
 
 
-void setup()
+// Run a touch table if it makes sense.  Otherwise the one that was running carries on
+// and this returns false.
+bool LoadTouchGraph(const TouchGraphSettings &oSettings)
 {
-	// Works with Teensy 3.2
-	FastLED.addLeds<NEOPIXEL, DATA_PIN>(g_aLeds, NUM_LEDS);
-	
-	// Works with Teensy 4.0? Nope... :(
-	//FastLED.addLeds<1, SK6812, DATA_PIN, GRB>(g_aLeds, NUM_LEDS);
+	int iNumNodes = oSettings.oTable.m_yNumNodes;
+	if(oSettings.yInputNode >= iNumNodes || oSettings.yDerivNode >= iNumNodes || !g_oTouchGraph.Load(oSettings.oTable))
+	{
+		g_oTouchGraph.Load(g_oTouchGraphSettings.oTable);
+		return false;
+	}
+	if(&oSettings != &g_oTouchGraphSettings)
+	{
+		memcpy(&g_oTouchGraphSettings, &oSettings, sizeof(g_oTouchGraphSettings));
+	}
+	return true;
 }
 
-
-
-void AddSpark(byte ayHeat[], int iMin = 0, int iMax = NUM_LEDS, int iWidth = SPARK_WIDTH, byte ySparkHeatMin = SPARK_HEAT_MIN, byte ySparkHeatMax = SPARK_HEAT_MAX) 
+// The next word of a command, "" if there isn't one
+const char *NextCommandWord()
 {
-	int y = random8(iMin, iMax - iWidth);
+	const char *szWord = strtok(NULL, " ");
+	return szWord ? szWord : "";
+}
 
-	byte yNewHeat = random8(ySparkHeatMin, ySparkHeatMax);
-	for(int j = 0; j < iWidth; ++j)
+// Touch table commands, a line each over Serial:
+//
+//   node <i> <type> <input> <param 1> <param 2>
+//       Set node i of the table being edited.  The type is a SignalNodeType (0 is
+//       SIGNAL_NODE_EMA, see EASignalGraph.h) and input 255 is the sensor.
+//   use <number of nodes> <smoothed input node> <smoothed 1st derivative node>
+//       Run the edited table and save it
+//   default
+//       Go back to the default table and save that
+void RunTouchGraphCommand(char *szCommand)
+{
+	const char *szWord = strtok(szCommand, " ");
+	if(!szWord)
 	{
-		ayHeat[y+j] = qadd8( ayHeat[y+j],  yNewHeat);
+		return;
 	}
-}
-
-
 
-void UpdateHeat(byte ayHeat[], bool bAddSparks)
-{
-	// Cool down every cell a little
-	for(int i = 0; i < NUM_LEDS; i++)
+	if(strcmp(szWord, "node") == 0)
 	{
-		ayHeat[i] = qsub8(ayHeat[i],  random8(COOLING_MIN, COOLING_MAX));
+		int i = atoi(NextCommandWord());
+		if(i < 0 || i >= TOUCH_GRAPH_MAX_NODES)
+		{
+			Serial.println("No such touch node");
+			return;
+		}
+		SignalNodeDesc &oNode = g_oEditTouchGraph.oTable.m_aoNodes[i];
+		oNode.m_yType = atoi(NextCommandWord());
+		oNode.m_yInput = atoi(NextCommandWord());
+		oNode.m_fParam1 = atof(NextCommandWord());
+		oNode.m_fParam2 = atof(NextCommandWord());
 	}
-	 
-	// Heat from each cell drifts out
-	for(int i = 1; i < NUM_LEDS-1; i++)
+	else if(strcmp(szWord, "use") == 0)
 	{
-		ayHeat[i] = (ayHeat[i]*3 + ayHeat[i-1]*2 + ayHeat[i+1]*2) / 7;
+		g_oEditTouchGraph.oTable.m_yNumNodes = atoi(NextCommandWord());
+		g_oEditTouchGraph.yInputNode = atoi(NextCommandWord());
+		g_oEditTouchGraph.yDerivNode = atoi(NextCommandWord());
+		if(!LoadTouchGraph(g_oEditTouchGraph))
+		{
+			Serial.println("That touch table doesn't make sense, still using the old one");
+			return;
+		}
+		g_oTouchGraphStore.Commit(g_oTouchGraphSettings);
+		Serial.println("Touch table saved");
 	}
-	
-	// Randomly ignite new 'sparks' of heat - per 10 leds
-	if(bAddSparks)
+	else if(strcmp(szWord, "default") == 0)
 	{
-		for(int i = 0; i < NUM_LEDS / 10; i++)
+		LoadTouchGraph(g_oDefaultTouchGraph);
+		memcpy(&g_oEditTouchGraph, &g_oDefaultTouchGraph, sizeof(g_oEditTouchGraph));
+		g_oTouchGraphStore.Commit(g_oTouchGraphSettings);
+		Serial.println("Default touch table saved");
+	}
+}
+
+void ReadSerialCommands()
+{
+	while(Serial.available() > 0)
+	{
+		char c = Serial.read();
+		if(c != '\n' && c != '\r')
 		{
-			if(random8() < SPARKING )
+			if(g_iCommandLength < (int)sizeof(g_szCommand) - 1)
 			{
-				AddSpark(ayHeat);
+				g_szCommand[g_iCommandLength++] = c;
 			}
+			continue;
 		}
+		g_szCommand[g_iCommandLength] = 0;
+		g_iCommandLength = 0;
+		RunTouchGraphCommand(g_szCommand);
+	}
+}
+
+
+
+void setup()
+{
+	// Works with Teensy 3.2
+	FastLED.addLeds<NEOPIXEL, DATA_PIN>(g_aLeds, NUM_LEDS);
+	
+	// Works with Teensy 4.0? Nope... :(
+	//FastLED.addLeds<1, SK6812, DATA_PIN, GRB>(g_aLeds, NUM_LEDS);
+
+	// The touch heat is scaled to MAX_HEAT before it picks a color
+	for(int iHeat = 0; iHeat < 256; ++iHeat)
+	{
+		g_oTouchColor.m_ayHeatMap[iHeat] = scale8(iHeat, MAX_HEAT);
+	}
+	g_oCompositor.SetScene(g_aoLayers, 2, 0, millis());
+
+	// The touch table saved in EEPROM, or the default
+	memcpy(&g_oTouchGraphSettings, &g_oDefaultTouchGraph, sizeof(g_oTouchGraphSettings));
+	LoadTouchGraph(g_oDefaultTouchGraph);
+	TouchGraphSettings oSaved;
+	if(g_oTouchGraphStore.Load(oSaved) && !LoadTouchGraph(oSaved))
+	{
+		Serial.println("The saved touch table doesn't make sense, using the default");
 	}
+	memcpy(&g_oEditTouchGraph, &g_oTouchGraphSettings, sizeof(g_oEditTouchGraph));
+
+	// Start sampling the touch pins.  analogRead() can't be used after this.
+	static const uint8_t ayPins[] = {SENSOR_PIN_TOUCH, SENSOR_PIN_CONTROL};
+	g_oSensorSampler.Begin(ayPins, SENSOR_SAMPLE_RATE_HZ);
 }
 
 
 
+// Heat simulations for the main heat and the touch heat.  The touch heat only gets
+// sparks from touches (see UpdateFromTouchInput).
+HeatField<NUM_LEDS, HeatKernel322, HeatSparksPer10> g_oHeatField(
+	COOLING_MIN,
+	COOLING_MAX,
+	HeatSparksPer10(SPARKING, SPARK_HEAT_MIN, SPARK_HEAT_MAX, SPARK_WIDTH));
+HeatField<NUM_LEDS, HeatKernel322, HeatSparksNone> g_oTouchHeatField(
+	COOLING_MIN,
+	COOLING_MAX,
+	HeatSparksNone());
+
+
+
 void UpdateFromTouchInput()
 {
+	// Run the touch detection on every reading taken since the last frame.  A touch
+	// in any of them is a touch this frame.
+	bool bTriggered = false;
+	uint16_t aiReadings[2];
+	while(g_oSensorSampler.ReadBlock(aiReadings))
+	{
+		// Sometimes this system has noise, particularlly if people are near the touch lights
+		// and are only holding the sensor read handled (as opposed to the postive voltage handle).
+		// This takes off the noise floor, which follows the input while nothing is touched.
+		g_iSensorValue = g_oTouchTrigger.RemoveNoiseFloor(aiReadings[0]);
+		g_iControlValue = aiReadings[1];
+
+		// Process the raw sensor value
+		ProcessSignal();
+		bTriggered |= g_bTriggerNow;
+	}
+	g_bTriggerNow = bTriggered;
+
 	// Turn lights off and on based on control pin
-	bool bControlTouched = analogRead(SENSOR_PIN_CONTROL) > MIN_CONTROL_ON;
+	bool bControlTouched = g_iControlValue > MIN_CONTROL_ON;
 	if(bControlTouched & !g_bLastControlTouched)
 	{
 		if(g_bLedsOn) 
@@ -381,24 +462,6 @@ void UpdateFromTouchInput()
 		}
 	}
 	g_bLastControlTouched = bControlTouched;
-	
-	// Read raw touch input value
-	g_iSensorValue = analogRead(SENSOR_PIN_TOUCH);
-
-	// Sometimes this system has noise, particularlly if people are near the touch lights
-	// and are only holding the sensor read handled (as opposed to the postive voltage handle).
-	// This helps removed that noise.
-	if(g_iSensorValue < MIN_SENSOR_VALUE)
-	{
-		g_iSensorValue = 0;
-	}
-	else
-	{
-		g_iSensorValue = g_iSensorValue - MIN_SENSOR_VALUE;
-	}
-	
-	// Process the raw sensor value
-	ProcessSignal();
 
 	// Show touches
 	if(g_bTriggerNow)
@@ -412,13 +475,13 @@ void UpdateFromTouchInput()
 			Serial.println(g_iSensorValue);
 		}
 		
-		AddSpark(g_ayTouchHeat, NUM_LEDS/2, NUM_LEDS, 10, 255, 255);
+		AddHeatSpark(g_ayTouchHeat, NUM_LEDS/2, NUM_LEDS, 10, 255, 255);
 		g_iNumInterpFrames -= HEAT_SPEED_UP_RATE;
 	}
 	
 	// Take raw sensor value and turn it unto a useful input value called fInput
 	float fSensor = 0;
-	if(g_iSensorValue > MIN_INPUT_VALUE)
+	if(g_iSensorValue > g_oTouchTrigger.GetNoiseMargin())
 	{
 		fSensor = g_iSensorValue / 1000.0;
 		if(fSensor > 1.0)
@@ -441,11 +504,13 @@ void UpdateFromTouchInput()
 
 void loop()
 {
+	ReadSerialCommands();
+
 	// Save off the last heat value to interp between
 	memcpy(g_ayLastHeat, g_ayHeat, NUM_LEDS);
 
 	// Update the head simulation 
-	UpdateHeat(g_ayHeat, true);
+	g_oHeatField.Update(g_ayHeat);
 	
 	// Slow things down naturally
 	if(random8(0, 255) < HEAT_SLOW_DOWN_RATE)
@@ -475,7 +540,7 @@ void loop()
 		UpdateFromTouchInput();
 
 		// Update the head simulation 
-		UpdateHeat(g_ayTouchHeat, false);
+		g_oTouchHeatField.Update(g_ayTouchHeat);
  		
 		// If the LEDs are off, we don't need to do anything else.
 		if(!g_bLedsOn)
@@ -487,36 +552,32 @@ void loop()
 			// If the LEDs aren't off, we should adjust the brightness
 			FastLED.setBrightness(LED_BRIGHTNESS_MIN + g_fTouchInput * LED_BRIGHTNESS_TOUCH_ADD);
 
-			// Lerp between the target frames
-			fract8 fLerp = i * 256 / g_iNumInterpFrames;
-			byte yLerpHeat;
-			for(int j = 0; j < NUM_LEDS; ++j)
+			// Work out what each heat value turns into this frame (once for all 256
+			// heat values instead of once per LED)
+			byte yTouchAdd = g_fTouchInput * HEAT_TOUCH_ADD;
+			for(int iHeat = 0; iHeat < 256; ++iHeat)
 			{
-				// Fade between last and cur heat values
-				yLerpHeat = lerp8by8(g_ayLastHeat[j], g_ayHeat[j], fLerp);
-				
-				// Add based on touch
-				yLerpHeat = qadd8(yLerpHeat, g_fTouchInput * HEAT_TOUCH_ADD);
-
-				// Scale heat
-				yLerpHeat = scale8(yLerpHeat, MAX_HEAT);
-				
-				// Get the heat color
-				CRGB color0 = ColorFromPalette(g_oPalHeat, yLerpHeat);
-				
-				// Get the touch color
-				//CRGB color1 = ColorFromPalette(g_oPalTouch, g_fTouchInput * MAX_HEAT);
-				CRGB color1 = ColorFromPalette(g_oPalTouch, scale8(g_ayTouchHeat[j], MAX_HEAT));
-				
-				// Blend them together
-				g_aLeds[j] = color0 + color1;
+				// Add based on touch and scale heat
+				g_oHeatColor.m_ayHeatMap[iHeat] = scale8(qadd8(iHeat, yTouchAdd), MAX_HEAT);
 			}
+
+			// Lerp between the target frames and get the heat colors with the touch
+			// colors added on top
+			fract8 fLerp = i * 256 / g_iNumInterpFrames;
+			g_oCompositor.Render(g_aLeds, NUM_LEDS, fLerp, millis());
 		}
 
-		// Update the LEDs
-		FastLED.show();
+		// Update the LEDs.  These are NeoPixels so sending just the changed start of
+		// the strip leaves the rest as it was.
+		int iNumToSend = g_oFrameTracker.Update(g_aLeds, FastLED.getBrightness());
+		if(iNumToSend > 0)
+		{
+			FastLED[0].setLeds(g_aLeds, iNumToSend);
+			FastLED.show();
+		}
 		
-		// Keep a regular framerate
-		FastLED.delay(1000 / FRAMES_PER_SECOND);
+		// Keep a regular framerate.  This is a plain delay since FastLED.delay() would
+		// keep sending the frame the whole time.
+		delay(1000 / FRAMES_PER_SECOND);
 	}
 }
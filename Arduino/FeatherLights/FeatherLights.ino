@@ -15,6 +15,22 @@
 #endif
 #include <FastLED.h>
 #include <EEPROM.h>
+#include <EAHeatField.h>
+#include <EAHeatColor.h>
+#include <EALayerCompositor.h>
+#include <EAHeatMemory.h>
+#include <EASparkParticles.h>
+#include <EASpeedSmoother.h>
+#include <EATuningLink.h>
+#include <EATelemetry.h>
+// Motion sensor.  Uncomment one of these to time the sensor with hardware input capture
+// instead of a pin interupt (see EAMotionCapture.h for the pins).
+//#define USE_MOTION_CAPTURE_FREQMEASURE
+//#define USE_MOTION_CAPTURE_AVR_ICP
+#include <EAMotionCapture.h>
+#include <EASpeedCurve.h>
+#include <EANodeFrame.h>
+#include <EASettingsStore.h>
 
 // Use Serial to print out debug statements
 static bool USE_SERIAL_FOR_DEBUGGING = true;
@@ -38,14 +54,50 @@ int g_iNodeIndex = -1;
 
 // The address in EEPROM for various saved values
 static const int EEPROM_ADDR_NODE_INDEX = 0;
+
+// The old settings layout.  Only read once to carry the settings over to the store.
 static const int EEPROM_ADDR_DATA_VERSION = 21;
 static const int EEPROM_ADDR_MIN_SPEED = 22;
 static const int EEPROM_ADDR_MAX_SPEED = 24;
 static const int EEPROM_ADDR_NEW_SPEED_WEIGHT = 26;
 static const int EEPROM_ADDR_INPUT_EXPONENT = 28;
+static const int OLD_EEPROM_DATA_VERSION = 2;
 
-// The current data version of the EEPROM data.  Each time the format changes, increment this
-static const int CUR_EEPROM_DATA_VERSION = 2;
+// Tuning settings saved in EEPROM.  These use the same 16 bit scaling as the TUNING
+// frame from the PC (see ApplySettings()).
+struct NodeSettings
+{
+	uint16_t iMinSpeed;
+	uint16_t iMaxSpeed;
+	uint16_t iNewSpeedWeight;
+	uint16_t iInputExponent;
+};
+
+// Where the settings are saved (see EASettingsStore.h).  Each time NodeSettings
+// changes, increment SETTINGS_SCHEMA_VERSION.  New tuning values from the PC are used
+// right away but only saved one byte per loop so a tuning push never stalls the show.
+static const int EEPROM_ADDR_SETTINGS = 32;
+static const int EEPROM_SETTINGS_BYTES = 128;
+static const int SETTINGS_SCHEMA_VERSION = 3;
+SettingsStore<NodeSettings, EEPROMClass> g_oSettingsStore(EEPROM, EEPROM_ADDR_SETTINGS, EEPROM_SETTINGS_BYTES, SETTINGS_SCHEMA_VERSION);
+
+// Confirmation that new tuning values arrived.  DrawTuningConfirmation() draws it
+// over the normal display for a few seconds.
+static const unsigned long TUNING_CONFIRM_STEP_MS = 10;
+static const unsigned long TUNING_CONFIRM_PAUSE_MS = 200;
+static const int TUNING_CONFIRM_PASSES = 2;
+bool g_bTuningConfirmActive = false;
+unsigned long g_iTuningConfirmStartMS = 0;
+
+// Tuning values the PC can set over the USB serial port with TUNING_MSG_SET_TUNING
+// (see EATuningLink.h).  From Python/tuning_link.py that is:
+//
+//   port.write(tuning_link.set_tuning(0, 4)) # Render mode 4
+enum TuningParam
+{
+	TUNING_RENDER_MODE
+};
+TuningFrameReader g_oTuningReader;
 
 // If this is true, we use RS-485 to send signals.
 static const bool USE_RS485 = true;
@@ -86,10 +138,10 @@ int ClampI(int iVal, int iMin, int iMax)
 
 // FastLEDs
 
-// Allotted time in microsecond for LED processing.  Frequently the LEDs code will take
-// different amounts time to run.  This causes changes in the input smoothing code
-//
-#define ALLOTTED_LED_TIME_MICRO 8000
+// Reference frame time in microseconds.  The interp frame counts and fNewSpeedWeight were
+// tuned when every frame was padded out to this length.  Frames now take as long as they
+// take and the smoothing and interp are driven by the measured delta time instead.
+#define REF_FRAME_TIME_MICRO 8000
 
 // Data pin for Adafruit_NeoPixel
 #define LED_DATA_PIN 40
@@ -97,10 +149,8 @@ int ClampI(int iVal, int iMin, int iMax)
 // Create led and head arrays
 CRGB g_LEDs[NUM_NEO_PIXELS];
 byte g_ayHeat[NUM_NEO_PIXELS];
-byte g_ayHeat2[NUM_NEO_PIXELS];
-// TEMP_CL i think I'm running out of memory
-byte g_ayPrevHeat[NUM_NEO_PIXELS]; // Used for frame blending
 byte g_ayLast_heat[NUM_NEO_PIXELS]; // Used for interp between heat frames
+PackedHeat<NUM_NEO_PIXELS> g_oSparkHeat; // Sparks for mode 4, 4 bits a cell is plenty
 
 // Trying more yellow
 // Fire color - bright for club
@@ -137,23 +187,46 @@ DEFINE_GRADIENT_PALETTE( g_Heatmap2_gp ) {
 CRGBPalette256 g_Pal = g_Heatmap_gp;
 CRGBPalette256 g_Pal2 = g_Heatmap2_gp;
 
+// Heat to color tables for g_Pal
+HeatColorMap g_oHeatColor(g_Pal);
+
+// Draws the layers of the render mode into g_LEDs
+LayerCompositor g_oCompositor;
+
+// RAM for the buffers above (LEDs, 2 heat arrays, the packed sparks, 2 palettes and a
+// color map).  The board has 8 KB, the rest is for everything else and the stack.
+#define HEAT_RAM_BUDGET 5120
+typedef HeatMemoryPlan<NUM_NEO_PIXELS, 2, 1, 2, 1> MemoryPlan;
+static_assert(MemoryPlan::TOTAL_BYTES <= HEAT_RAM_BUDGET, "Too many LEDs for the RAM on this board");
+
 
 #define MAX_HEAT 240 // Don't go above 240
 #define ADJUST_CONTRAST_ON_MOVEMENT false
-#define MODE 3
+
+// Render modes (see g_aoRenderModes).  This is the one used at power on.  The PC can
+// switch it while running over the tuning link (see ReadTuningLink()).
+#define NUM_RENDER_MODES 5
+#define DEFAULT_RENDER_MODE 3
+int g_iRenderMode = DEFAULT_RENDER_MODE;
+
+// Mode to switch to once the lights have faded down, or -1
+int g_iNextRenderMode = -1;
 
 
 // Set slowest intermp num frames 
 #define MAX_INTERP_FRAMES 60
 #define MIN_INTERP_FRAMES 10
 
-// Current interp frame
-int g_iCurInterpFrame = 0;
+// Time into the current interp in microseconds
+unsigned long g_iCurInterpTimeMicro = 0;
+
+// Time since the last mode 4 spark step in microseconds
+unsigned long g_iSparkStepTimeMicro = 0;
 
 
 
 // Used for delta time
-unsigned long g_iLastTimeMS;
+unsigned long g_iLastLoopTimeMicro;
 
 // Distance (as ratio from start 0.0 to end 1.0) that it takes to go from 0.0 intensity to 1.0 intensity 
 #define FADE_DISTANCE 1.5
@@ -166,13 +239,6 @@ static const int INT_PIN = 19; // INT7 (interupt 7)
 // This is the number of init loops to code does to test LEDs
 static const int NUM_INIT_LOOPS = 2;
 
-// Recieve data start byte and end byte
-static const int START_RCV_BYTE = 240; // Binary = 11110000 (this also translates to node 7 sending 16 (out of 32) as a motion value).
-static const int END_RCV_BYTE = 241; // Binary = 11110001 (this also translates to node 7 sending 17 (out of 32) as a motion value).
-
-// Recieve data timeout counter.  Use this to avoid getting stuck waiting for data.
-static const int RCV_TIMEOUT_MAX_COUNT = 1000;
-
 // The hardware serial port used for communication (either RS-485 or XBee)
 HardwareSerial Uart = HardwareSerial();
 
@@ -186,19 +252,13 @@ static const int RS485_ENABLE_WRITE_PIN = 22;
 // The motion sensor indicates the speed of the motion detected by oscillating its output pin.
 // The faster the pulses, the faster the motion.  The detect the speed, we are counting the
 // number of microseconds between rising pulses using a hardware interupt pin.  The interupt
-// is called each time a rising pulse is detect and we save off the between the new pulse and
-// the last pulse.  All the other code for calculating speed is done outside of teh interupt
+// is called each time a rising pulse is detect and pushes the time of the pulse into a ring.
+// All the other code for calculating speed is done outside of teh interupt
 // because the interupt code needs to be as light weight at possible so it returns execution
 // to the main code as quickly as possible.
 
-// This is the last period detected
-volatile unsigned long g_iLastPeriodMicro = 0;
-
-// This is the last time the interupt was called
-volatile unsigned long g_iLastTimeMicro = 0;
-
-// The number of tuning vars there are per node.  These are sent from the PC program.
-static int NUM_TUNING_VARS = 4;
+// Median period of all the pulses since the last frame
+MotionCapture g_oMotionCapture(PulsePeriodEstimator::MEDIAN);
 
 // Tuning - The min speed in meters per second to respond to.  Any motion at or below this will be 
 // considered no motion at all.
@@ -208,8 +268,8 @@ float fMinSpeed = 0.02;
 float fMaxSpeed = 0.22;
 
 // Tuning - This is the speed smoothing factor (0, 1.0].  Low values mean more smoothing while a value of 1 means 
-// no smoothing at all.  This value depends on the loop speed so if anything changes the loop speed,
-// the amount of smoothing will change (see LOOP_DELAY_MS).
+// no smoothing at all.  This is the weight given to a new value over one REF_FRAME_TIME_MICRO frame.  The
+// smoother scales it by the real delta time so the amount of smoothing doesn't depend on the loop speed.
 //static float fNewSpeedWeight = 0.15;
 float fNewSpeedWeight = 0.05;
 
@@ -217,18 +277,33 @@ float fNewSpeedWeight = 0.05;
 // to be adjusted in a non-linear fashion.
 float fInputExponent = 1.0;
 
+// Fixed point speed ratio and input exponent curve (see EASpeedCurve.h).  These are
+// set up from the tuning values above by ApplySettings().
+SpeedRatioMap g_oSpeedRatioMap;
+SpeedCurve<> g_oSpeedCurve;
+
+// The curve that turns the display speed ratio into the number of interp frames.
+// Each render mode has its own exponent.  It only picks a whole number of frames so
+// a small table is close enough.
+SpeedCurve<4> g_oInterpFrameCurve;
+
 // This is the outout speed ratio [0, 1.0].  It is based on the speed read from the motion detector
 // and fMinSpeed, fMaxSpeed, fNewSpeedWeight.
 float g_fSpeedRatio;
+SpeedSmoother g_oSpeedSmoother(REF_FRAME_TIME_MICRO / 1000.0);
 
-// Settings needed for timing out nodes in case some disconnect, break, or a signal is lost.
-// These could probably be lower but right now I want to bias towards waiting more to make sure
-// all communication works as opposed to having things still be fast when nodes are removed.
-// This means running a partial node setup isn't a really good idea.
-static const int NODE_COM_TIMEOUT_MS = 30; 
-static const int PC_COM_TIMEOUT_MS = 70;
-int g_iNextNodeIndex = 0;
-unsigned long g_iLastReceiveTime = 0;
+// Speed and loop time diagnostics.  Sampled every loop but only printed as min/mean/max
+// every TELEMETRY_PERIOD_MICRO, and only when there is room in the serial buffer.
+#define TELEMETRY_PERIOD_MICRO 250000
+#define NUM_TELEMETRY_CHANNELS 4
+const char* const g_asTelemetryNames[NUM_TELEMETRY_CHANNELS] =
+{
+	"fNewSpeedRatio",
+	"g_fSpeedRatio",
+	"fDisplaySpeedRatio",
+	"LoopTimeMicro"
+};
+Telemetry<NUM_TELEMETRY_CHANNELS, 4> g_oTelemetry(TELEMETRY_PERIOD_MICRO, g_asTelemetryNames);
 
 
 
@@ -267,6 +342,7 @@ void setup()
 		// setup debugging serial port (over USB cable) at 9600 bps
 		Serial.begin(9600);
 		Serial.println("EAMidiNodes - Setup");
+		MemoryPlan::Report(Serial);
 	}
 
 	// setup Uart
@@ -297,9 +373,16 @@ void setup()
 		EEPROMWrite(EEPROM_ADDR_NODE_INDEX, g_iNodeIndex);
 	}
 
+	// Start from the default speed range and exponent in case nothing was saved
+	g_oSpeedRatioMap.SetRange(fMinSpeed, fMaxSpeed);
+	g_oSpeedCurve.SetExponent(fInputExponent);
+
 	// Read in settings from EPROM
 	ReadSettingsFromEEPROM();
 
+	// Pick the look.  This also sets up the interp frame curve.
+	ApplyRenderMode(DEFAULT_RENDER_MODE);
+
 
 	// Init NeoPixel
 	FastLED.addLeds<NEOPIXEL, LED_DATA_PIN>(g_LEDs, NUM_NEO_PIXELS);
@@ -326,24 +409,35 @@ void setup()
 	}
 
 	// Setup interupt
-	pinMode(INT_PIN, INPUT);
-	attachInterrupt(INT_PIN, MotionDetectorPulse, RISING);   // Attach an Interupt to INT_PIN for timing period of motion detector input
+	g_oMotionCapture.Begin(INT_PIN, RISING);   // Attach an Interupt to INT_PIN for timing period of motion detector input
 }
 
 
 
 void ReadSettingsFromEEPROM()
+{
+	NodeSettings oSettings;
+	if(g_oSettingsStore.Load(oSettings))
+	{
+		ApplySettings(oSettings);
+		return;
+	}
+
+	// Nothing in the store yet.  Carry over settings saved in the old layout.
+	if(ReadOldSettingsFromEEPROM(oSettings))
+	{
+		ApplySettings(oSettings);
+		g_oSettingsStore.Commit(oSettings);
+	}
+}
+
+
+
+// Read settings saved by older versions of this sketch.  Returns false if there aren't any.
+bool ReadOldSettingsFromEEPROM(NodeSettings &oSettings)
 {
 	int ySavedDataVersion = EEPROM.read(EEPROM_ADDR_DATA_VERSION);
-	int ySavedMinSpeedU = EEPROM.read(EEPROM_ADDR_MIN_SPEED);
-	int ySavedMinSpeedL = EEPROM.read(EEPROM_ADDR_MIN_SPEED+1);
-	int ySavedMaxSpeedU = EEPROM.read(EEPROM_ADDR_MAX_SPEED);
-	int ySavedMaxSpeedL = EEPROM.read(EEPROM_ADDR_MAX_SPEED+1);
-	int ySavedNewSpeedWeightU = EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT);
-	int ySavedNewSpeedWeightL = EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT+1);
-	int ySavedInputExponentU = EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT);
-	int ySavedInputExponentL = EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT+1);
-	if( ySavedDataVersion != CUR_EEPROM_DATA_VERSION )
+	if( ySavedDataVersion != OLD_EEPROM_DATA_VERSION )
 	{
 		// Invalid saved settings
 		if(USE_SERIAL_FOR_DEBUGGING)
@@ -351,85 +445,68 @@ void ReadSettingsFromEEPROM()
 			Serial.print("EAMidiNodes - tried to read settings from EEPROM but failed.  Read in data version ");
 			Serial.println(ySavedDataVersion);
 		}
+		return false;
 	}
-	else
-	{
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print("EAMidiNodes - Read in data version ");
-			Serial.println(ySavedDataVersion);
-			Serial.println(ySavedMinSpeedU);
-			Serial.println(ySavedMinSpeedL);
-			Serial.println(ySavedMaxSpeedU);
-			Serial.println(ySavedMaxSpeedL);
-			Serial.println(ySavedNewSpeedWeightU);
-			Serial.println(ySavedNewSpeedWeightL);
-			Serial.println(ySavedInputExponentU);
-			Serial.println(ySavedInputExponentL);
-		}
 
-		// Update fMinSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
-		int iNewMinSpeed = (ySavedMinSpeedU << 8) + ySavedMinSpeedL;
-		fMinSpeed = iNewMinSpeed / 65535.0 * 2.0;
+	memset(&oSettings, 0, sizeof(oSettings));
+	oSettings.iMinSpeed       = (EEPROM.read(EEPROM_ADDR_MIN_SPEED) << 8)        + EEPROM.read(EEPROM_ADDR_MIN_SPEED+1);
+	oSettings.iMaxSpeed       = (EEPROM.read(EEPROM_ADDR_MAX_SPEED) << 8)        + EEPROM.read(EEPROM_ADDR_MAX_SPEED+1);
+	oSettings.iNewSpeedWeight = (EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT) << 8) + EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT+1);
+	oSettings.iInputExponent  = (EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT) << 8)   + EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT+1);
+	return true;
+}
 
-		// Update fMaxSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
-		int iNewMaxSpeed = (ySavedMaxSpeedU << 8) + ySavedMaxSpeedL;
-		fMaxSpeed = iNewMaxSpeed / 65535.0 * 2.0;
 
-		// Update fNewSpeedWeight with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
-		int iNewWeight = (ySavedNewSpeedWeightU << 8) + ySavedNewSpeedWeightL;
-		fNewSpeedWeight = iNewWeight / 65535.0;
 
-		// Update fInputExponent with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
-		int iInputExponent = (ySavedInputExponentU << 8) + ySavedInputExponentL;
-		fInputExponent = iInputExponent / 65535.0 * 5.0;
+// Set the live settings from their 16 bit saved / network values
+void ApplySettings(const NodeSettings &oSettings)
+{
+	// Update fMinSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
+	fMinSpeed = oSettings.iMinSpeed / 65535.0 * 2.0;
 
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.println("Settings from EEPROM:");
-			Serial.print("fMinSpeed=");
-			Serial.println(fMinSpeed);
-			Serial.print("fMaxSpeed=");
-			Serial.println(fMaxSpeed);
-			Serial.print("fNewSpeedWeight*10=");
-			Serial.println(fNewSpeedWeight*10);
-			Serial.print("fInputExponent*10=");
-			Serial.println(fInputExponent*10);
-		}
-	}
-}
+	// Update fMaxSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
+	fMaxSpeed = oSettings.iMaxSpeed / 65535.0 * 2.0;
 
+	// Update fNewSpeedWeight with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
+	fNewSpeedWeight = oSettings.iNewSpeedWeight / 65535.0;
 
-// Interupt called to get time between pulses
-void MotionDetectorPulse()
-{
-	unsigned long iCurTimeMicro = micros();
-	g_iLastPeriodMicro = iCurTimeMicro - g_iLastTimeMicro;
-	g_iLastTimeMicro = iCurTimeMicro;
-}
+	// Update fInputExponent with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
+	fInputExponent = oSettings.iInputExponent / 65535.0 * 5.0;
 
+	// Only redone here, not every frame
+	g_oSpeedRatioMap.SetRange(fMinSpeed, fMaxSpeed);
+	g_oSpeedCurve.SetExponent(fInputExponent);
 
+	if(USE_SERIAL_FOR_DEBUGGING)
+	{
+		Serial.println("New settings:");
+		Serial.print("fMinSpeed=");
+		Serial.println(fMinSpeed);
+		Serial.print("fMaxSpeed=");
+		Serial.println(fMaxSpeed);
+		Serial.print("fNewSpeedWeight*10=");
+		Serial.println(fNewSpeedWeight*10);
+		Serial.print("fInputExponent*10=");
+		Serial.println(fInputExponent*10);
+	}
+}
 
-// Returns the number of micro seconds for the last period (time between pulses)
-// for the motion sensor.  If the time between this call and
-// the last inpterupt call is greater than the last period , we return the time
+
+// Returns the number of micro seconds for the period (time between pulses) for the
+// motion sensor.  This is the median of all the periods since the last call.  If the time
+// between this call and the last inpterupt call is greater than that, we return the time
 // between this call and the the last interupt.  This is to ensure that if we
 // abruptly go from fast motion to slow motion, that this function will not smoothly
-// transition to slow motion.
+// transition to slow motion.  Call this once per frame.
 unsigned long GetLastPeriodMicro()
 {
-	unsigned long iCurTimeMicro = micros();
-	unsigned long iThisPeriodMicro = iCurTimeMicro - g_iLastTimeMicro;
-	if(iThisPeriodMicro < g_iLastPeriodMicro)
-		return g_iLastPeriodMicro;
-	else
-		return iThisPeriodMicro;
+	return g_oMotionCapture.GetPeriodMicro();
 }
 
 
 
-// Returns the current speed of the detected motion in meters per second.
-// It is calculated with the following formula (pulled from the X-Band website)
+// Returns the current speed ratio of the detected motion.  The speed in meters
+// per second is calculated with the following formula (pulled from the X-Band website)
 // http://www.parallax.com/Portals/0/Downloads/docs/prod/sens/32213-X-BandMotionDetector-v1.1.pdf
 //
 // Resulting frequency for speed detection:
@@ -445,12 +522,14 @@ unsigned long GetLastPeriodMicro()
 //
 // Thus and object moving at 0.2 ms/2 =
 // 2*0.2*(10.525*10^9/(3*10^8)) = 14.0333
-float GetCurSpeed()
+//
+// The speed is then clamped to [fMinSpeed, fMaxSpeed] and returned as a ratio
+// of that range [0, Q16_ONE].  g_oSpeedRatioMap does this in fixed point with
+// 70.1666 = (2 * Ft/c) (see EASpeedCurve.h).  The angle (cos(theta)) is ignored
+// because we have no way of knowing it.
+q16_t GetCurSpeedRatio()
 {
-	float iLastPeriod = GetLastPeriodMicro();
-	float fFreq = 1.0 / (iLastPeriod / 1000000.0);
-	float fSpeed = fFreq / 70.1666; // 70.1666 = (2 * Ft/c) - Ignore angle (cos(theta)) because we have no way of knowing it
-	return fSpeed;
+	return g_oSpeedRatioMap.GetRatio(GetLastPeriodMicro());
 }
 
 
@@ -470,130 +549,113 @@ void EEPROMWrite(int iAddr, byte yValue)
 
 
 
-bool ReceiveTuningMessage()
+// Handle tuning link messages from the PC on the USB serial port.  Only whole messages
+// are handled so this never waits for bytes.
+void ReadTuningLink()
 {
-	if(USE_SERIAL_FOR_DEBUGGING)
+	TuningMessage oMsg;
+	while(Serial.available() > 0)
 	{
-		Serial.println("##### ReceiveTuningMessage ######");
-	}
-
-	// Once we have the start of a message, delay until we have it all
-	int iTimeoutCounter = 0;
-	int iNumExpectedBytes = NUM_TUNING_VARS * 2 * NUM_NODES + 1; // 3 tuning vars * 2 bytes per var * number of nodes + the end byte
-	while(Uart.available() < iNumExpectedBytes && iTimeoutCounter < RCV_TIMEOUT_MAX_COUNT)
-	{
-		iTimeoutCounter++;
-		delay(1);
-	}
-
-	// Return false if we hit the timeout max
-	if(iTimeoutCounter >= RCV_TIMEOUT_MAX_COUNT)
-	{
-		if(USE_SERIAL_FOR_DEBUGGING)
+		if(!g_oTuningReader.Feed(Serial.read(), oMsg))
 		{
-			Serial.print("ReceiveTuningMessage timeout: iNumExpectedBytes=");
-			Serial.print(iNumExpectedBytes);
-			Serial.print(" available=");
-			Serial.println(Uart.available());
+			continue;
 		}
 
-		return false;
-	}
-
-	// Read data
-	int iNewMinSpeedU = -1;
-	int iNewMinSpeedL = -1;
-	int iNewMaxSpeedU = -1;
-	int iNewMaxSpeedL = -1;
-	int iNewWeightU = -1;
-	int iNewWeightL = -1;
-	int iNewInputExponentU = -1;
-	int iNewInputExponentL = -1;
-	for(int i = 0; i < NUM_NODES; i++)
-	{
-		// If this is our node, read in the values and save them
-		if(i == g_iNodeIndex)
+		byte yParam;
+		float fValue;
+		if(oMsg.m_yType != TUNING_MSG_SET_TUNING || !oMsg.GetByte(yParam) || !oMsg.GetFloat(fValue))
 		{
-			iNewMinSpeedU      = Uart.read();
-			iNewMinSpeedL      = Uart.read();
-			iNewMaxSpeedU      = Uart.read();
-			iNewMaxSpeedL      = Uart.read();
-			iNewWeightU        = Uart.read();
-			iNewWeightL        = Uart.read();
-			iNewInputExponentU = Uart.read();
-			iNewInputExponentL = Uart.read();
+			DebugLog("Unrecognised tuning message");
+		}
+		// Range checked as a float first, since int() of a NaN or anything
+		// out of range is undefined (a NaN fails both compares)
+		else if(yParam != TUNING_RENDER_MODE || !(fValue >= 0.0f && fValue < NUM_RENDER_MODES) || !SetRenderMode(int(fValue)))
+		{
+			DebugLog("Unrecognised tuning var");
 		}
-		// Otherwise, just read and ignore the results
 		else
 		{
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
+			DebugLog("Render mode = ", int(fValue));
 		}
 	}
+}
 
-	// Return false if we don't hit the correct end byte
-	int iEndByte = Uart.read();
-	if(iEndByte != END_RCV_BYTE)
-	{
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print("Didn't get valid End Byte. iEndByte=");
-			Serial.println(iEndByte);
-		}
 
-		return false;
+
+// Draw the tuning confirmation over this frame.  It sweeps grey from the end of the
+// strip to the start, twice.  The display and the sensing keep running under it.
+void DrawTuningConfirmation()
+{
+	if(!g_bTuningConfirmActive)
+	{
+		return;
 	}
 
-	// Debug saying we got a valid message
-	// This works for both the NeoPixels and the LEDs
-	for(int nLED = 0; nLED < NUM_NEO_PIXELS; nLED++)
+	unsigned long iPassTimeMS = NUM_NEO_PIXELS * TUNING_CONFIRM_STEP_MS + TUNING_CONFIRM_PAUSE_MS;
+	unsigned long iElapsedMS = millis() - g_iTuningConfirmStartMS;
+	if(iElapsedMS >= iPassTimeMS * TUNING_CONFIRM_PASSES)
 	{
-		g_LEDs[nLED] = CRGB::Black;
+		g_bTuningConfirmActive = false;
+		return;
 	}
-	FastLED.show();
-	for(int i = 0; i < 2; i++)
+
+	int iNumLit = min((int)((iElapsedMS % iPassTimeMS) / TUNING_CONFIRM_STEP_MS) + 1, NUM_NEO_PIXELS);
+	for(int j = NUM_NEO_PIXELS - iNumLit; j < NUM_NEO_PIXELS; j++)
 	{
-		for(int j = NUM_NEO_PIXELS - 1; j >= 0; j--)
-		{
-			g_LEDs[j] = CRGB::Grey;
-			FastLED.show();
-			delay(10);
-		}
-		delay(200);
+		g_LEDs[j] = CRGB::Grey;
 	}
+}
+
 
+
+// Pull this node's values out of a TUNING frame from the PC and save them
+bool ReceiveTuningMessage(NodeFrame &oFrame)
+{
 	if(USE_SERIAL_FOR_DEBUGGING)
 	{
-		Serial.println("Get new settings from network:");
-		Serial.println(iNewMinSpeedU);
-		Serial.println(iNewMinSpeedL);
-		Serial.println(iNewMaxSpeedU);
-		Serial.println(iNewMaxSpeedL);
-		Serial.println(iNewWeightU);
-		Serial.println(iNewWeightL);
-		Serial.println(iNewInputExponentU);
-		Serial.println(iNewInputExponentL);
+		Serial.println("##### ReceiveTuningMessage ######");
 	}
 
-	// Save out settings to EEPROM
-	EEPROMWrite(EEPROM_ADDR_DATA_VERSION, CUR_EEPROM_DATA_VERSION);
-	EEPROMWrite(EEPROM_ADDR_MIN_SPEED,   iNewMinSpeedU);
-	EEPROMWrite(EEPROM_ADDR_MIN_SPEED+1, iNewMinSpeedL);
-	EEPROMWrite(EEPROM_ADDR_MAX_SPEED,   iNewMaxSpeedU);
-	EEPROMWrite(EEPROM_ADDR_MAX_SPEED+1, iNewMaxSpeedL);
-	EEPROMWrite(EEPROM_ADDR_NEW_SPEED_WEIGHT,   iNewWeightU);
-	EEPROMWrite(EEPROM_ADDR_NEW_SPEED_WEIGHT+1, iNewWeightL);
-	EEPROMWrite(EEPROM_ADDR_INPUT_EXPONENT,   iNewInputExponentU);
-	EEPROMWrite(EEPROM_ADDR_INPUT_EXPONENT+1, iNewInputExponentL);
-
-	// Read data just written to EEPROM as new settings
-	ReadSettingsFromEEPROM();
+	// Read data.  There are NODE_NUM_TUNING_VARS values for each node.
+	byte yNumNodes;
+	if(!oFrame.GetByte(yNumNodes) || g_iNodeIndex >= yNumNodes)
+	{
+		DebugLog("ReceiveTuningMessage - no values for this node");
+		return false;
+	}
+	uint16_t iSkip;
+	for(int i = 0; i < g_iNodeIndex * NODE_NUM_TUNING_VARS; i++)
+	{
+		oFrame.GetWord(iSkip);
+	}
+	uint16_t iNewMinSpeed;
+	uint16_t iNewMaxSpeed;
+	uint16_t iNewWeight;
+	uint16_t iNewInputExponent;
+	if(!oFrame.GetWord(iNewMinSpeed) ||
+	   !oFrame.GetWord(iNewMaxSpeed) ||
+	   !oFrame.GetWord(iNewWeight) ||
+	   !oFrame.GetWord(iNewInputExponent))
+	{
+		DebugLog("ReceiveTuningMessage - frame too short");
+		return false;
+	}
+
+	NodeSettings oSettings;
+	memset(&oSettings, 0, sizeof(oSettings));
+	oSettings.iMinSpeed = iNewMinSpeed;
+	oSettings.iMaxSpeed = iNewMaxSpeed;
+	oSettings.iNewSpeedWeight = iNewWeight;
+	oSettings.iInputExponent = iNewInputExponent;
+
+	// Use the new settings now and save them over the next few loops.  This replaces
+	// anything from an earlier message that hasn't been saved yet.
+	ApplySettings(oSettings);
+	g_oSettingsStore.BeginCommit(oSettings);
+
+	// Show that we got a valid message
+	g_bTuningConfirmActive = true;
+	g_iTuningConfirmStartMS = millis();
 
 	return true;
 }
@@ -634,117 +696,37 @@ class Color GetIntensityColor(float fIntensity)
 
 
 
-//#define COOLING_MIN  5
-//#define COOLING_MAX  15
-//#define SPARKING 130
-//#define SPARK_HEAT_MIN 50
-//#define SPARK_HEAT_MAX 100
-//#define SPARK_WIDTH 2
+// Heat simulation for mode 0
+HeatField<NUM_NEO_PIXELS, HeatKernel322, HeatSparksPer10> g_oHeatField0(
+	5,   // Cooling min
+	15,  // Cooling max
+	HeatSparksPer10(130, 50, 100, 2)); // Sparking, spark heat min, spark heat max, spark width
 
-void UpdateHeat0(float fDisplaySpeedRatio, int iDeltaTimeMS)
-{
-	static const int COOLING_MIN = 5;
-	static const int COOLING_MAX = 15;
-	static const int SPARKING = 130;
-	static const int SPARK_HEAT_MIN = 50;
-	static const int SPARK_HEAT_MAX = 100;
-	static const int SPARK_WIDTH = 2;
-	
-	//// TEMP_CL - just do random
-	//for( int i = 0; i < NUM_NEO_PIXELS; i++)
-	//{
-	//	g_ayHeat[i] = random8(0, 255);
-	//}
-	//return;
-  
+// Heat simulation for mode 1 - no cooling, blurred, sparks driven by speed (per 100 leds)
+#define BLUR_HALF_WIDTH 2
+#define MAX_SPARKS_PER_SEC 20.0
+#define MIN_SPARKS_PER_SEC 0.5
+HeatField<NUM_NEO_PIXELS, HeatKernelBlur5, HeatSparksTimed> g_oHeatField1(
+	0,
+	0,
+	HeatSparksTimed(MIN_SPARKS_PER_SEC, MAX_SPARKS_PER_SEC, 2, BLUR_HALF_WIDTH));
 
-	// Cool down every cell a little
-	for(int i = 0; i < NUM_NEO_PIXELS; i++)
-	{
-		g_ayHeat[i] = qsub8( g_ayHeat[i],  random8(COOLING_MIN, COOLING_MAX));
-	}
-	
-	// Save a copy for bluring
- 	// TEMP_CL i think I'm running out of memory
-	//memcpy(prev_heat, heat, NUM_NEO_PIXELS);
- 
-	// Heat from each cell drifts out
-	//// TEMP_CL - assume there are only 3 for now
-	//g_ayHeat[0] = (g_ayHeat[0]*3 + g_ayHeat[1]*2 + g_ayHeat[2]) / 6;
-	//g_ayHeat[1] = (g_ayHeat[1]*3 + g_ayHeat[1]*2 + g_ayHeat[2]*2) / 7;
-	//g_ayHeat[2] = (g_ayHeat[2]*3 + g_ayHeat[1]*2 + g_ayHeat[0]) / 6;
-	for(int i = 1; i < NUM_NEO_PIXELS-1; i++)
-	{
-		// TEMP_CL i think I'm running out of memory
-		//g_ayHeat[i] = (prev_heat[i]*3 + prev_heat[i-1]*2 + prev_heat[i+1]*2) / 7;
-		g_ayHeat[i] = (g_ayHeat[i]*3 + g_ayHeat[i-1]*2 + g_ayHeat[i+1]*2) / 7;
-	}
-	
-	// Randomly ignite new 'sparks' of heat - per 10 leds
-	for(int i = 0; i < NUM_NEO_PIXELS / 10; i++) {
-		if( random8() < SPARKING )
-		{
-			int y = random16(0, NUM_NEO_PIXELS - SPARK_WIDTH);
+// Heat simulation for modes 3 and 4
+HeatField<NUM_NEO_PIXELS, HeatKernel322, HeatSparksPer10> g_oHeatField3(
+	5,   // Cooling min
+	15,  // Cooling max
+	HeatSparksPer10(100, 50, 100, 3)); // Sparking, spark heat min, spark heat max, spark width
 
-			byte newHeat = random8(SPARK_HEAT_MIN, SPARK_HEAT_MAX);
-			for(int j = 0; j < SPARK_WIDTH; ++j) {
-				g_ayHeat[y+j] = qadd8( g_ayHeat[y+j],  newHeat);
-			}
-			//byte halfHeat = newHeat >> 1;
-			//g_ayHeat[y-1] = qadd8( g_ayHeat[y], halfHeat );
-			//g_ayHeat[y+1] = qadd8( g_ayHeat[y], halfHeat );
-		}
-	}
+void UpdateHeat0(float fDisplaySpeedRatio, int iDeltaTimeMS)
+{
+	g_oHeatField0.Update(g_ayHeat);
 }
 
 
 
 void UpdateHeat1(float fDisplaySpeedRatio, int iDeltaTimeMS)
-{	
-	static const int SPARK_WIDTH = 2;
-	
-	// Save a copy for bluring
- 	// TEMP_CL i think I'm running out of memory
-	memcpy(g_ayPrevHeat, g_ayHeat, NUM_NEO_PIXELS);
- 
-	// Heat from each cell drifts out
-	#define BLUR_HALF_WIDTH 2
-	//static const fract8 yBlurScale[] = {16, 32, 159, 32, 16};
-	//static const fract8 yBlurScale[] = {8, 32, 112, 64, 32};
-	//static const fract8 yBlurScale[] = {7, 30, 100, 60, 30};
-	static const fract8 yBlurScale[] = {7, 30, 60, 100, 30};
-	for(int i = BLUR_HALF_WIDTH; i < NUM_NEO_PIXELS-BLUR_HALF_WIDTH; i++)
-	{
-		g_ayHeat[i] = 
-			scale8(g_ayPrevHeat[i-2], yBlurScale[0]) + 
-			scale8(g_ayPrevHeat[i-1], yBlurScale[1]) +
-			scale8(g_ayPrevHeat[i-0], yBlurScale[2]) +
-			scale8(g_ayPrevHeat[i+1], yBlurScale[3]) +
-			scale8(g_ayPrevHeat[i+2], yBlurScale[4]);
-	}
-	
-	// Ignite new 'sparks' of heat - per 100 leds
-	#define MAX_SPARKS_PER_SEC 20.0
-	#define MIN_SPARKS_PER_SEC 0.5
-	byte yNewSparkHeat = 120 + byte(120 * fDisplaySpeedRatio);
-	//float fSParksPerSecond = (fDisplaySpeedRatio * MAX_SPARKS_PER_SEC * NUM_NEO_PIXELS / 100.0) + 0.5; // TEMP_CL - fix
-	float fSParksPerSecond = (fDisplaySpeedRatio * (MAX_SPARKS_PER_SEC - MIN_SPARKS_PER_SEC) + MIN_SPARKS_PER_SEC) *
-							 NUM_NEO_PIXELS / 100.0;
-	int iSparkTimeMS = int(1000 / fSParksPerSecond);
-	static int iTimeSinceSparkMS = 0;
-	iTimeSinceSparkMS += iDeltaTimeMS;
-	while(iTimeSinceSparkMS > iSparkTimeMS)
-	{
-		iTimeSinceSparkMS -= iSparkTimeMS;
-		
-		int y = random16(BLUR_HALF_WIDTH, NUM_NEO_PIXELS - SPARK_WIDTH - BLUR_HALF_WIDTH);
-
-		byte newHeat = yNewSparkHeat;
-		for(int j = 0; j < SPARK_WIDTH; ++j) {
-			g_ayHeat[y+j] = qadd8( g_ayHeat[y+j],  newHeat);
-		}
-
-	}
+{
+	g_oHeatField1.Update(g_ayHeat, fDisplaySpeedRatio, iDeltaTimeMS);
 }
 
 
@@ -804,127 +786,184 @@ void UpdateHeat2(float fDisplaySpeedRatio, int iDeltaTimeMS)
 
 void UpdateHeat3(float fDisplaySpeedRatio, int iDeltaTimeMS)
 {
-	static const int COOLING_MIN = 5;
-	static const int COOLING_MAX = 15;
-	static const int SPARKING = 100;
-	static const int SPARK_HEAT_MIN = 50;
-	static const int SPARK_HEAT_MAX = 100;
-	static const int SPARK_WIDTH = 3;
-	
-	//// TEMP_CL - just do random
-	//for( int i = 0; i < NUM_NEO_PIXELS; i++)
-	//{
-	//	g_ayHeat[i] = random8(0, 255);
-	//}
-	//return;
-  
-
-	// Cool down every cell a little
-	for(int i = 0; i < NUM_NEO_PIXELS; i++)
-	{
-		g_ayHeat[i] = qsub8( g_ayHeat[i],  random8(COOLING_MIN, COOLING_MAX));
-	}
-	
-	// Save a copy for bluring
- 	// TEMP_CL i think I'm running out of memory
-	//memcpy(prev_heat, heat, NUM_NEO_PIXELS);
- 
-	// Heat from each cell drifts out
-	//// TEMP_CL - assume there are only 3 for now
-	//g_ayHeat[0] = (g_ayHeat[0]*3 + g_ayHeat[1]*2 + g_ayHeat[2]) / 6;
-	//g_ayHeat[1] = (g_ayHeat[1]*3 + g_ayHeat[1]*2 + g_ayHeat[2]*2) / 7;
-	//g_ayHeat[2] = (g_ayHeat[2]*3 + g_ayHeat[1]*2 + g_ayHeat[0]) / 6;
-	for(int i = 1; i < NUM_NEO_PIXELS-1; i++)
-	{
-		// TEMP_CL i think I'm running out of memory
-		//g_ayHeat[i] = (prev_heat[i]*3 + prev_heat[i-1]*2 + prev_heat[i+1]*2) / 7;
-		g_ayHeat[i] = (g_ayHeat[i]*3 + g_ayHeat[i-1]*2 + g_ayHeat[i+1]*2) / 7;
-	}
-	
-	// Randomly ignite new 'sparks' of heat - per 10 leds
-	for(int i = 0; i < NUM_NEO_PIXELS / 10; i++) {
-		if( random8() < SPARKING )
-		{
-			int y = random16(0, NUM_NEO_PIXELS - SPARK_WIDTH);
-
-			byte newHeat = random8(SPARK_HEAT_MIN, SPARK_HEAT_MAX);
-			for(int j = 0; j < SPARK_WIDTH; ++j) {
-				g_ayHeat[y+j] = qadd8( g_ayHeat[y+j],  newHeat);
-			}
-			//byte halfHeat = newHeat >> 1;
-			//g_ayHeat[y-1] = qadd8( g_ayHeat[y], halfHeat );
-			//g_ayHeat[y+1] = qadd8( g_ayHeat[y], halfHeat );
-		}
-	}
+	g_oHeatField3.Update(g_ayHeat);
 }
 
 
+// Sparks for mode 4.  They start at the bottom and fly up the strip two cells wide.
 #define NUM_SPARKS 20
+#define SPARK_WIDTH 2
+SparkParticles<NUM_SPARKS, SPARK_WIDTH> g_oSparks;
+SpeedSpawner g_oSparkSpawner(100, 0.75, 10);
+
 void UpdateHeat4(float fDisplaySpeedRatio, int iDeltaTimeMS)
 {
-	//static const float fSpeedMin = 0.75;
-	//static const float fSpeedMax = 2.5;
-	//static const float fSpeedDiff = fSpeedMax - fSpeedMin;
-	//static const float fSpeeds[5] = {0.5, 0.75, 1.0, 1.25, 1.5};
-	//static const float fSpeeds[5] = {1.5, 1.0, 1.0, 2, 2};
-	static const float fSpeeds[5] = {1.0, 1.5, 2.0, 2.5, 3.0};
+	// Cells per step
+	static const uint16_t aiSpeeds[5] = {PARTICLE_CELL, PARTICLE_CELL * 3 / 2, PARTICLE_CELL * 2, PARTICLE_CELL * 5 / 2, PARTICLE_CELL * 3};
 	static const int iFade = 50;
-	
-	static float afPositions[NUM_SPARKS];
-//	= {NUM_NEO_PIXELS, NUM_NEO_PIXELS, NUM_NEO_PIXELS, NUM_NEO_PIXELS};
-	static float afSpeeds[NUM_SPARKS];
-	
+
 	// Fade
-	for(int i = 0; i < NUM_NEO_PIXELS; i++)
-	{
-		g_ayHeat2[i] = qsub8( g_ayHeat2[i],  iFade);
-	}
-	
+	g_oSparkHeat.Fade(iFade);
+
 	// Spawn new sparks based on movement
-	static int iNextSpark = 0;
-	//if(random8() / 255.0 < (fDisplaySpeedRatio - 0.25) * 0.1)
-	static int iNextSparkCountdown = 100;
-	if(fDisplaySpeedRatio > 0.75)
+	if(g_oSparkSpawner.Step(fDisplaySpeedRatio))
 	{
-		iNextSparkCountdown -= int(fDisplaySpeedRatio * 10);
+		g_oSparks.Spawn(0, aiSpeeds[random8(5)], 240);
 	}
-	if(iNextSparkCountdown < 0)
+
+	// Move and flicker between 40 and 240
+	g_oSparks.Update(g_oSparkHeat, NUM_NEO_PIXELS, 43);
+}
+
+
+
+// Set up the heat colors for this frame.  The heat map is filled in for all 256 heat
+// values (not per LED).  The compositor then does the lerp and color lookup for the
+// whole strip.
+void ShadeHeat(float fDisplaySpeedRatio, byte ySpeedAdd, byte yBrightness)
+{
+	for(int i = 0; i < 256; ++i)
 	{
-		iNextSparkCountdown = 100;
-		afPositions[iNextSpark] = 0;
-		//afSpeeds[iNextSpark] = random8(0, 255) / 255.0 * fSpeedDiff + fSpeedMin;
-		afSpeeds[iNextSpark] = fSpeeds[random8(5)];
-		iNextSpark = (iNextSpark + 1) % NUM_SPARKS;
+		// Scale heat
+		byte yHeat = scale8(i, MAX_HEAT);
+		
+		if(ADJUST_CONTRAST_ON_MOVEMENT)
+		{
+			// Try adding contrast based on speed
+			int iMid = MAX_HEAT / 5;
+			yHeat = ClampI((int(yHeat) - iMid) * (fDisplaySpeedRatio * 8 + 1.0) + iMid, 0, MAX_HEAT);
+		}
+		
+		//yHeat = qadd8(yHeat, ySpeedAdd);
+		yHeat = ClampI(yHeat + ySpeedAdd, 0, 240);
+		g_oHeatColor.m_ayHeatMap[i] = yHeat;
 	}
-	
-	// Move
-	int iPos;
-	for(int i = 0; i < NUM_SPARKS; i++)
+	g_oHeatColor.SetBrightness(yBrightness);
+}
+
+
+
+// Heat straight through the palette at full brightness (modes 0 and 1)
+void ShadeHeatPlain(float fDisplaySpeedRatio)
+{
+	ShadeHeat(fDisplaySpeedRatio, 0, 255);
+}
+
+
+
+// Brighter and hotter with speed (mode 3)
+void ShadeHeat3(float fDisplaySpeedRatio)
+{
+	byte ySpeedAdd = byte(32 * fDisplaySpeedRatio);
+	byte yBrightness = byte(225 * fDisplaySpeedRatio) + 30;
+	ShadeHeat(fDisplaySpeedRatio, ySpeedAdd, yBrightness);
+}
+
+
+
+// Like mode 3 but dimmer, with the moving sparks added on top (mode 4)
+void ShadeHeat4(float fDisplaySpeedRatio)
+{
+	byte ySpeedAdd = byte(32 * fDisplaySpeedRatio);
+	byte yBrightness = byte(100 * fDisplaySpeedRatio) + 30;
+	ShadeHeat(fDisplaySpeedRatio, ySpeedAdd, yBrightness);
+}
+
+
+
+// The layers each render mode draws (see EALayerCompositor.h)
+HeatLayer g_aoHeatLayers[] =
+{
+	HeatLayer(g_ayLast_heat, g_ayHeat, g_oHeatColor, LAYER_BLEND_ADD)
+};
+HeatLayer g_aoDirectLayers[] =
+{
+	HeatLayer(NULL, g_ayHeat, g_Pal, LAYER_BLEND_ADD)
+};
+HeatLayer g_aoSparkLayers[] =
+{
+	HeatLayer(g_ayLast_heat, g_ayHeat, g_oHeatColor, LAYER_BLEND_ADD),
+	HeatLayer(g_oSparkHeat, g_Pal2, LAYER_BLEND_ADD)
+};
+#define NUM_LAYERS(a) (sizeof(a) / sizeof(a[0]))
+
+// Time to fade down and back up from one render mode to the next
+#define RENDER_MODE_FADE_MS 1000
+
+// The render modes.  Each one makes new heat frames to interp to and has the layers
+// that turn the heat into colors.  The loops over the LEDs are in the heat updates
+// and the compositor so once a mode is picked nothing is decided per LED.  The
+// number of reference frames each interp takes is:
+//
+//   iSlowInterpFrames - fDisplaySpeedRatio^fInterpExponent * iSpeedInterpFrames
+struct RenderMode
+{
+	int m_iSlowInterpFrames;
+	int m_iSpeedInterpFrames;
+	float m_fInterpExponent;
+
+	// Makes the next heat frame
+	void (*m_pUpdate)(float fDisplaySpeedRatio, int iDeltaTimeMS);
+
+	// Called once per reference frame, or NULL
+	void (*m_pStep)(float fDisplaySpeedRatio, int iDeltaTimeMS);
+
+	// Sets up the heat colors for this frame, or NULL
+	void (*m_pShade)(float fDisplaySpeedRatio);
+
+	// What gets drawn
+	const HeatLayer *m_pLayers;
+	int m_iNumLayers;
+};
+
+static const RenderMode g_aoRenderModes[NUM_RENDER_MODES] =
+{
+	{ MAX_INTERP_FRAMES + MIN_INTERP_FRAMES, MAX_INTERP_FRAMES - MIN_INTERP_FRAMES, 0.5,  UpdateHeat0, NULL,        ShadeHeatPlain, g_aoHeatLayers,   NUM_LAYERS(g_aoHeatLayers) },
+	{ 10,                                    0,                                     1.0,  UpdateHeat1, NULL,        ShadeHeatPlain, g_aoHeatLayers,   NUM_LAYERS(g_aoHeatLayers) },
+	{ 1,                                     0,                                     1.0,  UpdateHeat2, NULL,        NULL,           g_aoDirectLayers, NUM_LAYERS(g_aoDirectLayers) },
+	{ MAX_INTERP_FRAMES + 2,                 MAX_INTERP_FRAMES - 2,                 0.35, UpdateHeat3, NULL,        ShadeHeat3,     g_aoHeatLayers,   NUM_LAYERS(g_aoHeatLayers) },
+	{ MAX_INTERP_FRAMES + 2,                 MAX_INTERP_FRAMES - 2,                 0.35, UpdateHeat3, UpdateHeat4, ShadeHeat4,     g_aoSparkLayers,  NUM_LAYERS(g_aoSparkLayers) }
+};
+
+// The mode in use
+const RenderMode *g_pRenderMode = &g_aoRenderModes[DEFAULT_RENDER_MODE];
+
+
+
+// Switch to another render mode.  Returns false for an unknown mode.  The modes
+// share the heat arrays and g_oHeatColor, so a cross fade between their layers would
+// show the new mode right away.  Instead the lights fade down to black, the mode
+// changes there and they fade back up (see DisplayMovementSpeed()).
+bool SetRenderMode(int iMode)
+{
+	if(iMode < 0 || iMode >= NUM_RENDER_MODES)
 	{
-		if(afPositions[i] < NUM_NEO_PIXELS)
-		{		
-			afPositions[i] = afPositions[i] + afSpeeds[i];
-		}
-		iPos = (int)afPositions[i];
-		if(iPos < NUM_NEO_PIXELS)
-		{	
-			//byte yNewBrightness = 240;
-			byte yNewBrightness = random8(40,240);
-			g_ayHeat2[iPos] = yNewBrightness;
-			g_ayHeat2[iPos-1] = yNewBrightness;
-		}
+		return false;
 	}
+	g_iNextRenderMode = iMode;
+	g_oCompositor.FadeThroughBlack(RENDER_MODE_FADE_MS, millis());
+	return true;
 }
 
 
 
-void DisplayMovementSpeed(float fDisplaySpeedRatio, int iDeltaTimeMS)
+// Use a render mode now
+void ApplyRenderMode(int iMode)
+{
+	g_pRenderMode = &g_aoRenderModes[iMode];
+	g_iRenderMode = iMode;
+	g_oInterpFrameCurve.SetExponent(g_pRenderMode->m_fInterpExponent);
+
+	// Start the new look with a fresh interp
+	g_iCurInterpTimeMicro = 0;
+	g_iSparkStepTimeMicro = 0;
+	g_oCompositor.SetScene(g_pRenderMode->m_pLayers, g_pRenderMode->m_iNumLayers, 0, millis());
+}
+
+
+
+void DisplayMovementSpeed(float fDisplaySpeedRatio, unsigned long iDeltaTimeMicro)
 {
-	// Time vars in microseconds
-	unsigned long iStartTime;
-	unsigned long iEndTime;
-	iStartTime = micros();
-	
 	//fDisplaySpeedRatio = 1.0; // TEMP_CL
 	
 
@@ -938,151 +977,69 @@ void DisplayMovementSpeed(float fDisplaySpeedRatio, int iDeltaTimeMS)
 	//// Write final values to LEDs
 	//FastLED.show();
 
-	
-	// Update frame count
-	g_iCurInterpFrame++;
-	
-	// Get number of interp frames from speed
-	int iNumFrames = MAX_INTERP_FRAMES;
-	if(MODE == 0) 
-	{
-		iNumFrames = MAX_INTERP_FRAMES - int(pow(fDisplaySpeedRatio,0.5) * (MAX_INTERP_FRAMES - MIN_INTERP_FRAMES)) + MIN_INTERP_FRAMES;
-	}
-	else if(MODE == 1)
+	// Change the render mode once the lights are down
+	if(g_iNextRenderMode >= 0 && g_oCompositor.IsPastBlack(millis()))
 	{
-		iNumFrames = 10; 
-	}
-	else if(MODE == 2 )
-	{
-		iNumFrames = 1; 
-	}
-	if( MODE == 3) 
-	{
-		iNumFrames = 
-			MAX_INTERP_FRAMES - 
-			int(pow(fDisplaySpeedRatio,0.35) * (MAX_INTERP_FRAMES - 2)) +
-			2;
-	}
-	if( MODE == 4) 
-	{
-		//iNumFrames = 1; 
-		iNumFrames = 
-			MAX_INTERP_FRAMES - 
-			int(pow(fDisplaySpeedRatio,0.35) * (MAX_INTERP_FRAMES - 2)) +
-			2;
-		UpdateHeat4(fDisplaySpeedRatio, iDeltaTimeMS * iNumFrames);
+		ApplyRenderMode(g_iNextRenderMode);
+		g_iNextRenderMode = -1;
 	}
+
+	const RenderMode &oMode = *g_pRenderMode;
+	
+	// Update interp time
+	g_iCurInterpTimeMicro += iDeltaTimeMicro;
 	
-	// If we're past the number of frames we should have, start a new interp
-	if(g_iCurInterpFrame >= iNumFrames)
+	// Get number of interp frames from speed.  These are counted in reference frames.
+	q16_t iInterpFrameRatio = g_oInterpFrameCurve.Apply(FloatToQ16(fDisplaySpeedRatio));
+	int iNumFrames = oMode.m_iSlowInterpFrames - int(iInterpFrameRatio * oMode.m_iSpeedInterpFrames >> 16);
+	unsigned long iInterpTimeMicro = (unsigned long)iNumFrames * REF_FRAME_TIME_MICRO;
+	int iInterpTimeMS = iInterpTimeMicro / 1000;
+
+	if(oMode.m_pStep != NULL)
 	{
-		// Save off last heat to interp from
-		memcpy(g_ayLast_heat, g_ayHeat, NUM_NEO_PIXELS);
-		
-		// Get a new frame to interp to
-		if(MODE == 0) 
-		{
-			UpdateHeat0(fDisplaySpeedRatio, iDeltaTimeMS * iNumFrames);
-		}
-		else if(MODE == 1)
+		// Things that move a fixed step run once per reference frame
+		g_iSparkStepTimeMicro += iDeltaTimeMicro;
+		if(g_iSparkStepTimeMicro > REF_FRAME_TIME_MICRO * 4)
 		{
-			UpdateHeat1(fDisplaySpeedRatio, iDeltaTimeMS * iNumFrames);
+			// Don't try to catch up after a long hitch
+			g_iSparkStepTimeMicro = REF_FRAME_TIME_MICRO;
 		}
-		else if(MODE == 2)
+		while(g_iSparkStepTimeMicro >= REF_FRAME_TIME_MICRO)
 		{
-			UpdateHeat2(fDisplaySpeedRatio, iDeltaTimeMS * iNumFrames);
+			g_iSparkStepTimeMicro -= REF_FRAME_TIME_MICRO;
+			oMode.m_pStep(fDisplaySpeedRatio, iInterpTimeMS);
 		}
-		else if(MODE == 3)
-		{
-			UpdateHeat3(fDisplaySpeedRatio, iDeltaTimeMS * iNumFrames);
-		}
-		else if(MODE == 4)
-		{
-			UpdateHeat3(fDisplaySpeedRatio, iDeltaTimeMS * iNumFrames);
-		}
-		
-		// Restart interp frame counter
-		g_iCurInterpFrame = 0;
-	}
-  
-	byte ySpeedAdd = 0;
-	byte yBrightness = 0;
-	if(MODE == 3)
-	{
-		ySpeedAdd = byte(32 * fDisplaySpeedRatio);
-		yBrightness = byte(225 * fDisplaySpeedRatio) + 30;
-	}
-	else if(MODE == 4)
-	{
-		ySpeedAdd = byte(32 * fDisplaySpeedRatio);
-		yBrightness = byte(100 * fDisplaySpeedRatio) + 30;
 	}
 	
-	if(MODE == 2) 
+	// If we're past the time this interp should take, start a new interp
+	if(g_iCurInterpTimeMicro >= iInterpTimeMicro)
 	{
-		for( int j = 0; j < NUM_NEO_PIXELS; ++j)
-		{			
-			g_LEDs[j] = ColorFromPalette( g_Pal, g_ayHeat[j]);
-		}
-	}
-	else
-	{
-		// Do interp
-		fract8 fLerp = g_iCurInterpFrame*256/iNumFrames;
-		byte lerpHeat;
-		for( int j = 0; j < NUM_NEO_PIXELS; ++j)
+		// Save off last heat to interp from
+		memcpy(g_ayLast_heat, g_ayHeat, NUM_NEO_PIXELS);
+		
+		// Get a new frame to interp to
+		oMode.m_pUpdate(fDisplaySpeedRatio, iInterpTimeMS);
+		
+		// Restart the interp time but keep any left over so the timing stays even
+		g_iCurInterpTimeMicro -= iInterpTimeMicro;
+		if(g_iCurInterpTimeMicro >= iInterpTimeMicro)
 		{
-			// Fade between last and cur heat values
-			lerpHeat = lerp8by8(g_ayLast_heat[j], g_ayHeat[j], fLerp);
-
-			// Scale heat
-			lerpHeat = scale8(lerpHeat, MAX_HEAT);
-			
-			if(ADJUST_CONTRAST_ON_MOVEMENT)
-			{
-				// Try adding contrast based on speed
-				int iMid = MAX_HEAT / 5;
-				lerpHeat = ClampI((int(lerpHeat) - iMid) * (fDisplaySpeedRatio * 8 + 1.0) + iMid, 0, MAX_HEAT);
-			}
-			
-			if(MODE == 3) 
-			{
-				//byte yOutHeat = qadd8(lerpHeat, ySpeedAdd);
-				byte yOutHeat = ClampI(lerpHeat + ySpeedAdd, 0, 240);
-				g_LEDs[j] = ColorFromPalette( g_Pal, yOutHeat, yBrightness);
-			}
-			else if(MODE == 4) 
-			{
-				//byte yOutHeat = qadd8(lerpHeat, ySpeedAdd);
-				byte yOutHeat = ClampI(lerpHeat + ySpeedAdd, 0, 240);
-				CRGB color0 = ColorFromPalette( g_Pal, yOutHeat, yBrightness);
-				//CRGB color0 = ColorFromPalette( g_Pal, 0);
-				CRGB color1 = ColorFromPalette( g_Pal2, g_ayHeat2[j]);
-				g_LEDs[j] = color0 + color1;
-				//g_LEDs[j] = ColorFromPalette( g_Pal2, g_ayHeat2[j]);
-			}
-			else
-			{
-				g_LEDs[j] = ColorFromPalette( g_Pal, lerpHeat);
-			}
+			g_iCurInterpTimeMicro = 0;
 		}
 	}
 
-	FastLED.show(); // display this frame
-
-	
-	// Make this take a consistent amount of time so the frame rate dependent
-	// smoothing code runs cleanly.
-	iEndTime = micros();
-	int iMicrosToDelay = ALLOTTED_LED_TIME_MICRO - (iEndTime-iStartTime);
-	if(iMicrosToDelay > 0)
+	// Turn the heat into colors
+	if(oMode.m_pShade != NULL)
 	{
-		delayMicroseconds(iMicrosToDelay);
+		oMode.m_pShade(fDisplaySpeedRatio);
 	}
+	fract8 fLerp = g_iCurInterpTimeMicro * 256 / iInterpTimeMicro;
+	g_oCompositor.Render(g_LEDs, NUM_NEO_PIXELS, fLerp, millis());
 
-	//// TEMP_CL - profile
-	//iEndTime = micros();
-	//DebugLog("Total LED time = ",int(iEndTime-iStartTime));
+	// Draw the tuning confirmation on top
+	DrawTuningConfirmation();
+
+	FastLED.show(); // display this frame
 }
 
 
@@ -1094,14 +1051,8 @@ void loop()
 	unsigned long iEndTime;
 	iStartTime = micros();
 
-	// Get the cur
-	float fCurSpeed = GetCurSpeed();
-
-	// Clamp the range of the speed
-	fCurSpeed = Clamp(fCurSpeed, fMinSpeed, fMaxSpeed);
-
-	// Calculate the new speed ratio
-	float fNewSpeedRatio = (fCurSpeed - fMinSpeed) / (fMaxSpeed - fMinSpeed);
+	// Get the current speed ratio
+	float fNewSpeedRatio = Q16ToFloat(GetCurSpeedRatio());
 
 	// TEMP_CL - try this AFTER the smoothing..
 	//// Apply the input exponent to change the input curve
@@ -1111,172 +1062,49 @@ void loop()
 	//Serial.print(" fNewSpeedRatio post exponent = ");
 	//Serial.println(fNewSpeedRatio);
 
+	// Get delta time
+	unsigned long iCurTimeMicro = micros();
+	unsigned long iDeltaTimeMicro = iCurTimeMicro - g_iLastLoopTimeMicro;
+	g_iLastLoopTimeMicro = iCurTimeMicro;
+
 	// Calculate the smoothed speed ratio
-	g_fSpeedRatio = fNewSpeedRatio * fNewSpeedWeight + g_fSpeedRatio * (1.0 - fNewSpeedWeight);
+	g_fSpeedRatio = g_oSpeedSmoother.Update(fNewSpeedRatio, fNewSpeedWeight, iDeltaTimeMicro);
 
 	// Apply the input exponent to change the input curve.  This is the final output.
-	float fDisplaySpeedRatio = pow(g_fSpeedRatio, fInputExponent);
-	Serial.print("TEMP_CL fNewSpeedRatio =");
-	Serial.print(fNewSpeedRatio);
-	Serial.print(" g_fSpeedRatio=");
-	Serial.print(g_fSpeedRatio);
-	Serial.print(" fDisplaySpeedRatio=");
-	Serial.println(fDisplaySpeedRatio);
-
-	// Get delta time.  TODO TEMP_CL - figure out how this different from the CurTime below.
-	// Maybe that time needs to be really really acurate and doing all the LED stuff in the middle
-	// will mess it up?
-	unsigned long iCurTimeMS = millis();
-	int iDeltaTimeMS = iCurTimeMS - g_iLastTimeMS;
-	g_iLastTimeMS = iCurTimeMS;
+	float fDisplaySpeedRatio = Q16ToFloat(g_oSpeedCurve.Apply(FloatToQ16(g_fSpeedRatio)));
 
 	// TEMP_CL
-	if(iDeltaTimeMS > 50)
+	if(iDeltaTimeMicro > 50000)
 	{
 		DebugLog("TEMP_CL - HITCH --------------------------------------------------");
 	}
 
-	// Use the speed ratio to set the brightness of the LEDs
-	DisplayMovementSpeed(fDisplaySpeedRatio, iDeltaTimeMS);
-
-	/* TEMP_CL - not sure we need this now...
-	
-	// Construct the byte to send that contains our node ID
-	// and the current speed.  We are compressing our speed ratio
-	// to 5 bits (32 values) so that it fits in a single byte.
-	// We are also never sending a byte of 0 so make speed run from 1 to 31, not 0 to 31
-	byte ySendByte = g_iNodeIndex << 5;
-	ySendByte = ySendByte | (int(fDisplaySpeedRatio * 30 + 0.5) + 1);
-
-	// Get the current time (after all the sensor and LED stuff)
-	unsigned long iCurTime = millis();
-
-	// Listen for other nodes talking
-	int iNumReadBytes = 0;
-	while(Uart.available() > 0)
-	{
-		// Get the byte 
-		int iReadByte = Uart.read();
-		iNumReadBytes++;
-
-		// Really, I don't think we should be reading more than one each loop... but maybe not?
-		if(iNumReadBytes > 1)
-		{
-			DebugLog("Got more more than a single byte in a loop:", iNumReadBytes);
-		}
-
-		// If we got a new start signal, start trying to read the packet
-		if(iReadByte == START_RCV_BYTE)
-		{
-			ReceiveTuningMessage();
-		}
-		else
-		{
-			// Get the node index of the sender
-			int iIncomingNodeIndex = iReadByte >> 5;
+	// Pick up a new render mode before drawing
+	ReadTuningLink();
 
-			if(USE_SERIAL_FOR_DEBUGGING)
-			{
-				Serial.print(iCurTime);
-				Serial.print(" Got data ");
-				Serial.print(iReadByte);
-				Serial.print(" from node ");
-				Serial.print(iIncomingNodeIndex);
-
-				int iMotion = (iReadByte & 31) << 3;
-				Serial.print(" with value ");
-				Serial.println(iMotion);
-			}
+	// Use the speed ratio to set the brightness of the LEDs
+	DisplayMovementSpeed(fDisplaySpeedRatio, iDeltaTimeMicro);
 
-			// Throw out 0 bytes
-			if(iReadByte == 0)
-			{
-				DebugLog(" ############# Ignoring 0 byte!");
-				continue;
-			}
+	// This node doesn't talk on the com bus for now.  To put it back, bring over
+	// ServiceBus() from EaMidiNodesNeoPixel (EATdmaScheduler.h and EANodeFrame.h) and
+	// call it often enough for the slot guard.
 
-			// Do some error checking that can likely be commented out in a final version
-			// The PC "node" index is NUM_NODES, so accept that as a valid value too.
-			if( iIncomingNodeIndex == g_iNodeIndex ||
-				iIncomingNodeIndex > NUM_NODES )
-			{
-				DebugLog(" ############# Got invlaid node index!");
-			}
-			else
-			{
-				// Save the next node index
-				g_iNextNodeIndex = (iIncomingNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-			}
-		
-			// Save off the time we got this message so we can time out if a node isn't sending.
-			g_iLastReceiveTime = iCurTime;
-		}
-	}
+	// Save any new tuning values a byte at a time
+	g_oSettingsStore.Update();
 
-	if(iNumReadBytes == 0)
+	//// TEMP_CL - Profiling
+	iEndTime = micros();
+	float afSample[NUM_TELEMETRY_CHANNELS] =
 	{
-		unsigned int iTimeout = (g_iNextNodeIndex == NUM_NODES) ? PC_COM_TIMEOUT_MS : NODE_COM_TIMEOUT_MS;
-		// Check for a timeout.
-		if(iCurTime - g_iLastReceiveTime > iTimeout)
-		{
-			if(USE_SERIAL_FOR_DEBUGGING)
-			{
-				Serial.print(iCurTime);
-				Serial.print(" Timeout! g_iNextNodeIndex=");
-				Serial.print(g_iNextNodeIndex);
-				Serial.print(" g_iLastReceiveTime=");
-				Serial.print(g_iLastReceiveTime);
-				Serial.println("");
-			}
-
-			g_iNextNodeIndex = (g_iNextNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-			g_iLastReceiveTime = iCurTime;
-		}
-	}
-
-	// If we are supposed to send next, do that
-	if(g_iNodeIndex == g_iNextNodeIndex)
+		fNewSpeedRatio,
+		g_fSpeedRatio,
+		fDisplaySpeedRatio,
+		float(iEndTime - iStartTime)
+	};
+	g_oTelemetry.Add(afSample);
+	g_oTelemetry.Update(iEndTime);
+	if(USE_SERIAL_FOR_DEBUGGING)
 	{
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print(iCurTime);
-			Serial.print(" About to write data g_iNodeIndex=");
-			Serial.print(g_iNodeIndex);
-			Serial.print(" value=");
-			Serial.print(ySendByte & 31);
-			Serial.println("");
-		}
-
-		if(USE_RS485)
-		{
-			delay(1); // short extra delay just to be safe
-			digitalWrite (RS485_ENABLE_WRITE_PIN, HIGH);  // enable sending
-		}
-		Uart.write(ySendByte);
-		if(USE_RS485)
-		{
-			Uart.flush();
-			delay(1); // short extra delay just to be safe
-			digitalWrite (RS485_ENABLE_WRITE_PIN, LOW);  // disable sending  
-
-		}
-
-		// Update next node now that we have sent
-		g_iNextNodeIndex = (g_iNextNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-
-		// Also reset the time or else we will timeout too early
-		g_iLastReceiveTime = iCurTime;
-
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print(iCurTime);
-			Serial.print(" Just wrote data g_iNodeIndex=");
-			Serial.println(g_iNodeIndex);
-		}
+		g_oTelemetry.SendText(Serial);
 	}
-	*/
-
-	//// TEMP_CL - Profiling
-	iEndTime = micros();
-	DebugLog("Total loop time = ", int(iEndTime-iStartTime));
 }
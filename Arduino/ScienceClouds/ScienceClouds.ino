@@ -12,6 +12,19 @@
 #include <WS2812Serial.h>
 #define USE_WS2812SERIAL
 #include <FastLED.h>
+#include <EAHeatField.h>
+#include <EAHeatColor.h>
+#include <EAFrameTracker.h>
+#include <EALedTiming.h>
+
+// Motion includes
+#include <EASpeedSmoother.h>
+// Motion sensor.  Uncomment one of these to time the sensor with hardware input capture
+// instead of a pin interupt (see EAMotionCapture.h for the pins).
+//#define USE_MOTION_CAPTURE_FREQMEASURE
+//#define USE_MOTION_CAPTURE_AVR_ICP
+#include <EAMotionCapture.h>
+#include <EASpeedCurve.h>
 
 // Audio includes
 #include <Audio.h>
@@ -27,19 +40,57 @@
 
 // EEPROM includes
 #include <EEPROM.h>
+#include <EASettingsStore.h>
+
+// Tuning includes
+#include <EATuningLink.h>
+#include <EATelemetry.h>
 
 
 // LED
-#define DATA_PIN 17
 
 #define NUM_LEDS 1000 
+
+// The LEDs can be wired as NUM_STRIPS runs of LEDS_PER_STRIP, each on its own pin.
+// Every WS2812Serial pin has its own serial port and DMA so the runs all go out at
+// the same time.  Sending 1000 LEDs down one pin takes about 30 ms, which holds the
+// frame rate near 33 FPS, 4 runs get it past FRAMES_PER_SECOND (see EALedTiming.h and
+// Python/led_timing.py).  g_aLeds stays one array with the runs one after another.
+// The WS2812Serial pins the audio shield leaves free on a Teensy 4.0 are 17, 1, 24
+// and 29 (24 and 29 are pads on the bottom).  NUM_STRIPS 1 on pin 17 is the original wiring.
+#define NUM_STRIPS 1
+#define LEDS_PER_STRIP (NUM_LEDS / NUM_STRIPS)
+#define DATA_PIN 17
+#define DATA_PIN_2 1
+#define DATA_PIN_3 24
+#define DATA_PIN_4 29
+
+#if NUM_STRIPS < 1 || NUM_STRIPS > 4 || NUM_LEDS % NUM_STRIPS != 0
+ #error "NUM_STRIPS has to be 1 to 4 and split NUM_LEDS evenly"
+#endif
 #define MAX_HEAT 255
+
+// Reference frame rate.  g_iNumInterpFrames and g_fNewSpeedWeight are counted in frames
+// of this length.  The loop itself isn't held to this rate anymore, the interp and
+// smoothing are driven by the measured delta time.
 #define FRAMES_PER_SECOND 120
+#define REF_FRAME_TIME_MICRO (1000000 / FRAMES_PER_SECOND)
 
 CRGB g_aLeds[NUM_LEDS];
+
+// Skips sending frames that are the same as the last one.  The loop runs much
+// faster than the lerp moves so many are (see EAFrameTracker.h).  WS2812Serial
+// always sends the whole strip so any change sends everything.
+LedFrameTracker<NUM_LEDS> g_oFrameTracker;
 byte g_ayHeat[NUM_LEDS];
 byte g_ayLastHeat[NUM_LEDS]; // Used for interp between heat frames
 
+// Time into the current interp in microseconds
+unsigned long g_iCurInterpTimeMicro = 0;
+
+// Used for delta time
+unsigned long g_iLastLoopTimeMicro = 0;
+
 // Define the color gradient
 #define COLOR_GRAD_SIZE 20
 byte g_ayColorGrad[] = {
@@ -54,6 +105,10 @@ byte g_ayColorGradDefault[COLOR_GRAD_SIZE];
 
 CRGBPalette256 g_oPalHeat;
 
+// Heat to color tables for the palette.  Call g_oHeatColor.PaletteChanged() after
+// loading new colors into g_oPalHeat.
+HeatColorMap g_oHeatColor(g_oPalHeat);
+
 #define COOLING_MIN  8
 #define COOLING_MAX  22
 #define SPARKING 130
@@ -61,6 +116,11 @@ CRGBPalette256 g_oPalHeat;
 #define SPARK_HEAT_MAX 150
 #define SPARK_WIDTH 2
 
+HeatField<NUM_LEDS, HeatKernel322, HeatSparksPer10> g_oHeatField(
+	COOLING_MIN,
+	COOLING_MAX,
+	HeatSparksPer10(SPARKING, SPARK_HEAT_MIN, SPARK_HEAT_MAX, SPARK_WIDTH));
+
 int g_iLedSpacing = 1;
 
 // Color tuning
@@ -113,16 +173,15 @@ bool g_bAudioInitialized;
 // The motion sensor indicates the speed of the motion detected by oscillating its output pin.
 // The faster the pulses, the faster the motion.  The detect the speed, we are counting the
 // number of microseconds between rising pulses using a hardware interrupt pin.  The interrupt
-// is called each time a rising pulse is detect and we save off the between the new pulse and
-// the last pulse.  All the other code for calculating speed is done outside of the interrupt
+// is called each time a rising pulse is detect and pushes the time of the pulse into a ring.
+// All the other code for calculating speed is done outside of the interrupt
 // because the interrupt code needs to be as light weight at possible so it returns execution
 // to the main code as quickly as possible.
 
-// This is the last period detected
-volatile unsigned long g_iLastPeriodMicro = 0;
-
-// This is the last time the interrupt was called
-volatile unsigned long g_iLastTimeMicro = 0;
+// Median period of all the pulses since the last frame.  HACK - For some reason the
+// interrupt is getting called twice in very quick succession so anything 100us or
+// less is treated as the same pulse.
+MotionCapture g_oMotionCapture(PulsePeriodEstimator::MEDIAN, 100);
 
 // TEMP_CL - Testing x-band
 volatile unsigned long g_iPulseCount = 0;
@@ -139,8 +198,8 @@ float g_fMaxSpeedSaved = g_fMaxSpeed;
 float g_fMaxSpeedDefault = g_fMaxSpeed;
 
 // Tuning - This is the speed smoothing factor (0, 1.0].  Low values mean more smoothing while a value of 1 means 
-// no smoothing at all.  This value depends on the loop speed so if anything changes the loop speed,
-// the amount of smoothing will change (see LOOP_DELAY_MS).
+// no smoothing at all.  This is the weight given to a new value over one reference frame (FRAMES_PER_SECOND).
+// The smoother scales it by the real delta time so the amount of smoothing doesn't depend on the loop speed.
 //static float fNewSpeedWeight = 0.15;
 float g_fNewSpeedWeight = 0.03;
 float g_fNewSpeedWeightSaved = g_fNewSpeedWeight;
@@ -155,25 +214,72 @@ float g_fInputExponentDefault = g_fInputExponent;
 // This is the raw speed ratio [0, 1.0].  It is based on the speed read from the motion detector
 // and g_fMinSpeed, g_fMaxSpeed, g_fNewSpeedWeight.
 float g_fRawSpeedRatio;
+SpeedSmoother g_oSpeedSmoother(1000.0 / FRAMES_PER_SECOND);
 
 // This is the outout speed ratio [0, 1.0] after being adjusted with g_fInputExponent 
 float g_fSpeedRatio;
 
-// TEMP_CL
-int g_iPulsesSinceLastTick = 0;
+// Fixed point speed ratio and input exponent curve (see EASpeedCurve.h)
+SpeedRatioMap g_oSpeedRatioMap;
+SpeedCurve<> g_oSpeedCurve;
+
+// Tuning link (binary messages over the serial port, see EATuningLink.h)
+
+TuningFrameReader g_oTuningReader;
+
+// Tuning param ids used by the tuning link.  These have to match tuning_param_list
+// in Python/cloud_tuner.py.
+enum TuningParam
+{
+	TUNING_MIN_SPEED,
+	TUNING_MAX_SPEED,
+	TUNING_NEW_SPEED_WEIGHT,
+	TUNING_INPUT_EXPONENT,
+	TUNING_BASE_HEAT_MAX,
+	TUNING_MOTION_HEAD_MULT,
+	TUNING_MOTION_HEAT_ADD,
+	TUNING_NUM_INTERP_FRAMES,
+	NUM_TUNING_PARAMS
+};
 
-// Reading data from serial port
+// Color gradient ids used by the tuning link
+#define COLOR_GRAD_PAL_HEAT 0
 
-char g_acSerialInputBuffer [256];
-int g_iSerialInputBufferPos = 0;
+// Speed diagnostics for the tuner.  Sampled every frame but only sent as min/mean/max
+// every TELEMETRY_PERIOD_MICRO.  The channel order has to match display_vars_list in
+// Python/cloud_tuner.py.
+#define TELEMETRY_PERIOD_MICRO 50000
+#define NUM_TELEMETRY_CHANNELS 6
+Telemetry<NUM_TELEMETRY_CHANNELS, 4> g_oTelemetry(TELEMETRY_PERIOD_MICRO);
 
 
 // EEPROM saved settigs
 
+// Everything that gets saved, as one record (see EASettingsStore.h)
+struct CloudSettings
+{
+	byte ayColorGrad[COLOR_GRAD_SIZE];
+	float fMinSpeed;
+	float fMaxSpeed;
+	float fNewSpeedWeight;
+	float fInputExponent;
+	byte yBaseHeatMax;
+	float fMotionHeadMult;
+	byte yMotionHeatAdd;
+	int iNumInterpFrames;
+};
+
+// Each time CloudSettings changes, increment this
+#define SETTINGS_SCHEMA_VERSION 3
+#define EEPROM_ADDR_SETTINGS 256
+#define EEPROM_SETTINGS_BYTES 768
+SettingsStore<CloudSettings, EEPROMClass> g_oSettingsStore(EEPROM, EEPROM_ADDR_SETTINGS, EEPROM_SETTINGS_BYTES, SETTINGS_SCHEMA_VERSION);
+
+// The old layout, only read once to carry the settings over to the store
 #define EEPROM_VERSION 2
 #define EEPROM_ADDR_VER 0
 #define EEPROM_ADDR_COLORS 2
-#define EEPROM_ADDR_TUNING 100 // Make sure this is far enough along for larger color arrays
+#define EEPROM_ADDR_TUNING 100
 
 
 
@@ -202,11 +308,25 @@ void setup()
 	
 	// LEDs
 	
-	// WS2812Serial and FastLED
-	LEDS.addLeds<WS2812SERIAL, DATA_PIN, BRG>(g_aLeds, NUM_LEDS);
+	// WS2812Serial and FastLED.  One controller per run, each on its own slice of g_aLeds.
+	LEDS.addLeds<WS2812SERIAL, DATA_PIN, BRG>(g_aLeds, 0, LEDS_PER_STRIP);
+#if NUM_STRIPS > 1
+	LEDS.addLeds<WS2812SERIAL, DATA_PIN_2, BRG>(g_aLeds, 1 * LEDS_PER_STRIP, LEDS_PER_STRIP);
+#endif
+#if NUM_STRIPS > 2
+	LEDS.addLeds<WS2812SERIAL, DATA_PIN_3, BRG>(g_aLeds, 2 * LEDS_PER_STRIP, LEDS_PER_STRIP);
+#endif
+#if NUM_STRIPS > 3
+	LEDS.addLeds<WS2812SERIAL, DATA_PIN_4, BRG>(g_aLeds, 3 * LEDS_PER_STRIP, LEDS_PER_STRIP);
+#endif
+	char sLEDLog[64];
+	snprintf(sLEDLog, sizeof(sLEDLog), "%d LED runs of %d, at most %d FPS", NUM_STRIPS, LEDS_PER_STRIP,
+			 int(LedTiming::MaxFps(NUM_LEDS, NUM_STRIPS, 0, true)));
+	send_log(sLEDLog);
 	
 	// Define color gradiant
 	g_oPalHeat.loadDynamicGradientPalette(g_ayColorGrad);
+	g_oHeatColor.PaletteChanged();
 	
 	
 	// Audio 
@@ -217,14 +337,14 @@ void setup()
 	SPI.setSCK(SDCARD_SCK_PIN);
 	if (!(SD.begin(SDCARD_CS_PIN)))
 	{
-		Serial.println("Unable to access the SD card. Audio not initialized.");
+		send_log("Unable to access the SD card. Audio not initialized.");
 	}
 	else
 	{
 		AudioMemory(8);
 		sgtl5000_1.enable();
 		sgtl5000_1.volume(0.5);
-		Serial.print("Audio and SD card successfully initialized.");
+		send_log("Audio and SD card successfully initialized.");
 		g_bAudioInitialized = true;
 	}
 	delay(1000);
@@ -233,8 +353,7 @@ void setup()
 	// Radar
 	
 	// Attach an Interrupt to INTERRUPT_PIN for timing period of motion detector input
-	pinMode(INTERRUPT_PIN, INPUT);
-	attachInterrupt(digitalPinToInterrupt(INTERRUPT_PIN), MotionDetectorPulse, CHANGE);   
+	g_oMotionCapture.Begin(INTERRUPT_PIN, CHANGE);
 	
 	
 	// EEPROM saved settigs
@@ -254,16 +373,17 @@ void setup()
 }
 
 
-void update_speed() 
+void update_speed(unsigned long iDeltaTimeMicro) 
 {
-	// Get the cur
-	float fRawSpeed = GetCurSpeed();
+	// The tuning can change from the tuner, the saved settings or the defaults.
+	// These only redo their math when the values really changed.
+	g_oSpeedRatioMap.SetRange(g_fMinSpeed, g_fMaxSpeed);
+	g_oSpeedCurve.SetExponent(g_fInputExponent);
 
-	// Clamp the range of the speed
-	float fCurSpeed = Clamp(fRawSpeed, g_fMinSpeed, g_fMaxSpeed);
-
-	// Calculate the new speed ratio
-	float fNewSpeedRatio = (fCurSpeed - g_fMinSpeed) / (g_fMaxSpeed - g_fMinSpeed);
+	// Get the current speed and where it is between g_fMinSpeed and g_fMaxSpeed
+	unsigned long iPeriodMicro = GetLastPeriodMicro();
+	float fRawSpeed = GetCurSpeed(iPeriodMicro);
+	float fNewSpeedRatio = Q16ToFloat(g_oSpeedRatioMap.GetRatio(iPeriodMicro));
 
 	// TEMP_CL - try this AFTER the smoothing..
 	//// Apply the input exponent to change the input curve
@@ -274,117 +394,118 @@ void update_speed()
 	//Serial.println(fNewSpeedRatio);
 
 	// Calculate the smoothed speed ratio
-	if(isnan(g_fRawSpeedRatio))
-	{
-		g_fRawSpeedRatio = fNewSpeedRatio;
-	}
-	else
-	{
-		g_fRawSpeedRatio = fNewSpeedRatio * g_fNewSpeedWeight + g_fRawSpeedRatio * (1.0 - g_fNewSpeedWeight);
-	}
+	g_fRawSpeedRatio = g_oSpeedSmoother.Update(fNewSpeedRatio, g_fNewSpeedWeight, iDeltaTimeMicro);
 
 	// Apply the input exponent to change the input curve.  This is the final output.
-	g_fSpeedRatio = pow(g_fRawSpeedRatio, g_fInputExponent);
+	g_fSpeedRatio = Q16ToFloat(g_oSpeedCurve.Apply(FloatToQ16(g_fRawSpeedRatio)));
 	
 	// TEMP_CL
-	float fPulsesSinceLastTick = g_iPulsesSinceLastTick / 10.0;
-	g_iPulsesSinceLastTick = 0;
+	float fPulsesSinceLastTick = g_oMotionCapture.GetNumPeriods() / 10.0;
 	
-	// Send current status over the serial port either for debugging or talking to tuner program
-	Serial.print("STATUS - ");
-	Serial.print(micros());
-	Serial.print(" -");
-	Serial.print(" fRawSpeed=");
-	Serial.print(fRawSpeed);
-	Serial.print(" fCurSpeed=");
-	Serial.print(fCurSpeed);
-	Serial.print(" fNewSpeedRatio=");
-	Serial.print(fNewSpeedRatio);
-	Serial.print(" g_fRawSpeedRatio=");
-	Serial.print(g_fRawSpeedRatio);
-	Serial.print(" g_fSpeedRatio=");
-	Serial.print(g_fSpeedRatio);
-	Serial.print(" fPulsesSinceLastTick=");
-	Serial.print(fPulsesSinceLastTick);
-	Serial.println("");
+	// Record the current status for the tuner program.  It gets sent from loop() at a fixed rate.
+	float afSample[NUM_TELEMETRY_CHANNELS] =
+	{
+		g_fSpeedRatio,
+		g_fRawSpeedRatio,
+		fNewSpeedRatio,
+		fCurSpeed,
+		fRawSpeed,
+		fPulsesSinceLastTick
+	};
+	g_oTelemetry.Add(afSample);
+}
+
+
+// Write a tuning link message out the serial port
+void send_message(const TuningMessage &oMsg)
+{
+	byte ayFrame[TUNING_MAX_FRAME];
+	int iFrameLength = oMsg.Encode(ayFrame);
+	Serial.write(ayFrame, iFrameLength);
 }
 
+// Send a line of text for the tuner to print
+void send_log(const char *sLog)
+{
+	TuningMessage oMsg;
+	oMsg.Begin(TUNING_MSG_LOG);
+	oMsg.PutBytes(sLog, min((int)strlen(sLog), TUNING_MAX_PAYLOAD));
+	send_message(oMsg);
+}
+
+
+void send_tuning(byte ySet,
+				 float fMinSpeed,
+				 float fMaxSpeed,
+				 float fNewSpeedWeight,
+				 float fInputExponent,
+				 byte yBaseHeatMax,
+				 float fMotionHeadMult,
+				 byte yMotionHeatAdd,
+				 int iNumInterpFrames)
+{
+	// Values go in TuningParam order
+	TuningMessage oMsg;
+	oMsg.Begin(TUNING_MSG_TUNING);
+	oMsg.PutByte(ySet);
+	oMsg.PutByte(NUM_TUNING_PARAMS);
+	oMsg.PutFloat(fMinSpeed);
+	oMsg.PutFloat(fMaxSpeed);
+	oMsg.PutFloat(fNewSpeedWeight);
+	oMsg.PutFloat(fInputExponent);
+	oMsg.PutFloat(yBaseHeatMax);
+	oMsg.PutFloat(fMotionHeadMult);
+	oMsg.PutFloat(yMotionHeatAdd);
+	oMsg.PutFloat(iNumInterpFrames);
+	send_message(oMsg);
+}
 
 void send_tuning_vars()
 {
-	// Send the tuning variables over the serial port
-	Serial.print("TUNING -");
-	Serial.print(" g_fMinSpeed=");
-	Serial.print(g_fMinSpeed);
-	Serial.print(" g_fMaxSpeed=");
-	Serial.print(g_fMaxSpeed);
-	Serial.print(" g_fNewSpeedWeight=");
-	Serial.print(g_fNewSpeedWeight);
-	Serial.print(" g_fInputExponent=");
-	Serial.print(g_fInputExponent);
-	Serial.print(" g_yBaseHeatMax=");
-	Serial.print(g_yBaseHeatMax);
-	Serial.print(" g_fMotionHeadMult=");
-	Serial.print(g_fMotionHeadMult);
-	Serial.print(" g_yMotionHeatAdd=");
-	Serial.print(g_yMotionHeatAdd);
-	Serial.print(" g_iNumInterpFrames=");
-	Serial.print(g_iNumInterpFrames);
-	Serial.println("");
+	send_tuning(TUNING_SET_CURRENT,
+				g_fMinSpeed,
+				g_fMaxSpeed,
+				g_fNewSpeedWeight,
+				g_fInputExponent,
+				g_yBaseHeatMax,
+				g_fMotionHeadMult,
+				g_yMotionHeatAdd,
+				g_iNumInterpFrames);
 }
 
 void send_tuning_vars_saved()
 {
-	// Send the tuning variables over the serial port
-	Serial.print("TUNING_SAVED -");
-	Serial.print(" g_fMinSpeed=");
-	Serial.print(g_fMinSpeedSaved);
-	Serial.print(" g_fMaxSpeed=");
-	Serial.print(g_fMaxSpeedSaved);
-	Serial.print(" g_fNewSpeedWeight=");
-	Serial.print(g_fNewSpeedWeightSaved);
-	Serial.print(" g_fInputExponent=");
-	Serial.print(g_fInputExponentSaved);
-	Serial.print(" g_yBaseHeatMax=");
-	Serial.print(g_yBaseHeatMaxSaved);
-	Serial.print(" g_fMotionHeadMult=");
-	Serial.print(g_fMotionHeadMultSaved);
-	Serial.print(" g_yMotionHeatAdd=");
-	Serial.print(g_yMotionHeatAddSaved);
-	Serial.print(" g_iNumInterpFrames=");
-	Serial.print(g_iNumInterpFramesSaved);
-	Serial.println("");
+	send_tuning(TUNING_SET_SAVED,
+				g_fMinSpeedSaved,
+				g_fMaxSpeedSaved,
+				g_fNewSpeedWeightSaved,
+				g_fInputExponentSaved,
+				g_yBaseHeatMaxSaved,
+				g_fMotionHeadMultSaved,
+				g_yMotionHeatAddSaved,
+				g_iNumInterpFramesSaved);
 }
 
 
+void send_color_gradient(byte ySet, const byte ayColorGrad[])
+{
+	TuningMessage oMsg;
+	oMsg.Begin(TUNING_MSG_COLORS);
+	oMsg.PutByte(ySet);
+	oMsg.PutByte(COLOR_GRAD_PAL_HEAT);
+	oMsg.PutByte(COLOR_GRAD_SIZE);
+	oMsg.PutBytes(ayColorGrad, COLOR_GRAD_SIZE);
+	send_message(oMsg);
+}
+
 void send_color_gradient()
 {
-	// Send the tuning variables over the serial port
-	Serial.print("COLORS - ");
-	for(int i = 0; i < COLOR_GRAD_SIZE; ++i) 
-	{
-		Serial.print(g_ayColorGrad[i]);
-		if(i != COLOR_GRAD_SIZE - 1)
-		{
-			Serial.print(",");
-		}
-	}
-	Serial.println("");
+	send_color_gradient(TUNING_SET_CURRENT, g_ayColorGrad);
 }
 
 void send_color_gradient_saved()
 {
-	// Send the tuning variables over the serial port
-	Serial.print("COLORS_SAVED - ");
-	for(int i = 0; i < COLOR_GRAD_SIZE; ++i) 
-	{
-		Serial.print(g_ayColorGradSaved[i]);
-		if(i != COLOR_GRAD_SIZE - 1)
-		{
-			Serial.print(",");
-		}
-	}
-	Serial.println("");
+	send_color_gradient(TUNING_SET_SAVED, g_ayColorGradSaved);
 }
 
 
@@ -401,30 +522,19 @@ void save_current_settings_to_eeprom()
 	g_yMotionHeatAddSaved = g_yMotionHeatAdd;
 	g_iNumInterpFramesSaved = g_iNumInterpFrames;
 	
-	// Write the current version out first
-	EEPROM.write(EEPROM_ADDR_VER, EEPROM_VERSION);
-	
-	// Write out the color array
-	EEPROM.put(EEPROM_ADDR_COLORS, g_ayColorGradSaved);
-	
-	// Write out all the tuning vars
-	int iCurTuningAddr = EEPROM_ADDR_TUNING;
-	EEPROM.put(iCurTuningAddr, g_fMinSpeedSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.put(iCurTuningAddr, g_fMaxSpeedSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.put(iCurTuningAddr, g_fNewSpeedWeightSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.put(iCurTuningAddr, g_fInputExponentSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.put(iCurTuningAddr, g_yBaseHeatMaxSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.put(iCurTuningAddr, g_fMotionHeadMultSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.put(iCurTuningAddr, g_yMotionHeatAddSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.put(iCurTuningAddr, g_iNumInterpFramesSaved);
-	iCurTuningAddr += sizeof(float);
+	// Then write them out as one record.  Only the bytes that changed get written.
+	CloudSettings oSettings;
+	memset(&oSettings, 0, sizeof(oSettings));
+	memcpy(oSettings.ayColorGrad, g_ayColorGradSaved, COLOR_GRAD_SIZE);
+	oSettings.fMinSpeed = g_fMinSpeedSaved;
+	oSettings.fMaxSpeed = g_fMaxSpeedSaved;
+	oSettings.fNewSpeedWeight = g_fNewSpeedWeightSaved;
+	oSettings.fInputExponent = g_fInputExponentSaved;
+	oSettings.yBaseHeatMax = g_yBaseHeatMaxSaved;
+	oSettings.fMotionHeadMult = g_fMotionHeadMultSaved;
+	oSettings.yMotionHeatAdd = g_yMotionHeatAddSaved;
+	oSettings.iNumInterpFrames = g_iNumInterpFramesSaved;
+	g_oSettingsStore.Commit(oSettings);
 }
 
 bool load_eeprom_to_current_settings()
@@ -433,6 +543,7 @@ bool load_eeprom_to_current_settings()
 	{
 		memcpy(g_ayColorGrad, g_ayColorGradSaved, COLOR_GRAD_SIZE);
 		g_oPalHeat.loadDynamicGradientPalette(g_ayColorGrad);
+		g_oHeatColor.PaletteChanged();
 
 		g_fMinSpeed = g_fMinSpeedSaved;
 		g_fMaxSpeed = g_fMaxSpeedSaved;
@@ -450,42 +561,70 @@ bool load_eeprom_to_current_settings()
 }
 
 bool load_eeprom()
+{
+	// One read of the newest good record.  If there isn't one yet, carry over
+	// anything saved in the old layout.
+	CloudSettings oSettings;
+	if(!g_oSettingsStore.Load(oSettings))
+	{
+		if(!load_old_eeprom(oSettings))
+		{
+			return false;
+		}
+		send_log("Moving EEPROM settings to the settings store.");
+		g_oSettingsStore.Commit(oSettings);
+	}
+	
+	memcpy(g_ayColorGradSaved, oSettings.ayColorGrad, COLOR_GRAD_SIZE);
+	g_fMinSpeedSaved = oSettings.fMinSpeed;
+	g_fMaxSpeedSaved = oSettings.fMaxSpeed;
+	g_fNewSpeedWeightSaved = oSettings.fNewSpeedWeight;
+	g_fInputExponentSaved = oSettings.fInputExponent;
+	g_yBaseHeatMaxSaved = oSettings.yBaseHeatMax;
+	g_fMotionHeadMultSaved = oSettings.fMotionHeadMult;
+	g_yMotionHeatAddSaved = oSettings.yMotionHeatAdd;
+	g_iNumInterpFramesSaved = oSettings.iNumInterpFrames;
+	
+	return true;
+}
+
+// Read settings saved by older versions of this sketch
+bool load_old_eeprom(CloudSettings &oSettings)
 {
 	// Get the saved version.
 	// If it doesn't match the saved version, don't load anything else.
 	byte yCurVer = EEPROM.read(EEPROM_ADDR_VER);
 	if(yCurVer != EEPROM_VERSION)
 	{
-		Serial.println("Wrong EEPROM version!");
-		Serial.print("Got ");
-		Serial.print(yCurVer);
-		Serial.print(" when expecting ");
-		Serial.println(EEPROM_VERSION);
+		char sLog[64];
+		snprintf(sLog, sizeof(sLog), "No saved settings. Got EEPROM version %d when expecting %d", yCurVer, EEPROM_VERSION);
+		send_log(sLog);
 		
 		return false;
 	}
 	
+	memset(&oSettings, 0, sizeof(oSettings));
+	
 	// Get the color array
-	EEPROM.get(EEPROM_ADDR_COLORS, g_ayColorGradSaved);
+	EEPROM.get(EEPROM_ADDR_COLORS, oSettings.ayColorGrad);
 	
-	// Get all the tuning vars
+	// Get all the tuning vars.  These were each given the space of a float.
 	int iCurTuningAddr = EEPROM_ADDR_TUNING;
-	EEPROM.get(iCurTuningAddr, g_fMinSpeedSaved);
-	iCurTuningAddr += sizeof(float);
-	EEPROM.get(iCurTuningAddr, g_fMaxSpeedSaved);
+	EEPROM.get(iCurTuningAddr, oSettings.fMinSpeed);
 	iCurTuningAddr += sizeof(float);
-	EEPROM.get(iCurTuningAddr, g_fNewSpeedWeightSaved);
+	EEPROM.get(iCurTuningAddr, oSettings.fMaxSpeed);
 	iCurTuningAddr += sizeof(float);
-	EEPROM.get(iCurTuningAddr, g_fInputExponentSaved);
+	EEPROM.get(iCurTuningAddr, oSettings.fNewSpeedWeight);
 	iCurTuningAddr += sizeof(float);
-	EEPROM.get(iCurTuningAddr, g_yBaseHeatMaxSaved);
+	EEPROM.get(iCurTuningAddr, oSettings.fInputExponent);
 	iCurTuningAddr += sizeof(float);
-	EEPROM.get(iCurTuningAddr, g_fMotionHeadMultSaved);
+	EEPROM.get(iCurTuningAddr, oSettings.yBaseHeatMax);
 	iCurTuningAddr += sizeof(float);
-	EEPROM.get(iCurTuningAddr, g_yMotionHeatAddSaved);
+	EEPROM.get(iCurTuningAddr, oSettings.fMotionHeadMult);
 	iCurTuningAddr += sizeof(float);
-	EEPROM.get(iCurTuningAddr, g_iNumInterpFramesSaved);
+	EEPROM.get(iCurTuningAddr, oSettings.yMotionHeatAdd);
 	iCurTuningAddr += sizeof(float);
+	EEPROM.get(iCurTuningAddr, oSettings.iNumInterpFrames);
 	
 	return true;
 }
@@ -494,6 +633,7 @@ void restore_defaults_to_current_settings()
 {
 	memcpy(g_ayColorGrad, g_ayColorGradDefault, COLOR_GRAD_SIZE);
 	g_oPalHeat.loadDynamicGradientPalette(g_ayColorGrad);
+	g_oHeatColor.PaletteChanged();
 
 	g_fMinSpeed = g_fMinSpeedDefault;
 	g_fMaxSpeed = g_fMaxSpeedDefault;
@@ -507,250 +647,146 @@ void restore_defaults_to_current_settings()
 }
 
 
-void check_serial()
+// Set one tuning value by its id.  Returns false for an unknown id.
+bool set_tuning_param(byte yParam, float fValue)
 {
-	static const char REQUEST_TUNING[] = "REQUEST_TUNING";
-	static const char REQUEST_COLORS[] = "REQUEST_COLORS";
-	static const char REQUEST_TUNING_SAVED[] = "REQUEST_TUNING_SAVED";
-	static const char REQUEST_COLORS_SAVED[] = "REQUEST_COLORS_SAVED";
-	static const char SAVE_CURRENT[] = "SAVE_CURRENT";
-	static const char OVERWRITE_CURRENT_WITH_SAVED[] = "OVERWRITE_CURRENT_WITH_SAVED";
-	static const char RESTORE_DEFAULTS[] = "RESTORE_DEFAULTS";
-	static const char NEW_TUNING[] = "NEW_TUNING";
-	static size_t NEW_TUNING_LEN = strlen(NEW_TUNING);
-	static const char NEW_COLOR_GRAD[] = "NEW_COLOR_GRAD";
-	static size_t NEW_COLOR_GRAD_LEN = strlen(NEW_COLOR_GRAD);
-	
-	// Check to see if tuning variables have been requested
-	while(Serial.available() > 0)
+	switch(yParam)
 	{
-        char c = Serial.read();
-		//Serial.print("TEMP_CL - got char:");
-		//Serial.println(c);
-        if ((c == '\n') || (g_iSerialInputBufferPos == sizeof(g_acSerialInputBuffer)-1))
-		{
-			g_acSerialInputBuffer[g_iSerialInputBufferPos] = '\0';
-            g_iSerialInputBufferPos = 0;
-			
-			Serial.print("Got serial input:");
-			Serial.println(g_acSerialInputBuffer);
-			Serial.flush();
-			
-			if(strcmp(g_acSerialInputBuffer, REQUEST_TUNING) == 0)
-			{
-				send_tuning_vars();
-			}
-			else if(strcmp(g_acSerialInputBuffer, REQUEST_COLORS) == 0)
+		case TUNING_MIN_SPEED:         g_fMinSpeed = fValue; break;
+		case TUNING_MAX_SPEED:         g_fMaxSpeed = fValue; break;
+		case TUNING_NEW_SPEED_WEIGHT:  g_fNewSpeedWeight = fValue; break;
+		case TUNING_INPUT_EXPONENT:    g_fInputExponent = fValue; break;
+		case TUNING_BASE_HEAT_MAX:     g_yBaseHeatMax = fValue; break;
+		case TUNING_MOTION_HEAD_MULT:  g_fMotionHeadMult = fValue; break;
+		case TUNING_MOTION_HEAT_ADD:   g_yMotionHeatAdd = fValue; break;
+		case TUNING_NUM_INTERP_FRAMES: g_iNumInterpFrames = fValue; break;
+		default: return false;
+	}
+	return true;
+}
+
+
+// Handle one message from the tuner
+void handle_tuning_message(TuningMessage &oMsg)
+{
+	byte ySet;
+	switch(oMsg.m_yType)
+	{
+		case TUNING_MSG_REQUEST_TUNING:
+			if(oMsg.GetByte(ySet))
 			{
-				send_color_gradient();
+				if(ySet == TUNING_SET_SAVED)
+				{
+					send_tuning_vars_saved();
+				}
+				else
+				{
+					send_tuning_vars();
+				}
 			}
-			if(strcmp(g_acSerialInputBuffer, REQUEST_TUNING_SAVED) == 0)
+			break;
+			
+		case TUNING_MSG_REQUEST_COLORS:
+			if(oMsg.GetByte(ySet))
 			{
-				send_tuning_vars_saved();
+				if(ySet == TUNING_SET_SAVED)
+				{
+					send_color_gradient_saved();
+				}
+				else
+				{
+					send_color_gradient();
+				}
 			}
-			else if(strcmp(g_acSerialInputBuffer, REQUEST_COLORS_SAVED) == 0)
+			break;
+			
+		case TUNING_MSG_SAVE_CURRENT:
+			save_current_settings_to_eeprom();
+			load_eeprom_to_current_settings();
+			send_tuning_vars();
+			send_color_gradient();
+			send_tuning_vars_saved();
+			send_color_gradient_saved();
+			break;
+			
+		case TUNING_MSG_LOAD_SAVED:
+			load_eeprom_to_current_settings();
+			send_tuning_vars();
+			send_color_gradient();
+			send_tuning_vars_saved();
+			send_color_gradient_saved();
+			break;
+			
+		case TUNING_MSG_RESTORE_DEFAULTS:
+			restore_defaults_to_current_settings();
+			send_tuning_vars();
+			send_color_gradient();
+			send_tuning_vars_saved();
+			send_color_gradient_saved();
+			break;
+			
+		case TUNING_MSG_SET_TUNING:
+		{
+			byte yParam;
+			float fValue;
+			if(!oMsg.GetByte(yParam) || !oMsg.GetFloat(fValue))
 			{
-				send_color_gradient_saved();
+				send_log("Invalid tuning message");
 			}
-			if(strcmp(g_acSerialInputBuffer, SAVE_CURRENT) == 0)
+			else if(!set_tuning_param(yParam, fValue))
 			{
-				save_current_settings_to_eeprom();
-				load_eeprom_to_current_settings();
-				send_tuning_vars();
-				send_color_gradient();
-				send_tuning_vars_saved();
-				send_color_gradient_saved();
+				send_log("Unrecognised tuning var");
 			}
-			else if(strcmp(g_acSerialInputBuffer, OVERWRITE_CURRENT_WITH_SAVED) == 0)
+			break;
+		}
+			
+		case TUNING_MSG_SET_COLORS:
+		{
+			byte yGrad;
+			byte yCount;
+			byte ayColorGrad[COLOR_GRAD_SIZE];
+			if(!oMsg.GetByte(yGrad) ||
+			   !oMsg.GetByte(yCount) ||
+			   yCount != COLOR_GRAD_SIZE ||
+			   !oMsg.GetBytes(ayColorGrad, COLOR_GRAD_SIZE))
 			{
-				load_eeprom_to_current_settings();
-				send_tuning_vars();
-				send_color_gradient();
-				send_tuning_vars_saved();
-				send_color_gradient_saved();
+				send_log("Invalid color gradiant format - Wrong number of bytes");
 			}
-			else if(strcmp(g_acSerialInputBuffer, RESTORE_DEFAULTS) == 0)
+			// Sanity check values
+			else if(ayColorGrad[0] != 0 || ayColorGrad[COLOR_GRAD_SIZE - 4] != 255)
 			{
-				restore_defaults_to_current_settings();
-				send_tuning_vars();
-				send_color_gradient();
-				send_tuning_vars_saved();
-				send_color_gradient_saved();
+				send_log("Invalid color gradiant format - Bad first or last entry");
 			}
-			// Example = "NEW_TUNING MaxSpeed=0.25"
-			else if(strncmp(g_acSerialInputBuffer, NEW_TUNING, NEW_TUNING_LEN) == 0)
+			else if(yGrad != COLOR_GRAD_PAL_HEAT)
 			{
-				strtok(g_acSerialInputBuffer, " "); // Read off the NEW_TUNING tag
-				char *pTuningKey = NULL;
-				char *pTuningValue = NULL;
-				
-				if((pTuningKey = strtok(NULL, "=")) != NULL && (pTuningValue = strtok(NULL, " ")) != NULL)
-				{
-					Serial.println(pTuningKey);
-					Serial.flush();
-					Serial.println(pTuningValue);
-					Serial.flush();
-					
-					// Test if valid float
-					char *pEndPtr;
-					float fValue = strtof(pTuningValue, &pEndPtr);
-					bool bValidFloat = *pEndPtr == '\0';
-					if(!bValidFloat)
-					{
-						Serial.print("Invalid float format! ");
-						Serial.println(pTuningValue);
-					}
-					else 
-					{
-						bool bGotNewValue = false;
-						if(strcmp(pTuningKey, "MinSpeed") == 0 && bValidFloat)
-						{
-							g_fMinSpeed = fValue;
-							bGotNewValue = true;
-						}
-						else if(strcmp(pTuningKey, "MaxSpeed") == 0 && bValidFloat)
-						{
-							g_fMaxSpeed = fValue;
-							bGotNewValue = true;
-						}
-						else if(strcmp(pTuningKey, "NewSpeedWeight") == 0 && bValidFloat)
-						{
-							g_fNewSpeedWeight = fValue;
-							bGotNewValue = true;
-						}
-						else if(strcmp(pTuningKey, "InputExponent") == 0 && bValidFloat)
-						{
-							g_fInputExponent = fValue;
-							bGotNewValue = true;
-						}
-						else if(strcmp(pTuningKey, "BaseHeatMax") == 0 && bValidFloat)
-						{
-							g_yBaseHeatMax = fValue;
-							bGotNewValue = true;
-						}
-						else if(strcmp(pTuningKey, "MotionHeadMult") == 0 && bValidFloat)
-						{
-							g_fMotionHeadMult = fValue;
-							bGotNewValue = true;
-						}
-						else if(strcmp(pTuningKey, "MotionHeatAdd") == 0 && bValidFloat)
-						{
-							g_yMotionHeatAdd = fValue;
-							bGotNewValue = true;
-						}
-						else if(strcmp(pTuningKey, "NumInterpFrames") == 0 && bValidFloat)
-						{
-							g_iNumInterpFrames = fValue;
-							bGotNewValue = true;
-						}
-						
-						if(bGotNewValue) 
-						{
-							Serial.print("Got new tunning: ");
-							Serial.print(pTuningKey);
-							Serial.print("=");
-							Serial.println(fValue);
-						}
-						else
-						{
-							Serial.print("Unrecognised tuning var: ");
-							Serial.println(pTuningKey);
-						}
-					}
-				}
-				else
-				{
-					Serial.println("Invalid tuning format! Should be 'NEW_TUNING MaxSpeed=0.25'.");
-				}
+				send_log("Unrecognised color gradiant");
 			}
-			// Color gradiant
-			else if(strncmp(g_acSerialInputBuffer, NEW_COLOR_GRAD, NEW_COLOR_GRAD_LEN) == 0)
+			else
 			{
-				strtok(g_acSerialInputBuffer, " "); // Read off the NEW_TUNING tag
-				char *pTuningKey = NULL;
-				
-				if((pTuningKey = strtok(NULL, "=")) != NULL)
-				{
-					Serial.println(pTuningKey);
-					Serial.flush();
-					
-					char *pTuningValue = NULL;
-					bool bGotValidColorGrad = true;
-					byte ayColorGrad[COLOR_GRAD_SIZE];
-					for(int i = 0; i < COLOR_GRAD_SIZE; ++i) 
-					{
-						pTuningValue = strtok(NULL, ",");
-						if(pTuningValue == NULL)
-						{
-							Serial.print("Invalid color gradiant format - Didn't get ");
-							Serial.print(COLOR_GRAD_SIZE);
-							Serial.println(" bytes");
-							bGotValidColorGrad = false;
-							break;
-						}
-						
-						// Test if valid byte
-						char *pEndPtr;
-						long int iValue = strtol(pTuningValue, &pEndPtr, 10);
-						bool bValidInt = *pEndPtr == '\0';
-						if(!bValidInt)
-						{
-							Serial.println("Invalid color gradiant format - Couldn't parse number");
-							bGotValidColorGrad = false;
-							break;
-						}
-						bool bValidByte = iValue >= 0 && iValue <= 255;
-						if(!bValidByte)
-						{
-							Serial.println("Invalid color gradiant format - Data out of range");
-							bGotValidColorGrad = false;
-							break;
-						}
-						
-						ayColorGrad[i] = (byte)iValue;
-					}
-					
-					// Sanity check values
-					if(bGotValidColorGrad &&
-					   (ayColorGrad[0] != 0 ||
-					    ayColorGrad[COLOR_GRAD_SIZE - 4] != 255))
-					{
-						Serial.println("Invalid color gradiant format - Bad first or last entry");
-						bGotValidColorGrad = false;
-					}
-					
-					if(bGotValidColorGrad)
-					{
-						bool bGotNewValue = false;
-						if(strcmp(pTuningKey, "PalHeat") == 0)
-						{
-							memcpy(g_ayColorGrad, ayColorGrad, COLOR_GRAD_SIZE);
-							g_oPalHeat.loadDynamicGradientPalette(g_ayColorGrad);
-							bGotNewValue = true;
-						}
-						
-						if(bGotNewValue) 
-						{
-							Serial.print("Got new color gradiant for: ");
-							Serial.println(pTuningKey);
-						}
-						else
-						{
-							Serial.print("Unrecognised tuning var: ");
-							Serial.println(pTuningKey);
-						}
-					}
-				}
-				else
-				{
-					Serial.println("Invalid color gradiant format - Should be:");
-					Serial.println("NEW_COLOR_GRAD PalHeat=0,0,0,8,50,32,8,4,100,128,64,32,200,255,200,64,255,255,255,255");
-				}
+				memcpy(g_ayColorGrad, ayColorGrad, COLOR_GRAD_SIZE);
+				g_oPalHeat.loadDynamicGradientPalette(g_ayColorGrad);
+				g_oHeatColor.PaletteChanged();
 			}
+			break;
 		}
-		else 
+			
+		default:
+			send_log("Unrecognised message");
+			break;
+	}
+}
+
+
+// Read whatever has come in on the serial port and handle any complete messages.
+// This never waits for more bytes.
+void check_serial()
+{
+	TuningMessage oMsg;
+	while(Serial.available() > 0)
+	{
+		if(g_oTuningReader.Feed(Serial.read(), oMsg))
 		{
-			g_acSerialInputBuffer[g_iSerialInputBufferPos++] = c;
+			handle_tuning_message(oMsg);
 		}
 	}
 }
@@ -762,7 +798,7 @@ void loop()
 	// Make sure wav file is playing
 	if(g_bAudioInitialized && playSdWav1.isPlaying() == false)
 	{
-		Serial.println("Start playing");
+		send_log("Start playing");
 		//playSdWav1.play("SDTEST2.WAV");
 		//playSdWav1.play("elaborate_thunder-Mike_Koenig-1877244752.WAV");
 		playSdWav1.play("thunder.wav");
@@ -774,127 +810,96 @@ void loop()
 	// Add entropy to random number generator; we use a lot of it.
 	// TEMP_CL random16_add_entropy( random());
 
-	memcpy(g_ayLastHeat, g_ayHeat, NUM_LEDS);
-	UpdateHeat(); // run simulation frame, using palette colors
-  
-	for(int i = 0; i < g_iNumInterpFrames; ++i)
+	// Get delta time
+	unsigned long iCurTimeMicro = micros();
+	unsigned long iDeltaTimeMicro = iCurTimeMicro - g_iLastLoopTimeMicro;
+	g_iLastLoopTimeMicro = iCurTimeMicro;
+
+	// Start a new heat frame once the last interp is done.  The interp takes
+	// g_iNumInterpFrames reference frames no matter how fast this loop runs.
+	unsigned long iInterpTimeMicro = (unsigned long)max(g_iNumInterpFrames, 1) * REF_FRAME_TIME_MICRO;
+	g_iCurInterpTimeMicro += iDeltaTimeMicro;
+	if(g_iCurInterpTimeMicro >= iInterpTimeMicro)
 	{
-		// Serial input
-		check_serial();
-		
-		// Radar
-		update_speed();
-		
-		// Adjust sound volume based on motion
-		if(g_bAudioInitialized) {
-			sgtl5000_1.volume(g_fSpeedRatio / 2.0 + 0.05);
-		}
-
-		
-		//LEDs
+		memcpy(g_ayLastHeat, g_ayHeat, NUM_LEDS);
+		UpdateHeat(); // run simulation frame, using palette colors
 
-		// Lerp between the target frames
-		fract8 fLerp = i * 256 / g_iNumInterpFrames;
-		byte yLerpHeat;
-		for(int j = 0; j < NUM_LEDS / g_iLedSpacing; ++j)
+		// Keep any left over time so the timing stays even
+		g_iCurInterpTimeMicro -= iInterpTimeMicro;
+		if(g_iCurInterpTimeMicro >= iInterpTimeMicro)
 		{
-			// Fade between last and cur heat values
-			yLerpHeat = lerp8by8(g_ayLastHeat[j], g_ayHeat[j], fLerp);
-			
-			// TEMP_CL - Scale heat
-			yLerpHeat = scale8(yLerpHeat, g_yBaseHeatMax);
-
-			// Account for touch
-			yLerpHeat = byte(Clamp(yLerpHeat * (g_fSpeedRatio * (g_fMotionHeadMult-1.0) + 1.0), 0, 255));
-			yLerpHeat = qadd8(yLerpHeat, g_fSpeedRatio * g_yMotionHeatAdd);
-
-			// Scale heat
-			yLerpHeat = scale8(yLerpHeat, MAX_HEAT);
-			
-			// Get the heat color
-			g_aLeds[j*g_iLedSpacing] = ColorFromPalette(g_oPalHeat, yLerpHeat);
-						
+			g_iCurInterpTimeMicro = 0;
 		}
-		FastLED.show(); // display this frame
-		
-		// Delay a consistent amount of time so this code basically works the same on different chips
-		//FastLED.delay(1000 / FRAMES_PER_SECOND); // This doesnt seem to work on the Teensy 4.0
-		delay(1000 / FRAMES_PER_SECOND);
 	}
-}
-
 
+	// Serial input
+	check_serial();
+	
+	// Radar
+	update_speed(iDeltaTimeMicro);
 
-void UpdateHeat()
-{
-	// Cool down every cell a little
-	for(int i = 0; i < NUM_LEDS; i++)
-	{
-		g_ayHeat[i] = qsub8( g_ayHeat[i],  random8(COOLING_MIN, COOLING_MAX));
+	// Send the diagnostics if a window is done and there is room for it in the serial buffer
+	g_oTelemetry.Update(iCurTimeMicro);
+	g_oTelemetry.SendFrame(Serial);
+	
+	// Adjust sound volume based on motion
+	if(g_bAudioInitialized) {
+		sgtl5000_1.volume(g_fSpeedRatio / 2.0 + 0.05);
 	}
+
 	
-	// Heat from each cell drifts out
-	for(int i = 1; i < NUM_LEDS-1; i++)
+	//LEDs
+
+	// Work out what each heat value turns into this frame.  This is the same for
+	// every LED so it is done once for all 256 heat values instead of once per LED.
+	// The multiplier stays a double, as it was per LED, so the heat is the same.
+	double fMotionMult = g_fSpeedRatio * (g_fMotionHeadMult-1.0) + 1.0;
+	byte yMotionAdd = g_fSpeedRatio * g_yMotionHeatAdd;
+	for(int i = 0; i < 256; ++i)
 	{
-		g_ayHeat[i] = (g_ayHeat[i]*3 + g_ayHeat[i-1]*2 + g_ayHeat[i+1]*2) / 7;
+		// TEMP_CL - Scale heat
+		byte yHeat = scale8(i, g_yBaseHeatMax);
+
+		// Account for touch
+		yHeat = byte(Clamp(yHeat * fMotionMult, 0, 255));
+		yHeat = qadd8(yHeat, yMotionAdd);
+
+		// Scale heat
+		g_oHeatColor.m_ayHeatMap[i] = scale8(yHeat, MAX_HEAT);
 	}
-	
-	// Randomly ignite new 'sparks' of heat - per 10 leds
-	for(int i = 0; i < NUM_LEDS / 10; i++) {
-		if( random8() < SPARKING )
-		{
-			int y = random16(0, NUM_LEDS - SPARK_WIDTH);
 
-			byte newHeat = random8(SPARK_HEAT_MIN, SPARK_HEAT_MAX);
-			for(int j = 0; j < SPARK_WIDTH; ++j) {
-				g_ayHeat[y+j] = qadd8( g_ayHeat[y+j],  newHeat);
-			}
-		}
+	// Lerp between the target frames and get the heat colors
+	fract8 fLerp = g_iCurInterpTimeMicro * 256 / iInterpTimeMicro;
+	g_oHeatColor.Render(g_ayLastHeat, g_ayHeat, fLerp, g_aLeds, NUM_LEDS / g_iLedSpacing, g_iLedSpacing);
+	if(g_oFrameTracker.Update(g_aLeds, FastLED.getBrightness()) > 0)
+	{
+		FastLED.show(); // display this frame
 	}
 }
 
 
 
-// Interrupt called to get time between pulses
-void MotionDetectorPulse()
+void UpdateHeat()
 {
-	unsigned long iCurTimeMicro = micros();
-	
-	// HACK - For some reason the interrupt is getting called twice is
-	// in very quick succession. This prevents the timing from being 
-	// effected by that.
-	unsigned long iPeriod = iCurTimeMicro - g_iLastTimeMicro;
-	if(iPeriod > 100) 
-	{
-		g_iLastPeriodMicro = (iPeriod + g_iLastPeriodMicro) / 2;
-		g_iLastTimeMicro = iCurTimeMicro;
-	
-		// TEMP_CL
-		++g_iPulsesSinceLastTick;
-	}
+	g_oHeatField.Update(g_ayHeat);
 }
 
 
 
-// Returns the number of micro seconds for the last period (time between pulses)
-// for the motion sensor.  If the time between this call and
-// the last inpterupt call is greater than the last period , we return the time
+// Returns the number of micro seconds for the period (time between pulses) for the
+// motion sensor.  This is the median of all the periods since the last call.  If the time
+// between this call and the last inpterupt call is greater than that, we return the time
 // between this call and the the last interrupt.  This is to ensure that if we
 // abruptly go from fast motion to slow motion, that this function will not smoothly
-// transition to slow motion.
+// transition to slow motion.  Call this once per frame.
 unsigned long GetLastPeriodMicro()
 {
-	unsigned long iCurTimeMicro = micros();
-	unsigned long iThisPeriodMicro = iCurTimeMicro - g_iLastTimeMicro;
-	if(iThisPeriodMicro < g_iLastPeriodMicro)
-		return g_iLastPeriodMicro;
-	else
-		return iThisPeriodMicro;
+	return g_oMotionCapture.GetPeriodMicro();
 }
 
 
 
-// Returns the current speed of the detected motion in meters per second.
+// Returns the speed of the detected motion in meters per second for a pulse period.
 // It is calculated with the following formula (pulled from the X-Band website)
 // http://www.parallax.com/Portals/0/Downloads/docs/prod/sens/32213-X-BandMotionDetector-v1.1.pdf
 //
@@ -911,12 +916,12 @@ unsigned long GetLastPeriodMicro()
 //
 // Thus and object moving at 0.2 ms/2 =
 // 2*0.2*(10.525*10^9/(3*10^8)) = 14.0333
-float GetCurSpeed()
+//
+// g_oSpeedRatioMap does this in fixed point with 70.1666 = (2 * Ft/c) (see EASpeedCurve.h).
+// The angle (cos(theta)) is ignored because we have no way of knowing it.
+float GetCurSpeed(unsigned long iPeriodMicro)
 {
-	float iLastPeriod = GetLastPeriodMicro();
-	float fFreq = 1.0 / (iLastPeriod / 1000000.0);
-	float fSpeed = fFreq / 70.1666; // 70.1666 = (2 * Ft/c) - Ignore angle (cos(theta)) because we have no way of knowing it
-	return fSpeed;
+	return Q16ToFloat(g_oSpeedRatioMap.GetSpeedQ16(iPeriodMicro));
 }
 
 
@@ -1,4 +1,5 @@
 #include <FastLED.h>
+#include <EAHeatField.h>
 
 #define LED_PIN     10
 #define CLOCK_PIN   9
@@ -152,44 +153,10 @@ void loop() {
 // Default 120, suggested range 50-200.
 #define SPARKING 150
 
-void Fire2012WithPalette() {
-  // Array of temperature readings at each simulation cell
-  //static byte heat[NUM_LEDS];
-
-  // Step 1.  Cool down every cell a little
-  for( int i = 0; i < NUM_LEDS; i++) {
-    //heat[i] = qsub8( heat[i],  random8(0, ((COOLING * 10) / NUM_LEDS) + 2));
-    //heat[i] = qsub8( heat[i],  random8(0, ((COOLING * 1) / NUM_LEDS) + 2));
-    heat[i] = qsub8( heat[i],  random8(0, 3));
-  }
-  
-  // Step 2.  Heat from each cell drifts out
-  for( int k= 2; k < NUM_LEDS-2; k++) {
-    heat[k] = (heat[k - 2] + heat[k - 1]*2 + heat[k]*4 + heat[k + 1]*2 + heat[k + 2]) / 10;
-  }
-    
-  // Step 3.  Randomly ignite new 'sparks' of heat
-  if( random8() < SPARKING ) {
-    int y = random8(2, NUM_LEDS-2);
-    //heat[y] = qadd8( heat[y], random8(160,255) );
-    //heat[y] = qadd8( heat[y], random8(64,128) );
-
-	byte newHeat = random8(16,32);
-	byte halfHeat = newHeat >> 1;
-	//byte halfHeat = newHeat / 2;
-    heat[y] = qadd8( heat[y],  newHeat);
-    heat[y-1] = qadd8( heat[y], halfHeat );
-    heat[y+1] = qadd8( heat[y], halfHeat );
-  }
-
-  //// Step 4.  Map from heat cells to LED colors
-  //for( int j = 0; j < NUM_LEDS; j++) {
-  //  // Scale the heat value from 0-255 down to 0-240
-  //  // for best results with color palettes.
+// Cooling is a random 0-2 per cell, spark heat is 16-31 with half that on each side
+HeatField<NUM_LEDS, HeatKernelFire2012, HeatSparksFire2012> g_oHeatField(0, 3, HeatSparksFire2012(SPARKING, 16, 32));
 
-  //  //byte colorindex = scale8( heat[j], 240);
-  //  //leds[j] = ColorFromPalette( gPal, colorindex);
-
-  //  //next_leds[j] = ColorFromPalette( gPal, heat[j]);
-  //}
+void Fire2012WithPalette() {
+  // Steps 1-3.  Cool, drift and spark (step 4 is done in loop() with interpolation)
+  g_oHeatField.Update(heat);
 }
\ No newline at end of file
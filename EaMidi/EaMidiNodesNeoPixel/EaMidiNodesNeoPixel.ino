@@ -12,6 +12,15 @@
 
 #include <EEPROM.h>
 #include <Adafruit_NeoPixel.h>
+// Motion sensor.  Uncomment one of these to time the sensor with hardware input capture
+// instead of a pin interupt (see EAMotionCapture.h for the pins).
+//#define USE_MOTION_CAPTURE_FREQMEASURE
+//#define USE_MOTION_CAPTURE_AVR_ICP
+#include <EAMotionCapture.h>
+#include <EASpeedCurve.h>
+#include <EATdmaScheduler.h>
+#include <EANodeFrame.h>
+#include <EASettingsStore.h>
 
 // Use Serial to print out debug statements
 static bool USE_SERIAL_FOR_DEBUGGING = true;
@@ -35,14 +44,40 @@ int g_iNodeIndex = -1;
 
 // The address in EEPROM for various saved values
 static const int EEPROM_ADDR_NODE_INDEX = 0;
+
+// The old settings layout.  Only read once to carry the settings over to the store.
 static const int EEPROM_ADDR_DATA_VERSION = 21;
 static const int EEPROM_ADDR_MIN_SPEED = 22;
 static const int EEPROM_ADDR_MAX_SPEED = 24;
 static const int EEPROM_ADDR_NEW_SPEED_WEIGHT = 26;
 static const int EEPROM_ADDR_INPUT_EXPONENT = 28;
+static const int OLD_EEPROM_DATA_VERSION = 2;
+
+// Tuning settings saved in EEPROM.  These use the same 16 bit scaling as the TUNING
+// frame from the PC (see ApplySettings()).
+struct NodeSettings
+{
+	uint16_t iMinSpeed;
+	uint16_t iMaxSpeed;
+	uint16_t iNewSpeedWeight;
+	uint16_t iInputExponent;
+};
 
-// The current data version of the EEPROM data.  Each time the format changes, increment this
-static const int CUR_EEPROM_DATA_VERSION = 2;
+// Where the settings are saved (see EASettingsStore.h).  Each time NodeSettings
+// changes, increment SETTINGS_SCHEMA_VERSION.  New tuning values from the PC are used
+// right away but only saved one byte per loop so a tuning push never stalls the show.
+static const int EEPROM_ADDR_SETTINGS = 32;
+static const int EEPROM_SETTINGS_BYTES = 128;
+static const int SETTINGS_SCHEMA_VERSION = 3;
+SettingsStore<NodeSettings, EEPROMClass> g_oSettingsStore(EEPROM, EEPROM_ADDR_SETTINGS, EEPROM_SETTINGS_BYTES, SETTINGS_SCHEMA_VERSION);
+
+// Confirmation that new tuning values arrived.  DrawTuningConfirmation() draws it
+// over the normal display for a few seconds.
+static const unsigned long TUNING_CONFIRM_STEP_MS = 100;
+static const unsigned long TUNING_CONFIRM_PAUSE_MS = 200;
+static const int TUNING_CONFIRM_PASSES = 2;
+bool g_bTuningConfirmActive = false;
+unsigned long g_iTuningConfirmStartMS = 0;
 
 // If this is true, we use Xbee to send signals.  Right now, these doesn't turn on anything special but it might at some point.
 static const bool USE_XBEE = false;
@@ -188,13 +223,6 @@ static const int INT_PIN = 19; // INT7 (interupt 7)
 // This is the number of init loops to code does to test LEDs
 static const int NUM_INIT_LOOPS = 2;
 
-// Recieve data start byte and end byte
-static const int START_RCV_BYTE = 240; // Binary = 11110000 (this also translates to node 7 sending 16 (out of 32) as a motion value).
-static const int END_RCV_BYTE = 241; // Binary = 11110001 (this also translates to node 7 sending 17 (out of 32) as a motion value).
-
-// Recieve data timeout counter.  Use this to avoid getting stuck waiting for data.
-static const int RCV_TIMEOUT_MAX_COUNT = 1000;
-
 // Lookup map used to linearize LED brightness
 static const unsigned char exp_map[256]={
   0,0,0,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
@@ -226,19 +254,13 @@ static const int RS485_ENABLE_WRITE_PIN = 22;
 // The motion sensor indicates the speed of the motion detected by oscillating its output pin.
 // The faster the pulses, the faster the motion.  The detect the speed, we are counting the
 // number of microseconds between rising pulses using a hardware interupt pin.  The interupt
-// is called each time a rising pulse is detect and we save off the between the new pulse and
-// the last pulse.  All the other code for calculating speed is done outside of teh interupt
+// is called each time a rising pulse is detect and pushes the time of the pulse into a ring.
+// All the other code for calculating speed is done outside of teh interupt
 // because the interupt code needs to be as light weight at possible so it returns execution
 // to the main code as quickly as possible.
 
-// This is the last period detected
-volatile unsigned long g_iLastPeriodMicro = 0;
-
-// This is the last time the interupt was called
-volatile unsigned long g_iLastTimeMicro = 0;
-
-// The number of tuning vars there are per node.  These are sent from the PC program.
-static int NUM_TUNING_VARS = 4;
+// Median period of all the pulses since the last frame
+MotionCapture g_oMotionCapture(PulsePeriodEstimator::MEDIAN);
 
 // Tuning - The min speed in meters per second to respond to.  Any motion at or below this will be 
 // considered no motion at all.
@@ -257,18 +279,41 @@ float fNewSpeedWeight = 0.05;
 // to be adjusted in a non-linear fashion.
 float fInputExponent = 1.0;
 
+// Fixed point speed ratio and input exponent curve (see EASpeedCurve.h).  These are
+// set up from the tuning values above by ApplySettings().
+SpeedRatioMap g_oSpeedRatioMap;
+SpeedCurve<> g_oSpeedCurve;
+
 // This is the outout speed ratio [0, 1.0].  It is based on the speed read from the motion detector
 // and fMinSpeed, fMaxSpeed, fNewSpeedWeight.
 float g_fSpeedRatio;
 
-// Settings needed for timing out nodes in case some disconnect, break, or a signal is lost.
-// These could probably be lower but right now I want to bias towards waiting more to make sure
-// all communication works as opposed to having things still be fast when nodes are removed.
-// This means running a partial node setup isn't a really good idea.
-static const int NODE_COM_TIMEOUT_MS = 30; 
-static const int PC_COM_TIMEOUT_MS = 70;
-int g_iNextNodeIndex = 0;
-unsigned long g_iLastReceiveTime = 0;
+// Time slotted com bus (see EATdmaScheduler.h).  The PC starts each round with a beacon
+// and then each node talks in its own slot.  The guard time has to be at least twice
+// the longest time the node goes without calling ServiceBus() or the node will miss its
+// slot.  ServiceBus() is called between the slow parts of loop() and through the LED
+// padding, so the longest gap is the longest of those parts: show(), 30 us a pixel plus
+// the latch, or a settings byte written to EEPROM (about 3.4 ms).  The LED drawing is
+// shorter than either but can't be worked out here, so ServiceBus() logs any gap over
+// half the guard.  This NEEDS to be the same as the setting in the PC program!
+#define NEOPIXEL_SHOW_MICRO (NUM_NEO_PIXELS * 30 + 50)
+#define EEPROM_WRITE_MICRO 3400
+#define COM_LONGEST_BUS_GAP_MICRO (NEOPIXEL_SHOW_MICRO > EEPROM_WRITE_MICRO ? NEOPIXEL_SHOW_MICRO : EEPROM_WRITE_MICRO)
+static const unsigned long COM_SLOT_GUARD_MICRO = 7000;
+static_assert(COM_SLOT_GUARD_MICRO >= 2 * COM_LONGEST_BUS_GAP_MICRO, "The com slot guard is too short for the longest time between ServiceBus() calls");
+TdmaScheduler g_oTdma(0, NUM_NODES, COM_BAUD_RATE, NODE_MOTION_FRAME_BYTES, COM_SLOT_GUARD_MICRO);
+static const unsigned long COM_BYTE_MICRO = TdmaScheduler::ByteTimeMicro(COM_BAUD_RATE);
+
+// Frames read from the bus and the sequence number of the next one we send
+NodeFrameReader g_oFrameReader;
+byte g_yNextSequence = 0;
+
+// The motion sent in our slot, from the last loop()
+uint16_t g_iSendMotion = 0;
+
+// When ServiceBus() last finished and the longest time between calls so far
+unsigned long g_iLastBusServiceMicro = 0;
+unsigned long g_iLongestBusGapMicro = 0;
 
 
 
@@ -336,6 +381,11 @@ void setup()
 	{
 		EEPROMWrite(EEPROM_ADDR_NODE_INDEX, g_iNodeIndex);
 	}
+	g_oTdma.SetNodeIndex(g_iNodeIndex);
+
+	// Start from the default speed range and exponent in case nothing was saved
+	g_oSpeedRatioMap.SetRange(fMinSpeed, fMaxSpeed);
+	g_oSpeedCurve.SetExponent(fInputExponent);
 
 	// Read in settings from EPROM
 	ReadSettingsFromEEPROM();
@@ -421,24 +471,37 @@ void setup()
 	}
 
 	// Setup interupt
-	pinMode(INT_PIN, INPUT);
-	attachInterrupt(INT_PIN, MotionDetectorPulse, RISING);   // Attach an Interupt to INT_PIN for timing period of motion detector input
+	g_oMotionCapture.Begin(INT_PIN, RISING);   // Attach an Interupt to INT_PIN for timing period of motion detector input
+
+	g_iLastBusServiceMicro = micros();
 }
 
 
 
 void ReadSettingsFromEEPROM()
+{
+	NodeSettings oSettings;
+	if(g_oSettingsStore.Load(oSettings))
+	{
+		ApplySettings(oSettings);
+		return;
+	}
+
+	// Nothing in the store yet.  Carry over settings saved in the old layout.
+	if(ReadOldSettingsFromEEPROM(oSettings))
+	{
+		ApplySettings(oSettings);
+		g_oSettingsStore.Commit(oSettings);
+	}
+}
+
+
+
+// Read settings saved by older versions of this sketch.  Returns false if there aren't any.
+bool ReadOldSettingsFromEEPROM(NodeSettings &oSettings)
 {
 	int ySavedDataVersion = EEPROM.read(EEPROM_ADDR_DATA_VERSION);
-	int ySavedMinSpeedU = EEPROM.read(EEPROM_ADDR_MIN_SPEED);
-	int ySavedMinSpeedL = EEPROM.read(EEPROM_ADDR_MIN_SPEED+1);
-	int ySavedMaxSpeedU = EEPROM.read(EEPROM_ADDR_MAX_SPEED);
-	int ySavedMaxSpeedL = EEPROM.read(EEPROM_ADDR_MAX_SPEED+1);
-	int ySavedNewSpeedWeightU = EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT);
-	int ySavedNewSpeedWeightL = EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT+1);
-	int ySavedInputExponentU = EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT);
-	int ySavedInputExponentL = EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT+1);
-	if( ySavedDataVersion != CUR_EEPROM_DATA_VERSION )
+	if( ySavedDataVersion != OLD_EEPROM_DATA_VERSION )
 	{
 		// Invalid saved settings
 		if(USE_SERIAL_FOR_DEBUGGING)
@@ -446,85 +509,68 @@ void ReadSettingsFromEEPROM()
 			Serial.print("EAMidiNodes - tried to read settings from EEPROM but failed.  Read in data version ");
 			Serial.println(ySavedDataVersion);
 		}
+		return false;
 	}
-	else
-	{
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print("EAMidiNodes - Read in data version ");
-			Serial.println(ySavedDataVersion);
-			Serial.println(ySavedMinSpeedU);
-			Serial.println(ySavedMinSpeedL);
-			Serial.println(ySavedMaxSpeedU);
-			Serial.println(ySavedMaxSpeedL);
-			Serial.println(ySavedNewSpeedWeightU);
-			Serial.println(ySavedNewSpeedWeightL);
-			Serial.println(ySavedInputExponentU);
-			Serial.println(ySavedInputExponentL);
-		}
 
-		// Update fMinSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
-		int iNewMinSpeed = (ySavedMinSpeedU << 8) + ySavedMinSpeedL;
-		fMinSpeed = iNewMinSpeed / 65535.0 * 2.0;
+	memset(&oSettings, 0, sizeof(oSettings));
+	oSettings.iMinSpeed       = (EEPROM.read(EEPROM_ADDR_MIN_SPEED) << 8)        + EEPROM.read(EEPROM_ADDR_MIN_SPEED+1);
+	oSettings.iMaxSpeed       = (EEPROM.read(EEPROM_ADDR_MAX_SPEED) << 8)        + EEPROM.read(EEPROM_ADDR_MAX_SPEED+1);
+	oSettings.iNewSpeedWeight = (EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT) << 8) + EEPROM.read(EEPROM_ADDR_NEW_SPEED_WEIGHT+1);
+	oSettings.iInputExponent  = (EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT) << 8)   + EEPROM.read(EEPROM_ADDR_INPUT_EXPONENT+1);
+	return true;
+}
 
-		// Update fMaxSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
-		int iNewMaxSpeed = (ySavedMaxSpeedU << 8) + ySavedMaxSpeedL;
-		fMaxSpeed = iNewMaxSpeed / 65535.0 * 2.0;
 
-		// Update fNewSpeedWeight with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
-		int iNewWeight = (ySavedNewSpeedWeightU << 8) + ySavedNewSpeedWeightL;
-		fNewSpeedWeight = iNewWeight / 65535.0;
 
-		// Update fInputExponent with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
-		int iInputExponent = (ySavedInputExponentU << 8) + ySavedInputExponentL;
-		fInputExponent = iInputExponent / 65535.0 * 5.0;
+// Set the live settings from their 16 bit saved / network values
+void ApplySettings(const NodeSettings &oSettings)
+{
+	// Update fMinSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
+	fMinSpeed = oSettings.iMinSpeed / 65535.0 * 2.0;
 
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.println("Settings from EEPROM:");
-			Serial.print("fMinSpeed=");
-			Serial.println(fMinSpeed);
-			Serial.print("fMaxSpeed=");
-			Serial.println(fMaxSpeed);
-			Serial.print("fNewSpeedWeight*10=");
-			Serial.println(fNewSpeedWeight*10);
-			Serial.print("fInputExponent*10=");
-			Serial.println(fInputExponent*10);
-		}
-	}
-}
+	// Update fMaxSpeed. This has a range from 0.0 to 2.0 stored 2 bytes
+	fMaxSpeed = oSettings.iMaxSpeed / 65535.0 * 2.0;
 
+	// Update fNewSpeedWeight with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
+	fNewSpeedWeight = oSettings.iNewSpeedWeight / 65535.0;
 
-// Interupt called to get time between pulses
-void MotionDetectorPulse()
-{
-	unsigned long iCurTimeMicro = micros();
-	g_iLastPeriodMicro = iCurTimeMicro - g_iLastTimeMicro;
-	g_iLastTimeMicro = iCurTimeMicro;
-}
+	// Update fInputExponent with new value. This has a range from 0.0 to 1.0 stored 2 bytes 
+	fInputExponent = oSettings.iInputExponent / 65535.0 * 5.0;
 
+	// Only redone here, not every frame
+	g_oSpeedRatioMap.SetRange(fMinSpeed, fMaxSpeed);
+	g_oSpeedCurve.SetExponent(fInputExponent);
+
+	if(USE_SERIAL_FOR_DEBUGGING)
+	{
+		Serial.println("New settings:");
+		Serial.print("fMinSpeed=");
+		Serial.println(fMinSpeed);
+		Serial.print("fMaxSpeed=");
+		Serial.println(fMaxSpeed);
+		Serial.print("fNewSpeedWeight*10=");
+		Serial.println(fNewSpeedWeight*10);
+		Serial.print("fInputExponent*10=");
+		Serial.println(fInputExponent*10);
+	}
+}
 
 
-// Returns the number of micro seconds for the last period (time between pulses)
-// for the motion sensor.  If the time between this call and
-// the last inpterupt call is greater than the last period , we return the time
+// Returns the number of micro seconds for the period (time between pulses) for the
+// motion sensor.  This is the median of all the periods since the last call.  If the time
+// between this call and the last inpterupt call is greater than that, we return the time
 // between this call and the the last interupt.  This is to ensure that if we
 // abruptly go from fast motion to slow motion, that this function will not smoothly
-// transition to slow motion.
+// transition to slow motion.  Call this once per frame.
 unsigned long GetLastPeriodMicro()
 {
-	unsigned long iCurTimeMicro = micros();
-	unsigned long iThisPeriodMicro = iCurTimeMicro - g_iLastTimeMicro;
-	if(iThisPeriodMicro < g_iLastPeriodMicro)
-		return g_iLastPeriodMicro;
-	else
-		return iThisPeriodMicro;
+	return g_oMotionCapture.GetPeriodMicro();
 }
 
 
 
-// Returns the current speed of the detected motion in meters per second.
-// It is calculated with the following formula (pulled from the X-Band website)
+// Returns the current speed ratio of the detected motion.  The speed in meters
+// per second is calculated with the following formula (pulled from the X-Band website)
 // http://www.parallax.com/Portals/0/Downloads/docs/prod/sens/32213-X-BandMotionDetector-v1.1.pdf
 //
 // Resulting frequency for speed detection:
@@ -540,12 +586,14 @@ unsigned long GetLastPeriodMicro()
 //
 // Thus and object moving at 0.2 ms/2 =
 // 2*0.2*(10.525*10^9/(3*10^8)) = 14.0333
-float GetCurSpeed()
+//
+// The speed is then clamped to [fMinSpeed, fMaxSpeed] and returned as a ratio
+// of that range [0, Q16_ONE].  g_oSpeedRatioMap does this in fixed point with
+// 70.1666 = (2 * Ft/c) (see EASpeedCurve.h).  The angle (cos(theta)) is ignored
+// because we have no way of knowing it.
+q16_t GetCurSpeedRatio()
 {
-	float iLastPeriod = GetLastPeriodMicro();
-	float fFreq = 1.0 / (iLastPeriod / 1000000.0);
-	float fSpeed = fFreq / 70.1666; // 70.1666 = (2 * Ft/c) - Ignore angle (cos(theta)) because we have no way of knowing it
-	return fSpeed;
+	return g_oSpeedRatioMap.GetRatio(GetLastPeriodMicro());
 }
 
 
@@ -598,138 +646,86 @@ void EEPROMWrite(int iAddr, byte yValue)
 
 
 
-bool ReceiveTuningMessage()
+// Draw the tuning confirmation over this frame.  It steps a white marker onto the strip
+// for each of the NUM_LEDS_PER_NODE old LEDs, last to first, twice, and flashes the
+// matching old LED.  The display and the sensing keep running under it.
+void DrawTuningConfirmation()
 {
-	if(USE_SERIAL_FOR_DEBUGGING)
+	if(!g_bTuningConfirmActive)
 	{
-		Serial.println("##### ReceiveTuningMessage ######");
+		return;
 	}
 
-	// Once we have the start of a message, delay until we have it all
-	int iTimeoutCounter = 0;
-	int iNumExpectedBytes = NUM_TUNING_VARS * 2 * NUM_NODES + 1; // 3 tuning vars * 2 bytes per var * number of nodes + the end byte
-	while(Uart.available() < iNumExpectedBytes && iTimeoutCounter < RCV_TIMEOUT_MAX_COUNT)
+	unsigned long iPassTimeMS = NUM_LEDS_PER_NODE * TUNING_CONFIRM_STEP_MS + TUNING_CONFIRM_PAUSE_MS;
+	unsigned long iElapsedMS = millis() - g_iTuningConfirmStartMS;
+	int iStep = (iElapsedMS % iPassTimeMS) / TUNING_CONFIRM_STEP_MS;
+	if(iElapsedMS >= iPassTimeMS * TUNING_CONFIRM_PASSES)
 	{
-		iTimeoutCounter++;
-		delay(1);
+		g_bTuningConfirmActive = false;
+		iStep = NUM_LEDS_PER_NODE;
 	}
 
-	// Return false if we hit the timeout max
-	if(iTimeoutCounter >= RCV_TIMEOUT_MAX_COUNT)
+	for(int j = 0; j < NUM_LEDS_PER_NODE; j++)
 	{
-		if(USE_SERIAL_FOR_DEBUGGING)
+		int iStepForLED = NUM_LEDS_PER_NODE-1 - j;
+		digitalWrite(pins[j], (g_bTuningConfirmActive && iStep == iStepForLED) ? HIGH : LOW);
+		if(g_bTuningConfirmActive && iStep >= iStepForLED)
 		{
-			Serial.print("ReceiveTuningMessage timeout: iNumExpectedBytes=");
-			Serial.print(iNumExpectedBytes);
-			Serial.print(" available=");
-			Serial.println(Uart.available());
+			g_Leds.setPixelColor(j*(NUM_NEO_PIXELS/5), 0xFFFFFF);
 		}
-
-		return false;
 	}
+}
+
+
 
-	// Read data
-	int iNewMinSpeedU = -1;
-	int iNewMinSpeedL = -1;
-	int iNewMaxSpeedU = -1;
-	int iNewMaxSpeedL = -1;
-	int iNewWeightU = -1;
-	int iNewWeightL = -1;
-	int iNewInputExponentU = -1;
-	int iNewInputExponentL = -1;
-	for(int i = 0; i < NUM_NODES; i++)
+// Pull this node's values out of a TUNING frame from the PC and save them
+bool ReceiveTuningMessage(NodeFrame &oFrame)
+{
+	if(USE_SERIAL_FOR_DEBUGGING)
 	{
-		// If this is our node, read in the values and save them
-		if(i == g_iNodeIndex)
-		{
-			iNewMinSpeedU      = Uart.read();
-			iNewMinSpeedL      = Uart.read();
-			iNewMaxSpeedU      = Uart.read();
-			iNewMaxSpeedL      = Uart.read();
-			iNewWeightU        = Uart.read();
-			iNewWeightL        = Uart.read();
-			iNewInputExponentU = Uart.read();
-			iNewInputExponentL = Uart.read();
-		}
-		// Otherwise, just read and ignore the results
-		else
-		{
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-			Uart.read();
-		}
+		Serial.println("##### ReceiveTuningMessage ######");
 	}
 
-	// Return false if we don't hit the correct end byte
-	int iEndByte = Uart.read();
-	if(iEndByte != END_RCV_BYTE)
+	// Read data.  There are NODE_NUM_TUNING_VARS values for each node.
+	byte yNumNodes;
+	if(!oFrame.GetByte(yNumNodes) || g_iNodeIndex >= yNumNodes)
 	{
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print("Didn't get valid End Byte. iEndByte=");
-			Serial.println(iEndByte);
-		}
-
+		DebugLog("ReceiveTuningMessage - no values for this node");
 		return false;
 	}
-
-	// Debug saying we got a valid message
-	// This works for both the NeoPixels and the LEDs
-	for(int nLED = 0; nLED < NUM_NEO_PIXELS; nLED++)
+	uint16_t iSkip;
+	for(int i = 0; i < g_iNodeIndex * NODE_NUM_TUNING_VARS; i++)
 	{
-		g_Leds.setPixelColor(nLED, 0);
+		oFrame.GetWord(iSkip);
 	}
-	g_Leds.show();
-	for(int i = 0; i < 2; i++)
+	uint16_t iNewMinSpeed;
+	uint16_t iNewMaxSpeed;
+	uint16_t iNewWeight;
+	uint16_t iNewInputExponent;
+	if(!oFrame.GetWord(iNewMinSpeed) ||
+	   !oFrame.GetWord(iNewMaxSpeed) ||
+	   !oFrame.GetWord(iNewWeight) ||
+	   !oFrame.GetWord(iNewInputExponent))
 	{
-		for(int j = NUM_LEDS_PER_NODE-1; j >= 0; j--)
-		{
-			analogWrite(pins[j], 255);
-			delay(100);
-			digitalWrite(pins[j], LOW);
-
-			g_Leds.setPixelColor(j*(NUM_NEO_PIXELS/5), 0xFFFFFF);
-			g_Leds.show();
-		}
-		delay(200);
-		for(int nLED = 0; nLED < NUM_NEO_PIXELS; nLED++)
-		{
-			g_Leds.setPixelColor(nLED, 0);
-		}
-		g_Leds.show();
+		DebugLog("ReceiveTuningMessage - frame too short");
+		return false;
 	}
 
-	if(USE_SERIAL_FOR_DEBUGGING)
-	{
-		Serial.println("Get new settings from network:");
-		Serial.println(iNewMinSpeedU);
-		Serial.println(iNewMinSpeedL);
-		Serial.println(iNewMaxSpeedU);
-		Serial.println(iNewMaxSpeedL);
-		Serial.println(iNewWeightU);
-		Serial.println(iNewWeightL);
-		Serial.println(iNewInputExponentU);
-		Serial.println(iNewInputExponentL);
-	}
+	NodeSettings oSettings;
+	memset(&oSettings, 0, sizeof(oSettings));
+	oSettings.iMinSpeed = iNewMinSpeed;
+	oSettings.iMaxSpeed = iNewMaxSpeed;
+	oSettings.iNewSpeedWeight = iNewWeight;
+	oSettings.iInputExponent = iNewInputExponent;
 
-	// Save out settings to EEPROM
-	EEPROMWrite(EEPROM_ADDR_DATA_VERSION, CUR_EEPROM_DATA_VERSION);
-	EEPROMWrite(EEPROM_ADDR_MIN_SPEED,   iNewMinSpeedU);
-	EEPROMWrite(EEPROM_ADDR_MIN_SPEED+1, iNewMinSpeedL);
-	EEPROMWrite(EEPROM_ADDR_MAX_SPEED,   iNewMaxSpeedU);
-	EEPROMWrite(EEPROM_ADDR_MAX_SPEED+1, iNewMaxSpeedL);
-	EEPROMWrite(EEPROM_ADDR_NEW_SPEED_WEIGHT,   iNewWeightU);
-	EEPROMWrite(EEPROM_ADDR_NEW_SPEED_WEIGHT+1, iNewWeightL);
-	EEPROMWrite(EEPROM_ADDR_INPUT_EXPONENT,   iNewInputExponentU);
-	EEPROMWrite(EEPROM_ADDR_INPUT_EXPONENT+1, iNewInputExponentL);
-
-	// Read data just written to EEPROM as new settings
-	ReadSettingsFromEEPROM();
+	// Use the new settings now and save them over the next few loops.  This replaces
+	// anything from an earlier message that hasn't been saved yet.
+	ApplySettings(oSettings);
+	g_oSettingsStore.BeginCommit(oSettings);
+
+	// Show that we got a valid message
+	g_bTuningConfirmActive = true;
+	g_iTuningConfirmStartMS = millis();
 
 	return true;
 }
@@ -768,6 +764,98 @@ class Color GetIntensityColor(float fIntensity)
 
 
 
+// Listen for other nodes talking and for the PC beacon that starts each round, and send
+// our frame if our slot has come up.  Only whole frames are handled so this never waits
+// for bytes.
+void ServiceBus()
+{
+	unsigned long iGapMicro = micros() - g_iLastBusServiceMicro;
+	if(iGapMicro > g_iLongestBusGapMicro)
+	{
+		g_iLongestBusGapMicro = iGapMicro;
+		if(iGapMicro > COM_SLOT_GUARD_MICRO / 2)
+		{
+			DebugLog("Bus not serviced in time, micros = ", int(iGapMicro));
+		}
+	}
+
+	while(Uart.available() > 0)
+	{
+		NodeFrame oFrame;
+		if(!g_oFrameReader.Feed(Uart.read(), oFrame))
+		{
+			continue;
+		}
+
+		if(oFrame.m_yType == NODE_FRAME_BEACON)
+		{
+			// The slots are timed from when the beacon ended on the bus.  Any bytes
+			// still waiting behind it came in after it, one byte time each.
+			byte yRound;
+			if(oFrame.GetByte(yRound))
+			{
+				g_oTdma.OnBeacon(yRound, micros() - Uart.available() * COM_BYTE_MICRO);
+			}
+		}
+		else if(oFrame.m_yType == NODE_FRAME_TUNING)
+		{
+			ReceiveTuningMessage(oFrame);
+		}
+		else if(oFrame.m_yType == NODE_FRAME_MOTION)
+		{
+			g_oTdma.OnNodeFrame(oFrame.m_ySender);
+
+			if(USE_SERIAL_FOR_DEBUGGING)
+			{
+				uint16_t iMotion = 0;
+				oFrame.GetWord(iMotion);
+				Serial.print(millis());
+				Serial.print(" Got data from node ");
+				Serial.print(oFrame.m_ySender);
+				Serial.print(" seq ");
+				Serial.print(oFrame.m_ySequence);
+				Serial.print(" with value ");
+				Serial.println(iMotion);
+			}
+		}
+	}
+
+	// If our slot has come up, send the current speed (12 bits)
+	if(g_oTdma.ShouldSend(micros()))
+	{
+		NodeFrame oSendFrame;
+		oSendFrame.Begin(NODE_FRAME_MOTION, g_iNodeIndex, g_yNextSequence);
+		oSendFrame.PutWord(g_iSendMotion);
+		oSendFrame.PutWord(millis() & 0xFFFF);
+
+		if(USE_RS485)
+		{
+			digitalWrite (RS485_ENABLE_WRITE_PIN, HIGH);  // enable sending
+		}
+		byte ayWire[NODE_FRAME_MAX_WIRE];
+		Uart.write(ayWire, oSendFrame.Encode(ayWire));
+		g_yNextSequence++;
+		if(USE_RS485)
+		{
+			Uart.flush();
+			digitalWrite (RS485_ENABLE_WRITE_PIN, LOW);  // disable sending  
+		}
+
+		if(USE_SERIAL_FOR_DEBUGGING)
+		{
+			Serial.print(millis());
+			Serial.print(" Just wrote data g_iNodeIndex=");
+			Serial.print(g_iNodeIndex);
+			Serial.print(" seq=");
+			Serial.println(g_yNextSequence - 1);
+		}
+	}
+
+	g_iLastBusServiceMicro = micros();
+}
+
+
+
 void DisplayMovementSpeed(float fDisplaySpeedRatio, int iDeltaTimeMS)
 {
 	// Time vars in microseconds
@@ -856,20 +944,23 @@ void DisplayMovementSpeed(float fDisplaySpeedRatio, int iDeltaTimeMS)
 		g_Leds.setPixelColor(i, exp_map[g_aoLEDOut[i].m_yR], exp_map[g_aoLEDOut[i].m_yG], exp_map[g_aoLEDOut[i].m_yB]);
 	}
 
+	// Draw the tuning confirmation on top
+	DrawTuningConfirmation();
+
 	// Write final values to LEDs
 	//g_Leds.setBrightness(80); // Dim for now to use less power
 	g_Leds.setBrightness(255);
+	ServiceBus();
 	g_Leds.show();
 
 
 	// Make this take a consistent amount of time so the frame rate dependent
-	// smoothing code runs cleanly.
-	iEndTime = micros();
-	int iMicrosToDelay = ALLOTTED_LED_TIME_MICRO - (iEndTime-iStartTime);
-	if(iMicrosToDelay > 0)
+	// smoothing code runs cleanly.  The bus is looked after while waiting.
+	do
 	{
-		delayMicroseconds(iMicrosToDelay);
-	}
+		ServiceBus();
+		iEndTime = micros();
+	} while(iEndTime - iStartTime < ALLOTTED_LED_TIME_MICRO);
 
 	//// TEMP_CL - profile
 	//iEndTime = micros();
@@ -885,14 +976,8 @@ void loop()
 	unsigned long iEndTime;
 	iStartTime = micros();
 
-	// Get the cur
-	float fCurSpeed = GetCurSpeed();
-
-	// Clamp the range of the speed
-	fCurSpeed = Clamp(fCurSpeed, fMinSpeed, fMaxSpeed);
-
-	// Calculate the new speed ratio
-	float fNewSpeedRatio = (fCurSpeed - fMinSpeed) / (fMaxSpeed - fMinSpeed);
+	// Get the current speed ratio
+	float fNewSpeedRatio = Q16ToFloat(GetCurSpeedRatio());
 
 	// TEMP_CL - try this AFTER the smoothing..
 	//// Apply the input exponent to change the input curve
@@ -906,7 +991,7 @@ void loop()
 	g_fSpeedRatio = fNewSpeedRatio * fNewSpeedWeight + g_fSpeedRatio * (1.0 - fNewSpeedWeight);
 
 	// Apply the input exponent to change the input curve.  This is the final output.
-	float fDisplaySpeedRatio = pow(g_fSpeedRatio, fInputExponent);
+	float fDisplaySpeedRatio = Q16ToFloat(g_oSpeedCurve.Apply(FloatToQ16(g_fSpeedRatio)));
 	//Serial.print("TEMP_CL fNewSpeedRatio =");
 	//Serial.print(fNewSpeedRatio);
 	//Serial.print(" g_fSpeedRatio=");
@@ -930,139 +1015,13 @@ void loop()
 	// Use the speed ratio to set the brightness of the LEDs
 	DisplayMovementSpeed(fDisplaySpeedRatio, iDeltaTimeMS);
 
-	// Construct the byte to send that contains our node ID
-	// and the current speed.  We are compressing our speed ratio
-	// to 5 bits (32 values) so that it fits in a single byte.
-	// We are also never sending a byte of 0 so make speed run from 1 to 31, not 0 to 31
-	byte ySendByte = g_iNodeIndex << 5;
-	ySendByte = ySendByte | (int(fDisplaySpeedRatio * 30 + 0.5) + 1);
+	// The speed to send in our slot
+	g_iSendMotion = int(fDisplaySpeedRatio * NODE_MOTION_MAX + 0.5);
+	ServiceBus();
 
-	// Get the current time (after all the sensor and LED stuff)
-	unsigned long iCurTime = millis();
-
-	// Listen for other nodes talking
-	int iNumReadBytes = 0;
-	while(Uart.available() > 0)
-	{
-		// Get the byte 
-		int iReadByte = Uart.read();
-		iNumReadBytes++;
-
-		// Really, I don't think we should be reading more than one each loop... but maybe not?
-		if(iNumReadBytes > 1)
-		{
-			DebugLog("Got more more than a single byte in a loop:", iNumReadBytes);
-		}
-
-		// If we got a new start signal, start trying to read the packet
-		if(iReadByte == START_RCV_BYTE)
-		{
-			ReceiveTuningMessage();
-		}
-		else
-		{
-			// Get the node index of the sender
-			int iIncomingNodeIndex = iReadByte >> 5;
-
-			if(USE_SERIAL_FOR_DEBUGGING)
-			{
-				Serial.print(iCurTime);
-				Serial.print(" Got data ");
-				Serial.print(iReadByte);
-				Serial.print(" from node ");
-				Serial.print(iIncomingNodeIndex);
-
-				int iMotion = (iReadByte & 31) << 3;
-				Serial.print(" with value ");
-				Serial.println(iMotion);
-			}
-
-			// Throw out 0 bytes
-			if(iReadByte == 0)
-			{
-				DebugLog(" ############# Ignoring 0 byte!");
-				continue;
-			}
-
-			// Do some error checking that can likely be commented out in a final version
-			// The PC "node" index is NUM_NODES, so accept that as a valid value too.
-			if( iIncomingNodeIndex == g_iNodeIndex ||
-				iIncomingNodeIndex > NUM_NODES )
-			{
-				DebugLog(" ############# Got invlaid node index!");
-			}
-			else
-			{
-				// Save the next node index
-				g_iNextNodeIndex = (iIncomingNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-			}
-		
-			// Save off the time we got this message so we can time out if a node isn't sending.
-			g_iLastReceiveTime = iCurTime;
-		}
-	}
-
-	if(iNumReadBytes == 0)
-	{
-		int iTimeout = (g_iNextNodeIndex == NUM_NODES) ? PC_COM_TIMEOUT_MS : NODE_COM_TIMEOUT_MS;
-		// Check for a timeout.
-		if(iCurTime - g_iLastReceiveTime > iTimeout)
-		{
-			if(USE_SERIAL_FOR_DEBUGGING)
-			{
-				Serial.print(iCurTime);
-				Serial.print(" Timeout! g_iNextNodeIndex=");
-				Serial.print(g_iNextNodeIndex);
-				Serial.print(" g_iLastReceiveTime=");
-				Serial.print(g_iLastReceiveTime);
-				Serial.println("");
-			}
-
-			g_iNextNodeIndex = (g_iNextNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-			g_iLastReceiveTime = iCurTime;
-		}
-	}
-
-	// If we are supposed to send next, do that
-	if(g_iNodeIndex == g_iNextNodeIndex)
-	{
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print(iCurTime);
-			Serial.print(" About to write data g_iNodeIndex=");
-			Serial.print(g_iNodeIndex);
-			Serial.print(" value=");
-			Serial.print(ySendByte & 31);
-			Serial.println("");
-		}
-
-		if(USE_RS485)
-		{
-			delay(1); // short extra delay just to be safe
-			digitalWrite (RS485_ENABLE_WRITE_PIN, HIGH);  // enable sending
-		}
-		Uart.write(ySendByte);
-		if(USE_RS485)
-		{
-			Uart.flush();
-			delay(1); // short extra delay just to be safe
-			digitalWrite (RS485_ENABLE_WRITE_PIN, LOW);  // disable sending  
-
-		}
-
-		// Update next node now that we have sent
-		g_iNextNodeIndex = (g_iNextNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-
-		// Also reset the time or else we will timeout too early
-		g_iLastReceiveTime = iCurTime;
-
-		if(USE_SERIAL_FOR_DEBUGGING)
-		{
-			Serial.print(iCurTime);
-			Serial.print(" Just wrote data g_iNodeIndex=");
-			Serial.println(g_iNodeIndex);
-		}
-	}
+	// Save any new tuning values a byte at a time
+	g_oSettingsStore.Update();
+	ServiceBus();
 
 	//// TEMP_CL - Profiling
 	//iEndTime = micros();
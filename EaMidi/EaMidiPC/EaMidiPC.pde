@@ -107,9 +107,22 @@ boolean[] g_abNoteOn = new boolean[NUM_NODES];
 // This is used for testing and lets the PC override the latest motion data
 int[] g_aiPCOverrideMotion = new int[NUM_NODES];
 
-// Send data start byte
-static int START_SEND_BYTE = 240; // Binary = 11110000 (this also translates to node 7 sending 16 (out of 32) as a motion value).
-static int END_SEND_BYTE = 241; // Binary = 11110001 (this also translates to node 7 sending 17 (out of 32) as a motion value).
+// Node bus frames.  These NEED to match libraries/EANodeBus/EANodeFrame.h!
+// On the wire a frame is COBS(version << 4 | type, sender, sequence, payload..., crc8) followed by 0.
+static int NODE_FRAME_VERSION = 1;
+static int NODE_FRAME_MOTION = 1;
+static int NODE_FRAME_BEACON = 2;
+static int NODE_FRAME_TUNING = 3;
+static int NODE_MOTION_MAX = 4095;
+static int NODE_MOTION_FRAME_BYTES = 10;
+static int NODE_BEACON_FRAME_BYTES = 7;
+
+// Bytes of the frame being read, the sequence number of our next frame, and the
+// last sequence number from each node (to count dropped frames)
+int[] g_aiFrameBytes = new int[128];
+int g_iNumFrameBytes = 0;
+int g_iNextSequence = 0;
+int[] g_aiLastNodeSequence = new int[NUM_NODES];
 
 // The filename of the settings file.  If the file doesn't exist, the values below are used.
 static String SETTINGS_FILENAME = "NodeSettings.txt";
@@ -162,12 +175,25 @@ int g_iStartupPushValuesToNodesTimes = 3;
 // This var tracks how long to wait between startup tuning value pushes in MS.  It should be initialized to 0.
 float g_fCurTimeTillNextStartupPushMS = 0;
 
-// This is the next node index expected on the com bus.  Each node takes its turn on the com bus.
-int g_iNextExpectedNodeIndex = 0;
+// Time slotted com bus.  This is the PC half of libraries/EANodeBus/EATdmaScheduler.h.
+// The PC sends a beacon to start each round, then each present node talks in its own slot
+// followed by one join slot for nodes coming back.  These NEED to be the same as the settings
+// in the node file and EATdmaScheduler.h!
+static int COM_SLOT_GUARD_MICRO = 7000;
+static int TDMA_MISSES_TO_DROP = 3;
+static int TDMA_NUM_ROUND_IDS = 15;
 
-// But sometimes a node drops out so we need to time out.
-int g_iLastReceiveTime = 0;
-static int NODE_COM_TIMEOUT_MS = 30; // This NEEDS to be the same as the setting in the node file!
+// Extra time to wait before the beacon in case node bytes are still stuck in the USB serial driver
+static int PC_BEACON_MARGIN_MS = 5;
+
+// Which nodes have a slot, which were heard this round, and for how many rounds they have been missing
+boolean[] g_abNodePresent = new boolean[NUM_NODES];
+boolean[] g_abNodeHeard = new boolean[NUM_NODES];
+int[] g_aiNodeMisses = new int[NUM_NODES];
+
+// The round number sent in the last beacon and when it was sent
+int g_iRound = 0;
+int g_iLastBeaconTimeMS = 0;
 
 // Layout constants
 static int WINDOW_WIDTH = 700;
@@ -315,6 +341,161 @@ void setup()
 
 
 
+// Time for the beacon itself to go out in ms.  The nodes time their slots from when it ends.
+int GetBeaconTimeMS()
+{
+	int iByteTimeMicro = (10 * 1000000 + COM_BAUD_RATE - 1) / COM_BAUD_RATE;
+	return (iByteTimeMicro * NODE_BEACON_FRAME_BYTES + 999) / 1000;
+}
+
+// Length of the node part of a round in ms: one slot for each present node and the join slot.
+// This has to match TdmaScheduler::GetRoundMicro().
+int GetRoundTimeMS()
+{
+	int iByteTimeMicro = (10 * 1000000 + COM_BAUD_RATE - 1) / COM_BAUD_RATE;
+	int iSlotMicro = iByteTimeMicro * NODE_MOTION_FRAME_BYTES + COM_SLOT_GUARD_MICRO;
+	int iNumPresent = 0;
+	for(int i = 0; i < NUM_NODES; i++)
+	{
+		if(g_abNodePresent[i])
+		{
+			iNumPresent++;
+		}
+	}
+	return ((iNumPresent + 1) * iSlotMicro + 999) / 1000;
+}
+
+
+
+// Close out the last round and send the beacon that starts the next one.
+// This has to match TdmaScheduler::StartRound().
+void SendBeacon()
+{
+	for(int i = 0; i < NUM_NODES; i++)
+	{
+		if(g_abNodeHeard[i])
+		{
+			g_aiNodeMisses[i] = 0;
+			g_abNodePresent[i] = true;
+		}
+		else if(g_abNodePresent[i])
+		{
+			g_aiNodeMisses[i]++;
+			if(g_aiNodeMisses[i] >= TDMA_MISSES_TO_DROP)
+			{
+				println(g_iCurTimeMS + " Node " + i + " dropped from the com rounds");
+				g_abNodePresent[i] = false;
+			}
+		}
+		g_abNodeHeard[i] = false;
+	}
+
+	g_iRound = (g_iRound % TDMA_NUM_ROUND_IDS) + 1;
+	int[] aiPayload = { g_iRound };
+	SendFrame(NODE_FRAME_BEACON, aiPayload);
+	g_iLastBeaconTimeMS = millis();
+}
+
+
+
+// CRC-8 (poly 0x07, start 0).  Same as NodeCrc8().
+int NodeCrc8(int[] aiData, int iLength)
+{
+	int iCrc = 0;
+	for(int i = 0; i < iLength; i++)
+	{
+		iCrc ^= aiData[i];
+		for(int j = 0; j < 8; j++)
+		{
+			iCrc = ((iCrc & 0x80) != 0) ? ((iCrc << 1) ^ 0x07) & 0xFF : (iCrc << 1) & 0xFF;
+		}
+	}
+	return iCrc;
+}
+
+
+
+// Build a frame from the PC and write it out
+void SendFrame(int iType, int[] aiPayload)
+{
+	int[] aiRaw = new int[aiPayload.length + 4];
+	aiRaw[0] = (NODE_FRAME_VERSION << 4) | iType;
+	aiRaw[1] = NUM_NODES;
+	aiRaw[2] = g_iNextSequence;
+	for(int i = 0; i < aiPayload.length; i++)
+	{
+		aiRaw[3 + i] = aiPayload[i];
+	}
+	aiRaw[aiRaw.length - 1] = NodeCrc8(aiRaw, aiRaw.length - 1);
+	g_iNextSequence = (g_iNextSequence + 1) & 255;
+
+	// COBS encode so the only 0 is the one at the end
+	byte[] ayWire = new byte[aiRaw.length + aiRaw.length / 254 + 2];
+	int iCodePos = 0;
+	int iOutPos = 1;
+	int iCode = 1;
+	for(int i = 0; i < aiRaw.length; i++)
+	{
+		if(aiRaw[i] == 0)
+		{
+			ayWire[iCodePos] = (byte)iCode;
+			iCodePos = iOutPos++;
+			iCode = 1;
+		}
+		else
+		{
+			ayWire[iOutPos++] = (byte)aiRaw[i];
+			iCode++;
+			if(iCode == 0xFF)
+			{
+				ayWire[iCodePos] = (byte)iCode;
+				iCodePos = iOutPos++;
+				iCode = 1;
+			}
+		}
+	}
+	ayWire[iCodePos] = (byte)iCode;
+	ayWire[iOutPos++] = 0;
+
+	g_port.write(java.util.Arrays.copyOf(ayWire, iOutPos));
+}
+
+
+
+// Decode the frame in g_aiFrameBytes.  Returns the raw frame without the CRC or null if it is bad.
+int[] DecodeFrame()
+{
+	int[] aiRaw = new int[g_iNumFrameBytes];
+	int iInPos = 0;
+	int iOutPos = 0;
+	while(iInPos < g_iNumFrameBytes)
+	{
+		int iCode = g_aiFrameBytes[iInPos++];
+		if(iInPos + iCode - 1 > g_iNumFrameBytes)
+		{
+			return null;
+		}
+		for(int i = 1; i < iCode; i++)
+		{
+			aiRaw[iOutPos++] = g_aiFrameBytes[iInPos++];
+		}
+		if(iCode != 0xFF && iInPos < g_iNumFrameBytes)
+		{
+			aiRaw[iOutPos++] = 0;
+		}
+	}
+
+	if(iOutPos < 4 ||
+	   NodeCrc8(aiRaw, iOutPos - 1) != aiRaw[iOutPos - 1] ||
+	   (aiRaw[0] >> 4) != NODE_FRAME_VERSION)
+	{
+		return null;
+	}
+	return java.util.Arrays.copyOf(aiRaw, iOutPos - 1);
+}
+
+
+
 // Update min speed, max speed, and smoothing for all nodes
 void SendNewValuesToNodes()
 {
@@ -322,7 +503,10 @@ void SendNewValuesToNodes()
 
 	if(g_bUseSerial)
 	{
-		g_port.write(START_SEND_BYTE);
+		// All the nodes' values go in one frame
+		int[] aiPayload = new int[1 + NUM_NODES * 8];
+		int iPayloadPos = 0;
+		aiPayload[iPayloadPos++] = NUM_NODES;
 
 		for(int i = 0; i < NUM_NODES; i++)
 		{
@@ -346,14 +530,15 @@ void SendNewValuesToNodes()
 			int iNewExponentU = iNewExponent >> 8;
 			int iNewExponentL = iNewExponent & 255;
 
-			g_port.write(iNewMinSpeedU);
-			g_port.write(iNewMinSpeedL);
-			g_port.write(iNewMaxSpeedU);
-			g_port.write(iNewMaxSpeedL);
-			g_port.write(iNewWeightU);
-			g_port.write(iNewWeightL);
-			g_port.write(iNewExponentU);
-			g_port.write(iNewExponentL);
+			// Little endian like the rest of the frame
+			aiPayload[iPayloadPos++] = iNewMinSpeedL;
+			aiPayload[iPayloadPos++] = iNewMinSpeedU;
+			aiPayload[iPayloadPos++] = iNewMaxSpeedL;
+			aiPayload[iPayloadPos++] = iNewMaxSpeedU;
+			aiPayload[iPayloadPos++] = iNewWeightL;
+			aiPayload[iPayloadPos++] = iNewWeightU;
+			aiPayload[iPayloadPos++] = iNewExponentL;
+			aiPayload[iPayloadPos++] = iNewExponentU;
 
 			println("sent iNewMinSpeedU=" + iNewMinSpeedU);
 			println("sent iNewMinSpeedL=" + iNewMinSpeedL);
@@ -365,7 +550,7 @@ void SendNewValuesToNodes()
 			println("sent iNewExponentL=" + iNewExponentL);
 		}
 
-		g_port.write(END_SEND_BYTE);
+		SendFrame(NODE_FRAME_TUNING, aiPayload);
 		println("### New settings sent!");
 	}
 
@@ -519,23 +704,41 @@ void draw()
 	// will grow they will be lag between the new signal and it getting sent to MIDI
 	while(g_bUseSerial && g_port.available() > 0)
 	{
-		// read byte and then parse out node and motion value
+		// Collect bytes until the 0 that ends a frame
 		int iReadByte = g_port.read();
-		if(iReadByte == 0)
+		if(iReadByte != 0)
+		{
+			if(g_iNumFrameBytes < g_aiFrameBytes.length)
+			{
+				g_aiFrameBytes[g_iNumFrameBytes++] = iReadByte;
+			}
+			continue;
+		}
+		if(g_iNumFrameBytes == 0)
+		{
+			continue;
+		}
+		int[] aiFrame = DecodeFrame();
+		g_iNumFrameBytes = 0;
+		if(aiFrame == null)
+		{
+			println("Got bad frame!  Invalid! #########################################");
+			continue;
+		}
+
+		// Only motion frames come from the nodes
+		if((aiFrame[0] & 0x0F) != NODE_FRAME_MOTION || aiFrame.length < 7)
 		{
-			println("Got 0 byte!  Invalid! #########################################");
 			continue;
 		}
 
 		// Get node index
-		int iNodeIndex = iReadByte >> 5;
+		int iNodeIndex = aiFrame[1];
 
-		// We are compressing our speed ratio
-		// to 5 bits (32 values) so that it fits in a single byte.
-		// We are also never sending a byte of 0 so make speed run from 1 to 31, not 0 to 31
-		int iMotion = ((iReadByte & 31) - 1) * 255 / 30;
+		// Motion is 12 bits.  Scale it to the 0 - 255 used here.
+		int iMotion = (aiFrame[3] | (aiFrame[4] << 8)) * 255 / NODE_MOTION_MAX;
 
-		println("Read value iNodeIndex=" + iNodeIndex + " iMotion=" + iMotion + " at time " + g_iCurTimeMS);
+		println("Read value iNodeIndex=" + iNodeIndex + " iMotion=" + iMotion + " seq=" + aiFrame[2] + " at time " + g_iCurTimeMS);
 
 		if(iNodeIndex >= NUM_NODES)
 		{
@@ -543,6 +746,14 @@ void draw()
 			continue;
 		}
 
+		// Count frames lost since the last one from this node
+		int iSequenceGap = (aiFrame[2] - g_aiLastNodeSequence[iNodeIndex] - 1) & 255;
+		if(iSequenceGap != 0 && g_abNodePresent[iNodeIndex])
+		{
+			println("Lost " + iSequenceGap + " frames from node " + iNodeIndex);
+		}
+		g_aiLastNodeSequence[iNodeIndex] = aiFrame[2];
+
 		// Only update the motion value if we aren't overriding it
 		if(g_aiPCOverrideMotion[iNodeIndex] == 0)
 		{
@@ -553,22 +764,8 @@ void draw()
 			g_aiLastMotionUpdateTime[iNodeIndex] = g_iCurTimeMS;
 		}
 
-		// Save off the last node index and the time of the the last value so that we 
-		// can know when to talk on the common bus.
-		g_iNextExpectedNodeIndex = (iNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-		g_iLastReceiveTime = g_iCurTimeMS;
-	}
-
-	// Check for a com timeout and then increment the next expected node.
-	// This is slightly different from the node timeout below.  We might consider it ok
-	// to occationally miss an update in the com cycle but not consider that a node
-	// that needs to be zeroed out.
-	while(g_iCurTimeMS - g_iLastReceiveTime > NODE_COM_TIMEOUT_MS)
-	{
-		println(g_iCurTimeMS + " Timeout waiting for node " + g_iNextExpectedNodeIndex); 
-
-		g_iNextExpectedNodeIndex = (g_iNextExpectedNodeIndex + 1) % (NUM_NODES + 1); // The PC gets a chance to talk also and has a node index of NUM_NODES
-		g_iLastReceiveTime += NODE_COM_TIMEOUT_MS;
+		// Remember who talked this round so the slots match what the nodes work out
+		g_abNodeHeard[iNodeIndex] = true;
 	}
 
 	// TEMP_CL This is causing more problems than it seems to be fixing right now.  For the current run, the plan is to not have auto program switching.
@@ -584,27 +781,20 @@ void draw()
 	//	}
 	//}
 
-	// If it is our turn to talk, do that
-	if(g_iNextExpectedNodeIndex == NUM_NODES)
+	// If all the node slots are done, it is our turn to talk
+	if(g_iCurTimeMS - g_iLastBeaconTimeMS >= GetBeaconTimeMS() + GetRoundTimeMS() + PC_BEACON_MARGIN_MS)
 	{
-		// If we have new values to push to the nodes, check to see if it is our turn to talk
+		// If we have new values to push to the nodes, do that in our slot
 		if(g_bPushNewValuesToNodes)
 		{
 			SendNewValuesToNodes();
 		}
-		// Otherwise, just send a fake message with our "node" index to keep com flow going
-		else if(g_bUseSerial)
-		{
-			int iSendByte = (NUM_NODES << 5) | 1;
 
-			delay(3); // This delay matches the delay on the node side.  Without it the PC can send its message too earlyf or the nodes to be listening.
-			g_port.write(iSendByte);
-			println(g_iCurTimeMS + " Just sent PC message"); 
+		// Then start the next round
+		if(g_bUseSerial)
+		{
+			SendBeacon();
 		}
-
-		// Move along on the next expected node index and timeout time.
-		g_iNextExpectedNodeIndex = 0;
-		g_iLastReceiveTime = g_iCurTimeMS;
 	}
 
 	// Check for nodes timing out
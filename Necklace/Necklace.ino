@@ -1,4 +1,5 @@
 #include <FastLED.h>
+#include <EAHeatField.h>
 
 #define DATA_PIN 10
 
@@ -74,6 +75,11 @@ DEFINE_GRADIENT_PALETTE( heatmap_gp ) {
 
 CRGBPalette16 gPal = heatmap_gp;
 
+HeatField<NUM_LEDS, HeatKernelFirst3, HeatSparksSingle> g_oHeatField(
+	COOLING_MIN,
+	COOLING_MAX,
+	HeatSparksSingle(SPARKING, SPARK_HEAT_MIN, SPARK_HEAT_MAX));
+
 
 
 void setup()
@@ -139,36 +145,5 @@ void loop()
 
 void UpdateHeat()
 {
-	//// TEMP_CL - just do random
-	//for( int i = 0; i < NUM_LEDS; i++)
-	//{
-	//	heat[i] = random8(0, 255);
-	//}
-	//return;
-  
-
-
-	// Cool down every cell a little
-	for( int i = 0; i < NUM_LEDS; i++)
-	{
-		heat[i] = qsub8( heat[i],  random8(COOLING_MIN, COOLING_MAX));
-	}
-  
-	// Heat from each cell drifts out
-	// TEMP_CL - assume there are only 3 for now
-	heat[0] = (heat[0]*3 + heat[1]*2 + heat[2]) / 6;
-	heat[1] = (heat[1]*3 + heat[1]*2 + heat[2]*2) / 7;
-	heat[2] = (heat[2]*3 + heat[1]*2 + heat[0]) / 6;
-   
-	// Randomly ignite new 'sparks' of heat
-	if( random8() < SPARKING )
-	{
-		int y = random8(0, NUM_LEDS);
-
-		byte newHeat = random8(SPARK_HEAT_MIN, SPARK_HEAT_MAX);
-		byte halfHeat = newHeat >> 1;
-		heat[y] = qadd8( heat[y],  newHeat);
-		//heat[y-1] = qadd8( heat[y], halfHeat );
-		//heat[y+1] = qadd8( heat[y], halfHeat );
-	}
-}
\ No newline at end of file
+	g_oHeatField.Update(heat);
+}
@@ -10,6 +10,7 @@ import time
 import numpy as np
 import serial
 import sys
+import tuning_link
 
 # Define useful parameters
 window_width = 1000
@@ -19,6 +20,8 @@ DELAY = 10
 BLUE_COLOR = "#0492CF"
 RED_COLOR_LIGHT = '#EE7E77'
 
+# The index in these lists is the param id / value order used by the tuning link.
+# They have to match TuningParam and update_speed() in ScienceClouds.ino.
 tuning_param_list = ["MinSpeed", "MaxSpeed", "NewSpeedWeight", "InputExponent", "BaseHeatMax", "MotionHeadMult", "MotionHeatAdd", "NumInterpFrames"]
 display_vars_list = ["fSpeedRatio", "fRawSpeedRatio", "fNewSpeedRatio", "fCurSpeed", "fRawSpeed", "fPulsesSinceLastTick"]
 num_color_grad_rows = 5
@@ -218,116 +221,98 @@ class CloudTuner:
             print("Please attach a cloud node to this computer via USB.")
             sys.exit(0)
         
+        self.frame_reader = tuning_link.FrameReader()
+        
         # Request tuning vars
-        self.serial_port.write(b'REQUEST_TUNING\n')
-        self.serial_port.write(b'REQUEST_COLORS\n')
-        self.serial_port.write(b'REQUEST_TUNING_SAVED\n')
-        self.serial_port.write(b'REQUEST_COLORS_SAVED\n')
+        self.serial_port.write(tuning_link.request_tuning(tuning_link.SET_CURRENT))
+        self.serial_port.write(tuning_link.request_colors(tuning_link.SET_CURRENT))
+        self.serial_port.write(tuning_link.request_tuning(tuning_link.SET_SAVED))
+        self.serial_port.write(tuning_link.request_colors(tuning_link.SET_SAVED))
 
         
     def save_current(self):
         print("Save Current")
-        self.serial_port.write(b'SAVE_CURRENT\n')
+        self.serial_port.write(tuning_link.encode_frame(tuning_link.MSG_SAVE_CURRENT))
        
     def overwrite_current_with_saved(self):
         print("Overwrite Current with Saved")
-        self.serial_port.write(b'OVERWRITE_CURRENT_WITH_SAVED\n')
+        self.serial_port.write(tuning_link.encode_frame(tuning_link.MSG_LOAD_SAVED))
  
     def restore_defaults(self):
         print("Restore Defaults")
-        self.serial_port.write(b'RESTORE_DEFAULTS\n')
+        self.serial_port.write(tuning_link.encode_frame(tuning_link.MSG_RESTORE_DEFAULTS))
  
 
-    def read_val_string(self, str_in, match_string):
-        match_string_length = len(match_string)
-        val_start = str_in.find(match_string) + match_string_length + 1
-        val_end = str_in.find(" ", val_start)
-        val_string = str_in[val_start:val_end]
-        
-        return val_string
+    def format_val(self, val):
+        # Floats come over the link, show them about like Serial.print() did
+        return "{:g}".format(round(val, 4))
 
 
     def update_loop(self):
-        # Init the status string
-        latest_status = ""
+        # Init the status values
+        latest_status = None
         
         # Get most recent data
-        while self.serial_port.in_waiting:
-            str_in = self.serial_port.readline().decode('UTF-8')
-            
-            # Fine grain debugging
-            #c = self.serial_port.read()
-            #print("got char:", c)
-            
-            # Less fine grain debugging
-            if not(str_in.startswith("STATUS")):
-                print("got line:", str_in, end='')
+        if self.serial_port.in_waiting:
+            messages = self.frame_reader.feed(self.serial_port.read(self.serial_port.in_waiting))
+        else:
+            messages = []
             
-            # Look for new tuning vars
-            if str_in.startswith("TUNING - "):
-                for i in range(self.num_tuning_vars):
-                    val_string = self.read_val_string(str_in, tuning_param_list[i])
-                    # TEMP_CL print(val_string)
-                    self.text_inputs[i].delete(0, tk.END)
-                    self.text_inputs[i].insert(0, val_string)
-                    self.canvas.itemconfigure(self.cur_tuning_vars[i], text=val_string)
+        for msg_type, payload in messages:
+            # Look for tuning vars
+            if msg_type == tuning_link.MSG_TUNING:
+                which, vals = tuning_link.parse_tuning(payload)
+                print("got tuning:", which, vals)
+                for i in range(min(self.num_tuning_vars, len(vals))):
+                    val_string = self.format_val(vals[i])
+                    if which == tuning_link.SET_SAVED:
+                        self.canvas.itemconfigure(self.tuning_vars_saved[i], text=val_string)
+                    else:
+                        self.text_inputs[i].delete(0, tk.END)
+                        self.text_inputs[i].insert(0, val_string)
+                        self.canvas.itemconfigure(self.cur_tuning_vars[i], text=val_string)
                     
-            # Look for saved tuning vars
-            if str_in.startswith("TUNING_SAVED - "):
-                for i in range(self.num_tuning_vars):
-                    val_string = self.read_val_string(str_in, tuning_param_list[i])
-                    # TEMP_CL print(val_string)
-                    self.canvas.itemconfigure(self.tuning_vars_saved[i], text=val_string)
-                    
-            # Look for a new color gradient
-            color_prefix = "COLORS - "
-            if str_in.startswith(color_prefix):
-                color_str = str_in[len(color_prefix):]
-                colors = color_str.replace("\r\n","").split(',') # Won't work on Macs???
+            # Look for a color gradient
+            elif msg_type == tuning_link.MSG_COLORS:
+                which, grad_id, colors = tuning_link.parse_colors(payload)
+                print("got colors:", which, grad_id, colors)
+                if len(colors) < num_color_grad_rows * 4:
+                    print("Too few colors in gradient!")
+                    continue
                 for row in range(num_color_grad_rows):
                     for i in range(4):
                         color_entry_index = row * 4 + i
-                        # TEMP_CL print(colors[color_entry_index])
+                        color_string = str(colors[color_entry_index])
+                        
+                        if which == tuning_link.SET_SAVED:
+                            # Label
+                            self.canvas.itemconfigure(self.color_vals_saved[color_entry_index], text=color_string)
+                            continue
                         
                         # Entry
                         self.color_entrys[color_entry_index].config(state='normal')
                         self.color_entrys[color_entry_index].delete(0, tk.END)
-                        self.color_entrys[color_entry_index].insert(0, colors[color_entry_index])
+                        self.color_entrys[color_entry_index].insert(0, color_string)
                         if i == 0 and (row == 0 or row == 4):
                             self.color_entrys[color_entry_index].config(state='disabled')
                        
                         # Label
-                        self.canvas.itemconfigure(self.color_vals[color_entry_index], text=colors[color_entry_index])
-                        
-            # Look for a saved color gradient
-            color_prefix = "COLORS_SAVED - "
-            if str_in.startswith(color_prefix):
-                color_str = str_in[len(color_prefix):]
-                colors = color_str.replace("\r\n","").split(',')
-                for row in range(num_color_grad_rows):
-                    for i in range(4):
-                        color_entry_index = row * 4 + i
-                        # TEMP_CL print(colors[color_entry_index])
-                                               
-                        # Label
-                        self.canvas.itemconfigure(self.color_vals_saved[color_entry_index], text=colors[color_entry_index])
+                        self.canvas.itemconfigure(self.color_vals[color_entry_index], text=color_string)
                    
-            # Look for new status      
-            elif str_in.startswith("STATUS"):
-                latest_status = str_in
+            # Look for new status (min, mean, max over the last telemetry window)
+            elif msg_type == tuning_link.MSG_TELEMETRY:
+                num_samples, latest_status = tuning_link.parse_telemetry(payload)
+                
+            elif msg_type == tuning_link.MSG_LOG:
+                print("got log:", payload.decode('UTF-8', 'replace'))
         
         # If we got new status, update based on it
-        if latest_status != "":
-            for i in range(self.num_display_vars):
-                val_string = self.read_val_string(latest_status, display_vars_list[i])
-                try:
-                    val = float(val_string)
-                
-                    x0, y0, x1, y1 = self.canvas.coords(self.display_bars[i])
-                    self.canvas.coords(self.display_bars[i], x0, y1 - live_bars_height * val, x1, y1)
-                except:
-                    print("Invalid float value in status!", val_string)
-
+        if latest_status is not None:
+            for i in range(min(self.num_display_vars, len(latest_status))):
+                val_min, val, val_max = latest_status[i]
+                x0, y0, x1, y1 = self.canvas.coords(self.display_bars[i])
+                self.canvas.coords(self.display_bars[i], x0, y1 - live_bars_height * val, x1, y1)
+                val_string = self.format_val(val) + "\n" + self.format_val(val_min) + " - " + self.format_val(val_max)
                 self.canvas.itemconfigure(self.display_vals[i], text=val_string)
         
         # Keep loop going
@@ -349,34 +334,27 @@ class CloudTuner:
                 entry_text = self.text_inputs[i].get()
                 try:
                     text_val = float(entry_text)
-                    tuning_string = "NEW_TUNING " + tuning_param_list[i] + "=" + str(text_val) + "\n"
-                    tuning_bytes = tuning_string.encode('UTF-8')
-                    print("Sending:", tuning_bytes)
-                    self.serial_port.write(tuning_bytes)
+                    print("Sending:", tuning_param_list[i], text_val)
+                    self.serial_port.write(tuning_link.set_tuning(i, text_val))
                     
                     
                 except:
                     print("Invalid float value!", entry_text)
                     
             try:
-                color_string = "NEW_COLOR_GRAD PalHeat="
+                colors = []
                 for i in range(num_color_grad_rows*4):
                     entry_text = self.color_entrys[i].get()
-                    color_val = int(entry_text)
-                    color_string += str(color_val)
-                    if i < num_color_grad_rows*4 - 1:
-                        color_string += ","
-                color_string += "\n"
-                color_bytes = color_string.encode('UTF-8')
-                print("Sending:", color_bytes)
-                self.serial_port.write(color_bytes)
+                    colors.append(int(entry_text))
+                print("Sending: PalHeat", colors)
+                self.serial_port.write(tuning_link.set_colors(0, colors))
                 
             except:
                 print("Invalid color value!", entry_text)
 
             # Get the tuning vars back from the chip to show that it worked
-            byte_written = self.serial_port.write(b'REQUEST_TUNING\n')
-            byte_written = self.serial_port.write(b'REQUEST_COLORS\n')
+            self.serial_port.write(tuning_link.request_tuning(tuning_link.SET_CURRENT))
+            self.serial_port.write(tuning_link.request_colors(tuning_link.SET_CURRENT))
 
 
 game_instance = CloudTuner()
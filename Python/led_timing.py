@@ -0,0 +1,55 @@
+# led_timing.py
+#
+# Prints how many frames a second a WS2812 LED installation can reach when its
+# LEDs are split over 1 to 8 pins (sent at the same time with DMA, one after
+# the other when blocking).  This is the same model as
+# libraries/EAHeatField/EALedTiming.h, and both are checked against
+# test/host/LedTimingVectors.txt by "make test" in test/host.
+#
+#   python led_timing.py                      # ScienceClouds: 1000 LEDs
+#   python led_timing.py --leds 300 --render-us 1500 --blocking
+
+import argparse
+
+WS2812_BIT_RATE = 800000
+WS2812_RESET_MICRO = 300
+WS2812_DMA_COPY_NANO_PER_LED = 40
+
+
+def wire_micro(num_leds, bits_per_led=24):
+    bit_rate_khz = WS2812_BIT_RATE // 1000
+    return (num_leds * bits_per_led * 1000 + bit_rate_khz - 1) // bit_rate_khz + WS2812_RESET_MICRO
+
+
+def frame_micro(num_leds, num_strips, render_micro, dma):
+    leds_per_strip = (num_leds + num_strips - 1) // num_strips
+    wire = wire_micro(leds_per_strip)
+    if not dma:
+        return render_micro + wire * num_strips
+    cpu = render_micro + num_leds * WS2812_DMA_COPY_NANO_PER_LED // 1000
+    return max(cpu, wire)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='WS2812 frame rate for each number of parallel strips')
+    parser.add_argument('--leds', type=int, default=1000, help='total number of LEDs')
+    parser.add_argument('--render-us', type=int, default=2000, help='time to work out the colors for a frame')
+    parser.add_argument('--blocking', action='store_true', help='bit banged output instead of DMA')
+    parser.add_argument('--max-strips', type=int, default=8)
+    args = parser.parse_args()
+
+    dma = not args.blocking
+    print('%d LEDs, %d us render, %s' % (args.leds, args.render_us, 'DMA' if dma else 'blocking'))
+    print('strips  LEDs/strip  wire us  frame us    FPS  limited by')
+    for num_strips in range(1, args.max_strips + 1):
+        leds_per_strip = (args.leds + num_strips - 1) // num_strips
+        wire = wire_micro(leds_per_strip)
+        frame = frame_micro(args.leds, num_strips, args.render_us, dma)
+        limit = 'wire' if dma and frame == wire else 'render'
+        if not dma:
+            limit = 'both'
+        print('%6d  %10d  %7d  %8d  %5.1f  %s' % (num_strips, leds_per_strip, wire, frame, 1e6 / frame, limit))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,170 @@
+# tuning_link.py
+#
+# PC side of the binary tuning protocol in libraries/EATuningLink/EATuningLink.h.
+# The message types and framing have to match that file.
+# test/host/test_tuning_link.py checks the two against each other.
+#
+# Each message is a type byte and a payload.  On the wire it is
+# 0x00, COBS(type + payload + crc16 little endian), 0x00.
+
+import struct
+
+# PC to node
+MSG_REQUEST_TUNING = 0x01
+MSG_REQUEST_COLORS = 0x02
+MSG_SAVE_CURRENT = 0x03
+MSG_LOAD_SAVED = 0x04
+MSG_RESTORE_DEFAULTS = 0x05
+MSG_SET_TUNING = 0x06
+MSG_SET_COLORS = 0x07
+
+# Node to PC
+MSG_TUNING = 0x81
+MSG_COLORS = 0x82
+MSG_STATUS = 0x83
+MSG_LOG = 0x84
+MSG_TELEMETRY = 0x85
+
+SET_CURRENT = 0
+SET_SAVED = 1
+
+MAX_PAYLOAD = 96
+
+
+def crc16(data, crc=0xFFFF):
+    # CRC-16/CCITT-FALSE
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos = 0
+    code = 1
+    for byte in data:
+        if byte == 0:
+            out[code_pos] = code
+            code_pos = len(out)
+            out.append(0)
+            code = 1
+        else:
+            out.append(byte)
+            code += 1
+            if code == 0xFF:
+                out[code_pos] = code
+                code_pos = len(out)
+                out.append(0)
+                code = 1
+    out[code_pos] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    # Returns None if the data is bad
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        code = data[pos]
+        pos += 1
+        if code == 0 or pos + code - 1 > len(data):
+            return None
+        out += data[pos:pos + code - 1]
+        pos += code - 1
+        if code != 0xFF and pos < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(msg_type, payload=b''):
+    raw = bytes([msg_type]) + bytes(payload)
+    raw += struct.pack('<H', crc16(raw))
+    return b'\x00' + cobs_encode(raw) + b'\x00'
+
+
+def decode_frame(frame):
+    # frame is without the delimiters.  Returns (type, payload) or None.
+    raw = cobs_decode(frame)
+    if raw is None or len(raw) < 3 or len(raw) > 3 + MAX_PAYLOAD:
+        return None
+    crc, = struct.unpack('<H', raw[-2:])
+    if crc != crc16(raw[:-2]):
+        return None
+    return raw[0], raw[1:-2]
+
+
+class FrameReader:
+    # Collects bytes and hands back the good messages in them
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.bad_frames = 0
+
+    def feed(self, data):
+        messages = []
+        for byte in data:
+            if byte != 0:
+                self.buffer.append(byte)
+                continue
+            if len(self.buffer) > 0:
+                msg = decode_frame(bytes(self.buffer))
+                if msg is None:
+                    self.bad_frames += 1
+                else:
+                    messages.append(msg)
+            self.buffer = bytearray()
+        return messages
+
+
+# Message builders
+
+def request_tuning(which):
+    return encode_frame(MSG_REQUEST_TUNING, bytes([which]))
+
+
+def request_colors(which):
+    return encode_frame(MSG_REQUEST_COLORS, bytes([which]))
+
+
+def set_tuning(param_id, value):
+    return encode_frame(MSG_SET_TUNING, struct.pack('<Bf', param_id, value))
+
+
+def set_colors(grad_id, colors):
+    return encode_frame(MSG_SET_COLORS, bytes([grad_id, len(colors)]) + bytes(colors))
+
+
+# Payload parsers
+
+def parse_floats(payload, offset):
+    # u8 count followed by that many floats
+    count = payload[offset]
+    return list(struct.unpack_from('<%df' % count, payload, offset + 1))
+
+
+def parse_tuning(payload):
+    # Returns (set, values)
+    return payload[0], parse_floats(payload, 1)
+
+
+def parse_colors(payload):
+    # Returns (set, grad id, colors)
+    count = payload[2]
+    return payload[0], payload[1], list(payload[3:3 + count])
+
+
+def parse_status(payload):
+    return parse_floats(payload, 0)
+
+
+def parse_telemetry(payload):
+    # Returns (number of samples in the window, [(min, mean, max), ...])
+    count = payload[0]
+    num_samples, = struct.unpack_from('<H', payload, 1)
+    vals = struct.unpack_from('<%df' % (count * 3), payload, 3)
+    return num_samples, [tuple(vals[i * 3:i * 3 + 3]) for i in range(count)]
@@ -7,7 +7,7 @@
  */
 
 #include <Adafruit_NeoPixel.h>
-#include <TimerOne.h>                    
+#include <EAPhaseDimmer.h>
 
 // Setting for using serial for debugging or communicating with the PC
 bool bUseSerialForDebugging = false;
@@ -68,23 +68,19 @@ static const unsigned char exp_map[256]={
 
 // Dimmer vars
 
-// Variable to use as a counter
-volatile int g_iDimmerCounter = 0;
-
-// Boolean to store a "switch" to tell us if we have crossed zero
-volatile boolean g_bZeroCross = false;
-
 // PowerSSR Tail connected to digital pin 4
 #define PSSR1 4
 
+// Zero cross detector connected to digital pin 2 (interupt 0)
+#define ZERO_CROSS_PIN 2
+#define ZERO_CROSS_INTERRUPT 0
+
 // Default dimming level (0-127)  0 = off, 127 = on
 int g_iDimmerBrightness = 32;
 
-// This 66 microseconds.  AC power runs at 60 hz and crosses zero twice in a since cycle.  Our brightness runs from 0 to 127 so there are 128 different
-// brightness levels in a single half cycle.  This means our counter should count to 128 twice (256) every full power cycle.
-// 1,000,000 microseconds / 60 / 256 = 65.1 microseconds
-// And we rounded up to 66 because that ensures that we don't over count.
-int g_iFreqStep = 66;
+// Fires the PSSR Tail at the right time in each half cycle (see EAPhaseDimmer.h).  It times
+// the half cycles itself so 50 and 60 hz both work.
+PhaseDimmer g_oDimmer;
 
 // smoothing
 float g_fSmoothedBrightness = 0;
@@ -169,15 +165,9 @@ void setup()
 
 	// Dimmer setup
 
-	// Set SSR1 pin as output
-	pinMode(PSSR1, OUTPUT);
-
-	// Attach an Interupt to digital pin 2 (interupt 0),
-	attachInterrupt(0, ZeroCrossDetect, RISING);
-
-	// Init timer
-	Timer1.initialize(g_iFreqStep);
-	Timer1.attachInterrupt(DimmerCheck, g_iFreqStep);
+	// Set SSR1 pin as output and attach an interupt to the zero cross pin
+	static const uint8_t ayDimmerPins[] = {PSSR1};
+	g_oDimmer.Begin(ayDimmerPins, 1, ZERO_CROSS_PIN, ZERO_CROSS_INTERRUPT);
 }
 
 
@@ -249,6 +239,9 @@ void loop()
 		g_iDimmerBrightness = 1.0 - (cos(2 * 3.14 * fPeriodRatio) + 0.0) / 2.0 * g_iAttractBrightness; // TEMP_CL - This is wrong and I don't know why the +0.0 works (it should be +1.0) but it does so I'm leaving it.
 	}
 
+	// The dimmer picks this up at the next zero cross
+	g_oDimmer.SetBrightness(0, g_iDimmerBrightness);
+
 
 	// The RGB leds are a direct map of the input (unlike the dimmer)
 	int iRGB = fInput * 255;
@@ -275,44 +268,4 @@ void loop()
 	// With a 10ms delay, the base reading is about 10
 	// TEMP_CL delay(10);
 	delay(5);
-
-	// TEMP_CL
-	//DimmerCheck();
 }
-
-// This function will fire the triac at the proper time
-void DimmerCheck()
-{
-	// First check to make sure the zero-cross has happened else do nothing
-	if(g_bZeroCross)
-	{
-		if( g_iDimmerCounter < 120 && // If too much time has passed, don't fire the tail at all. This is because if we fire too late, it will get stuck on the whole next cycle and cause a flash in brightness
-			g_iDimmerCounter >= (127-g_iDimmerBrightness)) // The brighter the light should be, the sooner we should fire the tail to turn on the rest of this cycle
-		{
-			//These values will fire the PSSR Tail.  When the tail fires, it will stay on till the next zero cross.
-			//delayMicroseconds(100); // I'm not sure why there was this delay in the example code so I'm taking it out because it made the tail fire late sometimes which caused the light to flicker
-			digitalWrite(PSSR1, HIGH);
-			delayMicroseconds(50);
-			digitalWrite(PSSR1, LOW);
-
-			// Reset the accumulator
-			g_iDimmerCounter = 0;                         
-
-			// Reset the zero_cross so it may be turned on again at the next zero_cross_detect    
-			g_bZeroCross = false;                
-		}
-		else
-		{
-			// If the dimming value has not been reached, increment the counter
-			g_iDimmerCounter++;
-		}
-	}
-}
-
-
-void ZeroCrossDetect() 
-{
-	// set the boolean to true to tell our dimming function that a zero cross has occured
-	g_bZeroCross = true;
-	g_iDimmerCounter = 0;
-} 
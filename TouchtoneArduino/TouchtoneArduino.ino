@@ -7,7 +7,10 @@
  * Copyright: 2018 Chris Linder
  */
 
-#include <TimerOne.h>                    
+#include <EAProcessingNode.h>
+#include <EATouchTrigger.h>
+#include <EAAdcSampler.h>
+#include <EAPhaseDimmer.h>
 
 // Setting for using serial for debugging or communicating with the PC
 bool bUseSerialForDebugging = false;
@@ -21,14 +24,22 @@ bool bUseSerialForDebugging = false;
 #define PSSR1_PIN 4      // Dimmer 1
 #define PSSR2_PIN 5      // Dimmer 2
 #define ZERO_CROSS_PIN 2 // Zero cross pin
+#define ZERO_CROSS_INTERRUPT 2 // Its interrupt, as attachInterrupt() takes it
 
 // PowerSSR Tails connected to digital pins 
-static const int pssrPins[] = {PSSR1_PIN, PSSR2_PIN};
+static const uint8_t pssrPins[] = {PSSR1_PIN, PSSR2_PIN};
 
-// Global tuning
+// Global tuning.  These are where the noise floor and margin start, TouchTrigger
+// adjusts them while it runs.
 # define MIN_SENSOR_VALUE 90
 # define MIN_INPUT_VALUE 10
 
+// Sensor sampling.  The ADC runs off Timer0 at about 976 samples a second and
+// every SENSOR_OVERSAMPLING of them make one reading, so about 195 readings a
+// second, close to the old loop with its delay(5).
+#define SENSOR_OVERSAMPLING 5
+#define SENSOR_SAMPLE_RATE_HZ 976 // Only used by boards that aren't AVR
+
 // Tuning vars for touch light
 #define TOUCH_TRIGGER_FRAMES 10
 #define MIN_TOUCH_BRIGHTNESS 0.3
@@ -42,11 +53,15 @@ static int   g_iNode0Avg=2;
 static float g_fNode1Exp=0.3;
 static int   g_iNode1Avg=10;
 static float g_fDetectThreshold=0.4;
+static float g_fDetectOffThreshold=0.3;
 
 
 // Current sensor value
 int g_iSensorValue = 0;
 
+// Reads the sensor in the background
+AdcSampler<SENSOR_OVERSAMPLING> g_oSensorSampler;
+
 // Smoothied float value of the sensor
 float g_fSmoothedSensor = 0;
 
@@ -73,121 +88,23 @@ static const unsigned char exp_map[256]={
 
 // Dimmer vars
 
-// Variable to use as a counter between zero crossing events. Runs from 0 to 127.
-volatile int g_iDimmerCounter = 0;
-
-// Flag set by the interupt when a zero cross on the AC power occurs.
-volatile boolean g_bZeroCross = false;
-
 // Default dimming level (0-127)  0 = off, 127 = on
 int g_iDimmerBrightness[NUM_DIMMERS];
 
-// This is 66 microseconds.  AC power runs at 60 hz and crosses zero twice in a since cycle.  Our brightness runs from 0 to 127 so there are 128 different
-// brightness levels in a single half cycle.  This means our counter should count to 128 twice (256) every full power cycle.
-// 1,000,000 microseconds / 60 / 256 = 65.1 microseconds
-// And we rounded up to 66 because that ensures that we don't over count.
-#define FREQ_STEP 66
-
-
-// PC singal processing nodes from "InputGraph" program
-#define MAX_NUM_SAMPLES 30
-
-class ProcessingNode
-{
-  protected:
-  
-  class ProcessingNode* m_pNodeInput;
-  boolean m_bDerivative;
-  float m_fExponentialSmoothingWeight;
-  int m_iAvgSmoothingNumSamples;
-  float m_fScalingFactor;
-
-  float m_fInput;
-  float m_fProcessingVar;
-  float m_fExponentialSmoothedInput;
-  float m_fAvgSmoothedInput;
-
-  float m_afAvgBuffer[MAX_NUM_SAMPLES];
-  int m_iBufferIndex;
-  float m_fOutput;
-  
-  public:
-  
-  ProcessingNode(class ProcessingNode* pNodeInput, boolean bDerivative, float fExponentialSmoothingWeight, int iAvgSmoothingNumSamples, float fScalingFactor)
-  {
-    m_pNodeInput = pNodeInput;
-    m_bDerivative = bDerivative;
-    m_fExponentialSmoothingWeight = fExponentialSmoothingWeight;
-    m_iAvgSmoothingNumSamples = iAvgSmoothingNumSamples;
-    m_fScalingFactor = fScalingFactor;
-
-    m_iBufferIndex = 0;
-  }
-
-  void UpdateFromInput(int iDeltaTimeMS, float fInput)
-  {
-    if(m_bDerivative)
-    {
-      float fOldInput = m_fInput;
-      m_fInput = fInput;
-      m_fProcessingVar = (m_fInput - fOldInput) / iDeltaTimeMS * 1000.0;
-    }
-    else
-    {
-      m_fProcessingVar = fInput;
-    }
-
-    // Smooth the input using a Exponential moving average
-    if(m_fExponentialSmoothingWeight > 0)
-    {
-      m_fExponentialSmoothedInput = m_fProcessingVar * (1.0 - m_fExponentialSmoothingWeight) + m_fExponentialSmoothedInput * m_fExponentialSmoothingWeight;
-    }
-    else
-    {
-      m_fExponentialSmoothedInput = m_fProcessingVar;
-    }
+// Fires the PSSR Tails at the right time in each half cycle from g_iDimmerBrightness
+// (see EAPhaseDimmer.h).  It times the half cycles itself so 50 and 60 hz both work.
+PhaseDimmer g_oDimmer;
 
-    // Smooth the input using the last n samples (which have already been smoothed with the Exponential smoothing)
-    if(m_iAvgSmoothingNumSamples > 1)
-    {
-      m_iBufferIndex = (m_iBufferIndex + 1) % m_iAvgSmoothingNumSamples;
-      m_afAvgBuffer[m_iBufferIndex] = m_fExponentialSmoothedInput;
-      m_fAvgSmoothedInput = 0;
-      for(int i = 0; i < m_iAvgSmoothingNumSamples; ++i)
-      {
-        m_fAvgSmoothedInput += m_afAvgBuffer[i];
-      }
-      m_fAvgSmoothedInput /= m_iAvgSmoothingNumSamples;
-    }
-    else
-    {
-      m_fAvgSmoothedInput = m_fExponentialSmoothedInput;
-    }
-
-    // The output is the result of both types of smoothing scaled by the scaling factor
-    m_fOutput = m_fAvgSmoothedInput * m_fScalingFactor;
-  }
-
-  void Update(int iDeltaMS)
-  {
-    UpdateFromInput(iDeltaMS, m_pNodeInput->GetOutput());
-  }
-
-  float GetOutput()
-  {
-    return m_fOutput;
-  }
-};
 
-// Signal processing node setup
-ProcessingNode g_oNode0(NULL,     false, g_fNode0Exp, g_iNode0Avg, 1.0); // Input
-ProcessingNode g_oNode1(&g_oNode0, true,  g_fNode1Exp, g_iNode1Avg, 0.6); // 1st serivative
+// Signal processing node setup (from the "InputGraph" program).  The windows have to be at
+// least g_iNode0Avg and g_iNode1Avg samples.
+ProcessingNode<2>  g_oNode0(NULL,      false, g_fNode0Exp, g_iNode0Avg, 1.0); // Input
+ProcessingNode<10> g_oNode1(&g_oNode0, true,  g_fNode1Exp, g_iNode1Avg, 0.6); // 1st serivative
 
 // Touch vars
-bool g_bDetectOn = false; // If we are actively detecting a touch. This can be TRUE for multiple frames in a row.
+TouchTrigger g_oTouchTrigger(MIN_SENSOR_VALUE, MIN_INPUT_VALUE, g_fDetectThreshold, g_fDetectOffThreshold);
 bool g_bTriggerNow = false; // This is only true for the first frame of detecting a touch.
 float g_fTriggerVelocity = 0.0; // The velocity (0.0-1.0) of the last touch
-float g_fMaxSmoothedInput = 0.1; // Max of the smoothed input so far which is used to set g_fTriggerVelocity
 
 // Clamp function - float
 float ClampF(float fVal, float fMin, float fMax)
@@ -203,7 +120,7 @@ float ClampF(float fVal, float fMin, float fMax)
   return fVal;
 }
 
-// This reads the input nodes and sets g_bDetectOn, g_bTriggerNow, g_fTriggerVelocity, and g_fMaxSmoothedInput
+// This reads the input nodes and sets g_bTriggerNow and g_fTriggerVelocity
 void ProcessSignal()
 {
   float fRawInput = float(g_iSensorValue) / 1024.0; 
@@ -219,19 +136,11 @@ void ProcessSignal()
   float fSmoothedInput = g_oNode0.GetOutput();
   float fSmoothedFirstDeriv = g_oNode1.GetOutput();
   
-  g_bTriggerNow = false;
-  boolean bOldDetectOn = g_bDetectOn;
-  g_bDetectOn = fSmoothedFirstDeriv > g_fDetectThreshold;
-  if(!bOldDetectOn && g_bDetectOn)
+  // The trigger keeps track of the peak input so the velocity stays in range over time
+  g_bTriggerNow = g_oTouchTrigger.Update(fSmoothedInput, fSmoothedFirstDeriv);
+  if(g_bTriggerNow)
   {
-    // TODO - Find some way to recalibrate this over time as opposed to restarting the app
-    if(fSmoothedInput > g_fMaxSmoothedInput)
-    {
-      g_fMaxSmoothedInput = fSmoothedInput;
-    }
-  
-    g_fTriggerVelocity = ClampF(fSmoothedInput / (g_fMaxSmoothedInput * 0.9), 0.0, 1.0);
-    g_bTriggerNow = true;
+    g_fTriggerVelocity = g_oTouchTrigger.GetVelocity();
   }
 }
 
@@ -265,44 +174,38 @@ void setup()
 	pinMode(LED_OUT_PIN, OUTPUT);
 	digitalWrite(LED_OUT_PIN, LOW);
 
+	// Start sampling the sensor.  analogRead() can't be used after this.
+	static const uint8_t ayPins[] = {SENSOR_PIN};
+	g_oSensorSampler.Begin(ayPins, SENSOR_SAMPLE_RATE_HZ);
+
 
 	// Dimmer setup
 
-	// Set PSSR pins as output and set initial brightness levels
+	// Set initial brightness levels
   for(int i = 0; i < NUM_DIMMERS; ++i) 
   {
-    pinMode(pssrPins[i], OUTPUT);
     g_iDimmerBrightness[i] = 0;
   }
 
-	// Attach an Interupt to digital pin
-  pinMode(ZERO_CROSS_PIN, INPUT);
-  attachInterrupt(ZERO_CROSS_PIN, ZeroCrossDetect, RISING);
-
-	// Init timer
-	Timer1.initialize(FREQ_STEP);
-	Timer1.attachInterrupt(DimmerCheck, FREQ_STEP);
-
-
+	// Set PSSR pins as output and attach an interupt to the zero cross pin
+  g_oDimmer.Begin(pssrPins, NUM_DIMMERS, ZERO_CROSS_PIN, ZERO_CROSS_INTERRUPT);
 }
 
 
 void loop()
 {
-	// Read the current sensor value
-  g_iSensorValue = analogRead(SENSOR_PIN); 
+	// Wait for the next reading of the sensor.  These come at a steady rate so
+	// the loop doesn't need a delay to pace itself.
+  uint16_t iRawSensorValue;
+  if(!g_oSensorSampler.ReadBlock(&iRawSensorValue))
+  {
+    return;
+  }
 
   // Sometimes this system has noise, particularlly if people are near the touch lights
   // and are only holding the sensor read handled (as opposed to the postive voltage handle).
-  // This helps removed that noise.
-  if(g_iSensorValue < MIN_SENSOR_VALUE)
-  {
-    g_iSensorValue = 0;
-  }
-  else
-  {
-    g_iSensorValue = g_iSensorValue - MIN_SENSOR_VALUE;
-  }
+  // This takes off the noise floor, which follows the input while nothing is touched.
+  g_iSensorValue = g_oTouchTrigger.RemoveNoiseFloor(iRawSensorValue);
 
 	if(bUseSerialForDebugging)
 	{
@@ -326,7 +229,7 @@ void loop()
 
 	// Take raw sensor value and turn it unto a useful input value called fInput
 	float fSensor = 0;
-	if(g_iSensorValue > MIN_INPUT_VALUE)
+	if(g_iSensorValue > g_oTouchTrigger.GetNoiseMargin())
 	{
 		fSensor = g_iSensorValue / 1000.0;
 		if(fSensor > 1.0)
@@ -373,13 +276,21 @@ void loop()
   }
   g_fTouchBrightness = g_fTouchBrightness * g_fTouchSmoothAmount + g_fTargetTouchBrightness * (1.0 - g_fTouchSmoothAmount);
   g_iDimmerBrightness[1] = DEAFULT_BRIGHTNESS_LIGHT_1 + g_fTouchBrightness * (127 - DEAFULT_BRIGHTNESS_LIGHT_1);
+
+  // The dimmer picks these up at the next zero cross
+  for(int i = 0; i < NUM_DIMMERS; ++i) 
+  {
+    g_oDimmer.SetBrightness(i, g_iDimmerBrightness[i]);
+  }
   
 	if(bUseSerialForDebugging)
 	{
 		Serial.print("g_iDimmerBrightness0=");
     Serial.print(g_iDimmerBrightness[0]);
     Serial.print(" g_iDimmerBrightness1=");
-    Serial.println(g_iDimmerBrightness[1]);
+    Serial.print(g_iDimmerBrightness[1]);
+    Serial.print(" mains hz=");
+    Serial.println(g_oDimmer.GetMainsHz());
 	}
 
 	// The output LED is based on fInput not g_iDimmerBrightness
@@ -397,55 +308,4 @@ void loop()
 	  byte ySendByte = g_iSensorValue/4;
 	  Serial.write(ySendByte);
   }
-
-	// Delay a bit before reading again
-	// Oddly if this is too short the analog read seems have more noise near zero.
-	// Both 5 and 10 have worked well in the past
-	delay(5);
 }
-
-
-// This function will fire the triac in the PSSR Tail at the proper time based on g_iDimmerBrightness
-void DimmerCheck()
-{
-	// If we cross zero, reset the counter of how far along we are to the next zero cross.
-  // The counter runs from 0 to 127.
-	if(g_bZeroCross)
-	{
-    g_iDimmerCounter = 0;  
-    g_bZeroCross = false;
-	}
-
-  // Loop through all dimmers
-  for(int i = 0; i < NUM_DIMMERS; ++i) 
-  {
-    // If too much time has passed (g_iDimmerCounter >= 120), don't fire the tail at all. This is because if we fire too late,
-    // it will get stuck on the whole next cycle and cause a flash in brightness.
-    // The brighter the light should be, the sooner we should fire the tail to turn on for the rest of this cycle
-		if( g_iDimmerCounter < 120)
-		{
-		  if (g_iDimmerCounter >= (127-g_iDimmerBrightness[i])) 
-  		{
-  			//These values will fire the PSSR Tail. 
-  			digitalWrite(pssrPins[i], HIGH);
-  		}
-    }
-    else {
-      // Turn the tail off before the next zero cross. Even though we're setting the control pin low,
-      // the tail will stay on till the next zero cross.
-      digitalWrite(pssrPins[i], LOW);
-    }
-  }
-
-  // Increment the counter
-  ++g_iDimmerCounter;
-}
-
-
-void ZeroCrossDetect() 
-{
-	// Set the boolean to true to tell our dimming function that a zero cross has occured.
-  // This will be reset in the dimming function
-	g_bZeroCross = true;
-} 
-
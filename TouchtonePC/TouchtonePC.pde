@@ -112,13 +112,15 @@ class ProcessingNode
 		m_oNodeInput = oNodeInput;
 		m_bDerivative = bDerivative;
 		m_fExponentialSmoothingWeight = fExponentialSmoothingWeight;
-		m_iAvgSmoothingNumSamples = iAvgSmoothingNumSamples;
 		m_fScalingFactor = fScalingFactor;
 
 		m_afPastBuffer = new float[MAX_NUM_SAMPLES];
 		m_iPastBufferIndex = 0;
 
 		m_afAvgBuffer = new float[MAX_NUM_SAMPLES];
+		AdjustSmoothing(fExponentialSmoothingWeight, iAvgSmoothingNumSamples);
+
+		// The first sample has always gone in slot 1
 		m_iBufferIndex = 0;
 	}
 
@@ -135,7 +137,18 @@ class ProcessingNode
 	void AdjustSmoothing(float fExponentialSmoothingWeight, int iAvgSmoothingNumSamples)
 	{
 		m_fExponentialSmoothingWeight = fExponentialSmoothingWeight;
-		m_iAvgSmoothingNumSamples = iAvgSmoothingNumSamples;
+		m_iAvgSmoothingNumSamples = min(iAvgSmoothingNumSamples, MAX_NUM_SAMPLES);
+
+		// Start a new pass through the window with the sum of what's in it
+		if(m_iAvgSmoothingNumSamples > 1)
+		{
+			m_iBufferIndex = m_iAvgSmoothingNumSamples - 1;
+			m_fAvgSum = 0;
+			for(int i = 0; i < m_iAvgSmoothingNumSamples; ++i)
+			{
+				m_fAvgSum += m_afAvgBuffer[i];
+			}
+		}
 	}
 
 	void UpdateFromInput(int iDeltaTimeMS, float fInput)
@@ -165,17 +178,21 @@ class ProcessingNode
 		m_iPastBufferIndex = (m_iPastBufferIndex + 1) % MAX_NUM_SAMPLES;
 		m_afPastBuffer[m_iPastBufferIndex] = m_fExponentialSmoothedInput;
 
-		// Smooth the input using the last n samples (which have already been smoothed with the Exponential smoothing)
+		// Smooth the input using the last n samples (which have already been smoothed with the Exponential smoothing).
+		// This keeps a running sum, see libraries/EASignal/EAProcessingNode.h which has to be kept in step with this.
 		if(m_iAvgSmoothingNumSamples > 1)
 		{
 			m_iBufferIndex = (m_iBufferIndex + 1) % m_iAvgSmoothingNumSamples;
+			m_fAvgSum += m_fExponentialSmoothedInput - m_afAvgBuffer[m_iBufferIndex];
 			m_afAvgBuffer[m_iBufferIndex] = m_fExponentialSmoothedInput;
-			m_fAvgSmoothedInput = 0;
-			for(int i = 0; i < m_iAvgSmoothingNumSamples; ++i)
+
+			// Add up the window fresh as it is written and use that once it is full
+			m_fAvgResyncSum = m_iBufferIndex == 0 ? m_fExponentialSmoothedInput : m_fAvgResyncSum + m_fExponentialSmoothedInput;
+			if(m_iBufferIndex == m_iAvgSmoothingNumSamples - 1)
 			{
-				m_fAvgSmoothedInput += m_afAvgBuffer[i];
+				m_fAvgSum = m_fAvgResyncSum;
 			}
-			m_fAvgSmoothedInput /= m_iAvgSmoothingNumSamples;
+			m_fAvgSmoothedInput = m_fAvgSum / m_iAvgSmoothingNumSamples;
 		}
 		else
 		{
@@ -222,6 +239,8 @@ class ProcessingNode
 	int m_iPastBufferIndex;
 
 	float[] m_afAvgBuffer;
+	float m_fAvgSum;
+	float m_fAvgResyncSum;
 	int m_iBufferIndex;
 	float m_fOutput;
 }
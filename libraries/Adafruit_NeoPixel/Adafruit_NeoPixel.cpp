@@ -33,7 +33,7 @@
 
 #include "Adafruit_NeoPixel.h"
 
-Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t) : numLEDs(n), numBytes(n * 3), pin(p), type(t), pixels(NULL)
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t) : numLEDs(n), numBytes(n * 3), pin(p), type(t), brightness(0), pixels(NULL), wire(NULL), lut(NULL), gamma(NULL), lutDirty(true), transport(NULL), endTime(0)
 #ifdef __AVR__
   ,port(portOutputRegister(digitalPinToPort(p))),
    pinMask(digitalPinToBitMask(p))
@@ -42,6 +42,13 @@ Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t) : numLEDs
   if((pixels = (uint8_t *)malloc(numBytes))) {
     memset(pixels, 0, numBytes);
   }
+  if((type & NEO_RNDMASK) == NEO_RENDER) {
+    // Render-time brightness needs a second buffer for the scaled wire
+    // bytes and a 256 entry table.  If either fails, show() sends the
+    // pixels as is.
+    wire = (uint8_t *)malloc(numBytes);
+    lut  = (uint8_t *)malloc(256);
+  }
 }
 
 #ifdef __MK20DX128__ // Teensy 3.0
@@ -65,6 +72,22 @@ void Adafruit_NeoPixel::show(void) {
 
   if(!pixels) return;
 
+  // Async path: once the last frame and its latch time are done, the
+  // transport encodes the pixels (through the brightness/gamma table in
+  // NEO_RENDER mode) straight into its send buffer.  Interrupts are left
+  // on and the wire buffer isn't used.
+  if(transport) {
+    const uint8_t *map = renderLut();
+    while(transport->busy());
+    transport->write(pixels, numBytes, map);
+    return;
+  }
+
+  // Scale the pixels into the wire buffer before waiting on the latch so
+  // the work overlaps the latch time.  Outside of NEO_RENDER mode (or at
+  // full brightness with no gamma) this is just 'pixels'.
+  uint8_t *src = renderBytes();
+
   // Data latch = 50+ microsecond pause in the output stream.  Rather than
   // put a delay at the end of the function, the ending time is noted and
   // the function will simply hold off (if needed) on issuing the
@@ -93,7 +116,7 @@ void Adafruit_NeoPixel::show(void) {
   volatile uint16_t
     i   = numBytes; // Loop counter
   volatile uint8_t
-   *ptr = pixels,   // Pointer to next byte
+   *ptr = src,      // Pointer to next byte
     b   = *ptr++,   // Current byte value
     hi,             // PORT w/output bit set high
     lo;             // PORT w/output bit set low
@@ -721,7 +744,7 @@ void Adafruit_NeoPixel::show(void) {
   volatile uint8_t *clr = portClearRegister(pin);
   #define SET_HI   *set = 1;
   #define SET_LO   *clr = 1;
-  uint8_t *p   = pixels,
+  uint8_t *p   = src,
           *end = p + numBytes, pix, mask;
 
   if((type & NEO_SPDMASK) == NEO_KHZ800) { // 800 KHz bitstream
@@ -786,7 +809,7 @@ void Adafruit_NeoPixel::show(void) {
   portClear = &(port->PIO_CODR);            // starting timer to minimize
   timeValue = &(TC1->TC_CHANNEL[0].TC_CV);  // the initial 'while'.
   timeReset = &(TC1->TC_CHANNEL[0].TC_CCR);
-  p         =  pixels;
+  p         =  src;
   end       =  p + numBytes;
   pix       = *p++;
   mask      = 0x80;
@@ -819,6 +842,10 @@ void Adafruit_NeoPixel::show(void) {
 
 #endif // end Arduino Due
 
+#else // No bit-bang code for this architecture, only the async path
+
+  (void)src;
+
 #endif // end Architecture select
 
   interrupts();
@@ -829,7 +856,7 @@ void Adafruit_NeoPixel::show(void) {
 void Adafruit_NeoPixel::setPixelColor(
  uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
   if(n < numLEDs) {
-    if(brightness) { // See notes in setBrightness()
+    if(brightness && ((type & NEO_RNDMASK) != NEO_RENDER)) { // See notes in setBrightness()
       r = (r * brightness) >> 8;
       g = (g * brightness) >> 8;
       b = (b * brightness) >> 8;
@@ -848,7 +875,7 @@ void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c) {
       r = (uint8_t)(c >> 16),
       g = (uint8_t)(c >>  8),
       b = (uint8_t)c;
-    if(brightness) { // See notes in setBrightness()
+    if(brightness && ((type & NEO_RNDMASK) != NEO_RENDER)) { // See notes in setBrightness()
       r = (r * brightness) >> 8;
       g = (g * brightness) >> 8;
       b = (b * brightness) >> 8;
@@ -899,6 +926,8 @@ uint16_t Adafruit_NeoPixel::numPixels(void) {
 // the limited number of steps (quantization) in the old data will be
 // quite visible in the re-scaled version.  For a non-destructive
 // change, you'll need to re-render the full strip data.  C'est la vie.
+// Or construct the strip with NEO_RENDER: the pixels are then left alone
+// and the brightness is applied when show() builds the wire bytes.
 void Adafruit_NeoPixel::setBrightness(uint8_t b) {
   // Stored brightness value is different than what's passed.
   // This simplifies the actual scaling math later, allowing a fast
@@ -907,7 +936,13 @@ void Adafruit_NeoPixel::setBrightness(uint8_t b) {
   // (color values are interpreted literally; no scaling), 1 = min
   // brightness (off), 255 = just below max brightness.
   uint8_t newBrightness = b + 1;
-  if(newBrightness != brightness) { // Compare against prior value
+  if(newBrightness == brightness) return; // Same value, nothing to do
+  if((type & NEO_RNDMASK) == NEO_RENDER) {
+    // Pixels are kept at full precision, the new level is applied the
+    // next time show() builds the wire bytes.
+    brightness = newBrightness;
+    lutDirty   = true;
+  } else {
     // Brightness has changed -- re-scale existing data in RAM
     uint8_t  c,
             *ptr           = pixels,
@@ -923,3 +958,73 @@ void Adafruit_NeoPixel::setBrightness(uint8_t b) {
     brightness = newBrightness;
   }
 }
+
+// Return the brightness last passed to setBrightness() (255 if never set).
+uint8_t Adafruit_NeoPixel::getBrightness(void) {
+  return brightness - 1;
+}
+
+// NEO_RENDER only: apply a gamma curve to the wire bytes.  1.0 is linear.
+// This is done once here into a table so show() only does a lookup.
+void Adafruit_NeoPixel::setGamma(float g) {
+  if((type & NEO_RNDMASK) != NEO_RENDER) return;
+  if(g == 1.0) {
+    if(gamma) {
+      free(gamma);
+      gamma    = NULL;
+      lutDirty = true;
+    }
+    return;
+  }
+  if(!gamma && !(gamma = (uint8_t *)malloc(256))) return;
+  for(uint16_t i=0; i<256; i++) {
+    gamma[i] = (uint8_t)(pow((float)i / 255.0, g) * 255.0 + 0.5);
+  }
+  lutDirty = true;
+}
+
+// Rebuild the combined gamma + brightness table.  Only called from show()
+// after setBrightness() or setGamma() actually changed something.
+void Adafruit_NeoPixel::buildLut(void) {
+  uint8_t v;
+  for(uint16_t i=0; i<256; i++) {
+    v = gamma ? gamma[i] : (uint8_t)i;
+    lut[i] = brightness ? (v * brightness) >> 8 : v;
+  }
+  lutDirty = false;
+}
+
+// Return the table show() maps the pixels through: the brightness/gamma
+// table in NEO_RENDER mode, otherwise NULL for the pixels as is.
+uint8_t *Adafruit_NeoPixel::renderLut(void) {
+  if(((type & NEO_RNDMASK) != NEO_RENDER) || !wire || !lut) return NULL;
+  if(!brightness && !gamma) return NULL; // Full brightness, linear
+  if(lutDirty) buildLut();
+  return lut;
+}
+
+// Return the bytes show() should send.  In NEO_RENDER mode this is the
+// pixels run through the brightness/gamma table, otherwise the pixels as is.
+uint8_t *Adafruit_NeoPixel::renderBytes(void) {
+  uint8_t *map = renderLut();
+  if(!map) return pixels;
+  buildWireBytes(wire, pixels, numBytes, map);
+  return wire;
+}
+
+// Map n bytes of src through lut into dst.  Kept free of any hardware
+// access so the encoding can be checked off the chip.
+void Adafruit_NeoPixel::buildWireBytes(uint8_t *dst, const uint8_t *src,
+  uint16_t n, const uint8_t *lut) {
+  const uint8_t *end = src + n;
+  while(src < end) {
+    *dst++ = lut[*src++];
+  }
+}
+
+// Send frames through a transport (see NeoPixelAsync.h) instead of
+// bit-banging them.  show() then returns as soon as the frame is queued.
+// Pass NULL to go back to the normal show().
+void Adafruit_NeoPixel::setTransport(NeoPixelTransport *t) {
+  transport = t;
+}
@@ -26,6 +26,8 @@
  #include <pins_arduino.h>
 #endif
 
+#include "NeoPixelAsync.h"
+
 // 'type' flags for LED pixels (third parameter to constructor):
 #define NEO_RGB     0x00 // Wired for RGB data order
 #define NEO_GRB     0x01 // Wired for GRB data order
@@ -33,6 +35,9 @@
 #define NEO_KHZ400  0x00 // 400 KHz datastream
 #define NEO_KHZ800  0x02 // 800 KHz datastream
 #define NEO_SPDMASK 0x02
+#define NEO_RENDER  0x04 // Keep full-precision pixels, apply brightness
+                         // and gamma only when show() builds the wire bytes
+#define NEO_RNDMASK 0x04
 
 class Adafruit_NeoPixel {
 
@@ -46,16 +51,29 @@ class Adafruit_NeoPixel {
     show(void),
     setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b),
     setPixelColor(uint16_t n, uint32_t c),
-    setBrightness(uint8_t);
+    setBrightness(uint8_t),
+    setGamma(float g),
+    setTransport(NeoPixelTransport *t);
+  uint8_t
+    getBrightness(void);
   uint16_t
     numPixels(void);
   static uint32_t
     Color(uint8_t r, uint8_t g, uint8_t b);
   uint32_t
     getPixelColor(uint16_t n);
+  static void
+    buildWireBytes(uint8_t *dst, const uint8_t *src, uint16_t n,
+      const uint8_t *lut);
 
  private:
 
+  uint8_t
+   *renderLut(void),
+   *renderBytes(void);
+  void
+    buildLut(void);
+
   const uint16_t
     numLEDs,       // Number of RGB LEDs in strip
     numBytes;      // Size of 'pixels' buffer below
@@ -64,7 +82,14 @@ class Adafruit_NeoPixel {
     type;          // Pixel flags (400 vs 800 KHz, RGB vs GRB color)
   uint8_t
     brightness,
-   *pixels;        // Holds LED color values (3 bytes each)
+   *pixels,        // Holds LED color values (3 bytes each)
+   *wire,          // NEO_RENDER only: scaled copy of pixels sent by show()
+   *lut,           // NEO_RENDER only: combined brightness + gamma table
+   *gamma;         // NEO_RENDER only: gamma table, NULL for linear
+  boolean
+    lutDirty;      // NEO_RENDER only: brightness or gamma changed
+  NeoPixelTransport
+   *transport;     // Async show() only: encodes and streams the frames
   uint32_t
     endTime;       // Latch timing reference
 #ifdef __AVR__
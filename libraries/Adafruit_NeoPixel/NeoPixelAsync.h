@@ -0,0 +1,202 @@
+/*--------------------------------------------------------------------
+  Asynchronous show() support for Adafruit_NeoPixel.
+
+  The normal show() disables interrupts and bit-bangs the whole strip,
+  which blocks every other interrupt (like the motion sensor pulse
+  interrupt) for roughly 30 microseconds per pixel.  With a transport set
+  (Adafruit_NeoPixel::setTransport()) show() instead hands the pixel
+  buffer to the transport, which encodes it straight into the serial TX
+  memory and streams it out in the background.  show() returns as soon as
+  the frame is queued, so the next frame can be rendered while the last
+  one is still going out.  The only frame-sized buffers are the pixels
+  and the serial TX memory.
+
+  The encoding is the same one WS2812Serial uses: a UART running at
+  4 Mbaud with an inverted TX pin, where each UART frame (start bit, 8 data
+  bits, stop bit) makes two WS2812 bits of 1.25 microseconds each.  Every
+  pixel byte becomes 4 UART bytes.
+
+  Nothing in here touches hardware except NeoPixelSerialTransport, so the
+  encoder and show() can be built on a PC with NeoPixelMockTransport.
+  --------------------------------------------------------------------*/
+
+#ifndef NEOPIXEL_ASYNC_H
+#define NEOPIXEL_ASYNC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// UART bytes sent for every pixel byte
+#define NEO_UART_BYTES_PER_BYTE 4
+
+// Something that can stream a frame out in the background
+class NeoPixelTransport {
+
+ public:
+
+  virtual ~NeoPixelTransport() {}
+
+  // True while the last frame (and its latch time) is still going out
+  virtual bool busy(void) = 0;
+
+  // Encode numBytes pixel bytes, through lut if it isn't NULL, and start
+  // sending them.  Only called once busy() is false.  Must return without
+  // waiting for the frame to go out, and must not keep the pixels: they
+  // can change as soon as this returns.
+  virtual void write(const uint8_t *pixels, uint16_t numBytes,
+    const uint8_t *lut) = 0;
+};
+
+// Encode n pixel bytes into n * NEO_UART_BYTES_PER_BYTE UART bytes, first
+// mapping each one through lut if it isn't NULL.  Each UART byte carries
+// two pixel bits, most significant first.  With the TX line inverted the
+// start bit is the high part of the first bit and data bit 4 is the high
+// part of the second, so a 0 bit is 1 UART bit high and 4 low while a 1
+// bit is 4 high and 1 low.
+static inline void neoPixelUartEncode(uint8_t *dst, const uint8_t *src,
+  uint16_t n, const uint8_t *lut=NULL) {
+  const uint8_t *end = src + n;
+  uint8_t pix, x;
+  while(src < end) {
+    pix = lut ? lut[*src] : *src;
+    src++;
+    for(uint8_t i=0; i<NEO_UART_BYTES_PER_BYTE; i++) {
+      x = 0x08;
+      if(!(pix & 0x80)) x |= 0x07;
+      if(!(pix & 0x40)) x |= 0xE0;
+      pix <<= 2;
+      *dst++ = x;
+    }
+  }
+}
+
+#if defined(ARDUINO) && defined(__arm__) && defined(SERIAL_8N1_TXINV)
+
+// Pixel bytes encoded on the stack at a time on their way into the serial
+// TX memory
+#define NEO_UART_CHUNK_BYTES 16
+
+// Time the line has to stay low after the last byte for the strip to
+// latch, plus the bytes that can still be in the UART FIFO and shift
+// register (8 + 1 at 2.5 microseconds each) once the TX buffer is empty
+#define NEO_UART_LATCH_MICROS (300 + 25)
+
+// Teensy UART transport.  The serial TX buffer is grown (addMemoryForWrite)
+// to hold a whole encoded frame, and write() encodes the pixels into it a
+// few bytes at a time, so the frame is only ever copied once on its way
+// out; the UART interrupt sends the bytes.  txMem must be at least as big
+// as an encoded frame (numPixels * 3 * NEO_UART_BYTES_PER_BYTE).
+//
+// SerialPort is the port's own class, since on Teensy 3 Serial2 and
+// Serial3 are HardwareSerial2 and HardwareSerial3 and not every call they
+// need is virtual in HardwareSerial:
+//
+//   NeoPixelSerialTransport<HardwareSerial2> transport(Serial2, txMem, sizeof(txMem));
+template<class SerialPort>
+class NeoPixelSerialTransport : public NeoPixelTransport {
+
+ public:
+
+  NeoPixelSerialTransport(SerialPort &s, uint8_t *txMem, size_t txSize) :
+    serial(s), mem(txMem), memSize(txSize), emptyFree(0), drained(true),
+    drainTime(0) {}
+
+  void begin(void) {
+    serial.begin(4000000, SERIAL_8N1_TXINV);
+    serial.addMemoryForWrite(mem, memSize);
+    emptyFree = serial.availableForWrite();
+  }
+
+  // Busy while the serial TX buffer still holds bytes, then for the latch
+  // time after it is first seen empty.  The buffer is the real state; only
+  // the last few bytes in the UART FIFO are allowed for by time.
+  bool busy(void) {
+    if(serial.availableForWrite() < emptyFree) {
+      drained = false;
+      return true;
+    }
+    if(!drained) {
+      drained   = true;
+      drainTime = micros();
+    }
+    return (micros() - drainTime) < NEO_UART_LATCH_MICROS;
+  }
+
+  void write(const uint8_t *pixels, uint16_t numBytes, const uint8_t *lut) {
+    uint8_t chunk[NEO_UART_CHUNK_BYTES * NEO_UART_BYTES_PER_BYTE];
+    uint16_t n;
+    while(numBytes) {
+      n = numBytes < NEO_UART_CHUNK_BYTES ? numBytes : NEO_UART_CHUNK_BYTES;
+      neoPixelUartEncode(chunk, pixels, n, lut);
+      serial.write(chunk, n * NEO_UART_BYTES_PER_BYTE);
+      pixels   += n;
+      numBytes -= n;
+    }
+    drained = false;
+  }
+
+ private:
+
+  SerialPort
+    &serial;
+  uint8_t
+   *mem;
+  size_t
+    memSize;
+  int
+    emptyFree;     // availableForWrite() with nothing queued
+  bool
+    drained;       // TX buffer seen empty since the last write()
+  uint32_t
+    drainTime;     // When it was
+};
+
+#endif // Teensy UART
+
+// PC stand-in that keeps the encoded bytes that would have been sent.
+// busyPolls is how many times busy() reports true after each write().
+class NeoPixelMockTransport : public NeoPixelTransport {
+
+ public:
+
+  NeoPixelMockTransport(uint16_t busyPollsPerWrite=0) :
+    lastBuf(NULL), lastLen(0), writes(0), busyCalls(0), busyWrites(0),
+    busyPolls(0), busyPollsPerWrite(busyPollsPerWrite) {}
+
+  ~NeoPixelMockTransport() {
+    free(lastBuf);
+  }
+
+  bool busy(void) {
+    busyCalls++;
+    if(busyPolls) {
+      busyPolls--;
+      return true;
+    }
+    return false;
+  }
+
+  void write(const uint8_t *pixels, uint16_t numBytes, const uint8_t *lut) {
+    if(busyPolls) busyWrites++;
+    lastLen = numBytes * NEO_UART_BYTES_PER_BYTE;
+    lastBuf = (uint8_t *)realloc(lastBuf, lastLen);
+    neoPixelUartEncode(lastBuf, pixels, numBytes, lut);
+    busyPolls = busyPollsPerWrite;
+    writes++;
+  }
+
+  uint8_t
+   *lastBuf;       // Encoded bytes of the last frame
+  uint16_t
+    lastLen;
+  uint32_t
+    writes,
+    busyCalls,
+    busyWrites;    // write() called while still busy, which is a bug
+  uint16_t
+    busyPolls,
+    busyPollsPerWrite;
+};
+
+#endif // NEOPIXEL_ASYNC_H
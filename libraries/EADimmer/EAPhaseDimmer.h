@@ -0,0 +1,381 @@
+/**
+ * File: EAPhaseDimmer.h
+ *
+ * Description: Phase control dimming of AC lights through PowerSSR Tails,
+ * for TouchtoneArduino and SkinConductance.  At each zero cross the
+ * brightnesses are turned into a PhaseSchedule (EAPhaseSchedule.h) and a
+ * timer compare is set for each different firing time, so the cost is a few
+ * interrupts a half cycle instead of the old 66 microsecond polling
+ * interrupt, and adding dimmers doesn't add interrupts:
+ *
+ *   PhaseDimmer g_oDimmer;
+ *
+ *   static const uint8_t ayPins[] = {4, 5};
+ *   g_oDimmer.Begin(ayPins, 2, ZERO_CROSS_PIN, ZERO_CROSS_INTERRUPT);
+ *
+ *   g_oDimmer.SetBrightness(0, 64);       // 0 (off) to 127 (full)
+ *
+ * The zero cross interrupt also measures the mains (MainsPeriod), so 50 and
+ * 60 Hz both work without any changes.  The backend is picked from the
+ * board:
+ *
+ *   AVR with Timer2              Timer2 compare A times the events in steps
+ *                                of 1024 clocks (64us at 16MHz, the same
+ *                                as the old 66us counter), and the gates
+ *                                are set with direct port writes.  Takes
+ *                                over Timer2, so no PWM on the pins it
+ *                                drives (3 and 11 on an Uno) and no tone().
+ *                                Timer1 is left free.
+ *
+ *   Teensy 3.x                   An IntervalTimer runs whatever events are
+ *                                due by micros() every DIMMER_POLL_MICRO,
+ *                                and the gates are set through each pin's
+ *                                set and clear registers.  These are bit
+ *                                band aliases on the Teensy 3, one per pin,
+ *                                so it is one store a channel rather than
+ *                                one a port, but without digitalWrite().
+ *
+ *   USE_PHASE_DIMMER_POLLED      The same as the Teensy, but the sketch has
+ *                                to call Poll() every 50us or so itself,
+ *                                from a timer interrupt, and the gates are
+ *                                set with digitalWrite().  Any other board
+ *                                has to ask for this, it is an error to
+ *                                build for one without it, since nothing
+ *                                would ever fire.
+ *
+ * Up to DIMMER_MAX_CHANNELS channels on up to DIMMER_MAX_PORTS ports.  Only
+ * one PhaseDimmer can run at a time.
+ *
+ * This holds interrupt handlers so only include it from the sketch.
+ */
+
+#ifndef EA_PHASE_DIMMER_H
+#define EA_PHASE_DIMMER_H
+
+#include <Arduino.h>
+#include "EAPhaseSchedule.h"
+
+#if !defined(USE_PHASE_DIMMER_POLLED) && !(defined(__AVR__) && defined(TCCR2A))
+ #if defined(KINETISK)
+  #define USE_PHASE_DIMMER_POLLED
+  #define USE_PHASE_DIMMER_INTERVAL_TIMER
+ #else
+  #error "EAPhaseDimmer.h has no timer for this board.  Define USE_PHASE_DIMMER_POLLED and call PhaseDimmer::Poll() every 50us or so."
+ #endif
+#endif
+
+#if !defined(USE_PHASE_DIMMER_POLLED)
+ #include <avr/io.h>
+ #include <avr/interrupt.h>
+#endif
+
+#ifndef DIMMER_MAX_CHANNELS
+ #define DIMMER_MAX_CHANNELS 8
+#endif
+#define DIMMER_MAX_PORTS 4
+
+// How often the IntervalTimer runs the events, the firing time resolution
+#ifndef DIMMER_POLL_MICRO
+ #define DIMMER_POLL_MICRO 50
+#endif
+
+static_assert(DIMMER_MAX_CHANNELS <= 8 * DIMMER_MAX_PORTS, "DIMMER_MAX_CHANNELS needs more ports");
+
+// Shared with the interrupts
+static PhaseSchedule<DIMMER_MAX_CHANNELS, DIMMER_MAX_PORTS> g_oDimmerSchedule;
+static MainsPeriod g_oDimmerMains;
+static volatile uint8_t g_ayDimmerBrightness[DIMMER_MAX_CHANNELS];
+static int g_iDimmerNextEvent = 0;
+static uint32_t g_iDimmerLastZeroCrossMicro = 0;
+
+#if !defined(USE_PHASE_DIMMER_POLLED)
+
+// The port output registers the channels are on
+static volatile uint8_t *g_apDimmerPorts[DIMMER_MAX_PORTS];
+
+// Timer2 ticks from a half cycle in microseconds
+static inline uint16_t DimmerTicks(uint16_t iMicro)
+{
+	return ((uint32_t)iMicro * (F_CPU / 1000000L)) >> 10;
+}
+
+static inline uint16_t DimmerNow()
+{
+	return TCNT2;
+}
+
+// False if the time went by before the compare was set
+static inline bool DimmerWaitUntil(uint16_t iTime)
+{
+	OCR2A = iTime;
+	TIFR2 = _BV(OCF2A);
+	TIMSK2 |= _BV(OCIE2A);
+	return TCNT2 < iTime;
+}
+
+static inline void DimmerStop()
+{
+	TIMSK2 &= ~_BV(OCIE2A);
+}
+
+static inline void DimmerSetGates(const uint8_t ayMask[])
+{
+	for(int p = 0; p < g_oDimmerSchedule.GetNumPorts(); ++p)
+	{
+		*g_apDimmerPorts[p] |= ayMask[p];
+	}
+}
+
+static inline void DimmerClearGates()
+{
+	const uint8_t *ayAllMask = g_oDimmerSchedule.GetAllMask();
+	for(int p = 0; p < g_oDimmerSchedule.GetNumPorts(); ++p)
+	{
+		*g_apDimmerPorts[p] &= ~ayAllMask[p];
+	}
+}
+
+#else
+
+// Channel i is bit i % 8 of port i / 8
+static uint8_t g_yDimmerNumChannels = 0;
+
+ #if defined(USE_PHASE_DIMMER_INTERVAL_TIMER)
+static IntervalTimer g_oDimmerPollTimer;
+static volatile uint8_t *g_apDimmerSet[DIMMER_MAX_CHANNELS];
+static volatile uint8_t *g_apDimmerClear[DIMMER_MAX_CHANNELS];
+ #else
+static uint8_t g_ayDimmerPins[DIMMER_MAX_CHANNELS];
+ #endif
+
+static inline uint16_t DimmerTicks(uint16_t iMicro)
+{
+	return iMicro;
+}
+
+static inline uint16_t DimmerNow()
+{
+	return (uint16_t)(micros() - g_iDimmerLastZeroCrossMicro);
+}
+
+static inline bool DimmerWaitUntil(uint16_t iTime)
+{
+	return true;
+}
+
+static inline void DimmerStop()
+{
+}
+
+static void DimmerWriteGates(const uint8_t ayMask[], int iValue)
+{
+	for(int i = 0; i < g_yDimmerNumChannels; ++i)
+	{
+		if(ayMask[i / 8] & (1 << (i % 8)))
+		{
+ #if defined(USE_PHASE_DIMMER_INTERVAL_TIMER)
+			*(iValue == HIGH ? g_apDimmerSet[i] : g_apDimmerClear[i]) = 1;
+ #else
+			digitalWrite(g_ayDimmerPins[i], iValue);
+ #endif
+		}
+	}
+}
+
+static inline void DimmerSetGates(const uint8_t ayMask[])
+{
+	DimmerWriteGates(ayMask, HIGH);
+}
+
+static inline void DimmerClearGates()
+{
+	DimmerWriteGates(g_oDimmerSchedule.GetAllMask(), LOW);
+}
+
+#endif
+
+// Run every event that is due and wait for the next one.  Being called
+// early does no harm.
+static void DimmerRunEvents()
+{
+	int iNumEvents = g_oDimmerSchedule.GetNumEvents();
+	while(g_iDimmerNextEvent <= iNumEvents)
+	{
+		// The last event is the cut off
+		uint16_t iTime = g_iDimmerNextEvent < iNumEvents ?
+			g_oDimmerSchedule.GetEvent(g_iDimmerNextEvent).m_iTime :
+			g_oDimmerSchedule.GetOffTime();
+		if(DimmerNow() < iTime && DimmerWaitUntil(iTime))
+		{
+			return;
+		}
+
+		if(g_iDimmerNextEvent < iNumEvents)
+		{
+			DimmerSetGates(g_oDimmerSchedule.GetEvent(g_iDimmerNextEvent).m_ayMask);
+		}
+		else
+		{
+			DimmerClearGates();
+		}
+		++g_iDimmerNextEvent;
+	}
+	DimmerStop();
+}
+
+static void DimmerZeroCross()
+{
+	uint32_t iNowMicro = micros();
+	uint32_t iIntervalMicro = iNowMicro - g_iDimmerLastZeroCrossMicro;
+
+	// Much too soon is noise on the zero cross line, not a zero cross
+	if(iIntervalMicro < MAINS_MIN_HALF_MICRO / 2)
+	{
+		return;
+	}
+	g_iDimmerLastZeroCrossMicro = iNowMicro;
+	g_oDimmerMains.Update(iIntervalMicro);
+
+#if !defined(USE_PHASE_DIMMER_POLLED)
+	// Start the count from the zero cross, prescaler too where it can be
+	TCNT2 = 0;
+ #if defined(PSRASY)
+	GTCCR = _BV(PSRASY);
+ #endif
+#endif
+	DimmerClearGates();
+	g_oDimmerSchedule.Build(g_ayDimmerBrightness, DimmerTicks(g_oDimmerMains.GetHalfPeriodMicro()));
+	g_iDimmerNextEvent = 0;
+	DimmerRunEvents();
+}
+
+#if !defined(USE_PHASE_DIMMER_POLLED)
+
+ISR(TIMER2_COMPA_vect)
+{
+	DimmerRunEvents();
+}
+
+#endif
+
+
+
+class PhaseDimmer
+{
+public:
+
+	// ayPins are the gates, one a channel, all starting off.  iZeroCrossPin
+	// is the zero cross input and iZeroCrossInterrupt its interrupt, the
+	// number attachInterrupt() takes.  That isn't the pin number on most AVR
+	// boards (pin 2 is interrupt 0 on an Uno), so it is given as is rather
+	// than worked out from the pin.
+	void Begin(const uint8_t ayPins[], int iNumChannels, int iZeroCrossPin, int iZeroCrossInterrupt)
+	{
+		if(iNumChannels > DIMMER_MAX_CHANNELS)
+		{
+			iNumChannels = DIMMER_MAX_CHANNELS;
+		}
+
+#if !defined(USE_PHASE_DIMMER_POLLED)
+		int iNumPorts = 0;
+#endif
+		for(int i = 0; i < iNumChannels; ++i)
+		{
+			pinMode(ayPins[i], OUTPUT);
+			digitalWrite(ayPins[i], LOW);
+			g_ayDimmerBrightness[i] = 0;
+
+#if !defined(USE_PHASE_DIMMER_POLLED)
+			volatile uint8_t *pPort = portOutputRegister(digitalPinToPort(ayPins[i]));
+			int iPort = 0;
+			while(iPort < iNumPorts && g_apDimmerPorts[iPort] != pPort)
+			{
+				++iPort;
+			}
+			if(iPort == DIMMER_MAX_PORTS)
+			{
+				// Out of ports, this channel never fires
+				g_oDimmerSchedule.SetChannel(i, 0, 0);
+				continue;
+			}
+			if(iPort == iNumPorts)
+			{
+				g_apDimmerPorts[iNumPorts++] = pPort;
+			}
+			g_oDimmerSchedule.SetChannel(i, iPort, digitalPinToBitMask(ayPins[i]));
+#else
+ #if defined(USE_PHASE_DIMMER_INTERVAL_TIMER)
+			g_apDimmerSet[i] = portSetRegister(ayPins[i]);
+			g_apDimmerClear[i] = portClearRegister(ayPins[i]);
+ #else
+			g_ayDimmerPins[i] = ayPins[i];
+ #endif
+			g_oDimmerSchedule.SetChannel(i, i / 8, 1 << (i % 8));
+#endif
+		}
+
+#if !defined(USE_PHASE_DIMMER_POLLED)
+		// Normal mode, clk/1024
+		uint8_t ySREG = SREG;
+		cli();
+		TIMSK2 = 0;
+		TCCR2A = 0;
+		TCCR2B = _BV(CS22) | _BV(CS21) | _BV(CS20);
+		TCNT2 = 0;
+		SREG = ySREG;
+#else
+		g_yDimmerNumChannels = iNumChannels;
+ #if defined(USE_PHASE_DIMMER_INTERVAL_TIMER)
+		g_oDimmerPollTimer.begin(DimmerRunEvents, DIMMER_POLL_MICRO);
+ #endif
+#endif
+
+		pinMode(iZeroCrossPin, INPUT);
+		attachInterrupt(iZeroCrossInterrupt, DimmerZeroCross, RISING);
+	}
+
+	// 0 (off) to DIMMER_MAX_BRIGHTNESS (full).  Used from the next zero cross.
+	void SetBrightness(int iChannel, int iBrightness)
+	{
+		if(iBrightness < 0)
+		{
+			iBrightness = 0;
+		}
+		else if(iBrightness > DIMMER_MAX_BRIGHTNESS)
+		{
+			iBrightness = DIMMER_MAX_BRIGHTNESS;
+		}
+		g_ayDimmerBrightness[iChannel] = iBrightness;
+	}
+
+	int GetBrightness(int iChannel) const
+	{
+		return g_ayDimmerBrightness[iChannel];
+	}
+
+	// Measured mains frequency (60 until the first good measurement)
+	float GetMainsHz() const
+	{
+		noInterrupts();
+		MainsPeriod oMains = g_oDimmerMains;
+		interrupts();
+		return oMains.GetMainsHz();
+	}
+
+	bool IsMainsMeasured() const
+	{
+		return g_oDimmerMains.IsMeasured();
+	}
+
+#if defined(USE_PHASE_DIMMER_POLLED) && !defined(USE_PHASE_DIMMER_INTERVAL_TIMER)
+	// Call every 50us or so
+	void Poll()
+	{
+		noInterrupts();
+		DimmerRunEvents();
+		interrupts();
+	}
+#endif
+};
+
+#endif // EA_PHASE_DIMMER_H
@@ -0,0 +1,251 @@
+/**
+ * File: EAPhaseSchedule.h
+ *
+ * Description: The timing for phase control dimming of AC lights through
+ * PowerSSR Tails (see EAPhaseDimmer.h).  TouchtoneArduino and
+ * SkinConductance used to run a timer interrupt every 66 microseconds
+ * (1/128th of a 60 Hz half cycle) that counted up from the last zero cross
+ * and checked every dimmer against the count with digitalWrite().  That is
+ * about 15,000 interrupts a second whatever the lights are doing, it costs
+ * more with every dimmer, and it is only right at 60 Hz.
+ *
+ * Brightness is still 0 (off) to 127 (full) and a dimmer still fires
+ * (127 - brightness) 128ths of a half cycle after the zero cross, with the
+ * same cut off: nothing fires after DIMMER_CUTOFF 128ths, since a tail fired
+ * that late stays on through the whole next half cycle and flashes.  At the
+ * cut off all of the gates go low again (the tails stay on until the next
+ * zero cross anyway).  But now the half cycle is measured, and at each zero
+ * cross PhaseSchedule turns the brightnesses into a short list of events:
+ *
+ *   PhaseSchedule<8, 2> oSchedule;
+ *   oSchedule.SetChannel(0, 0, 0x10);         // Channel 0 is bit 4 of port 0
+ *   ...
+ *   oSchedule.Build(ayBrightness, iHalfPeriod);
+ *   for each event: at GetEvent(i).m_iTime set the GetEvent(i).m_ayMask bits
+ *   at GetOffTime() clear the GetAllMask() bits
+ *
+ * The channels are sorted by brightness (brightest fires first) and the ones
+ * that fire at the same time share an event, so there is one timer compare
+ * for each different firing time plus one for the cut off, however many
+ * channels there are.  Each event has the bits to set for every port, so
+ * firing is a single write a port.  Times are in whatever units the half
+ * period is given in.
+ *
+ * MainsPeriod measures the half cycle from the times between zero crosses
+ * and works for 50 and 60 Hz mains.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_PHASE_SCHEDULE_H
+#define EA_PHASE_SCHEDULE_H
+
+#include <stdint.h>
+
+// Brightness goes from 0 (off) to DIMMER_MAX_BRIGHTNESS
+#define DIMMER_MAX_BRIGHTNESS 127
+
+// Nothing fires this many 128ths or more into the half cycle and the gates
+// go low here
+#define DIMMER_CUTOFF 120
+
+// Half cycles between these (65 Hz and 45 Hz mains) are believed
+#define MAINS_MIN_HALF_MICRO 7692
+#define MAINS_MAX_HALF_MICRO 11111
+
+// Until there is a measurement
+#define MAINS_DEFAULT_HALF_MICRO 8333
+
+
+
+// Half cycle length from the times between zero crosses.  Times outside of
+// what 45 to 65 Hz mains could give (a missed or doubled zero cross) are
+// left out.  The first good one is taken as is, later ones are averaged in
+// with a weight of 1/16.
+class MainsPeriod
+{
+public:
+
+	MainsPeriod() :
+		m_iHalfMicro16((uint32_t)MAINS_DEFAULT_HALF_MICRO << 4),
+		m_bMeasured(false)
+	{
+	}
+
+	// False if the time was thrown out
+	bool Update(uint32_t iIntervalMicro)
+	{
+		if(iIntervalMicro < MAINS_MIN_HALF_MICRO || iIntervalMicro > MAINS_MAX_HALF_MICRO)
+		{
+			return false;
+		}
+		if(!m_bMeasured)
+		{
+			m_iHalfMicro16 = iIntervalMicro << 4;
+			m_bMeasured = true;
+		}
+		else
+		{
+			m_iHalfMicro16 += iIntervalMicro - (m_iHalfMicro16 >> 4);
+		}
+		return true;
+	}
+
+	uint16_t GetHalfPeriodMicro() const
+	{
+		return (uint16_t)((m_iHalfMicro16 + 8) >> 4);
+	}
+
+	float GetMainsHz() const
+	{
+		return 8000000.0f / m_iHalfMicro16;
+	}
+
+	// False until the first good zero cross to zero cross time
+	bool IsMeasured() const
+	{
+		return m_bMeasured;
+	}
+
+private:
+
+	uint32_t m_iHalfMicro16; // In 1/16ths of a microsecond
+	bool m_bMeasured;
+};
+
+
+
+template<int MAX_CHANNELS, int MAX_PORTS>
+class PhaseSchedule
+{
+public:
+
+	struct Event
+	{
+		uint16_t m_iTime;
+		uint8_t m_ayMask[MAX_PORTS];
+	};
+
+	PhaseSchedule() :
+		m_iNumChannels(0),
+		m_iNumPorts(0),
+		m_iNumEvents(0),
+		m_iOffTime(0)
+	{
+		for(int i = 0; i < MAX_PORTS; ++i)
+		{
+			m_ayAllMask[i] = 0;
+		}
+	}
+
+	// Channel i is yBit on port index yPort.  Channels have to be set in order
+	// from 0.
+	void SetChannel(int i, uint8_t yPort, uint8_t yBit)
+	{
+		m_ayPort[i] = yPort;
+		m_ayBit[i] = yBit;
+		m_ayAllMask[yPort] |= yBit;
+		if(i >= m_iNumChannels)
+		{
+			m_iNumChannels = i + 1;
+		}
+		if(yPort >= m_iNumPorts)
+		{
+			m_iNumPorts = yPort + 1;
+		}
+	}
+
+	// Make the events for the half cycle starting now.  ayBrightness has one
+	// brightness (0 to DIMMER_MAX_BRIGHTNESS) for each channel.
+	void Build(const volatile uint8_t ayBrightness[], uint16_t iHalfPeriod)
+	{
+		// Insertion sort, brightest first.  There are only a few channels and
+		// they are mostly in order from the last half cycle.
+		uint8_t ayOrder[MAX_CHANNELS];
+		uint8_t ayLevel[MAX_CHANNELS];
+		for(int i = 0; i < m_iNumChannels; ++i)
+		{
+			uint8_t yLevel = ayBrightness[i];
+			if(yLevel > DIMMER_MAX_BRIGHTNESS)
+			{
+				yLevel = DIMMER_MAX_BRIGHTNESS;
+			}
+			int j = i;
+			while(j > 0 && ayLevel[j-1] < yLevel)
+			{
+				ayLevel[j] = ayLevel[j-1];
+				ayOrder[j] = ayOrder[j-1];
+				--j;
+			}
+			ayLevel[j] = yLevel;
+			ayOrder[j] = i;
+		}
+
+		m_iNumEvents = 0;
+		for(int i = 0; i < m_iNumChannels; ++i)
+		{
+			uint8_t yStep = DIMMER_MAX_BRIGHTNESS - ayLevel[i];
+			if(yStep >= DIMMER_CUTOFF)
+			{
+				break; // The rest are dimmer still
+			}
+
+			uint16_t iTime = ((uint32_t)yStep * iHalfPeriod) >> 7;
+			if(m_iNumEvents == 0 || m_aoEvents[m_iNumEvents-1].m_iTime != iTime)
+			{
+				Event &oEvent = m_aoEvents[m_iNumEvents++];
+				oEvent.m_iTime = iTime;
+				for(int p = 0; p < m_iNumPorts; ++p)
+				{
+					oEvent.m_ayMask[p] = 0;
+				}
+			}
+			uint8_t yChannel = ayOrder[i];
+			m_aoEvents[m_iNumEvents-1].m_ayMask[m_ayPort[yChannel]] |= m_ayBit[yChannel];
+		}
+
+		m_iOffTime = ((uint32_t)DIMMER_CUTOFF * iHalfPeriod) >> 7;
+	}
+
+	int GetNumEvents() const
+	{
+		return m_iNumEvents;
+	}
+
+	// Events are in time order, no two at the same time
+	const Event &GetEvent(int i) const
+	{
+		return m_aoEvents[i];
+	}
+
+	// When all the gates go low
+	uint16_t GetOffTime() const
+	{
+		return m_iOffTime;
+	}
+
+	// Every channel's bit for each port
+	const uint8_t *GetAllMask() const
+	{
+		return m_ayAllMask;
+	}
+
+	int GetNumPorts() const
+	{
+		return m_iNumPorts;
+	}
+
+private:
+
+	uint8_t m_ayPort[MAX_CHANNELS];
+	uint8_t m_ayBit[MAX_CHANNELS];
+	uint8_t m_ayAllMask[MAX_PORTS];
+	int m_iNumChannels;
+	int m_iNumPorts;
+
+	Event m_aoEvents[MAX_CHANNELS];
+	int m_iNumEvents;
+	uint16_t m_iOffTime;
+};
+
+#endif // EA_PHASE_SCHEDULE_H
@@ -0,0 +1,166 @@
+/**
+ * File: EAFastLEDStub.h
+ *
+ * Description: Minimal stand-ins for the FastLED 8-bit math, random
+ * functions, CRGB and 256 entry palettes used by the heat code.  This is only used when building on a
+ * PC (no ARDUINO define) so the heat simulation can be compiled and timed
+ * without any hardware.  On the Arduino/Teensy the real FastLED versions
+ * are used instead.
+ *
+ * The math matches FastLED 3.3 (FASTLED_SCALE8_FIXED) so the results on the
+ * PC are the same as on the chip.
+ */
+
+#ifndef EA_FASTLED_STUB_H
+#define EA_FASTLED_STUB_H
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef uint8_t fract8;
+
+// Shared seed, same algorithm and start value as FastLED's rand16seed
+static uint16_t g_iEAStubRand16Seed = 1337;
+
+// Add one byte to another, saturating at 0xFF
+inline uint8_t qadd8(uint8_t i, uint8_t j)
+{
+	unsigned int t = i + j;
+	if(t > 255)
+	{
+		t = 255;
+	}
+	return (uint8_t)t;
+}
+
+// Subtract one byte from another, saturating at 0x00
+inline uint8_t qsub8(uint8_t i, uint8_t j)
+{
+	int t = i - j;
+	if(t < 0)
+	{
+		t = 0;
+	}
+	return (uint8_t)t;
+}
+
+// Scale one byte by a second one, which is treated as the numerator of a fraction whose denominator is 256
+inline uint8_t scale8(uint8_t i, fract8 scale)
+{
+	return (uint8_t)(((uint16_t)i * (1 + (uint16_t)scale)) >> 8);
+}
+
+// Linear interpolation between two unsigned 8-bit values, with 8-bit fraction
+inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 frac)
+{
+	if(b > a)
+	{
+		return a + scale8(b - a, frac);
+	}
+	return a - scale8(a - b, frac);
+}
+
+// Scale one byte by a second one, but never scale a non zero value down to zero
+inline uint8_t scale8_video(uint8_t i, fract8 scale)
+{
+	return (uint8_t)((((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0));
+}
+
+inline uint8_t random8()
+{
+	g_iEAStubRand16Seed = (g_iEAStubRand16Seed * 2053) + 13849;
+	return (uint8_t)((uint8_t)(g_iEAStubRand16Seed & 0xFF) + (uint8_t)(g_iEAStubRand16Seed >> 8));
+}
+
+inline uint8_t random8(uint8_t lim)
+{
+	return (uint8_t)((random8() * lim) >> 8);
+}
+
+inline uint8_t random8(uint8_t min, uint8_t lim)
+{
+	return random8(lim - min) + min;
+}
+
+inline uint16_t random16()
+{
+	g_iEAStubRand16Seed = (g_iEAStubRand16Seed * 2053) + 13849;
+	return g_iEAStubRand16Seed;
+}
+
+inline uint16_t random16(uint16_t lim)
+{
+	return (uint16_t)(((uint32_t)random16() * lim) >> 16);
+}
+
+inline uint16_t random16(uint16_t min, uint16_t lim)
+{
+	return random16(lim - min) + min;
+}
+
+inline void random16_set_seed(uint16_t seed)
+{
+	g_iEAStubRand16Seed = seed;
+}
+
+struct CRGB
+{
+	CRGB() : r(0), g(0), b(0)
+	{
+	}
+
+	CRGB(uint8_t yR, uint8_t yG, uint8_t yB) : r(yR), g(yG), b(yB)
+	{
+	}
+
+	CRGB &operator+=(const CRGB &oOther)
+	{
+		r = qadd8(r, oOther.r);
+		g = qadd8(g, oOther.g);
+		b = qadd8(b, oOther.b);
+		return *this;
+	}
+
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+};
+
+inline CRGB operator+(const CRGB &oA, const CRGB &oB)
+{
+	CRGB oSum = oA;
+	oSum += oB;
+	return oSum;
+}
+
+struct CRGBPalette256
+{
+	const CRGB &operator[](uint8_t yIndex) const
+	{
+		return entries[yIndex];
+	}
+
+	CRGB &operator[](uint8_t yIndex)
+	{
+		return entries[yIndex];
+	}
+
+	CRGB entries[256];
+};
+
+// Same rounding as FastLED's ColorFromPalette() for 256 entry palettes
+inline CRGB ColorFromPalette(const CRGBPalette256 &oPalette, uint8_t yIndex, uint8_t yBrightness = 255)
+{
+	CRGB oColor = oPalette[yIndex];
+	if(yBrightness != 255)
+	{
+		++yBrightness;
+		oColor.r = scale8_video(oColor.r, yBrightness);
+		oColor.g = scale8_video(oColor.g, yBrightness);
+		oColor.b = scale8_video(oColor.b, yBrightness);
+	}
+	return oColor;
+}
+
+#endif // EA_FASTLED_STUB_H
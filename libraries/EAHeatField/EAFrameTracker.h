@@ -0,0 +1,125 @@
+/**
+ * File: EAFrameTracker.h
+ *
+ * Description: Works out whether a frame has to be sent to the LEDs at all.
+ * The sketches call FastLED.show() every loop even when nothing changed
+ * (BarLights with its LEDs turned off, ScienceClouds between heat steps
+ * when the lerp hasn't moved), and with clockless LEDs the interrupts are
+ * off for the whole transfer, about 30 us per LED.
+ *
+ * The tracker keeps a small hash of each block of BLOCK_LEDS LEDs from the
+ * last frame that was sent.  Update() hashes the new frame and returns how
+ * many LEDs from the start of the strip have to be sent to get every
+ * changed block out, or 0 if nothing changed:
+ *
+ *   LedFrameTracker<NUM_LEDS> g_oFrameTracker;
+ *
+ *   if(g_oFrameTracker.Update(g_aLeds, FastLED.getBrightness()) > 0)
+ *   {
+ *       FastLED.show();
+ *   }
+ *
+ * WS2812 style LEDs keep their color until new data reaches them, so with
+ * those only the returned prefix has to go out (FastLED[0].setLeds(g_aLeds,
+ * iNumToSend) before show()).  A change in brightness changes every LED.
+ * The hash is 32 bit FNV-1a.  Each step (xor in a byte, multiply by an odd
+ * number) can be undone, so a single changed byte in a block is always
+ * caught, and any other change is missed about once in 4 billion.  A plain
+ * rotate and xor was used at first but it repeats every 32 bytes, so two
+ * changes 32 bytes apart cancelled out.  Keeping a copy of the last frame
+ * would be exact but costs 3 bytes of RAM an LED.  See
+ * test/host/TestFrameTracker.cpp.
+ *
+ * This is header only and builds on a PC (without the ARDUINO define) using
+ * the FastLED stand-ins in EAFastLEDStub.h.
+ */
+
+#ifndef EA_FRAME_TRACKER_H
+#define EA_FRAME_TRACKER_H
+
+#ifdef ARDUINO
+ #include <FastLED.h>
+#else
+ #include "EAFastLEDStub.h"
+#endif
+
+template<int NUM_LEDS, int BLOCK_LEDS = 16>
+class LedFrameTracker
+{
+public:
+
+	static const int NUM_BLOCKS = (NUM_LEDS + BLOCK_LEDS - 1) / BLOCK_LEDS;
+
+	LedFrameTracker() :
+		m_bHaveFrame(false),
+		m_yBrightness(0),
+		m_iNumSkipped(0)
+	{
+	}
+
+	// Forget the last frame so the next Update() sends everything
+	void Invalidate()
+	{
+		m_bHaveFrame = false;
+	}
+
+	// Number of LEDs from the start that have to be sent to show aoLeds, or
+	// 0 if it is the same as the last frame.  Assumes the frame does get sent.
+	int Update(const CRGB aoLeds[], uint8_t yBrightness)
+	{
+		const uint8_t *pData = (const uint8_t *)aoLeds;
+		int iLastChanged = -1;
+		for(int iBlock = 0; iBlock < NUM_BLOCKS; ++iBlock)
+		{
+			int iStart = iBlock * BLOCK_LEDS * 3;
+			int iEnd = (iBlock + 1) * BLOCK_LEDS * 3;
+			if(iEnd > NUM_LEDS * 3)
+			{
+				iEnd = NUM_LEDS * 3;
+			}
+
+			uint32_t iHash = FNV_OFFSET_BASIS;
+			for(int i = iStart; i < iEnd; ++i)
+			{
+				iHash = (iHash ^ pData[i]) * FNV_PRIME;
+			}
+			if(iHash != m_aiBlockHash[iBlock])
+			{
+				m_aiBlockHash[iBlock] = iHash;
+				iLastChanged = iBlock;
+			}
+		}
+
+		if(!m_bHaveFrame || yBrightness != m_yBrightness)
+		{
+			m_bHaveFrame = true;
+			m_yBrightness = yBrightness;
+			return NUM_LEDS;
+		}
+		if(iLastChanged < 0)
+		{
+			m_iNumSkipped++;
+			return 0;
+		}
+		int iNumToSend = (iLastChanged + 1) * BLOCK_LEDS;
+		return iNumToSend < NUM_LEDS ? iNumToSend : NUM_LEDS;
+	}
+
+	// Frames Update() said didn't need sending
+	unsigned long GetNumSkipped() const
+	{
+		return m_iNumSkipped;
+	}
+
+private:
+
+	static const uint32_t FNV_OFFSET_BASIS = 2166136261UL;
+	static const uint32_t FNV_PRIME = 16777619UL;
+
+	uint32_t m_aiBlockHash[NUM_BLOCKS];
+	bool m_bHaveFrame;
+	uint8_t m_yBrightness;
+	unsigned long m_iNumSkipped;
+};
+
+#endif // EA_FRAME_TRACKER_H
@@ -0,0 +1,133 @@
+/**
+ * File: EAHeatColor.h
+ *
+ * Description: Turns the heat arrays into LED colors.  The sketches used to
+ * do this for every LED every frame:
+ *
+ *   yHeat = lerp8by8(ayLastHeat[j], ayHeat[j], fLerp);
+ *   yHeat = ... scale8, qadd8, ClampI, sometimes a float multiply ...
+ *   aoLeds[j] = ColorFromPalette(oPal, yHeat, yBrightness);
+ *
+ * Everything after the lerp only depends on the heat value and on things
+ * that are the same for the whole frame, so HeatColorMap splits it into two
+ * 256 entry tables:
+ *
+ *   m_ayHeatMap   heat after the lerp -> final palette index.  The sketch
+ *                 fills this in once per frame (256 steps, not one per LED).
+ *   colors        palette index -> CRGB with the brightness applied.  This
+ *                 is only rebuilt when the palette or the brightness changes.
+ *
+ * Render() then does the lerp and the two lookups for each LED and writes
+ * straight into the LED buffer:
+ *
+ *   for(int i = 0; i < 256; ++i)
+ *   {
+ *       g_oHeatColor.m_ayHeatMap[i] = qadd8(scale8(i, MAX_HEAT), ySpeedAdd);
+ *   }
+ *   g_oHeatColor.SetBrightness(yBrightness);
+ *   g_oHeatColor.Render(g_ayLastHeat, g_ayHeat, fLerp, g_aLeds, NUM_LEDS);
+ *
+ * The colors match ColorFromPalette() exactly since that is what builds the
+ * table.  It costs 1 KB of RAM (768 bytes of colors and the heat map).
+ * test/host/BenchHeatColor.cpp times it against the old per LED loop for
+ * the ScienceClouds strip and checks that the colors are the same.
+ *
+ * This is header only and builds on a PC (without the ARDUINO define) using
+ * the FastLED stand-ins in EAFastLEDStub.h.
+ */
+
+#ifndef EA_HEAT_COLOR_H
+#define EA_HEAT_COLOR_H
+
+#ifdef ARDUINO
+ #include <FastLED.h>
+#else
+ #include "EAFastLEDStub.h"
+#endif
+
+class HeatColorMap
+{
+public:
+
+	// oPalette has to stay around.  The heat map starts out as a straight
+	// copy (heat i is palette index i).
+	HeatColorMap(const CRGBPalette256 &oPalette, uint8_t yBrightness = 255) :
+		m_pPalette(&oPalette),
+		m_yBrightness(yBrightness),
+		m_bColorsDirty(true)
+	{
+		for(int i = 0; i < 256; ++i)
+		{
+			m_ayHeatMap[i] = i;
+		}
+	}
+
+	// Use a different palette
+	void SetPalette(const CRGBPalette256 &oPalette)
+	{
+		m_pPalette = &oPalette;
+		m_bColorsDirty = true;
+	}
+
+	// Call after changing the colors in the palette (like after
+	// loadDynamicGradientPalette())
+	void PaletteChanged()
+	{
+		m_bColorsDirty = true;
+	}
+
+	// Same as the brightness passed to ColorFromPalette()
+	void SetBrightness(uint8_t yBrightness)
+	{
+		if(yBrightness != m_yBrightness)
+		{
+			m_yBrightness = yBrightness;
+			m_bColorsDirty = true;
+		}
+	}
+
+	// Color for a palette index
+	const CRGB &GetColor(uint8_t yIndex)
+	{
+		UpdateColors();
+		return m_aoColors[yIndex];
+	}
+
+	// Lerp iNumCells cells from ayLastHeat to ayHeat, map them through
+	// m_ayHeatMap and the colors and write them to every iLedSpacing'th LED
+	void Render(const uint8_t ayLastHeat[], const uint8_t ayHeat[], fract8 fLerp, CRGB aoLeds[], int iNumCells, int iLedSpacing = 1)
+	{
+		UpdateColors();
+		CRGB *pLed = aoLeds;
+		for(int j = 0; j < iNumCells; ++j)
+		{
+			*pLed = m_aoColors[m_ayHeatMap[lerp8by8(ayLastHeat[j], ayHeat[j], fLerp)]];
+			pLed += iLedSpacing;
+		}
+	}
+
+	// Heat after the lerp -> palette index.  Fill this in each frame.
+	uint8_t m_ayHeatMap[256];
+
+private:
+
+	void UpdateColors()
+	{
+		if(!m_bColorsDirty)
+		{
+			return;
+		}
+		for(int i = 0; i < 256; ++i)
+		{
+			m_aoColors[i] = ColorFromPalette(*m_pPalette, i, m_yBrightness);
+		}
+		m_bColorsDirty = false;
+	}
+
+	const CRGBPalette256 *m_pPalette;
+	uint8_t m_yBrightness;
+	bool m_bColorsDirty;
+	CRGB m_aoColors[256];
+};
+
+#endif // EA_HEAT_COLOR_H
@@ -0,0 +1,325 @@
+/**
+ * File: EAHeatField.h
+ *
+ * Description: Shared 1D "heat" simulation used by all the fire style sketches
+ * (FeatherLights, ScienceClouds, BarLights, AmbientEffects, Necklace, CampFire).
+ * Every frame the heat cells are cooled a little, the heat drifts out to the
+ * neighboring cells and new sparks of heat are added.  Each sketch used to
+ * carry its own copy of this loop.  Now they pick a diffusion kernel and a
+ * spark policy and the HeatField template puts them together:
+ *
+ *   HeatField<NUM_LEDS, HeatKernel322, HeatSparksPer10> g_oHeatField(
+ *       COOLING_MIN, COOLING_MAX,
+ *       HeatSparksPer10(SPARKING, SPARK_HEAT_MIN, SPARK_HEAT_MAX, SPARK_WIDTH));
+ *
+ *   g_oHeatField.Update(g_ayHeat);
+ *
+ * The heat array itself stays owned by the sketch so it can still be used
+ * for interpolating and rendering.
+ *
+ * This is header only and builds on a PC (without the ARDUINO define) using
+ * the FastLED stand-ins in EAFastLEDStub.h.  test/host/BenchHeatField.cpp
+ * times each kernel and spark policy pair at 98, 300 and 1000 LEDs.
+ */
+
+#ifndef EA_HEAT_FIELD_H
+#define EA_HEAT_FIELD_H
+
+#ifdef ARDUINO
+ #include <FastLED.h>
+#else
+ #include "EAFastLEDStub.h"
+#endif
+
+
+
+// Diffusion kernels
+//
+// Each kernel spreads the heat out to the neighboring cells.  They all work
+// on the heat array in place, so none of them needs a copy of the last frame.
+
+// No diffusion at all
+struct HeatKernelNone
+{
+	static inline void Apply(byte /*ayHeat*/[], int /*iNumCells*/)
+	{
+	}
+};
+
+// The standard 3-2-2 kernel used by most of the sketches.  This runs in place
+// so each cell sees the already updated cell to the left of it.
+struct HeatKernel322
+{
+	static inline void Apply(byte ayHeat[], int iNumCells)
+	{
+		for(int i = 1; i < iNumCells - 1; i++)
+		{
+			ayHeat[i] = (ayHeat[i]*3 + ayHeat[i-1]*2 + ayHeat[i+1]*2) / 7;
+		}
+	}
+};
+
+// The 1-2-4-2-1 kernel from Fire2012 (CampFire)
+struct HeatKernelFire2012
+{
+	static inline void Apply(byte ayHeat[], int iNumCells)
+	{
+		for(int k = 2; k < iNumCells - 2; k++)
+		{
+			ayHeat[k] = (ayHeat[k - 2] + ayHeat[k - 1]*2 + ayHeat[k]*4 + ayHeat[k + 1]*2 + ayHeat[k + 2]) / 10;
+		}
+	}
+};
+
+// Lopsided 5 wide blur from FeatherLights mode 1.  It reads the last frame on
+// both sides of each cell, but only the two cells to the left have been
+// written over by the time they are read, so their old values are carried
+// along in two locals instead of copying the whole frame.
+struct HeatKernelBlur5
+{
+	static inline void Apply(byte ayHeat[], int iNumCells)
+	{
+		static const fract8 yBlurScale[] = {7, 30, 60, 100, 30};
+
+		if(iNumCells < 5)
+		{
+			return;
+		}
+		byte yLast2 = ayHeat[0];
+		byte yLast1 = ayHeat[1];
+		for(int i = 2; i < iNumCells - 2; i++)
+		{
+			byte yLast0 = ayHeat[i];
+			ayHeat[i] =
+				scale8(yLast2,      yBlurScale[0]) +
+				scale8(yLast1,      yBlurScale[1]) +
+				scale8(yLast0,      yBlurScale[2]) +
+				scale8(ayHeat[i+1], yBlurScale[3]) +
+				scale8(ayHeat[i+2], yBlurScale[4]);
+			yLast2 = yLast1;
+			yLast1 = yLast0;
+		}
+	}
+};
+
+// Old necklace kernel which only diffuses the first three cells.  It is kept
+// so the necklace looks the same as it always has.
+struct HeatKernelFirst3
+{
+	static inline void Apply(byte ayHeat[], int /*iNumCells*/)
+	{
+		ayHeat[0] = (ayHeat[0]*3 + ayHeat[1]*2 + ayHeat[2]) / 6;
+		ayHeat[1] = (ayHeat[1]*3 + ayHeat[1]*2 + ayHeat[2]*2) / 7;
+		ayHeat[2] = (ayHeat[2]*3 + ayHeat[1]*2 + ayHeat[0]) / 6;
+	}
+};
+
+
+
+// Add a single spark of heat iWidth cells wide somewhere in [iMin, iMax - iWidth)
+inline void AddHeatSpark(byte ayHeat[], int iMin, int iMax, int iWidth, byte ySparkHeatMin, byte ySparkHeatMax)
+{
+	int y = (iMax > 255) ? random16(iMin, iMax - iWidth) : random8(iMin, iMax - iWidth);
+
+	byte yNewHeat = random8(ySparkHeatMin, ySparkHeatMax);
+	for(int j = 0; j < iWidth; ++j)
+	{
+		ayHeat[y+j] = qadd8(ayHeat[y+j], yNewHeat);
+	}
+}
+
+
+
+// Spark policies
+//
+// Each policy adds new heat to the field once per update.  fSpeedRatio [0, 1]
+// and iDeltaTimeMS are passed along for the policies that react to motion
+// or need to run at a fixed rate.  The other policies ignore them.
+
+// No new heat.  Used for layers that only get heat from outside (touches).
+struct HeatSparksNone
+{
+	inline void Ignite(byte /*ayHeat*/[], int /*iNumCells*/, float /*fSpeedRatio*/, int /*iDeltaTimeMS*/)
+	{
+	}
+};
+
+// Randomly ignite new sparks of heat, one chance per 10 cells
+struct HeatSparksPer10
+{
+	HeatSparksPer10(byte ySparking, byte ySparkHeatMin, byte ySparkHeatMax, byte ySparkWidth) :
+		m_ySparking(ySparking),
+		m_ySparkHeatMin(ySparkHeatMin),
+		m_ySparkHeatMax(ySparkHeatMax),
+		m_ySparkWidth(ySparkWidth)
+	{
+	}
+
+	inline void Ignite(byte ayHeat[], int iNumCells, float /*fSpeedRatio*/, int /*iDeltaTimeMS*/)
+	{
+		for(int i = 0; i < iNumCells / 10; i++)
+		{
+			if(random8() < m_ySparking)
+			{
+				AddHeatSpark(ayHeat, 0, iNumCells, m_ySparkWidth, m_ySparkHeatMin, m_ySparkHeatMax);
+			}
+		}
+	}
+
+	byte m_ySparking;     // Chance (out of 255) of a spark per 10 cells
+	byte m_ySparkHeatMin;
+	byte m_ySparkHeatMax;
+	byte m_ySparkWidth;
+};
+
+// A single chance per update of a one cell spark anywhere in the field
+struct HeatSparksSingle
+{
+	HeatSparksSingle(byte ySparking, byte ySparkHeatMin, byte ySparkHeatMax) :
+		m_ySparking(ySparking),
+		m_ySparkHeatMin(ySparkHeatMin),
+		m_ySparkHeatMax(ySparkHeatMax)
+	{
+	}
+
+	inline void Ignite(byte ayHeat[], int iNumCells, float /*fSpeedRatio*/, int /*iDeltaTimeMS*/)
+	{
+		if(random8() < m_ySparking)
+		{
+			AddHeatSpark(ayHeat, 0, iNumCells + 1, 1, m_ySparkHeatMin, m_ySparkHeatMax);
+		}
+	}
+
+	byte m_ySparking;
+	byte m_ySparkHeatMin;
+	byte m_ySparkHeatMax;
+};
+
+// Fire2012 style spark that also warms the cells on either side (CampFire)
+struct HeatSparksFire2012
+{
+	HeatSparksFire2012(byte ySparking, byte ySparkHeatMin, byte ySparkHeatMax) :
+		m_ySparking(ySparking),
+		m_ySparkHeatMin(ySparkHeatMin),
+		m_ySparkHeatMax(ySparkHeatMax)
+	{
+	}
+
+	inline void Ignite(byte ayHeat[], int iNumCells, float /*fSpeedRatio*/, int /*iDeltaTimeMS*/)
+	{
+		if(random8() < m_ySparking)
+		{
+			int y = random8(2, iNumCells - 2);
+			byte yNewHeat = random8(m_ySparkHeatMin, m_ySparkHeatMax);
+			byte yHalfHeat = yNewHeat >> 1;
+			ayHeat[y] = qadd8(ayHeat[y], yNewHeat);
+			ayHeat[y-1] = qadd8(ayHeat[y], yHalfHeat);
+			ayHeat[y+1] = qadd8(ayHeat[y], yHalfHeat);
+		}
+	}
+
+	byte m_ySparking;
+	byte m_ySparkHeatMin;
+	byte m_ySparkHeatMax;
+};
+
+// Sparks at a steady rate in time that goes up with the speed ratio.  The rate
+// is in sparks per second per 100 cells.  Sparks stay iMargin cells away from
+// the ends so a 5 wide blur never has to touch the edges (FeatherLights mode 1).
+struct HeatSparksTimed
+{
+	HeatSparksTimed(float fMinSparksPerSec, float fMaxSparksPerSec, byte ySparkWidth, byte yMargin) :
+		m_fMinSparksPerSec(fMinSparksPerSec),
+		m_fMaxSparksPerSec(fMaxSparksPerSec),
+		m_ySparkWidth(ySparkWidth),
+		m_yMargin(yMargin),
+		m_iTimeSinceSparkMS(0)
+	{
+	}
+
+	inline void Ignite(byte ayHeat[], int iNumCells, float fSpeedRatio, int iDeltaTimeMS)
+	{
+		byte yNewSparkHeat = 120 + byte(120 * fSpeedRatio);
+		float fSparksPerSecond = (fSpeedRatio * (m_fMaxSparksPerSec - m_fMinSparksPerSec) + m_fMinSparksPerSec) *
+								 iNumCells / 100.0;
+		int iSparkTimeMS = int(1000 / fSparksPerSecond);
+		m_iTimeSinceSparkMS += iDeltaTimeMS;
+		while(m_iTimeSinceSparkMS > iSparkTimeMS)
+		{
+			m_iTimeSinceSparkMS -= iSparkTimeMS;
+			AddHeatSpark(ayHeat, m_yMargin, iNumCells - m_yMargin, m_ySparkWidth, yNewSparkHeat, yNewSparkHeat);
+		}
+	}
+
+	float m_fMinSparksPerSec;
+	float m_fMaxSparksPerSec;
+	byte m_ySparkWidth;
+	byte m_yMargin;
+	int m_iTimeSinceSparkMS;
+};
+
+
+
+// The heat field itself: cool, diffuse, then ignite
+template<int NUM_CELLS, class Kernel, class Sparks>
+class HeatField
+{
+public:
+
+	// yCoolingMin and yCoolingMax are the range of heat removed from each cell
+	// every update.  A max of 0 turns cooling off.
+	HeatField(byte yCoolingMin, byte yCoolingMax, const Sparks &oSparks) :
+		m_yCoolingMin(yCoolingMin),
+		m_yCoolingMax(yCoolingMax),
+		m_oSparks(oSparks)
+	{
+	}
+
+	// Run a full simulation step on ayHeat (NUM_CELLS long)
+	void Update(byte ayHeat[], float fSpeedRatio = 0.0, int iDeltaTimeMS = 0)
+	{
+		Cool(ayHeat);
+		Diffuse(ayHeat);
+		Ignite(ayHeat, fSpeedRatio, iDeltaTimeMS);
+	}
+
+	// Cool down every cell a little
+	void Cool(byte ayHeat[])
+	{
+		if(m_yCoolingMax == 0)
+		{
+			return;
+		}
+
+		for(int i = 0; i < NUM_CELLS; i++)
+		{
+			ayHeat[i] = qsub8(ayHeat[i], random8(m_yCoolingMin, m_yCoolingMax));
+		}
+	}
+
+	// Heat from each cell drifts out
+	void Diffuse(byte ayHeat[])
+	{
+		Kernel::Apply(ayHeat, NUM_CELLS);
+	}
+
+	// Add new heat
+	void Ignite(byte ayHeat[], float fSpeedRatio = 0.0, int iDeltaTimeMS = 0)
+	{
+		m_oSparks.Ignite(ayHeat, NUM_CELLS, fSpeedRatio, iDeltaTimeMS);
+	}
+
+	Sparks &GetSparks()
+	{
+		return m_oSparks;
+	}
+
+	byte m_yCoolingMin;
+	byte m_yCoolingMax;
+
+private:
+
+	Sparks m_oSparks;
+};
+
+#endif // EA_HEAT_FIELD_H
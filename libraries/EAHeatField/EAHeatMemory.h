@@ -0,0 +1,181 @@
+/**
+ * File: EAHeatMemory.h
+ *
+ * Description: Keeps the LED and heat buffers of a sketch inside the RAM of
+ * the board.  A sketch like FeatherLights had five NUM_NEO_PIXELS sized
+ * arrays plus palettes and color tables, which on an 8 KB board (Teensy++,
+ * Mega) leaves very little for the stack once there are a few hundred LEDs.
+ *
+ *   PackedHeat      A heat array stored as 4 bit steps, two cells to a byte.
+ *                   Half the RAM of a byte array.  Fine for layers like
+ *                   sparks that are mostly full on or fading out, not for a
+ *                   smooth simulation that is blurred or interpolated.
+ *   HeatMemoryPlan  Adds up the static RAM the buffers of a configuration
+ *                   take, at compile time, so a sketch can static_assert
+ *                   that it fits and print the breakdown at startup:
+ *
+ *   typedef HeatMemoryPlan<NUM_LEDS, 2, 1, 2, 1> MemoryPlan;
+ *   static_assert(MemoryPlan::TOTAL_BYTES <= HEAT_RAM_BUDGET, "LED buffers don't fit");
+ *
+ *   MemoryPlan::Report(Serial);
+ *
+ * The diffusion kernels in EAHeatField.h all work in place, so a heat array
+ * doesn't need a second one of the same size to blur it.
+ *
+ * This is header only and builds on a PC (without the ARDUINO define) using
+ * the FastLED stand-ins in EAFastLEDStub.h.
+ */
+
+#ifndef EA_HEAT_MEMORY_H
+#define EA_HEAT_MEMORY_H
+
+#ifdef ARDUINO
+ #include <FastLED.h>
+#else
+ #include "EAFastLEDStub.h"
+#endif
+#include <string.h>
+#include "EAHeatColor.h"
+
+// Heat of one packed step.  Step 15 is full heat (255).
+#define PACKED_HEAT_STEP 17
+
+// Nearest step to a heat, (yHeat + 8) / 17 without the divide, which is a
+// slow library call on an AVR
+static inline uint8_t PackedHeatStep(uint8_t yHeat)
+{
+	return (uint8_t)(((uint16_t)yHeat + PACKED_HEAT_STEP / 2) * 241 >> 12);
+}
+
+// Expand iNumCells packed cells starting at cell iStart into ayHeat
+static inline void UnpackHeat(const uint8_t *pyPacked, int iStart, int iNumCells, uint8_t ayHeat[])
+{
+	for(int i = 0; i < iNumCells; ++i)
+	{
+		int iCell = iStart + i;
+		uint8_t yByte = pyPacked[iCell >> 1];
+		uint8_t yStep = (iCell & 1) ? (yByte >> 4) : (yByte & 0x0F);
+		ayHeat[i] = yStep | (yStep << 4);
+	}
+}
+
+
+
+template<int NUM_CELLS>
+class PackedHeat
+{
+public:
+
+	static const int NUM_BYTES = (NUM_CELLS + 1) / 2;
+
+	PackedHeat()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		memset(m_ayData, 0, NUM_BYTES);
+	}
+
+	// Heat of a cell.  Always a multiple of PACKED_HEAT_STEP.
+	uint8_t Get(int iCell) const
+	{
+		uint8_t yHeat;
+		UnpackHeat(m_ayData, iCell, 1, &yHeat);
+		return yHeat;
+	}
+
+	// Set a cell to the nearest step to yHeat
+	void Set(int iCell, uint8_t yHeat)
+	{
+		uint8_t yStep = PackedHeatStep(yHeat);
+		uint8_t &yByte = m_ayData[iCell >> 1];
+		if(iCell & 1)
+		{
+			yByte = (yByte & 0x0F) | (yStep << 4);
+		}
+		else
+		{
+			yByte = (yByte & 0xF0) | yStep;
+		}
+	}
+
+	// Set a cell to the nearest step to yHeat if that is higher than it is.
+	// Always written back, without a branch on which is higher, since the
+	// spark code calls this for cells that could go either way.
+	void Raise(int iCell, uint8_t yHeat)
+	{
+		uint8_t yStep = PackedHeatStep(yHeat);
+		uint8_t &yByte = m_ayData[iCell >> 1];
+		bool bHigh = iCell & 1;
+		uint8_t yOld = bHigh ? (yByte >> 4) : (yByte & 0x0F);
+		yStep = yStep > yOld ? yStep : yOld;
+		yByte = bHigh ? (uint8_t)((yByte & 0x0F) | (yStep << 4)) : (uint8_t)((yByte & 0xF0) | yStep);
+	}
+
+	// qsub8 yHeat from every cell.  yHeat is rounded to the nearest step.
+	void Fade(uint8_t yHeat)
+	{
+		uint8_t ySteps = PackedHeatStep(yHeat);
+		for(int i = 0; i < NUM_BYTES; ++i)
+		{
+			uint8_t yLow = m_ayData[i] & 0x0F;
+			uint8_t yHigh = m_ayData[i] >> 4;
+			yLow = yLow > ySteps ? yLow - ySteps : 0;
+			yHigh = yHigh > ySteps ? yHigh - ySteps : 0;
+			m_ayData[i] = yLow | (yHigh << 4);
+		}
+	}
+
+	// For UnpackHeat()
+	const uint8_t *GetData() const
+	{
+		return m_ayData;
+	}
+
+private:
+
+	uint8_t m_ayData[NUM_BYTES];
+};
+
+
+
+// Static RAM taken by the LED buffer and the heat buffers, palettes and color
+// maps that go with it.  Byte heat arrays and PackedHeat are NUM_LEDS cells
+// long.  Anything else (the compositor, the sketch's own globals) is left out,
+// so leave room for those and the stack in the budget.
+template<int NUM_LEDS, int NUM_HEAT, int NUM_PACKED_HEAT, int NUM_PALETTES, int NUM_COLOR_MAPS>
+struct HeatMemoryPlan
+{
+	static const long LED_BYTES = NUM_LEDS * (long)sizeof(CRGB);
+	static const long HEAT_BYTES = NUM_HEAT * (long)NUM_LEDS;
+	static const long PACKED_HEAT_BYTES = NUM_PACKED_HEAT * (long)PackedHeat<NUM_LEDS>::NUM_BYTES;
+	static const long PALETTE_BYTES = NUM_PALETTES * (long)sizeof(CRGBPalette256);
+	static const long COLOR_MAP_BYTES = NUM_COLOR_MAPS * (long)sizeof(HeatColorMap);
+	static const long TOTAL_BYTES = LED_BYTES + HEAT_BYTES + PACKED_HEAT_BYTES + PALETTE_BYTES + COLOR_MAP_BYTES;
+
+	// Print the breakdown, one line per kind of buffer
+	template<class PORT>
+	static void Report(PORT &oPort)
+	{
+		ReportLine(oPort, "LEDs: ", LED_BYTES);
+		ReportLine(oPort, "Heat: ", HEAT_BYTES);
+		ReportLine(oPort, "Packed heat: ", PACKED_HEAT_BYTES);
+		ReportLine(oPort, "Palettes: ", PALETTE_BYTES);
+		ReportLine(oPort, "Color maps: ", COLOR_MAP_BYTES);
+		ReportLine(oPort, "Total: ", TOTAL_BYTES);
+	}
+
+private:
+
+	template<class PORT>
+	static void ReportLine(PORT &oPort, const char *pName, long iBytes)
+	{
+		oPort.print(pName);
+		oPort.print(iBytes);
+		oPort.println(" bytes");
+	}
+};
+
+#endif // EA_HEAT_MEMORY_H
@@ -0,0 +1,358 @@
+/**
+ * File: EALayerCompositor.h
+ *
+ * Description: Draws a stack of heat layers into the LED buffer.  The
+ * sketches used to mix their layers by hand in a loop of their own after
+ * the base layer was drawn:
+ *
+ *   g_oHeatColor.Render(g_ayLastHeat, g_ayHeat, fLerp, g_aLeds, NUM_LEDS);
+ *   for(int j = 0; j < NUM_LEDS; ++j)
+ *   {
+ *       g_aLeds[j] += ColorFromPalette(g_oPalTouch, g_ayTouchHeat[j]);
+ *   }
+ *
+ * A scene is an array of HeatLayer.  Each layer has its own heat, its own
+ * colors (a HeatColorMap, see EAHeatColor.h, or a plain palette with the
+ * heat as the index), a blend mode and an opacity.  The layers are drawn
+ * over black in order:
+ *
+ *   LAYER_BLEND_ADD     led + color                    (saturating)
+ *   LAYER_BLEND_SCREEN  led + color - led * color      (brightens, never clips)
+ *   LAYER_BLEND_MAX     the brighter of the two, per channel
+ *   LAYER_BLEND_ALPHA   lerp from led to color by the opacity
+ *
+ * For the others the color is scaled by the opacity first.  The strip is
+ * done LAYER_BLOCK_LEDS LEDs at a time, with every layer drawn into a block
+ * before moving on to the next one, so each LED is only written back once.
+ * The blend mode is picked once per layer and block, not per LED.
+ *
+ * SetScene() can fade from the scene on show to a new one.  While it fades
+ * both scenes are drawn and mixed.  All the layers of both scenes share two
+ * blocks of scratch (96 bytes), so adding layers costs no RAM beyond the
+ * HeatLayer entries:
+ *
+ *   HeatLayer g_aoLayers[] =
+ *   {
+ *       HeatLayer(g_ayLastHeat, g_ayHeat, g_oHeatColor, LAYER_BLEND_ADD),
+ *       HeatLayer(NULL, g_ayTouchHeat, g_oPalTouch, LAYER_BLEND_ADD, 128)
+ *   };
+ *   LayerCompositor g_oCompositor;
+ *
+ *   g_oCompositor.SetScene(g_aoLayers, 2, 1000, millis());
+ *   g_oCompositor.Render(g_aLeds, NUM_LEDS, fLerp, millis());
+ *
+ * A cross fade only shows something if the two scenes draw differently.
+ * Scenes that share their heat arrays or their HeatColorMap draw the same
+ * thing as soon as the sketch changes what goes into them.  For those,
+ * FadeThroughBlack() dims the output down to black and back up instead, and
+ * the sketch makes the change once IsPastBlack() says the lights are down:
+ *
+ *   g_oCompositor.FadeThroughBlack(1000, millis());
+ *   ...
+ *   if(bChangePending && g_oCompositor.IsPastBlack(millis()))
+ *   {
+ *       ... change the heat, colors or scene ...
+ *       g_oCompositor.SetScene(g_aoOtherLayers, 1, 0, millis());
+ *   }
+ *
+ * Layers with no last heat (NULL) aren't interpolated.  A layer can also
+ * take its heat from a PackedHeat (see EAHeatMemory.h), which is unpacked a
+ * block at a time into another 16 bytes of shared scratch.  Those aren't
+ * interpolated either.  The scene arrays, heat arrays and colors have to
+ * stay around while they are in use.
+ *
+ * This is header only and builds on a PC (without the ARDUINO define) using
+ * the FastLED stand-ins in EAFastLEDStub.h.
+ */
+
+#ifndef EA_LAYER_COMPOSITOR_H
+#define EA_LAYER_COMPOSITOR_H
+
+#ifdef ARDUINO
+ #include <FastLED.h>
+#else
+ #include "EAFastLEDStub.h"
+#endif
+#include "EAHeatColor.h"
+#include "EAHeatMemory.h"
+
+#ifndef NULL
+ #define NULL 0
+#endif
+
+// LEDs drawn at a time
+#define LAYER_BLOCK_LEDS 16
+
+enum LayerBlend
+{
+	LAYER_BLEND_ADD,
+	LAYER_BLEND_SCREEN,
+	LAYER_BLEND_MAX,
+	LAYER_BLEND_ALPHA
+};
+
+struct HeatLayer
+{
+	// Colors from a HeatColorMap
+	HeatLayer(const uint8_t *pyLastHeat, const uint8_t *pyHeat, HeatColorMap &oColorMap, uint8_t yBlend, uint8_t yOpacity = 255) :
+		m_pyLastHeat(pyLastHeat),
+		m_pyHeat(pyHeat),
+		m_pColorMap(&oColorMap),
+		m_pPalette(NULL),
+		m_bPacked(false),
+		m_yBlend(yBlend),
+		m_yOpacity(yOpacity)
+	{
+	}
+
+	// Colors straight from a palette (the same as ColorFromPalette(oPalette, heat))
+	HeatLayer(const uint8_t *pyLastHeat, const uint8_t *pyHeat, const CRGBPalette256 &oPalette, uint8_t yBlend, uint8_t yOpacity = 255) :
+		m_pyLastHeat(pyLastHeat),
+		m_pyHeat(pyHeat),
+		m_pColorMap(NULL),
+		m_pPalette(&oPalette),
+		m_bPacked(false),
+		m_yBlend(yBlend),
+		m_yOpacity(yOpacity)
+	{
+	}
+
+	// Packed heat, colors straight from a palette
+	template<int NUM_CELLS>
+	HeatLayer(const PackedHeat<NUM_CELLS> &oHeat, const CRGBPalette256 &oPalette, uint8_t yBlend, uint8_t yOpacity = 255) :
+		m_pyLastHeat(NULL),
+		m_pyHeat(oHeat.GetData()),
+		m_pColorMap(NULL),
+		m_pPalette(&oPalette),
+		m_bPacked(true),
+		m_yBlend(yBlend),
+		m_yOpacity(yOpacity)
+	{
+	}
+
+	const uint8_t *m_pyLastHeat;
+	const uint8_t *m_pyHeat;
+	HeatColorMap *m_pColorMap;
+	const CRGBPalette256 *m_pPalette;
+	bool m_bPacked;
+	uint8_t m_yBlend;
+	uint8_t m_yOpacity;
+};
+
+
+
+class LayerCompositor
+{
+public:
+
+	LayerCompositor() :
+		m_pScene(NULL),
+		m_iNumLayers(0),
+		m_pLastScene(NULL),
+		m_iNumLastLayers(0),
+		m_iFadeStartMS(0),
+		m_iFadeMS(0),
+		m_iDimStartMS(0),
+		m_iDimMS(0)
+	{
+	}
+
+	// Show aoLayers.  With iFadeMS > 0 the scene on show now fades out over
+	// that time.  A change in the middle of a fade starts a new fade from the
+	// scene that was fading in.
+	void SetScene(const HeatLayer aoLayers[], int iNumLayers, unsigned long iFadeMS, unsigned long iNowMS)
+	{
+		if(aoLayers == m_pScene && iNumLayers == m_iNumLayers)
+		{
+			return;
+		}
+		m_pLastScene = m_pScene;
+		m_iNumLastLayers = m_iNumLayers;
+		m_pScene = aoLayers;
+		m_iNumLayers = iNumLayers;
+		m_iFadeStartMS = iNowMS;
+		m_iFadeMS = (m_pLastScene != NULL) ? iFadeMS : 0;
+	}
+
+	bool IsFading(unsigned long iNowMS) const
+	{
+		return m_iFadeMS > 0 && iNowMS - m_iFadeStartMS < m_iFadeMS;
+	}
+
+	// Dim the output to black over the first half of iFadeMS and back up over
+	// the second half
+	void FadeThroughBlack(unsigned long iFadeMS, unsigned long iNowMS)
+	{
+		m_iDimStartMS = iNowMS;
+		m_iDimMS = iFadeMS;
+	}
+
+	// True once the last FadeThroughBlack() has got down to black (and after
+	// it has finished)
+	bool IsPastBlack(unsigned long iNowMS) const
+	{
+		return iNowMS - m_iDimStartMS >= m_iDimMS / 2;
+	}
+
+	// Draw the scene into the first iNumLeds of aoLeds.  fLerp is how far to
+	// go from each layer's last heat to its heat.
+	void Render(CRGB aoLeds[], int iNumLeds, fract8 fLerp, unsigned long iNowMS)
+	{
+		// How far into the fade, 255 is all new scene
+		bool bFading = IsFading(iNowMS);
+		fract8 yFade = 255;
+		if(bFading)
+		{
+			yFade = (iNowMS - m_iFadeStartMS) * 256 / m_iFadeMS;
+		}
+		else
+		{
+			m_iFadeMS = 0;
+		}
+
+		// How bright the output is, down to 0 and back up to 255 while it fades
+		// through black
+		uint8_t yLevel = 255;
+		if(m_iDimMS > 0)
+		{
+			unsigned long iHalfMS = (m_iDimMS + 1) / 2;
+			unsigned long iElapsedMS = iNowMS - m_iDimStartMS;
+			if(iElapsedMS >= m_iDimMS)
+			{
+				m_iDimMS = 0;
+			}
+			else if(iElapsedMS < iHalfMS)
+			{
+				yLevel = 255 - iElapsedMS * 255 / iHalfMS;
+			}
+			else
+			{
+				yLevel = (iElapsedMS - iHalfMS) * 255 / iHalfMS;
+			}
+		}
+
+		for(int iStart = 0; iStart < iNumLeds; iStart += LAYER_BLOCK_LEDS)
+		{
+			int iNum = iNumLeds - iStart;
+			if(iNum > LAYER_BLOCK_LEDS)
+			{
+				iNum = LAYER_BLOCK_LEDS;
+			}
+			CRGB *pBlock = aoLeds + iStart;
+
+			DrawScene(m_pScene, m_iNumLayers, pBlock, iStart, iNum, fLerp);
+			if(bFading)
+			{
+				DrawScene(m_pLastScene, m_iNumLastLayers, m_aoFadeBlock, iStart, iNum, fLerp);
+				for(int i = 0; i < iNum; ++i)
+				{
+					pBlock[i].r = lerp8by8(m_aoFadeBlock[i].r, pBlock[i].r, yFade);
+					pBlock[i].g = lerp8by8(m_aoFadeBlock[i].g, pBlock[i].g, yFade);
+					pBlock[i].b = lerp8by8(m_aoFadeBlock[i].b, pBlock[i].b, yFade);
+				}
+			}
+			if(yLevel < 255)
+			{
+				uint8_t *pyBlock = (uint8_t *)pBlock;
+				for(int i = 0; i < iNum * 3; ++i)
+				{
+					pyBlock[i] = scale8(pyBlock[i], yLevel);
+				}
+			}
+		}
+	}
+
+private:
+
+	// Draw one block of a scene into pBlock
+	void DrawScene(const HeatLayer aoLayers[], int iNumLayers, CRGB pBlock[], int iStart, int iNum, fract8 fLerp)
+	{
+		memset((void *)pBlock, 0, iNum * sizeof(CRGB));
+		for(int iLayer = 0; iLayer < iNumLayers; ++iLayer)
+		{
+			const HeatLayer &oLayer = aoLayers[iLayer];
+			const uint8_t *pyHeat = oLayer.m_pyHeat + iStart;
+			if(oLayer.m_bPacked)
+			{
+				UnpackHeat(oLayer.m_pyHeat, iStart, iNum, m_ayHeatBlock);
+				pyHeat = m_ayHeatBlock;
+			}
+			const uint8_t *pyLastHeat = (oLayer.m_pyLastHeat != NULL) ? oLayer.m_pyLastHeat + iStart : pyHeat;
+
+			// The layer's own colors
+			if(oLayer.m_pColorMap != NULL)
+			{
+				oLayer.m_pColorMap->Render(pyLastHeat, pyHeat, fLerp, m_aoLayerBlock, iNum);
+			}
+			else
+			{
+				const CRGBPalette256 &oPalette = *oLayer.m_pPalette;
+				for(int i = 0; i < iNum; ++i)
+				{
+					m_aoLayerBlock[i] = oPalette[lerp8by8(pyLastHeat[i], pyHeat[i], fLerp)];
+				}
+			}
+
+			Blend(pBlock, m_aoLayerBlock, iNum, oLayer.m_yBlend, oLayer.m_yOpacity);
+		}
+	}
+
+	static void Blend(CRGB pDst[], const CRGB pSrc[], int iNum, uint8_t yBlend, uint8_t yOpacity)
+	{
+		uint8_t *pyDst = (uint8_t *)pDst;
+		const uint8_t *pySrc = (const uint8_t *)pSrc;
+		int iNumBytes = iNum * 3;
+		switch(yBlend)
+		{
+			case LAYER_BLEND_ADD:
+				for(int i = 0; i < iNumBytes; ++i)
+				{
+					pyDst[i] = qadd8(pyDst[i], scale8(pySrc[i], yOpacity));
+				}
+				break;
+
+			case LAYER_BLEND_SCREEN:
+				for(int i = 0; i < iNumBytes; ++i)
+				{
+					uint8_t ySrc = scale8(pySrc[i], yOpacity);
+					pyDst[i] = pyDst[i] + ySrc - scale8(pyDst[i], ySrc);
+				}
+				break;
+
+			case LAYER_BLEND_MAX:
+				for(int i = 0; i < iNumBytes; ++i)
+				{
+					uint8_t ySrc = scale8(pySrc[i], yOpacity);
+					if(ySrc > pyDst[i])
+					{
+						pyDst[i] = ySrc;
+					}
+				}
+				break;
+
+			case LAYER_BLEND_ALPHA:
+				for(int i = 0; i < iNumBytes; ++i)
+				{
+					pyDst[i] = lerp8by8(pyDst[i], pySrc[i], yOpacity);
+				}
+				break;
+		}
+	}
+
+	const HeatLayer *m_pScene;
+	int m_iNumLayers;
+	const HeatLayer *m_pLastScene;
+	int m_iNumLastLayers;
+	unsigned long m_iFadeStartMS;
+	unsigned long m_iFadeMS;
+	unsigned long m_iDimStartMS;
+	unsigned long m_iDimMS;
+
+	// Shared by every layer: the colors of the layer being drawn, the last
+	// scene while fading and the heat of a packed layer
+	CRGB m_aoLayerBlock[LAYER_BLOCK_LEDS];
+	CRGB m_aoFadeBlock[LAYER_BLOCK_LEDS];
+	uint8_t m_ayHeatBlock[LAYER_BLOCK_LEDS];
+};
+
+#endif // EA_LAYER_COMPOSITOR_H
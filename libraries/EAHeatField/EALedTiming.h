@@ -0,0 +1,72 @@
+/**
+ * File: EALedTiming.h
+ *
+ * Description: How fast a strip of WS2812 style LEDs can be updated.  Each
+ * LED takes 24 bits at 800 kHz (30 us), and a frame is only latched after
+ * the data line stays low for the reset time, so 1000 LEDs on one pin can't
+ * go faster than about 33 frames a second however fast the loop is.
+ * Splitting the LEDs into runs on separate pins that are sent at the same
+ * time (like ScienceClouds does with one WS2812Serial port per run) divides
+ * the wire time by the number of runs.
+ *
+ * With a DMA driver (WS2812Serial, OctoWS2811) the runs go out together
+ * and the next frame is drawn while the last one is still going out, so a
+ * frame takes the longer of the two.  A blocking driver (FastLED's bit
+ * banged clockless output) sends the runs one after the other with the
+ * CPU tied up, so splitting doesn't help and everything adds up:
+ *
+ *   blocking:      render + wire * NUM_STRIPS
+ *   DMA:           max(render + copy, wire)
+ *   wire:          ceil(NUM_LEDS / NUM_STRIPS) * bits per LED / bit rate + reset
+ *
+ * Python/led_timing.py prints this for a range of strip counts.  Both
+ * copies are checked against test/host/LedTimingVectors.txt (TestLedTiming
+ * and test_led_timing.py).
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_LED_TIMING_H
+#define EA_LED_TIMING_H
+
+// WS2812B bit rate and the low time that latches a frame
+#define WS2812_BIT_RATE 800000UL
+#define WS2812_RESET_MICRO 300UL
+
+// Time for the driver to copy (and for WS2812Serial, expand) one LED into
+// its DMA buffer.  A rough figure for a Teensy 4.0.
+#define WS2812_DMA_COPY_NANO_PER_LED 40UL
+
+struct LedTiming
+{
+	// Time on the wire for one strip of iNumLeds
+	static unsigned long WireMicro(int iNumLeds, int iBitsPerLed = 24)
+	{
+		// In kHz so this doesn't overflow 32 bits
+		unsigned long iBitRateKHz = WS2812_BIT_RATE / 1000;
+		return ((unsigned long)iNumLeds * iBitsPerLed * 1000UL + iBitRateKHz - 1) / iBitRateKHz + WS2812_RESET_MICRO;
+	}
+
+	// Time for a whole frame of iNumLeds split evenly over iNumStrips pins,
+	// sent at the same time with bDMA and one after the other without.
+	// iRenderMicro is the time the loop takes to work out the colors.
+	static unsigned long FrameMicro(int iNumLeds, int iNumStrips, unsigned long iRenderMicro, bool bDMA)
+	{
+		int iLedsPerStrip = (iNumLeds + iNumStrips - 1) / iNumStrips;
+		unsigned long iWireMicro = WireMicro(iLedsPerStrip);
+		if(!bDMA)
+		{
+			return iRenderMicro + iWireMicro * iNumStrips;
+		}
+		unsigned long iCopyMicro = (unsigned long)iNumLeds * WS2812_DMA_COPY_NANO_PER_LED / 1000;
+		unsigned long iCpuMicro = iRenderMicro + iCopyMicro;
+		return iCpuMicro > iWireMicro ? iCpuMicro : iWireMicro;
+	}
+
+	static float MaxFps(int iNumLeds, int iNumStrips, unsigned long iRenderMicro, bool bDMA)
+	{
+		return 1000000.0f / FrameMicro(iNumLeds, iNumStrips, iRenderMicro, bDMA);
+	}
+};
+
+#endif // EA_LED_TIMING_H
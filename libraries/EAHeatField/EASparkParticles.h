@@ -0,0 +1,265 @@
+/**
+ * File: EASparkParticles.h
+ *
+ * Description: Sparks that fly along the strip, leaving heat behind them
+ * (FeatherLights mode 4).  The sketch used to keep a float position and
+ * speed for each of 20 sparks and move all of them every step, dead or not.
+ *
+ * SparkParticles is a fixed pool of CAPACITY particles.  Each field is its
+ * own array and the live particles are always the first GetNumActive() of
+ * them (a particle that leaves the strip is swapped with the last live one),
+ * so a step only touches the particles that are alive.  Positions and speeds
+ * are in 1/256ths of a cell (PARTICLE_CELL is one cell).
+ *
+ * Each particle draws itself as a box WIDTH cells wide.  At a whole cell
+ * position it covers that cell and the WIDTH - 1 behind it.  In between,
+ * the cells at the two ends get the part of the heat they are covered by, so
+ * a particle moves smoothly instead of jumping a cell at a time.  The box is
+ * clipped to the strip, which also fixes the old sketch writing one cell
+ * before the start.  Heat only ever goes up (the brighter of the cell and the
+ * particle wins):
+ *
+ *   SparkParticles<20, 2> g_oSparks;      // 20 sparks 2 cells wide
+ *   SpeedSpawner g_oSpawner(100, 0.75, 10);
+ *
+ *   g_oSparkHeat.Fade(50);
+ *   if(g_oSpawner.Step(fDisplaySpeedRatio))
+ *   {
+ *       g_oSparks.Spawn(0, PARTICLE_CELL * 2, 240);
+ *   }
+ *   g_oSparks.Update(g_oSparkHeat, NUM_LEDS, 43);
+ *
+ * Update() is Step() then Deposit() in one pass.  The heat can be a byte
+ * array or a PackedHeat (see EAHeatMemory.h).  Spawn() does nothing when the
+ * pool is full.  test/host/BenchSparkParticles.cpp times a step against the
+ * old float loop.
+ *
+ * This is header only and builds on a PC (without the ARDUINO define) using
+ * the FastLED stand-ins in EAFastLEDStub.h.
+ */
+
+#ifndef EA_SPARK_PARTICLES_H
+#define EA_SPARK_PARTICLES_H
+
+#ifdef ARDUINO
+ #include <FastLED.h>
+#else
+ #include "EAFastLEDStub.h"
+#endif
+#include "EAHeatMemory.h"
+
+// One cell in particle positions and speeds
+#define PARTICLE_CELL 256
+
+
+
+// Decides when to spawn from the speed ratio.  Each step counts down by
+// fSpeedRatio * fCountPerStep while the ratio is over fMinRatio, and there is
+// a spawn each time it gets through iCount.
+class SpeedSpawner
+{
+public:
+
+	SpeedSpawner(int iCount, float fMinRatio, float fCountPerStep) :
+		m_iCount(iCount),
+		m_fMinRatio(fMinRatio),
+		m_fCountPerStep(fCountPerStep),
+		m_iCountdown(iCount)
+	{
+	}
+
+	// True if a particle should be spawned this step
+	bool Step(float fSpeedRatio)
+	{
+		if(fSpeedRatio > m_fMinRatio)
+		{
+			m_iCountdown -= int(fSpeedRatio * m_fCountPerStep);
+		}
+		if(m_iCountdown < 0)
+		{
+			m_iCountdown = m_iCount;
+			return true;
+		}
+		return false;
+	}
+
+private:
+
+	int m_iCount;
+	float m_fMinRatio;
+	float m_fCountPerStep;
+	int m_iCountdown;
+};
+
+
+
+template<int CAPACITY, int WIDTH = 2>
+class SparkParticles
+{
+public:
+
+	SparkParticles() :
+		m_iNumActive(0)
+	{
+	}
+
+	int GetNumActive() const
+	{
+		return m_iNumActive;
+	}
+
+	void Clear()
+	{
+		m_iNumActive = 0;
+	}
+
+	// Start a particle at iPos moving iSpeed a step (both in PARTICLE_CELLs).
+	// False if the pool is full.
+	bool Spawn(uint32_t iPos, uint16_t iSpeed, uint8_t yHeat)
+	{
+		if(m_iNumActive >= CAPACITY)
+		{
+			return false;
+		}
+		m_aiPos[m_iNumActive] = iPos;
+		m_aiSpeed[m_iNumActive] = iSpeed;
+		m_ayHeat[m_iNumActive] = yHeat;
+		m_iNumActive++;
+		return true;
+	}
+
+	// Move every particle one step.  Ones that have gone all the way off the
+	// end of iNumCells are removed.
+	void Step(int iNumCells)
+	{
+		uint32_t iEnd = (uint32_t)(iNumCells + WIDTH - 1) * PARTICLE_CELL;
+		int i = 0;
+		while(i < m_iNumActive)
+		{
+			m_aiPos[i] += m_aiSpeed[i];
+			if(m_aiPos[i] >= iEnd)
+			{
+				Remove(i);
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	// Draw every particle into the heat.  Each particle's heat is scaled by a
+	// random amount from yFlickerMin to 255 (255 for no flicker).
+	template<class HEAT>
+	void Deposit(HEAT &oHeat, int iNumCells, uint8_t yFlickerMin = 255)
+	{
+		int iNumActive = m_iNumActive;
+		for(int i = 0; i < iNumActive; ++i)
+		{
+			DepositOne(oHeat, m_aiPos[i], m_ayHeat[i], iNumCells, yFlickerMin);
+		}
+	}
+
+	// Step() and Deposit() in one pass over the particles
+	template<class HEAT>
+	void Update(HEAT &oHeat, int iNumCells, uint8_t yFlickerMin = 255)
+	{
+		uint32_t iEnd = (uint32_t)(iNumCells + WIDTH - 1) * PARTICLE_CELL;
+		int iNumActive = m_iNumActive;
+		int i = 0;
+		while(i < iNumActive)
+		{
+			uint32_t iPos = m_aiPos[i] + m_aiSpeed[i];
+			if(iPos >= iEnd)
+			{
+				m_iNumActive = iNumActive;
+				Remove(i);
+				iNumActive--;
+			}
+			else
+			{
+				m_aiPos[i] = iPos;
+				DepositOne(oHeat, iPos, m_ayHeat[i], iNumCells, yFlickerMin);
+				i++;
+			}
+		}
+		m_iNumActive = iNumActive;
+	}
+
+private:
+
+	// Takes the particle by value: the heat is bytes, and a byte store could
+	// be to any of the members as far as the compiler knows, so they would
+	// all be read again after every cell.
+	template<class HEAT>
+	static inline void DepositOne(HEAT &oHeat, uint32_t iPos, uint8_t yHeat, int iNumCells, uint8_t yFlickerMin)
+	{
+		if(yFlickerMin < 255)
+		{
+			yHeat = scale8(yHeat, random8(yFlickerMin, 255));
+		}
+
+		// The back cell of the box is covered by 1 - frac, the cells up to the
+		// one under the position are full and the next one is covered by frac.
+		// Most boxes are all on the strip and skip the clipping.
+		int iCell = iPos / PARTICLE_CELL;
+		uint8_t yFrac = iPos % PARTICLE_CELL;
+		int iBack = iCell - WIDTH + 1;
+		if(iBack >= 0 && iCell + 1 < iNumCells)
+		{
+			RaiseCell(oHeat, iBack, scale8(yHeat, 255 - yFrac));
+			for(int j = iBack + 1; j <= iCell; ++j)
+			{
+				RaiseCell(oHeat, j, yHeat);
+			}
+			RaiseCell(oHeat, iCell + 1, scale8(yHeat, yFrac));
+		}
+		else
+		{
+			DepositCell(oHeat, iNumCells, iBack, scale8(yHeat, 255 - yFrac));
+			for(int j = iBack + 1; j <= iCell; ++j)
+			{
+				DepositCell(oHeat, iNumCells, j, yHeat);
+			}
+			DepositCell(oHeat, iNumCells, iCell + 1, scale8(yHeat, yFrac));
+		}
+	}
+
+	void Remove(int i)
+	{
+		m_iNumActive--;
+		m_aiPos[i] = m_aiPos[m_iNumActive];
+		m_aiSpeed[i] = m_aiSpeed[m_iNumActive];
+		m_ayHeat[i] = m_ayHeat[m_iNumActive];
+	}
+
+	// The brighter of the cell and yHeat.  Written without a branch since
+	// which one wins is a coin toss.
+	static inline void RaiseCell(uint8_t ayHeat[], int iCell, uint8_t yHeat)
+	{
+		uint8_t yOld = ayHeat[iCell];
+		ayHeat[iCell] = yHeat > yOld ? yHeat : yOld;
+	}
+
+	template<int NUM_CELLS>
+	static inline void RaiseCell(PackedHeat<NUM_CELLS> &oHeat, int iCell, uint8_t yHeat)
+	{
+		oHeat.Raise(iCell, yHeat);
+	}
+
+	template<class HEAT>
+	static void DepositCell(HEAT &oHeat, int iNumCells, int iCell, uint8_t yHeat)
+	{
+		if(iCell >= 0 && iCell < iNumCells)
+		{
+			RaiseCell(oHeat, iCell, yHeat);
+		}
+	}
+
+	int m_iNumActive;
+	uint32_t m_aiPos[CAPACITY];
+	uint16_t m_aiSpeed[CAPACITY];
+	uint8_t m_ayHeat[CAPACITY];
+};
+
+#endif // EA_SPARK_PARTICLES_H
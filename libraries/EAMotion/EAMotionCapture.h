@@ -0,0 +1,207 @@
+/**
+ * File: EAMotionCapture.h
+ *
+ * Description: Period measurement for the X-band motion sensor with a choice
+ * of backend made at compile time.  Define one of these before including
+ * this file:
+ *
+ *   (nothing)                        attachInterrupt() on any pin.  The
+ *                                    interrupt pushes micros() into a
+ *                                    PulseRing (EAPulseRing.h).
+ *
+ *   USE_MOTION_CAPTURE_FREQMEASURE   Teensy input capture via the FreqMeasure
+ *                                    library.  The timer hardware latches
+ *                                    the edge time so interrupts being off
+ *                                    during FastLED.show() don't move it.
+ *                                    Fixed pin (Teensy 3.x: 3, Teensy 4.x: 22,
+ *                                    Teensy++ 2.0: 4).
+ *
+ *   USE_MOTION_CAPTURE_AVR_ICP       AVR Timer1 input capture (ICP1 pin,
+ *                                    Uno: 8, Teensy++ 2.0: 4).  Takes over
+ *                                    Timer1 so it can't be used with TimerOne.
+ *
+ * All of them give the same GetPeriodMicro() so GetCurSpeed() doesn't change.
+ * The interrupt backend can count both edges (CHANGE), the hardware ones
+ * always measure a full period, so with CHANGE they return half the period
+ * to keep the tuning the same.
+ *
+ * This holds interrupt handlers so only include it from the sketch.
+ */
+
+#ifndef EA_MOTION_CAPTURE_H
+#define EA_MOTION_CAPTURE_H
+
+#include <Arduino.h>
+#include "EAPulseRing.h"
+
+#if defined(USE_MOTION_CAPTURE_FREQMEASURE)
+ #include <FreqMeasure.h>
+#elif defined(USE_MOTION_CAPTURE_AVR_ICP)
+ #include <avr/io.h>
+ #include <avr/interrupt.h>
+#endif
+
+// Pulse (or capture) times waiting for the main loop
+static PulseRing<32> g_oMotionCaptureRing;
+
+#if defined(USE_MOTION_CAPTURE_AVR_ICP)
+
+// Timer1 runs at F_CPU / 8 and the overflows extend it to 32 bits
+#define MOTION_CAPTURE_TICKS_PER_MICRO (F_CPU / 8000000UL)
+static volatile uint16_t g_iMotionCaptureOverflows = 0;
+
+ISR(TIMER1_OVF_vect)
+{
+	g_iMotionCaptureOverflows++;
+}
+
+ISR(TIMER1_CAPT_vect)
+{
+	uint16_t iCapture = ICR1;
+	uint16_t iOverflows = g_iMotionCaptureOverflows;
+
+	// The overflow may have happened just before the capture but not been
+	// handled yet
+	if((TIFR1 & _BV(TOV1)) && iCapture < 0x8000)
+	{
+		iOverflows++;
+	}
+	g_oMotionCaptureRing.Push(((uint32_t)iOverflows << 16) | iCapture);
+}
+
+// Current time in Timer1 ticks (same clock as the captures)
+static uint32_t MotionCaptureNowTicks()
+{
+	uint8_t ySREG = SREG;
+	cli();
+	uint16_t iCount = TCNT1;
+	uint16_t iOverflows = g_iMotionCaptureOverflows;
+	if((TIFR1 & _BV(TOV1)) && iCount < 0x8000)
+	{
+		iOverflows++;
+	}
+	SREG = ySREG;
+	return ((uint32_t)iOverflows << 16) | iCount;
+}
+
+#elif !defined(USE_MOTION_CAPTURE_FREQMEASURE)
+
+static void MotionCapturePulse()
+{
+	g_oMotionCaptureRing.Push(micros());
+}
+
+#endif
+
+
+
+class MotionCapture
+{
+public:
+
+	// iMinPeriodMicro is only used by the interrupt backend to drop the
+	// double interrupts some boards see on a single edge.
+	MotionCapture(PulsePeriodEstimator::Mode eMode, uint32_t iMinPeriodMicro = 0) :
+#if defined(USE_MOTION_CAPTURE_AVR_ICP)
+		m_oEstimator(eMode, iMinPeriodMicro * MOTION_CAPTURE_TICKS_PER_MICRO),
+#else
+		m_oEstimator(eMode, iMinPeriodMicro),
+#endif
+		m_eMode(eMode),
+		m_bHalfPeriod(false),
+		m_iLastReadMicro(0),
+		m_iPeriodMicro(0),
+		m_iNumPeriods(0)
+	{
+	}
+
+	// iPin and iMode (RISING or CHANGE) are for the interrupt backend.  The
+	// hardware backends use their fixed pin and always capture rising edges.
+	void Begin(int iPin, int iMode)
+	{
+		m_bHalfPeriod = (iMode == CHANGE);
+#if defined(USE_MOTION_CAPTURE_FREQMEASURE)
+		FreqMeasure.begin();
+#elif defined(USE_MOTION_CAPTURE_AVR_ICP)
+		uint8_t ySREG = SREG;
+		cli();
+		TCCR1A = 0;
+		TCCR1B = _BV(ICNC1) | _BV(ICES1) | _BV(CS11); // Noise canceler, rising edge, clk/8
+		TCNT1 = 0;
+		TIFR1 = _BV(ICF1) | _BV(TOV1);
+		TIMSK1 = _BV(ICIE1) | _BV(TOIE1);
+		SREG = ySREG;
+#else
+		pinMode(iPin, INPUT);
+ #ifdef digitalPinToInterrupt
+		attachInterrupt(digitalPinToInterrupt(iPin), MotionCapturePulse, iMode);
+ #else
+		attachInterrupt(iPin, MotionCapturePulse, iMode);
+ #endif
+#endif
+	}
+
+	// Call once per frame.  Returns the period from all the pulses since the
+	// last call, or the time since the last pulse if that is longer.
+	unsigned long GetPeriodMicro()
+	{
+#if defined(USE_MOTION_CAPTURE_FREQMEASURE)
+		// FreqMeasure already hands out periods (in timer counts)
+		uint32_t aiPeriods[PulsePeriodEstimator::MAX_PERIODS];
+		int iNumPeriods = 0;
+		while(FreqMeasure.available())
+		{
+			uint32_t iCount = FreqMeasure.read();
+			if(iNumPeriods < PulsePeriodEstimator::MAX_PERIODS)
+			{
+				aiPeriods[iNumPeriods++] = iCount;
+			}
+		}
+
+		unsigned long iNowMicro = micros();
+		m_iNumPeriods = iNumPeriods;
+		if(iNumPeriods > 0)
+		{
+			uint32_t iCount = (m_eMode == PulsePeriodEstimator::MEDIAN) ?
+				PulsePeriodEstimator::Median(aiPeriods, iNumPeriods) :
+				PulsePeriodEstimator::Mean(aiPeriods, iNumPeriods);
+			m_iPeriodMicro = (unsigned long)(1000000.0 / FreqMeasure.countToFrequency(iCount));
+			if(m_bHalfPeriod)
+			{
+				m_iPeriodMicro /= 2;
+			}
+			m_iLastReadMicro = iNowMicro;
+		}
+
+		// Only known to the frame, not the pulse, but good enough for
+		// noticing that the motion stopped
+		unsigned long iSinceLastMicro = iNowMicro - m_iLastReadMicro;
+		return (iSinceLastMicro > m_iPeriodMicro) ? iSinceLastMicro : m_iPeriodMicro;
+#elif defined(USE_MOTION_CAPTURE_AVR_ICP)
+		unsigned long iPeriodMicro = m_oEstimator.Update(g_oMotionCaptureRing, MotionCaptureNowTicks()) / MOTION_CAPTURE_TICKS_PER_MICRO;
+		m_iNumPeriods = m_oEstimator.GetNumPeriods();
+		return m_bHalfPeriod ? iPeriodMicro / 2 : iPeriodMicro;
+#else
+		unsigned long iPeriodMicro = m_oEstimator.Update(g_oMotionCaptureRing, micros());
+		m_iNumPeriods = m_oEstimator.GetNumPeriods();
+		return iPeriodMicro;
+#endif
+	}
+
+	// Number of periods used by the last GetPeriodMicro()
+	int GetNumPeriods() const
+	{
+		return m_iNumPeriods;
+	}
+
+private:
+
+	PulsePeriodEstimator m_oEstimator;
+	PulsePeriodEstimator::Mode m_eMode;
+	bool m_bHalfPeriod;
+	unsigned long m_iLastReadMicro;
+	unsigned long m_iPeriodMicro;
+	int m_iNumPeriods;
+};
+
+#endif // EA_MOTION_CAPTURE_H
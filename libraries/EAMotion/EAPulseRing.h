@@ -0,0 +1,239 @@
+/**
+ * File: EAPulseRing.h
+ *
+ * Description: Pulse timestamps from the X-band motion sensor interrupt and
+ * the period estimate made from them.
+ *
+ * The sensor interrupt used to save only the last period into two volatile
+ * unsigned longs that the main loop read back without any protection, so a
+ * read could see half of an update.  It also threw away every pulse but the
+ * last one each frame.  Now the interrupt only pushes the pulse time into a
+ * PulseRing and the main loop drains it once per frame with a
+ * PulsePeriodEstimator, which uses all of the pulses since the last frame:
+ *
+ *   PulseRing<32> g_oPulseRing;
+ *   PulsePeriodEstimator g_oPeriodEstimator(PulsePeriodEstimator::MEDIAN);
+ *
+ *   void MotionDetectorPulse()
+ *   {
+ *       g_oPulseRing.Push(micros());
+ *   }
+ *
+ *   unsigned long GetLastPeriodMicro()
+ *   {
+ *       return g_oPeriodEstimator.Update(g_oPulseRing, micros());
+ *   }
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_PULSE_RING_H
+#define EA_PULSE_RING_H
+
+#include <stdint.h>
+
+// Single producer (the interrupt), single consumer (the main loop) ring of
+// pulse times.  SIZE must be a power of 2 no bigger than 128, since a full
+// ring of 256 would look the same as an empty one.  The head and tail are
+// single bytes so reading and writing them is atomic even on AVR; the
+// interrupt only writes the head and the main loop only writes the tail.
+template<int SIZE>
+class PulseRing
+{
+public:
+
+	static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0, "PulseRing SIZE must be a power of 2 no bigger than 128");
+
+	PulseRing() :
+		m_yHead(0),
+		m_yTail(0),
+		m_yDropped(0)
+	{
+	}
+
+	// Interrupt side.  If the main loop has fallen a whole ring behind the
+	// new pulse is dropped (the older ones are still good for the estimate).
+	inline void Push(uint32_t iTimeMicro)
+	{
+		uint8_t yHead = m_yHead;
+		if((uint8_t)(yHead - m_yTail) >= SIZE)
+		{
+			m_yDropped++;
+			return;
+		}
+		m_aiTimes[yHead & (SIZE - 1)] = iTimeMicro;
+		m_yHead = yHead + 1;
+	}
+
+	// Main loop side.  Returns false if the ring is empty.
+	inline bool Pop(uint32_t &iTimeMicro)
+	{
+		uint8_t yTail = m_yTail;
+		if(yTail == m_yHead)
+		{
+			return false;
+		}
+		iTimeMicro = m_aiTimes[yTail & (SIZE - 1)];
+		m_yTail = yTail + 1;
+		return true;
+	}
+
+	// Number of pulses waiting
+	inline uint8_t Count() const
+	{
+		return m_yHead - m_yTail;
+	}
+
+	// Number of pulses dropped because the ring was full (wraps at 256)
+	inline uint8_t Dropped() const
+	{
+		return m_yDropped;
+	}
+
+private:
+
+	volatile uint32_t m_aiTimes[SIZE];
+	volatile uint8_t m_yHead;
+	volatile uint8_t m_yTail;
+	volatile uint8_t m_yDropped;
+};
+
+
+
+// Turns the pulse times from a PulseRing into a period estimate once per
+// frame.  The estimate is the mean or median of all the periods that
+// finished since the last frame.  If none did, the last estimate is kept.
+// Like the old GetLastPeriodMicro(), if it has been longer than the estimate
+// since the last pulse, that time is returned instead so fast motion that
+// suddenly stops doesn't slowly fade out.
+class PulsePeriodEstimator
+{
+public:
+
+	enum Mode
+	{
+		MEAN,   // Cheapest, the span of the pulses over the number of periods
+		MEDIAN, // Ignores the odd double or missed pulse
+	};
+
+	// Most periods used for one estimate.  Older ones in the same frame are
+	// dropped.
+	static const int MAX_PERIODS = 32;
+
+	// Periods shorter than iMinPeriodMicro are treated as the same pulse
+	// (some interrupts fire twice in very quick succession).
+	PulsePeriodEstimator(Mode eMode, uint32_t iMinPeriodMicro = 0) :
+		m_eMode(eMode),
+		m_iMinPeriodMicro(iMinPeriodMicro),
+		m_iLastPulseMicro(0),
+		m_iPeriodMicro(0),
+		m_iNumPeriods(0),
+		m_bHavePulse(false)
+	{
+	}
+
+	template<int SIZE>
+	uint32_t Update(PulseRing<SIZE> &oRing, uint32_t iNowMicro)
+	{
+		uint32_t aiPeriods[MAX_PERIODS];
+		int iNumPeriods = 0;
+		uint32_t iPulseMicro;
+		while(oRing.Pop(iPulseMicro))
+		{
+			if(!m_bHavePulse)
+			{
+				m_iLastPulseMicro = iPulseMicro;
+				m_bHavePulse = true;
+				continue;
+			}
+
+			uint32_t iPeriod = iPulseMicro - m_iLastPulseMicro;
+			if(iPeriod <= m_iMinPeriodMicro)
+			{
+				continue;
+			}
+			m_iLastPulseMicro = iPulseMicro;
+
+			if(iNumPeriods == MAX_PERIODS)
+			{
+				// Keep the newest ones
+				for(int i = 1; i < MAX_PERIODS; ++i)
+				{
+					aiPeriods[i-1] = aiPeriods[i];
+				}
+				--iNumPeriods;
+			}
+			aiPeriods[iNumPeriods++] = iPeriod;
+		}
+
+		m_iNumPeriods = iNumPeriods;
+		if(iNumPeriods > 0)
+		{
+			m_iPeriodMicro = (m_eMode == MEDIAN) ?
+				Median(aiPeriods, iNumPeriods) :
+				Mean(aiPeriods, iNumPeriods);
+		}
+
+		// Same as before: drop straight to the time since the last pulse if
+		// that is already longer than the estimate.
+		uint32_t iSinceLastMicro = iNowMicro - m_iLastPulseMicro;
+		if(iSinceLastMicro > m_iPeriodMicro)
+		{
+			return iSinceLastMicro;
+		}
+		return m_iPeriodMicro;
+	}
+
+	uint32_t GetPeriodMicro() const
+	{
+		return m_iPeriodMicro;
+	}
+
+	// Number of periods used by the last Update() (at most MAX_PERIODS)
+	int GetNumPeriods() const
+	{
+		return m_iNumPeriods;
+	}
+
+	static uint32_t Mean(const uint32_t aiPeriods[], int iNum)
+	{
+		uint32_t iSum = 0;
+		for(int i = 0; i < iNum; ++i)
+		{
+			iSum += aiPeriods[i];
+		}
+		return iSum / iNum;
+	}
+
+	// Sorts aiPeriods in place (insertion sort, there are only a few)
+	static uint32_t Median(uint32_t aiPeriods[], int iNum)
+	{
+		for(int i = 1; i < iNum; ++i)
+		{
+			uint32_t iVal = aiPeriods[i];
+			int j = i - 1;
+			while(j >= 0 && aiPeriods[j] > iVal)
+			{
+				aiPeriods[j+1] = aiPeriods[j];
+				--j;
+			}
+			aiPeriods[j+1] = iVal;
+		}
+		if(iNum & 1)
+		{
+			return aiPeriods[iNum / 2];
+		}
+		return (aiPeriods[iNum / 2 - 1] + aiPeriods[iNum / 2]) / 2;
+	}
+
+private:
+
+	Mode m_eMode;
+	uint32_t m_iMinPeriodMicro;
+	uint32_t m_iLastPulseMicro;
+	uint32_t m_iPeriodMicro;
+	int m_iNumPeriods;
+	bool m_bHavePulse;
+};
+
+#endif // EA_PULSE_RING_H
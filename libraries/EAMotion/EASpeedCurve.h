@@ -0,0 +1,238 @@
+/**
+ * File: EASpeedCurve.h
+ *
+ * Description: Fixed point versions of the speed math the sketches do every
+ * loop.  They used to do:
+ *
+ *   fSpeed = (1.0 / (iPeriodMicro / 1000000.0)) / 70.1666;
+ *   fRatio = (Clamp(fSpeed, fMinSpeed, fMaxSpeed) - fMinSpeed) / (fMaxSpeed - fMinSpeed);
+ *   ... smoothing ...
+ *   fDisplayRatio = pow(fSmoothedRatio, fInputExponent);
+ *
+ * which is two float divides and a pow() per frame.  On an AVR (or any board
+ * without an FPU) the pow() alone is a good part of a millisecond.  Here the
+ * ratios are Q16 (16.16 fixed point, 1.0 is Q16_ONE):
+ *
+ *   SpeedRatioMap  period -> speed ratio.  One integer divide for the
+ *                  speed and a multiply by a reciprocal of the range that is
+ *                  only worked out again when the min or max speed changes.
+ *   SpeedCurve     ratio -> ratio^exponent out of a table that is only built
+ *                  again when the exponent changes.
+ *
+ *   g_oSpeedRatioMap.SetRange(fMinSpeed, fMaxSpeed);
+ *   g_oSpeedCurve.SetExponent(fInputExponent);
+ *   q16_t iRatio = g_oSpeedRatioMap.GetRatio(GetLastPeriodMicro());
+ *   ... smoothing ...
+ *   q16_t iDisplayRatio = g_oSpeedCurve.Apply(iSmoothedRatio);
+ *
+ * The Set calls do nothing if the value didn't change, so they can go in the
+ * loop next to the code that uses them.
+ *
+ * pow() gets very steep near 0 for exponents below 1, so a table spaced
+ * evenly over [0, 1] is way off for small ratios.  SpeedCurve spaces its
+ * points evenly within each power of two instead (STEPS_PER_OCTAVE points
+ * between 1/2 and 1, as many between 1/4 and 1/2, and so on down to 2^-16)
+ * and interpolates between them.  With 16 steps that is 257 entries (514
+ * bytes).  A curve that only picks a frame count can get by with fewer
+ * steps.  Largest error against the float math, for every ratio:
+ *
+ *   SpeedCurve<16>   0.0024 for exponents 0 to 5, 0.00026 for 0 to 2
+ *   SpeedCurve<4>    0.004 for exponents 0 to 2
+ *   SpeedRatioMap    0.0015 for ranges at least 0.01 m/s wide
+ *
+ * test/host/TestSpeedCurve.cpp holds them to these.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_SPEED_CURVE_H
+#define EA_SPEED_CURVE_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Ratios in 16.16 fixed point
+typedef uint32_t q16_t;
+#define Q16_ONE 65536UL
+
+// Ratio in [0, 1] to Q16
+static inline q16_t FloatToQ16(float f)
+{
+	if(f <= 0.0)
+	{
+		return 0;
+	}
+	if(f >= 1.0)
+	{
+		return Q16_ONE;
+	}
+	return (q16_t)(f * Q16_ONE + 0.5);
+}
+
+static inline float Q16ToFloat(q16_t i)
+{
+	return i * (1.0 / Q16_ONE);
+}
+
+// Doppler frequency in Hz of a target moving at 1 m/s for the Parallax X-Band
+// sensor (2 * Ft / c, ignoring the angle)
+#define XBAND_HZ_PER_METER_PER_SEC 70.1666
+
+
+
+class SpeedRatioMap
+{
+public:
+
+	SpeedRatioMap(float fHzPerMeterPerSec = XBAND_HZ_PER_METER_PER_SEC) :
+		m_iSpeedPeriodQ16((uint32_t)(1000000.0 / fHzPerMeterPerSec * Q16_ONE)),
+		m_fMinSpeed(-1.0),
+		m_fMaxSpeed(-1.0),
+		m_iMinSpeedQ16(0),
+		m_iRangeQ16(0),
+		m_iRangeScale(0)
+	{
+	}
+
+	// Speeds in meters per second
+	void SetRange(float fMinSpeed, float fMaxSpeed)
+	{
+		if(fMinSpeed == m_fMinSpeed && fMaxSpeed == m_fMaxSpeed)
+		{
+			return;
+		}
+		m_fMinSpeed = fMinSpeed;
+		m_fMaxSpeed = fMaxSpeed;
+		m_iMinSpeedQ16 = fMinSpeed > 0.0 ? (uint32_t)(fMinSpeed * Q16_ONE + 0.5) : 0;
+		uint32_t iMaxSpeedQ16 = fMaxSpeed > 0.0 ? (uint32_t)(fMaxSpeed * Q16_ONE + 0.5) : 0;
+		m_iRangeQ16 = iMaxSpeedQ16 > m_iMinSpeedQ16 ? iMaxSpeedQ16 - m_iMinSpeedQ16 : 0;
+
+		// (iOver * m_iRangeScale) >> 16 is iOver / m_iRangeQ16 in Q16.  This
+		// can't overflow since iOver is always less than m_iRangeQ16.
+		m_iRangeScale = m_iRangeQ16 > 0 ? 0xFFFFFFFFUL / m_iRangeQ16 : 0;
+	}
+
+	// Speed in meters per second (Q16) for a pulse period
+	uint32_t GetSpeedQ16(unsigned long iPeriodMicro) const
+	{
+		return iPeriodMicro > 0 ? m_iSpeedPeriodQ16 / iPeriodMicro : 0xFFFFFFFFUL;
+	}
+
+	// Speed ratio for a pulse period.  0 at or below the min speed and
+	// Q16_ONE at or above the max speed.
+	q16_t GetRatio(unsigned long iPeriodMicro) const
+	{
+		uint32_t iSpeedQ16 = GetSpeedQ16(iPeriodMicro);
+		if(iSpeedQ16 <= m_iMinSpeedQ16)
+		{
+			return 0;
+		}
+		uint32_t iOver = iSpeedQ16 - m_iMinSpeedQ16;
+		if(iOver >= m_iRangeQ16)
+		{
+			return Q16_ONE;
+		}
+		return (iOver * m_iRangeScale) >> 16;
+	}
+
+private:
+
+	uint32_t m_iSpeedPeriodQ16;
+	float m_fMinSpeed;
+	float m_fMaxSpeed;
+	uint32_t m_iMinSpeedQ16;
+	uint32_t m_iRangeQ16;
+	uint32_t m_iRangeScale;
+};
+
+
+
+// STEPS_PER_OCTAVE has to be a power of two.  The exponent can't be negative.
+template<int STEPS_PER_OCTAVE = 16>
+class SpeedCurve
+{
+public:
+
+	static const int NUM_OCTAVES = 16;
+	static const int NUM_POINTS = NUM_OCTAVES * STEPS_PER_OCTAVE + 1;
+
+	SpeedCurve() :
+		m_fExponent(-1.0)
+	{
+		// Work out how many bits pick the step within an octave
+		m_iStepBits = 0;
+		while((1 << m_iStepBits) < STEPS_PER_OCTAVE)
+		{
+			m_iStepBits++;
+		}
+		SetExponent(1.0);
+	}
+
+	// Rebuild the table if the exponent changed
+	void SetExponent(float fExponent)
+	{
+		if(fExponent == m_fExponent)
+		{
+			return;
+		}
+		m_fExponent = fExponent;
+
+		// Point i is at (1 + step / STEPS_PER_OCTAVE) * 2^(octave - 16).  The
+		// last one is 1.0, which is stored as the largest value that fits.
+		for(int i = 0; i < NUM_POINTS; ++i)
+		{
+			int iOctave = i / STEPS_PER_OCTAVE;
+			int iStep = i % STEPS_PER_OCTAVE;
+			float fRatio = ldexp(1.0 + (float)iStep / STEPS_PER_OCTAVE, iOctave - NUM_OCTAVES);
+			float fValue = pow(fRatio, fExponent) * Q16_ONE + 0.5;
+			m_aiPoints[i] = fValue < 65535.0 ? (uint16_t)fValue : 65535;
+		}
+		m_iAtZero = fExponent == 0.0 ? Q16_ONE : 0;
+	}
+
+	float GetExponent() const
+	{
+		return m_fExponent;
+	}
+
+	// iRatio^exponent
+	q16_t Apply(q16_t iRatio) const
+	{
+		if(iRatio >= Q16_ONE)
+		{
+			return Q16_ONE;
+		}
+		if(iRatio == 0)
+		{
+			return m_iAtZero;
+		}
+
+		// Shift the top bit up to bit 15.  The bits under it pick the step and
+		// the rest are how far it is to the next point.
+		int iOctave = 15;
+		uint16_t iMantissa = iRatio;
+		while(!(iMantissa & 0x8000))
+		{
+			iMantissa <<= 1;
+			iOctave--;
+		}
+		int iFracBits = 15 - m_iStepBits;
+		int iIndex = iOctave * STEPS_PER_OCTAVE + ((iMantissa >> iFracBits) & (STEPS_PER_OCTAVE - 1));
+		uint32_t iFrac = iMantissa & ((1U << iFracBits) - 1);
+
+		uint32_t iLow = m_aiPoints[iIndex];
+		uint32_t iHigh = m_aiPoints[iIndex + 1];
+
+		// The curve never goes down since the exponent isn't negative
+		return iLow + (((iHigh - iLow) * iFrac) >> iFracBits);
+	}
+
+private:
+
+	float m_fExponent;
+	int m_iStepBits;
+	q16_t m_iAtZero;
+	uint16_t m_aiPoints[NUM_POINTS];
+};
+
+#endif // EA_SPEED_CURVE_H
@@ -0,0 +1,96 @@
+/**
+ * File: EASpeedSmoother.h
+ *
+ * Description: Frame rate independent smoothing for the motion speed ratio.
+ *
+ * The sketches used to smooth the speed with a plain per loop EMA:
+ *
+ *   fSmoothed = fNew * fNewWeight + fSmoothed * (1.0 - fNewWeight);
+ *
+ * which only behaves the same if every loop takes the same amount of time,
+ * so the LED code padded each frame out with delays.  This does the same
+ * thing based on the measured delta time instead.  fNewWeight keeps its old
+ * meaning (the weight given to a new value over one reference frame) so the
+ * existing tuning values and the PC tuner still work.  Over a delta time of
+ * dt the weight becomes:
+ *
+ *   1 - (1 - fNewWeight)^(dt / RefFrame)
+ *
+ * which is the same as running the old EMA dt / RefFrame times.
+ * test/host/TestSpeedSmoother.cpp checks that the same pulse timeline gives
+ * the same curve at different loop rates.
+ */
+
+#ifndef EA_SPEED_SMOOTHER_H
+#define EA_SPEED_SMOOTHER_H
+
+#ifdef ARDUINO
+ #include <Arduino.h>
+#else
+ #include <math.h>
+#endif
+
+class SpeedSmoother
+{
+public:
+
+	// fRefFrameMS is the loop time the fNewWeight tuning values were made for
+	SpeedSmoother(float fRefFrameMS) :
+		m_fRefFrameMicro(fRefFrameMS * 1000.0),
+		m_fValue(0.0),
+		m_bHasValue(false),
+		m_fNewWeight(-1.0),
+		m_fLogKeep(0.0)
+	{
+	}
+
+	// Add a new value that came in iDeltaTimeMicro after the last one and
+	// return the smoothed value.  The first value is taken as is, and so is
+	// every value with a weight of 1 or more.  No time at all keeps the old
+	// value.
+	float Update(float fNewValue, float fNewWeight, unsigned long iDeltaTimeMicro)
+	{
+		if(!m_bHasValue || fNewWeight >= 1.0)
+		{
+			m_fValue = fNewValue;
+			m_bHasValue = true;
+			return m_fValue;
+		}
+		if(iDeltaTimeMicro == 0)
+		{
+			return m_fValue;
+		}
+
+		// Only redo the log when the tuning changes
+		if(fNewWeight != m_fNewWeight)
+		{
+			m_fNewWeight = fNewWeight;
+			m_fLogKeep = log(1.0 - fNewWeight);
+		}
+
+		float fWeight = 1.0 - exp(m_fLogKeep * (iDeltaTimeMicro / m_fRefFrameMicro));
+		m_fValue = fNewValue * fWeight + m_fValue * (1.0 - fWeight);
+		return m_fValue;
+	}
+
+	float Get() const
+	{
+		return m_fValue;
+	}
+
+	// Forget the history so the next value is taken as is
+	void Reset()
+	{
+		m_bHasValue = false;
+	}
+
+private:
+
+	float m_fRefFrameMicro;
+	float m_fValue;
+	bool m_bHasValue;
+	float m_fNewWeight;
+	float m_fLogKeep; // log(1 - m_fNewWeight)
+};
+
+#endif // EA_SPEED_SMOOTHER_H
@@ -0,0 +1,267 @@
+/**
+ * File: EANodeFrame.h
+ *
+ * Description: Frames sent on the RS-485 node bus.  The bus used to carry
+ * single bytes with the sender in the top 3 bits and the motion in the low
+ * 5, and the tuning push was a START_RCV_BYTE / END_RCV_BYTE wrapped blob.
+ * Motion only had 31 steps and the start byte was also node 7 sending a
+ * motion of 16.
+ *
+ * Now everything is a frame:
+ *
+ *   raw:   version << 4 | type,  sender,  sequence,  payload...,  crc8
+ *   wire:  COBS(raw)  0x00
+ *
+ * COBS (see EATuningLink.h) removes every 0x00 so the 0x00 at the end
+ * always marks the end of a frame, whatever the payload holds.  The CRC is
+ * CRC-8 (poly 0x07) over everything before it.  The sequence counts up for
+ * every frame a sender sends so lost frames can be counted.  Multi-byte
+ * values are little endian.
+ *
+ *   NODE_FRAME_MOTION  (node to all)   u16 motion 0-NODE_MOTION_MAX, u16 time (millis() & 0xFFFF)
+ *   NODE_FRAME_BEACON  (PC to all)     u8 round 1-TDMA_NUM_ROUND_IDS (see EATdmaScheduler.h)
+ *   NODE_FRAME_TUNING  (PC to all)     u8 count, then for each node:
+ *                                      u16 min speed, u16 max speed, u16 new speed weight, u16 input exponent
+ *                                      (same 16 bit scaling as the old tuning message)
+ *
+ * The PC side of this is in EaMidi/EaMidiPC/EaMidiPC.pde.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_NODE_FRAME_H
+#define EA_NODE_FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include <EATuningLink.h> // CobsEncode() and CobsDecode()
+
+// Bump this if the layout of the frames changes.  Frames with a different
+// version are dropped.
+#define NODE_FRAME_VERSION 1
+
+#define NODE_FRAME_MOTION 1
+#define NODE_FRAME_BEACON 2
+#define NODE_FRAME_TUNING 3
+
+// Motion is 12 bits
+#define NODE_MOTION_MAX 4095
+
+// Number of tuning values for each node in a TUNING frame
+#define NODE_NUM_TUNING_VARS 4
+
+// Largest payload: a TUNING frame for 7 nodes
+#define NODE_FRAME_MAX_PAYLOAD (1 + 7 * NODE_NUM_TUNING_VARS * 2)
+
+// Largest raw frame and largest frame on the wire (one COBS overhead byte
+// and the delimiter)
+#define NODE_FRAME_MAX_RAW (3 + NODE_FRAME_MAX_PAYLOAD + 1)
+#define NODE_FRAME_MAX_WIRE (NODE_FRAME_MAX_RAW + 2)
+
+// Bytes on the wire for a MOTION and a BEACON frame.  COBS adds one byte to
+// frames this short.
+#define NODE_MOTION_FRAME_BYTES (3 + 4 + 1 + 2)
+#define NODE_BEACON_FRAME_BYTES (3 + 1 + 1 + 2)
+
+
+
+// CRC-8 (poly 0x07, start 0)
+inline uint8_t NodeCrc8(const uint8_t *pData, int iLength)
+{
+	uint8_t yCrc = 0;
+	for(int i = 0; i < iLength; ++i)
+	{
+		yCrc ^= pData[i];
+		for(int j = 0; j < 8; ++j)
+		{
+			yCrc = (yCrc & 0x80) ? (yCrc << 1) ^ 0x07 : (yCrc << 1);
+		}
+	}
+	return yCrc;
+}
+
+
+
+// A frame being built or one that was just read
+class NodeFrame
+{
+public:
+
+	NodeFrame() :
+		m_yType(0),
+		m_ySender(0),
+		m_ySequence(0),
+		m_iLength(0),
+		m_iReadPos(0)
+	{
+	}
+
+	void Begin(uint8_t yType, uint8_t ySender, uint8_t ySequence)
+	{
+		m_yType = yType;
+		m_ySender = ySender;
+		m_ySequence = ySequence;
+		m_iLength = 0;
+		m_iReadPos = 0;
+	}
+
+	// The Put functions return false (and add nothing) if the value won't fit
+
+	bool PutByte(uint8_t yValue)
+	{
+		if(m_iLength + 1 > NODE_FRAME_MAX_PAYLOAD)
+		{
+			return false;
+		}
+		m_ayPayload[m_iLength++] = yValue;
+		return true;
+	}
+
+	bool PutWord(uint16_t iValue)
+	{
+		if(m_iLength + 2 > NODE_FRAME_MAX_PAYLOAD)
+		{
+			return false;
+		}
+		m_ayPayload[m_iLength++] = iValue & 0xFF;
+		m_ayPayload[m_iLength++] = iValue >> 8;
+		return true;
+	}
+
+	// The Get functions read the payload in order and return false once it
+	// runs out
+
+	bool GetByte(uint8_t &yValue)
+	{
+		if(m_iReadPos + 1 > m_iLength)
+		{
+			return false;
+		}
+		yValue = m_ayPayload[m_iReadPos++];
+		return true;
+	}
+
+	bool GetWord(uint16_t &iValue)
+	{
+		if(m_iReadPos + 2 > m_iLength)
+		{
+			return false;
+		}
+		iValue = m_ayPayload[m_iReadPos] | ((uint16_t)m_ayPayload[m_iReadPos + 1] << 8);
+		m_iReadPos += 2;
+		return true;
+	}
+
+	// Encode into a frame ready to write out (ending in the 0x00 delimiter).
+	// ayWire needs NODE_FRAME_MAX_WIRE bytes.  Returns the length.
+	int Encode(uint8_t ayWire[]) const
+	{
+		uint8_t ayRaw[NODE_FRAME_MAX_RAW];
+		ayRaw[0] = (NODE_FRAME_VERSION << 4) | m_yType;
+		ayRaw[1] = m_ySender;
+		ayRaw[2] = m_ySequence;
+		memcpy(ayRaw + 3, m_ayPayload, m_iLength);
+		ayRaw[3 + m_iLength] = NodeCrc8(ayRaw, 3 + m_iLength);
+
+		int iLength = CobsEncode(ayRaw, 4 + m_iLength, ayWire);
+		ayWire[iLength++] = 0;
+		return iLength;
+	}
+
+	// Decode a frame without its delimiter.  Returns false if it is bad or
+	// from a different version.
+	bool Decode(uint8_t ayWire[], int iWireLength)
+	{
+		int iLength = CobsDecode(ayWire, iWireLength, ayWire);
+		if(iLength < 4 || iLength > NODE_FRAME_MAX_RAW)
+		{
+			return false;
+		}
+		if(NodeCrc8(ayWire, iLength - 1) != ayWire[iLength - 1])
+		{
+			return false;
+		}
+		if((ayWire[0] >> 4) != NODE_FRAME_VERSION)
+		{
+			return false;
+		}
+		m_yType = ayWire[0] & 0x0F;
+		m_ySender = ayWire[1];
+		m_ySequence = ayWire[2];
+		m_iLength = iLength - 4;
+		memcpy(m_ayPayload, ayWire + 3, m_iLength);
+		m_iReadPos = 0;
+		return true;
+	}
+
+	uint8_t m_yType;
+	uint8_t m_ySender;
+	uint8_t m_ySequence;
+	uint8_t m_ayPayload[NODE_FRAME_MAX_PAYLOAD];
+	int m_iLength;
+
+private:
+
+	int m_iReadPos;
+};
+
+
+
+// Collects bus bytes one at a time and hands back each good frame.  It never
+// waits for more bytes so loop() can call it with whatever has arrived.  Bad
+// or too long frames are dropped and counted.
+class NodeFrameReader
+{
+public:
+
+	NodeFrameReader() :
+		m_iLength(0),
+		m_bOverflow(false),
+		m_iBadFrames(0)
+	{
+	}
+
+	// Returns true when yByte finished a good frame, which is put in oFrame
+	bool Feed(uint8_t yByte, NodeFrame &oFrame)
+	{
+		if(yByte != 0)
+		{
+			if(m_iLength < (int)sizeof(m_ayWire))
+			{
+				m_ayWire[m_iLength++] = yByte;
+			}
+			else
+			{
+				m_bOverflow = true;
+			}
+			return false;
+		}
+
+		bool bGood = false;
+		if(m_iLength > 0)
+		{
+			bGood = !m_bOverflow && oFrame.Decode(m_ayWire, m_iLength);
+			if(!bGood)
+			{
+				m_iBadFrames++;
+			}
+		}
+		m_iLength = 0;
+		m_bOverflow = false;
+		return bGood;
+	}
+
+	unsigned int GetBadFrames() const
+	{
+		return m_iBadFrames;
+	}
+
+private:
+
+	uint8_t m_ayWire[NODE_FRAME_MAX_WIRE];
+	int m_iLength;
+	bool m_bOverflow;
+	unsigned int m_iBadFrames;
+};
+
+#endif // EA_NODE_FRAME_H
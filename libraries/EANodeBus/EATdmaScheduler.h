@@ -0,0 +1,294 @@
+/**
+ * File: EATdmaScheduler.h
+ *
+ * Description: Time slotted turn taking for the nodes on the shared RS-485
+ * bus.  It replaces passing the turn along on every received byte with a
+ * 30 ms timeout (70 ms for the PC), where every missing node added 30 ms of
+ * dead air to each round.
+ *
+ * A round looks like this:
+ *
+ *   | beacon | slot | slot | ... | slot | join slot | PC slot ... | beacon |
+ *
+ * The PC starts every round with a beacon frame.  Each node that is present
+ * gets one fixed slot after the beacon, in node index order.  A node is
+ * present once it has been heard, and stops being present after it is
+ * missing for TDMA_MISSES_TO_DROP rounds in a row, so the slots of absent
+ * nodes shrink away and the round gets shorter.  Absent nodes (and nodes
+ * that just powered on) get back in through the join slot.  Only one node
+ * may use it each round, picked by the round number in the beacon, so
+ * joining can't collide either.  A node that just started listens for
+ * TDMA_MISSES_TO_DROP rounds before it sends anything so it agrees with the
+ * others about who is present.  The same happens after going
+ * TDMA_BEACON_TIMEOUT_MICRO without a beacon.
+ *
+ * Every node (and the PC) works out the same schedule from what it hears on
+ * the bus, so nothing else has to be sent.  The round is at most
+ * (NUM_NODES + 1) slots plus the PC slot, no matter how many nodes are
+ * missing.
+ *
+ * The slot is the time to send one MOTION frame at the baud rate plus a
+ * guard time.  The beacon can only be time stamped when the node gets
+ * around to reading it (less a byte time for each byte already waiting
+ * behind it), and the node only sends when it polls, so the guard has to
+ * cover both: a node only starts sending in the first half of its guard
+ * time, and it has to read the bus and poll at least that often.  So the
+ * guard has to be at least twice the longest time a node goes without
+ * looking at the bus.  If it is late it skips the round rather than
+ * collide.  test/host/TestTdmaBus.cpp runs 7 nodes and the PC on a
+ * simulated bus.
+ *
+ * The beacon and the node data are frames (EANodeFrame.h).  The beacon
+ * carries the round number, 1 to TDMA_NUM_ROUND_IDS.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_TDMA_SCHEDULER_H
+#define EA_TDMA_SCHEDULER_H
+
+#include <stdint.h>
+
+// Rounds a node can be missing before its slot is taken away
+#define TDMA_MISSES_TO_DROP 3
+
+// Beacon round numbers count 1 to TDMA_NUM_ROUND_IDS
+#define TDMA_NUM_ROUND_IDS 15
+
+// Most nodes the masks can hold
+#define TDMA_MAX_NODES 7
+
+// With no beacon for this long (PC gone, cable pulled) everything heard so
+// far is forgotten and the node listens again before it sends
+#define TDMA_BEACON_TIMEOUT_MICRO 500000UL
+
+class TdmaScheduler
+{
+public:
+
+	// iNodeIndex is this node (iNumNodes for the PC).  iSlotBytes is the
+	// length of what each node sends in its slot.
+	TdmaScheduler(int iNodeIndex, int iNumNodes, unsigned long iBaudRate, int iSlotBytes, unsigned long iGuardMicro) :
+		m_iNodeIndex(iNodeIndex),
+		m_iNumNodes(iNumNodes),
+		m_iSlotMicro(ByteTimeMicro(iBaudRate) * iSlotBytes + iGuardMicro),
+		m_iSendWindowMicro(iGuardMicro / 2)
+	{
+		Reset();
+	}
+
+	// Forget everything heard so far (like at power on)
+	void Reset()
+	{
+		m_yPresentMask = 0;
+		m_yHeardMask = 0;
+		for(int i = 0; i < TDMA_MAX_NODES; ++i)
+		{
+			m_ayMisses[i] = 0;
+		}
+		m_iBeaconMicro = 0;
+		m_yRound = 0;
+		m_iRoundsHeard = 0;
+		m_bHaveBeacon = false;
+		m_bSentThisRound = false;
+	}
+
+	// The node index usually isn't known until setup() reads it from EEPROM
+	void SetNodeIndex(int iNodeIndex)
+	{
+		m_iNodeIndex = iNodeIndex;
+	}
+
+	// Time for one byte: start bit, 8 data bits, stop bit
+	static unsigned long ByteTimeMicro(unsigned long iBaudRate)
+	{
+		return (10 * 1000000UL + iBaudRate - 1) / iBaudRate;
+	}
+
+	// Round number for the next beacon (PC only).  The PC passes its own
+	// beacon to OnBeacon() too.
+	uint8_t GetNextRound() const
+	{
+		return (m_yRound % TDMA_NUM_ROUND_IDS) + 1;
+	}
+
+	// Call when a beacon frame is read from the bus
+	void OnBeacon(uint8_t yRound, unsigned long iNowMicro)
+	{
+		if(yRound < 1 || yRound > TDMA_NUM_ROUND_IDS)
+		{
+			return;
+		}
+		if(m_bHaveBeacon && iNowMicro - m_iBeaconMicro > TDMA_BEACON_TIMEOUT_MICRO)
+		{
+			Reset();
+		}
+		StartRound(yRound, iNowMicro);
+	}
+
+	// Call when a frame from a node is read from the bus (including our own
+	// if the transceiver echoes them)
+	void OnNodeFrame(int iSender)
+	{
+		if(iSender >= 0 && iSender < m_iNumNodes)
+		{
+			m_yHeardMask |= 1 << iSender;
+		}
+	}
+
+	// Call often.  Returns true once per round when this node should send
+	// its frame right now.
+	bool ShouldSend(unsigned long iNowMicro)
+	{
+		if(!m_bHaveBeacon || m_bSentThisRound || m_iNodeIndex >= m_iNumNodes)
+		{
+			return false;
+		}
+
+		unsigned long iIntoRoundMicro = iNowMicro - m_iBeaconMicro;
+		if(iIntoRoundMicro > TDMA_BEACON_TIMEOUT_MICRO)
+		{
+			Reset();
+			return false;
+		}
+
+		// Learn who is present before talking
+		if(m_iRoundsHeard < TDMA_MISSES_TO_DROP)
+		{
+			return false;
+		}
+
+		int iSlot;
+		if(IsPresent(m_iNodeIndex))
+		{
+			iSlot = GetSlotIndex(m_iNodeIndex);
+		}
+		else if(m_yRound % m_iNumNodes == m_iNodeIndex)
+		{
+			iSlot = GetNumPresent();
+		}
+		else
+		{
+			return false;
+		}
+
+		unsigned long iSlotStartMicro = (unsigned long)iSlot * m_iSlotMicro;
+		if(iIntoRoundMicro < iSlotStartMicro)
+		{
+			return false;
+		}
+
+		// Only one chance per round.  If we are too late for the slot, skip it.
+		m_bSentThisRound = true;
+		if(iIntoRoundMicro - iSlotStartMicro > m_iSendWindowMicro)
+		{
+			return false;
+		}
+		m_yHeardMask |= 1 << m_iNodeIndex;
+		return true;
+	}
+
+	// True once all the node slots and the join slot of this round are over
+	// and it is the PC's turn.  Before the first beacon it is always the PC's
+	// turn.
+	bool IsPCTurn(unsigned long iNowMicro) const
+	{
+		if(!m_bHaveBeacon)
+		{
+			return true;
+		}
+		return iNowMicro - m_iBeaconMicro >= GetRoundMicro();
+	}
+
+	// Length of the node part of the current round (present slots and the
+	// join slot)
+	unsigned long GetRoundMicro() const
+	{
+		return (unsigned long)(GetNumPresent() + 1) * m_iSlotMicro;
+	}
+
+	unsigned long GetSlotMicro() const
+	{
+		return m_iSlotMicro;
+	}
+
+	bool IsPresent(int iNode) const
+	{
+		return (m_yPresentMask >> iNode) & 1;
+	}
+
+	uint8_t GetPresentMask() const
+	{
+		return m_yPresentMask;
+	}
+
+	int GetNumPresent() const
+	{
+		int iNum = 0;
+		for(int i = 0; i < m_iNumNodes; ++i)
+		{
+			iNum += IsPresent(i);
+		}
+		return iNum;
+	}
+
+	// Position of a present node among the present nodes
+	int GetSlotIndex(int iNode) const
+	{
+		int iSlot = 0;
+		for(int i = 0; i < iNode; ++i)
+		{
+			iSlot += IsPresent(i);
+		}
+		return iSlot;
+	}
+
+private:
+
+	void StartRound(uint8_t yRound, unsigned long iNowMicro)
+	{
+		// Close out the last round
+		if(m_bHaveBeacon)
+		{
+			for(int i = 0; i < m_iNumNodes; ++i)
+			{
+				if((m_yHeardMask >> i) & 1)
+				{
+					m_ayMisses[i] = 0;
+					m_yPresentMask |= 1 << i;
+				}
+				else if(IsPresent(i) && ++m_ayMisses[i] >= TDMA_MISSES_TO_DROP)
+				{
+					m_yPresentMask &= ~(1 << i);
+				}
+			}
+			if(m_iRoundsHeard < TDMA_MISSES_TO_DROP)
+			{
+				m_iRoundsHeard++;
+			}
+		}
+
+		m_yHeardMask = 0;
+		m_iBeaconMicro = iNowMicro;
+		m_yRound = yRound;
+		m_bHaveBeacon = true;
+		m_bSentThisRound = false;
+	}
+
+	int m_iNodeIndex;
+	int m_iNumNodes;
+	unsigned long m_iSlotMicro;
+	unsigned long m_iSendWindowMicro;
+
+	uint8_t m_yPresentMask;
+	uint8_t m_yHeardMask;
+	uint8_t m_ayMisses[TDMA_MAX_NODES];
+
+	unsigned long m_iBeaconMicro;
+	uint8_t m_yRound;
+	int m_iRoundsHeard;
+	bool m_bHaveBeacon;
+	bool m_bSentThisRound;
+};
+
+#endif // EA_TDMA_SCHEDULER_H
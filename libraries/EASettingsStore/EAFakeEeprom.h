@@ -0,0 +1,100 @@
+/**
+ * File: EAFakeEeprom.h
+ *
+ * Description: EEPROM in RAM for trying out SettingsStore (EASettingsStore.h)
+ * on a PC.  It starts out erased (all 0xFF) like a new chip, counts the
+ * writes to each byte so wear can be checked, and can stop taking writes
+ * part way through to act like the power going out during a save.
+ */
+
+#ifndef EA_FAKE_EEPROM_H
+#define EA_FAKE_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+template<int SIZE>
+class FakeEeprom
+{
+public:
+
+	FakeEeprom()
+	{
+		Erase();
+	}
+
+	// Same names as the Arduino EEPROM object
+
+	uint8_t read(int iAddr) const
+	{
+		return m_ayData[iAddr];
+	}
+
+	void write(int iAddr, uint8_t yValue)
+	{
+		if(m_iWritesLeft == 0)
+		{
+			return;
+		}
+		if(m_iWritesLeft > 0)
+		{
+			m_iWritesLeft--;
+		}
+		m_ayData[iAddr] = yValue;
+		m_aiWrites[iAddr]++;
+		m_iTotalWrites++;
+	}
+
+	int length() const
+	{
+		return SIZE;
+	}
+
+	// Back to all 0xFF with no writes counted
+	void Erase()
+	{
+		memset(m_ayData, 0xFF, sizeof(m_ayData));
+		memset(m_aiWrites, 0, sizeof(m_aiWrites));
+		m_iTotalWrites = 0;
+		m_iWritesLeft = -1;
+	}
+
+	// Ignore every write after the next iNumWrites.  -1 takes them all again.
+	void FailAfter(long iNumWrites)
+	{
+		m_iWritesLeft = iNumWrites;
+	}
+
+	unsigned long GetWrites(int iAddr) const
+	{
+		return m_aiWrites[iAddr];
+	}
+
+	unsigned long GetTotalWrites() const
+	{
+		return m_iTotalWrites;
+	}
+
+	// Most writes any one byte has taken
+	unsigned long GetMaxWrites() const
+	{
+		unsigned long iMax = 0;
+		for(int i = 0; i < SIZE; ++i)
+		{
+			if(m_aiWrites[i] > iMax)
+			{
+				iMax = m_aiWrites[i];
+			}
+		}
+		return iMax;
+	}
+
+private:
+
+	uint8_t m_ayData[SIZE];
+	unsigned long m_aiWrites[SIZE];
+	unsigned long m_iTotalWrites;
+	long m_iWritesLeft;
+};
+
+#endif // EA_FAKE_EEPROM_H
@@ -0,0 +1,289 @@
+/**
+ * File: EASettingsStore.h
+ *
+ * Description: Saves a settings struct to EEPROM.  The sketches used to
+ * write each setting to its own hand picked address with a version byte in
+ * front, so a reset half way through a save left a mix of old and new
+ * values marked as good, and the same few cells took every write.
+ *
+ * The store splits an area of the EEPROM into slots, each holding a whole
+ * copy of the record:
+ *
+ *   slot:  sequence (u16),  schema version,  record...,  crc16 (u16)
+ *
+ * The CRC is CRC-16/CCITT-FALSE (see EATuningLink.h) over everything before
+ * it.  Each commit goes into the slot after the current one, so the current
+ * copy is never touched while the new one is written (with 2 slots this is
+ * plain A/B) and the writes move around the whole area.  The sequence is
+ * written last so the new copy only wins once everything else is in place.
+ * Only bytes that differ from what is already in the slot are written, and
+ * a commit of the record that is already saved writes nothing.
+ *
+ * Load() reads the header of every slot and then the whole slot of the
+ * newest one.  If its CRC is bad it falls back to the next newest.
+ *
+ *   struct NodeSettings { uint16_t iMinSpeed; ... };
+ *   SettingsStore<NodeSettings, EEPROMClass> g_oStore(EEPROM, 32, 128, 1);
+ *
+ *   if(!g_oStore.Load(oSettings)) { ... use defaults ... }
+ *   g_oStore.Commit(oSettings);         // Writes it all now
+ *   g_oStore.BeginCommit(oSettings);    // Or a byte per g_oStore.Update()
+ *
+ * STORAGE is anything with read(iAddr) and write(iAddr, yValue), like the
+ * Arduino EEPROM object or FakeEeprom (EAFakeEeprom.h) on a PC.  The record
+ * is saved as its raw bytes, so fill it with memset() before setting the
+ * members or padding can make it look changed.  Change the schema version
+ * whenever the record changes.  0xFF is what erased EEPROM reads back as, so
+ * don't use it as a version.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_SETTINGS_STORE_H
+#define EA_SETTINGS_STORE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <EATuningLink.h> // TuningCrc16()
+
+// Slot bytes on top of the record: sequence, schema version and CRC
+#define SETTINGS_SLOT_OVERHEAD 5
+
+// Most slots an area can be split into
+#define SETTINGS_MAX_SLOTS 32
+
+template<class RECORD, class STORAGE>
+class SettingsStore
+{
+public:
+
+	static const int SLOT_BYTES = sizeof(RECORD) + SETTINGS_SLOT_OVERHEAD;
+
+	// Uses iAreaBytes of the EEPROM starting at iBaseAddr.  It needs room for
+	// at least 2 slots, with less GetNumSlots() is 0 and every Load() and
+	// Commit() fails.
+	SettingsStore(STORAGE &oStorage, int iBaseAddr, int iAreaBytes, uint8_t ySchemaVersion) :
+		m_oStorage(oStorage),
+		m_iBaseAddr(iBaseAddr),
+		m_iNumSlots(iAreaBytes / SLOT_BYTES),
+		m_ySchemaVersion(ySchemaVersion),
+		m_iSlot(-1),
+		m_iSequence(0),
+		m_bHaveRecord(false),
+		m_iTargetSlot(0),
+		m_iWritePos(SLOT_BYTES),
+		m_bCommitting(false),
+		m_iNumWrites(0)
+	{
+		if(m_iNumSlots > SETTINGS_MAX_SLOTS)
+		{
+			m_iNumSlots = SETTINGS_MAX_SLOTS;
+		}
+		else if(m_iNumSlots < 2)
+		{
+			m_iNumSlots = 0;
+		}
+	}
+
+	// Read the newest good copy into oRecord.  Returns false (and leaves
+	// oRecord alone) if there isn't one.
+	bool Load(RECORD &oRecord)
+	{
+		m_iWritePos = SLOT_BYTES;
+		m_bCommitting = false;
+		m_bHaveRecord = false;
+		m_iSlot = m_iNumSlots - 1;
+		m_iSequence = 0;
+
+		uint16_t aiSequence[SETTINGS_MAX_SLOTS];
+		uint32_t iCandidates = 0;
+		for(int i = 0; i < m_iNumSlots; ++i)
+		{
+			int iAddr = SlotAddr(i);
+			aiSequence[i] = m_oStorage.read(iAddr) | ((uint16_t)m_oStorage.read(iAddr + 1) << 8);
+			if(m_oStorage.read(iAddr + 2) == m_ySchemaVersion)
+			{
+				iCandidates |= (uint32_t)1 << i;
+			}
+		}
+
+		while(iCandidates != 0)
+		{
+			int iNewest = -1;
+			for(int i = 0; i < m_iNumSlots; ++i)
+			{
+				if(((iCandidates >> i) & 1) &&
+				   (iNewest < 0 || IsNewer(aiSequence[i], aiSequence[iNewest])))
+				{
+					iNewest = i;
+				}
+			}
+			iCandidates &= ~((uint32_t)1 << iNewest);
+
+			uint8_t aySlot[SLOT_BYTES];
+			ReadSlot(iNewest, aySlot);
+			if(SlotCrc(aySlot) == (aySlot[SLOT_BYTES - 2] | ((uint16_t)aySlot[SLOT_BYTES - 1] << 8)))
+			{
+				memcpy(&m_oRecord, aySlot + 3, sizeof(RECORD));
+				memcpy(&oRecord, aySlot + 3, sizeof(RECORD));
+				m_iSlot = iNewest;
+				m_iSequence = aiSequence[iNewest];
+				m_bHaveRecord = true;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Save oRecord right away.  Returns false if it was already saved or
+	// there is no room for it.
+	bool Commit(const RECORD &oRecord)
+	{
+		if(!BeginCommit(oRecord))
+		{
+			return false;
+		}
+		while(Update())
+		{
+		}
+		return true;
+	}
+
+	// Start saving oRecord.  Update() then writes it a byte at a time.  A
+	// commit that is still going is replaced.  Returns false if oRecord was
+	// already saved or there is no room for it.
+	bool BeginCommit(const RECORD &oRecord)
+	{
+		if(m_iNumSlots == 0)
+		{
+			return false;
+		}
+		if(m_bHaveRecord && memcmp(&oRecord, &m_oRecord, sizeof(RECORD)) == 0)
+		{
+			m_iWritePos = SLOT_BYTES;
+			m_bCommitting = false;
+			return false;
+		}
+
+		m_iTargetSlot = (m_iSlot + 1) % m_iNumSlots;
+		uint16_t iSequence = m_iSequence + 1;
+		m_aySlot[0] = iSequence & 0xFF;
+		m_aySlot[1] = iSequence >> 8;
+		m_aySlot[2] = m_ySchemaVersion;
+		memcpy(m_aySlot + 3, &oRecord, sizeof(RECORD));
+		uint16_t iCrc = SlotCrc(m_aySlot);
+		m_aySlot[SLOT_BYTES - 2] = iCrc & 0xFF;
+		m_aySlot[SLOT_BYTES - 1] = iCrc >> 8;
+		m_iWritePos = 0;
+		m_bCommitting = true;
+		return true;
+	}
+
+	// Write at most one changed byte of the commit in progress.  Returns true
+	// while there is more to do.
+	bool Update()
+	{
+		int iTargetAddr = SlotAddr(m_iTargetSlot);
+		while(m_iWritePos < SLOT_BYTES)
+		{
+			// Everything after the sequence first, then the sequence
+			int iOffset = (m_iWritePos + 2) % SLOT_BYTES;
+			m_iWritePos++;
+			if(m_oStorage.read(iTargetAddr + iOffset) != m_aySlot[iOffset])
+			{
+				m_oStorage.write(iTargetAddr + iOffset, m_aySlot[iOffset]);
+				m_iNumWrites++;
+				break;
+			}
+		}
+
+		if(m_iWritePos < SLOT_BYTES)
+		{
+			return true;
+		}
+		if(m_bCommitting)
+		{
+			FinishCommit();
+		}
+		return false;
+	}
+
+	bool IsCommitting() const
+	{
+		return m_bCommitting;
+	}
+
+	// Slot of the current copy, or -1 if there isn't one
+	int GetSlot() const
+	{
+		return m_bHaveRecord ? m_iSlot : -1;
+	}
+
+	int GetNumSlots() const
+	{
+		return m_iNumSlots;
+	}
+
+	// EEPROM bytes written since power on
+	unsigned long GetNumWrites() const
+	{
+		return m_iNumWrites;
+	}
+
+private:
+
+	int SlotAddr(int iSlot) const
+	{
+		return m_iBaseAddr + iSlot * SLOT_BYTES;
+	}
+
+	void ReadSlot(int iSlot, uint8_t aySlot[])
+	{
+		int iAddr = SlotAddr(iSlot);
+		for(int i = 0; i < SLOT_BYTES; ++i)
+		{
+			aySlot[i] = m_oStorage.read(iAddr + i);
+		}
+	}
+
+	static uint16_t SlotCrc(const uint8_t aySlot[])
+	{
+		return TuningCrc16(aySlot, SLOT_BYTES - 2);
+	}
+
+	// Sequence numbers wrap, so compare them by their difference
+	static bool IsNewer(uint16_t iSequence, uint16_t iThan)
+	{
+		return (int16_t)(iSequence - iThan) > 0;
+	}
+
+	void FinishCommit()
+	{
+		m_iSlot = m_iTargetSlot;
+		m_iSequence = m_aySlot[0] | ((uint16_t)m_aySlot[1] << 8);
+		memcpy(&m_oRecord, m_aySlot + 3, sizeof(RECORD));
+		m_bHaveRecord = true;
+		m_bCommitting = false;
+	}
+
+	STORAGE &m_oStorage;
+	int m_iBaseAddr;
+	int m_iNumSlots;
+	uint8_t m_ySchemaVersion;
+
+	// Newest good copy
+	int m_iSlot;
+	uint16_t m_iSequence;
+	RECORD m_oRecord;
+	bool m_bHaveRecord;
+
+	// Commit in progress
+	int m_iTargetSlot;
+	uint8_t m_aySlot[SLOT_BYTES];
+	int m_iWritePos;
+	bool m_bCommitting;
+
+	unsigned long m_iNumWrites;
+};
+
+#endif // EA_SETTINGS_STORE_H
@@ -0,0 +1,188 @@
+/**
+ * File: EAAdcDecimator.h
+ *
+ * Description: The ring the ADC interrupt pushes samples into and the filter
+ * the main loop turns each block of them into one reading with (see
+ * EAAdcSampler.h).  The sketches used to take one analogRead() a loop, so
+ * every bit of noise on the pin went straight into the touch detection.  Now
+ * the ADC runs off a timer at several times the loop rate and each reading
+ * is made from FACTOR samples:
+ *
+ *   SampleRing<64> g_oRing;        // Interrupt: g_oRing.Push(ADC);
+ *   AdcDecimator<5> g_oDecimator;
+ *
+ *   uint16_t aiBlock[5];
+ *   if(g_oRing.PopBlock(aiBlock, 5))
+ *   {
+ *       int iReading = g_oDecimator.Decimate(aiBlock);
+ *   }
+ *
+ * The filter is a second order CIC (two running sums and two differences),
+ * the same as a box average of FACTOR samples run twice.  It is cheap (two
+ * adds a sample and two subtracts a block), exact for a steady input, and
+ * cuts anything near a multiple of the block rate, which is what would
+ * otherwise fold back down into the readings.  Each reading covers the last
+ * two blocks, so a step in the input shows up over two readings.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_ADC_DECIMATOR_H
+#define EA_ADC_DECIMATOR_H
+
+#include <stdint.h>
+
+// Single producer (the ADC interrupt), single consumer (the main loop) ring
+// of samples.  SIZE must be a power of 2 no bigger than 128.  Like PulseRing
+// (EAPulseRing.h) the head and tail are single bytes, the interrupt only
+// writes the head and the main loop only writes the tail.
+template<int SIZE>
+class SampleRing
+{
+public:
+
+	static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0, "SampleRing SIZE must be a power of 2 no bigger than 128");
+
+	SampleRing() :
+		m_yHead(0),
+		m_yTail(0),
+		m_yDropped(0)
+	{
+	}
+
+	// Interrupt side.  False (and the sample is dropped) if the main loop has
+	// fallen a whole ring behind.
+	inline bool Push(uint16_t iSample)
+	{
+		uint8_t yHead = m_yHead;
+		if((uint8_t)(yHead - m_yTail) >= SIZE)
+		{
+			m_yDropped++;
+			return false;
+		}
+		m_aiSamples[yHead & (SIZE - 1)] = iSample;
+		m_yHead = yHead + 1;
+		return true;
+	}
+
+	// Interrupt side.  Room for this many more samples.
+	inline int Free() const
+	{
+		return SIZE - (int)(uint8_t)(m_yHead - m_yTail);
+	}
+
+	// Main loop side.  Takes iNum samples in the order they were pushed, or
+	// nothing and returns false if there aren't that many yet.
+	bool PopBlock(uint16_t aiOut[], uint8_t iNum)
+	{
+		uint8_t yTail = m_yTail;
+		if((uint8_t)(m_yHead - yTail) < iNum)
+		{
+			return false;
+		}
+		for(uint8_t i = 0; i < iNum; ++i)
+		{
+			aiOut[i] = m_aiSamples[(uint8_t)(yTail + i) & (SIZE - 1)];
+		}
+		m_yTail = yTail + iNum;
+		return true;
+	}
+
+	// Number of samples waiting
+	inline uint8_t Count() const
+	{
+		return m_yHead - m_yTail;
+	}
+
+	// Number of samples dropped because the ring was full (wraps at 256)
+	inline uint8_t Dropped() const
+	{
+		return m_yDropped;
+	}
+
+	// Interrupt side.  Counts samples the interrupt chose not to push.
+	inline void AddDropped(uint8_t iNum)
+	{
+		m_yDropped += iNum;
+	}
+
+private:
+
+	volatile uint16_t m_aiSamples[SIZE];
+	volatile uint8_t m_yHead;
+	volatile uint8_t m_yTail;
+	volatile uint8_t m_yDropped;
+};
+
+
+
+// Turns each block of FACTOR samples into one reading in the same units.
+// The sums wrap around but the differences of them are still right as long
+// as FACTOR * FACTOR * the largest sample fits in 32 bits, which it does by
+// a long way for any FACTOR up to 255 and a 16 bit ADC.
+template<int FACTOR>
+class AdcDecimator
+{
+public:
+
+	AdcDecimator()
+	{
+		Reset();
+	}
+
+	// Forget the old input.  The next block is also used as the block before
+	// it so the first reading doesn't start from zero.
+	void Reset()
+	{
+		m_iSum1 = 0;
+		m_iSum2 = 0;
+		m_iLastSum2 = 0;
+		m_iLastDiff1 = 0;
+		m_bPrimed = false;
+	}
+
+	// One block of FACTOR samples, iStride apart (for samples from more than
+	// one pin mixed together in a ring), down to one rounded reading
+	uint16_t Decimate(const uint16_t aiSamples[], int iStride = 1)
+	{
+		if(!m_bPrimed)
+		{
+			Integrate(aiSamples, iStride);
+			Dump();
+			m_bPrimed = true;
+		}
+		Integrate(aiSamples, iStride);
+		return (uint16_t)((Dump() + GAIN / 2) / GAIN);
+	}
+
+private:
+
+	static const uint32_t GAIN = (uint32_t)FACTOR * FACTOR;
+
+	void Integrate(const uint16_t aiSamples[], int iStride)
+	{
+		for(int i = 0; i < FACTOR; ++i)
+		{
+			m_iSum1 += aiSamples[i * iStride];
+			m_iSum2 += m_iSum1;
+		}
+	}
+
+	// The two differences, once a block
+	uint32_t Dump()
+	{
+		uint32_t iDiff1 = m_iSum2 - m_iLastSum2;
+		m_iLastSum2 = m_iSum2;
+		uint32_t iDiff2 = iDiff1 - m_iLastDiff1;
+		m_iLastDiff1 = iDiff1;
+		return iDiff2;
+	}
+
+	uint32_t m_iSum1;
+	uint32_t m_iSum2;
+	uint32_t m_iLastSum2;
+	uint32_t m_iLastDiff1;
+	bool m_bPrimed;
+};
+
+#endif // EA_ADC_DECIMATOR_H
@@ -0,0 +1,325 @@
+/**
+ * File: EAAdcSampler.h
+ *
+ * Description: Skin conductance sampling for TouchtoneArduino and
+ * BarLights.  The sketches used to call analogRead() in loop(), which waits
+ * the whole conversion out, and TouchtoneArduino then slept delay(5) to set
+ * its rate (shorter delays gave noisier readings).  Now a timer starts each
+ * conversion, the ADC complete interrupt pushes the result into a SampleRing
+ * and the main loop takes whole blocks of FACTOR samples a pin, each turned
+ * into one reading by an AdcDecimator (both in EAAdcDecimator.h):
+ *
+ *   AdcSampler<8, 2> g_oSampler;          // 8 samples a reading, 2 pins
+ *
+ *   static const uint8_t ayPins[] = {A1, A3};
+ *   g_oSampler.Begin(ayPins, 1600);       // Both pins together, so 100 readings a second
+ *
+ *   uint16_t aiReadings[2];
+ *   while(g_oSampler.ReadBlock(aiReadings))
+ *   {
+ *       ... aiReadings[0] is A1, aiReadings[1] is A3 ...
+ *   }
+ *
+ * The pins take turns, so each one gets iSampleRateHz over the number of
+ * pins.  The backend is picked from the board:
+ *
+ *   AVR                          Timer0 overflow starts each conversion,
+ *                                F_CPU / 16384 a second (976.5 at 16MHz).
+ *                                Timer0 is already running for millis() so
+ *                                nothing is changed on it and iSampleRateHz
+ *                                is ignored.  Timer1 is left for TimerOne.
+ *
+ *   Teensy 3.x                   The PDB timer starts each conversion at
+ *                                iSampleRateHz and the ADC also averages
+ *                                ADC_SAMPLER_HW_AVGS conversions in hardware
+ *                                for every sample.  The pins have to be on
+ *                                ADC0.  Conversions that finish while
+ *                                interrupts are off (FastLED.show() with
+ *                                FASTLED_ALLOW_INTERRUPTS 0) are lost, so
+ *                                that block just comes a little later.
+ *
+ *   USE_ADC_SAMPLER_ANALOGREAD   (or any other board) ReadBlock() calls
+ *                                analogRead() for the whole block once a
+ *                                block's worth of time has gone by.  Same
+ *                                readings, none of the savings.
+ *
+ * The readings are in the same units analogRead() gave, so the tuning in the
+ * sketches doesn't change.  Once Begin() has run the ADC belongs to the
+ * sampler, so analogRead() must not be called on any pin after that.  Only
+ * one AdcSampler can run at a time.
+ *
+ * This holds interrupt handlers so only include it from the sketch.
+ */
+
+#ifndef EA_ADC_SAMPLER_H
+#define EA_ADC_SAMPLER_H
+
+#include <Arduino.h>
+#include "EAAdcDecimator.h"
+
+#if !defined(USE_ADC_SAMPLER_ANALOGREAD) && !defined(__AVR__) && !defined(KINETISK)
+ #define USE_ADC_SAMPLER_ANALOGREAD
+#endif
+
+#if !defined(USE_ADC_SAMPLER_ANALOGREAD) && defined(__AVR__)
+ #include <avr/io.h>
+ #include <avr/interrupt.h>
+#endif
+
+// Samples waiting for the main loop (power of 2, at most 128).  Big enough
+// for a few blocks so the loop can be late now and then.
+#ifndef ADC_SAMPLER_RING_SIZE
+ #define ADC_SAMPLER_RING_SIZE 64
+#endif
+
+// Teensy 3.x hardware averaging: 0, 1, 2 or 3 for 4, 8, 16 or 32 conversions
+#ifndef ADC_SAMPLER_HW_AVGS
+ #define ADC_SAMPLER_HW_AVGS 2
+#endif
+
+#define ADC_SAMPLER_MAX_PINS 4
+
+#if !defined(USE_ADC_SAMPLER_ANALOGREAD)
+
+// Shared with the interrupt
+static SampleRing<ADC_SAMPLER_RING_SIZE> g_oAdcSamplerRing;
+static uint8_t g_ayAdcSamplerMux[ADC_SAMPLER_MAX_PINS];
+static uint8_t g_yAdcSamplerNumPins = 1;
+static uint8_t g_yAdcSamplerPin = 0;
+static bool g_bAdcSamplerSkipping = false;
+
+// Push one conversion and return the pin to convert next.  Only whole rounds
+// of the pins go in the ring, so the samples in it always start with the
+// first pin.
+static inline uint8_t AdcSamplerStore(uint16_t iSample)
+{
+	uint8_t yPin = g_yAdcSamplerPin;
+	if(yPin == 0)
+	{
+		g_bAdcSamplerSkipping = g_oAdcSamplerRing.Free() < g_yAdcSamplerNumPins;
+	}
+	if(g_bAdcSamplerSkipping)
+	{
+		g_oAdcSamplerRing.AddDropped(1);
+	}
+	else
+	{
+		g_oAdcSamplerRing.Push(iSample);
+	}
+
+	if(++yPin == g_yAdcSamplerNumPins)
+	{
+		yPin = 0;
+	}
+	g_yAdcSamplerPin = yPin;
+	return yPin;
+}
+
+#endif
+
+#if !defined(USE_ADC_SAMPLER_ANALOGREAD) && defined(__AVR__)
+
+#if defined(MUX5)
+static uint8_t g_ayAdcSamplerMux5[ADC_SAMPLER_MAX_PINS];
+#endif
+
+ISR(ADC_vect)
+{
+	uint8_t yNext = AdcSamplerStore(ADC);
+
+	// The new channel is used from the next conversion (the next overflow)
+	if(g_yAdcSamplerNumPins > 1)
+	{
+		ADMUX = g_ayAdcSamplerMux[yNext];
+#if defined(MUX5)
+		ADCSRB = (ADCSRB & ~_BV(MUX5)) | g_ayAdcSamplerMux5[yNext];
+#endif
+	}
+}
+
+#elif !defined(USE_ADC_SAMPLER_ANALOGREAD)
+
+// Top bit set for the pins on the b side of the ADC0 mux
+#define ADC_SAMPLER_MUXSEL_B 0x80
+
+static inline void AdcSamplerSelect(uint8_t yMux)
+{
+	if(yMux & ADC_SAMPLER_MUXSEL_B)
+	{
+		ADC0_CFG2 |= ADC_CFG2_MUXSEL;
+	}
+	else
+	{
+		ADC0_CFG2 &= ~ADC_CFG2_MUXSEL;
+	}
+
+	// With the hardware trigger on this only sets the channel for the next
+	// PDB trigger
+	ADC0_SC1A = ADC_SC1_AIEN | (yMux & 0x1F);
+}
+
+void adc0_isr()
+{
+	uint8_t yNext = AdcSamplerStore(ADC0_RA);
+	if(g_yAdcSamplerNumPins > 1)
+	{
+		AdcSamplerSelect(g_ayAdcSamplerMux[yNext]);
+	}
+}
+
+#endif
+
+
+
+template<int FACTOR, int NUM_PINS = 1>
+class AdcSampler
+{
+public:
+
+	static_assert(NUM_PINS <= ADC_SAMPLER_MAX_PINS, "Too many pins for AdcSampler");
+	static_assert(FACTOR * NUM_PINS <= ADC_SAMPLER_RING_SIZE, "ADC_SAMPLER_RING_SIZE is too small for a block");
+
+	AdcSampler() :
+		m_iSampleRateHz(0),
+		m_iBlockMicro(0),
+		m_iLastBlockMicro(0)
+	{
+	}
+
+	// iSampleRateHz is conversions a second over all the pins
+	void Begin(const uint8_t ayPins[], long iSampleRateHz)
+	{
+		m_iSampleRateHz = iSampleRateHz;
+#if defined(USE_ADC_SAMPLER_ANALOGREAD)
+		for(int i = 0; i < NUM_PINS; ++i)
+		{
+			m_ayPins[i] = ayPins[i];
+		}
+#elif defined(__AVR__)
+		// Let analogRead() work out the mux settings for each pin, then keep
+		// them for the interrupt
+		for(int i = 0; i < NUM_PINS; ++i)
+		{
+			analogRead(ayPins[i]);
+			g_ayAdcSamplerMux[i] = ADMUX;
+ #if defined(MUX5)
+			g_ayAdcSamplerMux5[i] = ADCSRB & _BV(MUX5);
+ #endif
+		}
+		g_yAdcSamplerNumPins = NUM_PINS;
+		g_yAdcSamplerPin = 0;
+		m_iSampleRateHz = F_CPU / 16384L;
+
+		uint8_t ySREG = SREG;
+		cli();
+		ADMUX = g_ayAdcSamplerMux[0];
+ #if defined(MUX5)
+		ADCSRB = (ADCSRB & ~_BV(MUX5)) | g_ayAdcSamplerMux5[0];
+ #endif
+		ADCSRB = (ADCSRB & ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0))) | _BV(ADTS2); // Timer0 overflow
+		ADCSRA |= _BV(ADATE) | _BV(ADIE) | _BV(ADIF); // Writing ADIF clears it
+		SREG = ySREG;
+#else
+		// Let analogRead() work out the mux settings for each pin, then keep
+		// them for the interrupt
+		for(int i = 0; i < NUM_PINS; ++i)
+		{
+			analogRead(ayPins[i]);
+			g_ayAdcSamplerMux[i] = (ADC0_SC1A & 0x1F) | ((ADC0_CFG2 & ADC_CFG2_MUXSEL) ? ADC_SAMPLER_MUXSEL_B : 0);
+		}
+		g_yAdcSamplerNumPins = NUM_PINS;
+		g_yAdcSamplerPin = 0;
+
+		ADC0_SC3 = ADC_SC3_AVGE | ADC_SC3_AVGS(ADC_SAMPLER_HW_AVGS);
+		ADC0_SC2 |= ADC_SC2_ADTRG;
+		AdcSamplerSelect(g_ayAdcSamplerMux[0]);
+		NVIC_ENABLE_IRQ(IRQ_ADC0);
+
+		// The PDB counter has to fit in 16 bits so slow rates need the prescaler
+		int iPrescaler = 0;
+		while(iPrescaler < 7 && (F_BUS >> iPrescaler) / iSampleRateHz > 65535)
+		{
+			++iPrescaler;
+		}
+		SIM_SCGC6 |= SIM_SCGC6_PDB;
+		PDB0_MOD = (F_BUS >> iPrescaler) / iSampleRateHz - 1;
+		PDB0_IDLY = 0;
+		PDB0_CH0C1 = 0x0101; // Pretrigger 0 (ADC0 SC1A) on, no delay
+		PDB0_CH0DLY0 = 0;
+		PDB0_SC = PDB_SC_TRGSEL(15) | PDB_SC_PDBEN | PDB_SC_CONT | PDB_SC_PRESCALER(iPrescaler) | PDB_SC_LDOK;
+		PDB0_SC = PDB_SC_TRGSEL(15) | PDB_SC_PDBEN | PDB_SC_CONT | PDB_SC_PRESCALER(iPrescaler) | PDB_SC_SWTRIG;
+#endif
+
+		m_iBlockMicro = (1000000L * FACTOR * NUM_PINS) / m_iSampleRateHz;
+		m_iLastBlockMicro = micros();
+	}
+
+	// One reading for each pin, in the order they were given to Begin(), from
+	// the next whole block.  False if there isn't a whole block yet.
+	bool ReadBlock(uint16_t aiReadings[])
+	{
+		uint16_t aiSamples[FACTOR * NUM_PINS];
+#if defined(USE_ADC_SAMPLER_ANALOGREAD)
+		unsigned long iNowMicro = micros();
+		if(iNowMicro - m_iLastBlockMicro < m_iBlockMicro)
+		{
+			return false;
+		}
+
+		// Keep to the block rate, but don't try to catch up after a long stall
+		m_iLastBlockMicro += m_iBlockMicro;
+		if(iNowMicro - m_iLastBlockMicro >= m_iBlockMicro)
+		{
+			m_iLastBlockMicro = iNowMicro;
+		}
+		for(int i = 0; i < FACTOR * NUM_PINS; ++i)
+		{
+			aiSamples[i] = analogRead(m_ayPins[i % NUM_PINS]);
+		}
+#else
+		if(!g_oAdcSamplerRing.PopBlock(aiSamples, FACTOR * NUM_PINS))
+		{
+			return false;
+		}
+#endif
+		for(int i = 0; i < NUM_PINS; ++i)
+		{
+			aiReadings[i] = m_aoDecimators[i].Decimate(aiSamples + i, NUM_PINS);
+		}
+		return true;
+	}
+
+	// Conversions a second over all the pins
+	long GetSampleRateHz() const
+	{
+		return m_iSampleRateHz;
+	}
+
+	// Time between blocks
+	unsigned long GetBlockMicro() const
+	{
+		return m_iBlockMicro;
+	}
+
+	// Samples lost because the main loop fell behind (wraps at 256)
+	uint8_t GetDropped() const
+	{
+#if defined(USE_ADC_SAMPLER_ANALOGREAD)
+		return 0;
+#else
+		return g_oAdcSamplerRing.Dropped();
+#endif
+	}
+
+private:
+
+	long m_iSampleRateHz;
+	unsigned long m_iBlockMicro;
+	unsigned long m_iLastBlockMicro;
+	AdcDecimator<FACTOR> m_aoDecimators[NUM_PINS];
+#if defined(USE_ADC_SAMPLER_ANALOGREAD)
+	uint8_t m_ayPins[NUM_PINS];
+#endif
+};
+
+#endif // EA_ADC_SAMPLER_H
@@ -0,0 +1,299 @@
+/**
+ * File: EAProcessingNode.h
+ *
+ * Description: The signal processing node from the InputGraph program, used
+ * to find touches in the skin conductance input (TouchtoneArduino, and
+ * BarLights as a SignalGraph table, see EASignalGraph.h).  Each node
+ * optionally takes the derivative of its input, then smooths it with an
+ * exponential moving average and then with a box average over the last few
+ * samples, and scales the result:
+ *
+ *   ProcessingNode<2>  g_oNode0(NULL,      false, 0.0, 2,  1.0); // Input
+ *   ProcessingNode<10> g_oNode1(&g_oNode0, true,  0.3, 10, 0.6); // 1st derivative
+ *
+ *   g_oNode0.UpdateFromInput(iDeltaTimeMS, fRawInput);
+ *   g_oNode1.Update(iDeltaTimeMS);
+ *
+ * Each sketch used to carry its own copy, which summed the whole window on
+ * every sample and kept a 30 sample buffer in every node.  Here the window
+ * is MAX_AVG_SAMPLES long and the box average keeps a running sum.  Floats
+ * pick up a little rounding error each time a sample is added and taken
+ * back out, so the sum is also added up fresh as each sample is written and
+ * replaces the running sum once every full pass through the window.  That is
+ * the same order the old loop added them in, so at those points the result
+ * is the same as before to the bit.
+ *
+ * With USE_PROCESSING_NODE_FIXED_POINT defined before the include all the
+ * math is done in 16.16 fixed point instead, with only 32 bit multiplies:
+ * the derivative multiplies by the reciprocal of the delta time, and the
+ * box average adds up each sample already multiplied by the reciprocal of
+ * the window length, so there is no divide for each sample and the running
+ * sum can't drift at all.  Values and their derivatives have to stay within
+ * +/-32767.  The outputs are close to the float ones but not the same to the
+ * bit (TestProcessingNodeFixed checks them against the same vectors).
+ *
+ * InputGraph/InputGraph.pde and TouchtonePC/TouchtonePC.pde do the same
+ * float math in the same order and have to be kept in step with this file.
+ * All three have to give the outputs in test/host/ProcessingNodeVectors.txt
+ * to the bit (TestProcessingNode and test_processing_node.py check them).
+ * Java rounds every float operation, so on a board with a fused multiply add
+ * (Teensy 3.5 and up) the outputs only match to the bit with
+ * -ffp-contract=off.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_PROCESSING_NODE_H
+#define EA_PROCESSING_NODE_H
+
+#include <stdint.h>
+
+#ifndef NULL
+ #define NULL 0
+#endif
+
+#if defined(USE_PROCESSING_NODE_FIXED_POINT)
+
+// 16.16 fixed point
+typedef int32_t processing_t;
+#define PROCESSING_ONE 65536L
+
+static inline processing_t ProcessingFromFloat(float f)
+{
+	return (processing_t)(f * PROCESSING_ONE + (f < 0.0f ? -0.5f : 0.5f));
+}
+
+static inline float ProcessingToFloat(processing_t i)
+{
+	return i * (1.0f / PROCESSING_ONE);
+}
+
+// The 16 bit halves are multiplied separately so it only needs 32 bit math.
+// Rounds down, the same as a 64 bit multiply and shift.
+static inline processing_t ProcessingMul(processing_t a, processing_t b)
+{
+	int32_t aHi = a >> 16;
+	int32_t bHi = b >> 16;
+	uint32_t aLo = a & 0xFFFF;
+	uint32_t bLo = b & 0xFFFF;
+	return aHi * bHi * PROCESSING_ONE + aHi * (int32_t)bLo + (int32_t)aLo * bHi + (int32_t)((aLo * bLo) >> 16);
+}
+
+// Change in a per iDeltaTimeMS to change per second
+static inline processing_t ProcessingPerSecond(processing_t a, int iDeltaTimeMS)
+{
+	return ProcessingMul(a, (1000 * PROCESSING_ONE + iDeltaTimeMS / 2) / iDeltaTimeMS);
+}
+
+// What one sample adds to the box sum, and the average from the sum.  The
+// samples go in already divided by the window length.
+static inline processing_t ProcessingBoxReciprocal(int iNumSamples)
+{
+	return (PROCESSING_ONE + iNumSamples / 2) / iNumSamples;
+}
+
+static inline processing_t ProcessingBoxTerm(processing_t a, processing_t reciprocal)
+{
+	return ProcessingMul(a, reciprocal);
+}
+
+static inline processing_t ProcessingBoxAverage(processing_t sum, int /* iNumSamples */)
+{
+	return sum;
+}
+
+#else
+
+typedef float processing_t;
+#define PROCESSING_ONE 1.0f
+
+static inline processing_t ProcessingFromFloat(float f)
+{
+	return f;
+}
+
+static inline float ProcessingToFloat(processing_t f)
+{
+	return f;
+}
+
+static inline processing_t ProcessingMul(processing_t a, processing_t b)
+{
+	return a * b;
+}
+
+static inline processing_t ProcessingPerSecond(processing_t a, int iDeltaTimeMS)
+{
+	return a / iDeltaTimeMS * 1000.0f;
+}
+
+static inline processing_t ProcessingBoxReciprocal(int iNumSamples)
+{
+	return 1.0f / iNumSamples;
+}
+
+static inline processing_t ProcessingBoxTerm(processing_t a, processing_t /* reciprocal */)
+{
+	return a;
+}
+
+static inline processing_t ProcessingBoxAverage(processing_t sum, int iNumSamples)
+{
+	return sum / iNumSamples;
+}
+
+#endif
+
+
+
+// What a node needs to know about the node feeding it, whatever its window
+class ProcessingNodeBase
+{
+public:
+
+	float GetOutput() const
+	{
+		return ProcessingToFloat(m_output);
+	}
+
+	processing_t GetRawOutput() const
+	{
+		return m_output;
+	}
+
+protected:
+
+	ProcessingNodeBase() :
+		m_output(0)
+	{
+	}
+
+	processing_t m_output;
+};
+
+
+
+template<int MAX_AVG_SAMPLES = 30>
+class ProcessingNode : public ProcessingNodeBase
+{
+public:
+
+	ProcessingNode(ProcessingNodeBase *pNodeInput, bool bDerivative, float fExponentialSmoothingWeight, int iAvgSmoothingNumSamples, float fScalingFactor) :
+		m_pNodeInput(pNodeInput),
+		m_bDerivative(bDerivative),
+		m_scalingFactor(ProcessingFromFloat(fScalingFactor)),
+		m_input(0),
+		m_exponentialSmoothedInput(0),
+		m_avgReciprocal(PROCESSING_ONE),
+		m_avgSum(0),
+		m_avgResyncSum(0),
+		m_iBufferIndex(0)
+	{
+		for(int i = 0; i < MAX_AVG_SAMPLES; ++i)
+		{
+			m_aAvgBuffer[i] = 0;
+		}
+		AdjustSmoothing(fExponentialSmoothingWeight, iAvgSmoothingNumSamples);
+
+		// The first sample has always gone in slot 1
+		m_iBufferIndex = 0;
+	}
+
+	// iAvgSmoothingNumSamples is capped at MAX_AVG_SAMPLES
+	void AdjustSmoothing(float fExponentialSmoothingWeight, int iAvgSmoothingNumSamples)
+	{
+		m_exponentialSmoothingWeight = ProcessingFromFloat(fExponentialSmoothingWeight);
+		m_iAvgSmoothingNumSamples = iAvgSmoothingNumSamples < MAX_AVG_SAMPLES ? iAvgSmoothingNumSamples : MAX_AVG_SAMPLES;
+
+		// Start a new pass through the window with the sum of what's in it
+		if(m_iAvgSmoothingNumSamples > 1)
+		{
+			m_avgReciprocal = ProcessingBoxReciprocal(m_iAvgSmoothingNumSamples);
+			m_iBufferIndex = m_iAvgSmoothingNumSamples - 1;
+			m_avgSum = 0;
+			for(int i = 0; i < m_iAvgSmoothingNumSamples; ++i)
+			{
+				m_avgSum += ProcessingBoxTerm(m_aAvgBuffer[i], m_avgReciprocal);
+			}
+		}
+	}
+
+	void UpdateFromInput(int iDeltaTimeMS, float fInput)
+	{
+		UpdateFromRawInput(iDeltaTimeMS, ProcessingFromFloat(fInput));
+	}
+
+	void UpdateFromRawInput(int iDeltaTimeMS, processing_t input)
+	{
+		processing_t processingVar;
+		if(m_bDerivative)
+		{
+			processing_t oldInput = m_input;
+			m_input = input;
+			processingVar = ProcessingPerSecond(m_input - oldInput, iDeltaTimeMS);
+		}
+		else
+		{
+			processingVar = input;
+		}
+
+		// Smooth the input using a Exponential moving average
+		if(m_exponentialSmoothingWeight > 0)
+		{
+			m_exponentialSmoothedInput = ProcessingMul(processingVar, PROCESSING_ONE - m_exponentialSmoothingWeight) + ProcessingMul(m_exponentialSmoothedInput, m_exponentialSmoothingWeight);
+		}
+		else
+		{
+			m_exponentialSmoothedInput = processingVar;
+		}
+
+		// Smooth the input using the last n samples (which have already been smoothed with the Exponential smoothing)
+		processing_t avgSmoothedInput;
+		if(m_iAvgSmoothingNumSamples > 1)
+		{
+			m_iBufferIndex = (m_iBufferIndex + 1) % m_iAvgSmoothingNumSamples;
+			processing_t term = ProcessingBoxTerm(m_exponentialSmoothedInput, m_avgReciprocal);
+			m_avgSum += term - ProcessingBoxTerm(m_aAvgBuffer[m_iBufferIndex], m_avgReciprocal);
+			m_aAvgBuffer[m_iBufferIndex] = m_exponentialSmoothedInput;
+
+			// Add up the window fresh as it is written and use that once it is full
+			m_avgResyncSum = m_iBufferIndex == 0 ? term : m_avgResyncSum + term;
+			if(m_iBufferIndex == m_iAvgSmoothingNumSamples - 1)
+			{
+				m_avgSum = m_avgResyncSum;
+			}
+			avgSmoothedInput = ProcessingBoxAverage(m_avgSum, m_iAvgSmoothingNumSamples);
+		}
+		else
+		{
+			avgSmoothedInput = m_exponentialSmoothedInput;
+		}
+
+		// The output is the result of both types of smoothing scaled by the scaling factor
+		m_output = ProcessingMul(avgSmoothedInput, m_scalingFactor);
+	}
+
+	void Update(int iDeltaMS)
+	{
+		UpdateFromRawInput(iDeltaMS, m_pNodeInput->GetRawOutput());
+	}
+
+private:
+
+	ProcessingNodeBase *m_pNodeInput;
+	bool m_bDerivative;
+	processing_t m_exponentialSmoothingWeight;
+	int m_iAvgSmoothingNumSamples;
+	processing_t m_scalingFactor;
+
+	processing_t m_input;
+	processing_t m_exponentialSmoothedInput;
+
+	processing_t m_aAvgBuffer[MAX_AVG_SAMPLES];
+	processing_t m_avgReciprocal;
+	processing_t m_avgSum;
+	processing_t m_avgResyncSum;
+	int m_iBufferIndex;
+};
+
+#endif // EA_PROCESSING_NODE_H
@@ -0,0 +1,345 @@
+/**
+ * File: EASignalGraph.h
+ *
+ * Description: A chain of signal processing steps described by a table, so
+ * the steps can be changed (or loaded from EEPROM) without writing code.
+ * ProcessingNode (EAProcessingNode.h) does a fixed derivative, EMA and box
+ * average in each node, and the sketches wire the nodes up and do the
+ * touch detection by hand.  Here each node does one thing:
+ *
+ *   SIGNAL_NODE_EMA         out = in * (1 - p1) + out * p1
+ *   SIGNAL_NODE_BOX         average of the last p1 samples (running sum)
+ *   SIGNAL_NODE_DERIVATIVE  change in the input per second
+ *   SIGNAL_NODE_SCALE       in * p1 + p2
+ *   SIGNAL_NODE_MEDIAN      median of the last p1 samples
+ *   SIGNAL_NODE_HYSTERESIS  1 once in goes over p1, 0 once it goes under p2
+ *   SIGNAL_NODE_PEAK_HOLD   in / peak, where the peak is the highest input so
+ *                           far, decayed by p1 each sample and never under p2
+ *   SIGNAL_NODE_TRIGGER     1 for the one sample where in goes over p1, then
+ *                           0 until in has gone back under p2
+ *
+ * A node reads either the graph input (SIGNAL_GRAPH_INPUT) or a node before
+ * it in the table, so running the table in order runs every node after the
+ * ones it depends on, in one pass.  BarLights runs its touch input through
+ * this table, which gives the same outputs as the ProcessingNode pair it
+ * replaced to the bit (node 0 and node 1 of the ProcessingNode version):
+ *
+ *   const SignalNodeDesc g_aoTouchGraph[] =
+ *   {
+ *       { SIGNAL_NODE_BOX,        SIGNAL_GRAPH_INPUT, 2,   0   }, // 0 Input
+ *       { SIGNAL_NODE_DERIVATIVE, 0,                  0,   0   }, // 1
+ *       { SIGNAL_NODE_EMA,        1,                  0.3, 0   }, // 2
+ *       { SIGNAL_NODE_BOX,        2,                  10,  0   }, // 3
+ *       { SIGNAL_NODE_SCALE,      3,                  0.6, 0   }  // 4 1st derivative
+ *   };
+ *   SignalGraph<8> g_oGraph;
+ *
+ *   g_oGraph.Load(g_aoTouchGraph, 5);
+ *   g_oGraph.Run(fRawInput, iDeltaTimeMS);
+ *   ... g_oGraph.GetOutput(0) and g_oGraph.GetOutput(4) ...
+ *
+ * SignalGraphTable holds a table as a plain struct so it can be saved with
+ * SettingsStore (EASettingsStore.h).  Load() checks the table and refuses
+ * one that doesn't make sense, so a bad table in EEPROM falls back to the
+ * default.
+ *
+ * Everything is allocated up front.  The box and median windows come out of
+ * a pool of POOL_FLOATS floats (a box takes p1 and a median 2 * p1, and a
+ * median can be at most SIGNAL_MAX_MEDIAN long).  A sample costs a few
+ * operations per node, plus p1 for a median.  test/host/BenchSignalGraph.cpp
+ * times it against the ProcessingNode pair.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_SIGNAL_GRAPH_H
+#define EA_SIGNAL_GRAPH_H
+
+#include <stdint.h>
+
+#ifndef NULL
+ #define NULL 0
+#endif
+
+enum SignalNodeType
+{
+	SIGNAL_NODE_EMA,
+	SIGNAL_NODE_BOX,
+	SIGNAL_NODE_DERIVATIVE,
+	SIGNAL_NODE_SCALE,
+	SIGNAL_NODE_MEDIAN,
+	SIGNAL_NODE_HYSTERESIS,
+	SIGNAL_NODE_PEAK_HOLD,
+	SIGNAL_NODE_TRIGGER,
+	NUM_SIGNAL_NODE_TYPES
+};
+
+// Input index for nodes that read the graph input
+#define SIGNAL_GRAPH_INPUT 0xFF
+
+// Longest median window
+#define SIGNAL_MAX_MEDIAN 15
+
+struct SignalNodeDesc
+{
+	uint8_t m_yType;  // SignalNodeType
+	uint8_t m_yInput; // Node to read, or SIGNAL_GRAPH_INPUT
+	float m_fParam1;
+	float m_fParam2;
+};
+
+// A table in one piece for SettingsStore
+template<int MAX_NODES>
+struct SignalGraphTable
+{
+	uint8_t m_yNumNodes;
+	SignalNodeDesc m_aoNodes[MAX_NODES];
+};
+
+
+
+template<int MAX_NODES, int POOL_FLOATS = 64>
+class SignalGraph
+{
+public:
+
+	SignalGraph() :
+		m_iNumNodes(0)
+	{
+	}
+
+	// Set up the nodes in aoNodes (which is copied).  False, with no nodes,
+	// if a node has an unknown type, reads from itself or a later node, has
+	// a parameter that is NaN or infinite, or has a window that is too small
+	// or doesn't fit in the pool.
+	bool Load(const SignalNodeDesc aoNodes[], int iNumNodes)
+	{
+		m_iNumNodes = 0;
+		if(iNumNodes < 0 || iNumNodes > MAX_NODES)
+		{
+			return false;
+		}
+
+		int iPoolUsed = 0;
+		for(int i = 0; i < iNumNodes; ++i)
+		{
+			const SignalNodeDesc &oDesc = aoNodes[i];
+			if(oDesc.m_yType >= NUM_SIGNAL_NODE_TYPES || (oDesc.m_yInput != SIGNAL_GRAPH_INPUT && oDesc.m_yInput >= i) ||
+			   !IsFinite(oDesc.m_fParam1) || !IsFinite(oDesc.m_fParam2))
+			{
+				return false;
+			}
+
+			Node &oNode = m_aoNodes[i];
+			oNode.m_oDesc = oDesc;
+			oNode.m_fOutput = 0;
+			oNode.m_fState = 0;
+			oNode.m_fSum = 0;
+			oNode.m_fResyncSum = 0;
+			oNode.m_pfWindow = NULL;
+			oNode.m_iWindow = 0;
+			oNode.m_iIndex = 0;
+			oNode.m_bOn = false;
+
+			// Windows come out of the pool
+			if(oDesc.m_yType == SIGNAL_NODE_BOX || oDesc.m_yType == SIGNAL_NODE_MEDIAN)
+			{
+				// Checked as a float first, the table can come from Serial or
+				// EEPROM and (int) of anything out of range is undefined
+				if(!(oDesc.m_fParam1 >= 1.0f && oDesc.m_fParam1 < 256.0f))
+				{
+					return false;
+				}
+				int iWindow = (int)oDesc.m_fParam1;
+				int iFloats = oDesc.m_yType == SIGNAL_NODE_BOX ? iWindow : iWindow * 2;
+				if((oDesc.m_yType == SIGNAL_NODE_MEDIAN && iWindow > SIGNAL_MAX_MEDIAN) || iPoolUsed + iFloats > POOL_FLOATS)
+				{
+					return false;
+				}
+				oNode.m_pfWindow = m_afPool + iPoolUsed;
+				oNode.m_iWindow = iWindow;
+				iPoolUsed += iFloats;
+				for(int j = 0; j < iFloats; ++j)
+				{
+					oNode.m_pfWindow[j] = 0;
+				}
+			}
+		}
+		m_iNumNodes = iNumNodes;
+		return true;
+	}
+
+	template<int TABLE_NODES>
+	bool Load(const SignalGraphTable<TABLE_NODES> &oTable)
+	{
+		return oTable.m_yNumNodes <= TABLE_NODES && Load(oTable.m_aoNodes, oTable.m_yNumNodes);
+	}
+
+	int GetNumNodes() const
+	{
+		return m_iNumNodes;
+	}
+
+	// Run every node once on a new input sample
+	void Run(float fInput, int iDeltaTimeMS)
+	{
+		for(int i = 0; i < m_iNumNodes; ++i)
+		{
+			Node &oNode = m_aoNodes[i];
+			float fIn = oNode.m_oDesc.m_yInput == SIGNAL_GRAPH_INPUT ? fInput : m_aoNodes[oNode.m_oDesc.m_yInput].m_fOutput;
+			RunNode(oNode, fIn, iDeltaTimeMS);
+		}
+	}
+
+	float GetOutput(int iNode) const
+	{
+		return m_aoNodes[iNode].m_fOutput;
+	}
+
+private:
+
+	struct Node
+	{
+		SignalNodeDesc m_oDesc;
+		float m_fOutput;
+		float m_fState;     // Last input or peak
+		float m_fSum;       // Box running sum
+		float m_fResyncSum; // Box sum added up fresh this pass
+		float *m_pfWindow;  // Box samples, or median samples then the same sorted
+		uint8_t m_iWindow;
+		uint8_t m_iIndex;
+		bool m_bOn;
+	};
+
+	// False for NaN and infinity, without needing math.h
+	static bool IsFinite(float f)
+	{
+		return f - f == 0.0f;
+	}
+
+	static void RunNode(Node &oNode, float fIn, int iDeltaTimeMS)
+	{
+		const float fParam1 = oNode.m_oDesc.m_fParam1;
+		const float fParam2 = oNode.m_oDesc.m_fParam2;
+		switch(oNode.m_oDesc.m_yType)
+		{
+			case SIGNAL_NODE_EMA:
+				oNode.m_fOutput = fIn * (1.0f - fParam1) + oNode.m_fOutput * fParam1;
+				break;
+
+			case SIGNAL_NODE_BOX:
+			{
+				// Same running sum as ProcessingNode, added up fresh once a pass
+				float *pfWindow = oNode.m_pfWindow;
+				oNode.m_iIndex = (oNode.m_iIndex + 1) % oNode.m_iWindow;
+				oNode.m_fSum += fIn - pfWindow[oNode.m_iIndex];
+				pfWindow[oNode.m_iIndex] = fIn;
+				oNode.m_fResyncSum = oNode.m_iIndex == 0 ? fIn : oNode.m_fResyncSum + fIn;
+				if(oNode.m_iIndex == oNode.m_iWindow - 1)
+				{
+					oNode.m_fSum = oNode.m_fResyncSum;
+				}
+				oNode.m_fOutput = oNode.m_fSum / oNode.m_iWindow;
+				break;
+			}
+
+			case SIGNAL_NODE_DERIVATIVE:
+				oNode.m_fOutput = (fIn - oNode.m_fState) / iDeltaTimeMS * 1000.0f;
+				oNode.m_fState = fIn;
+				break;
+
+			case SIGNAL_NODE_SCALE:
+				oNode.m_fOutput = fIn * fParam1 + fParam2;
+				break;
+
+			case SIGNAL_NODE_MEDIAN:
+				oNode.m_fOutput = Median(oNode, fIn);
+				break;
+
+			case SIGNAL_NODE_HYSTERESIS:
+				if(fIn > fParam1)
+				{
+					oNode.m_bOn = true;
+				}
+				else if(fIn < fParam2)
+				{
+					oNode.m_bOn = false;
+				}
+				oNode.m_fOutput = oNode.m_bOn ? 1.0f : 0.0f;
+				break;
+
+			case SIGNAL_NODE_PEAK_HOLD:
+			{
+				float fPeak = oNode.m_fState * fParam1;
+				if(fIn > fPeak)
+				{
+					fPeak = fIn;
+				}
+				if(fPeak < fParam2)
+				{
+					fPeak = fParam2;
+				}
+				oNode.m_fState = fPeak;
+				float fOut = fPeak > 0.0f ? fIn / fPeak : 0.0f;
+				oNode.m_fOutput = fOut < 0.0f ? 0.0f : fOut;
+				break;
+			}
+
+			case SIGNAL_NODE_TRIGGER:
+				// m_bOn is set while waiting for the input to drop back down
+				oNode.m_fOutput = 0.0f;
+				if(!oNode.m_bOn && fIn > fParam1)
+				{
+					oNode.m_bOn = true;
+					oNode.m_fOutput = 1.0f;
+				}
+				else if(oNode.m_bOn && fIn < fParam2)
+				{
+					oNode.m_bOn = false;
+				}
+				break;
+		}
+	}
+
+	// The window is the last samples in the order they came in followed by
+	// the same samples sorted.  The oldest sample is swapped for the new one
+	// in the sorted half and moved into place.
+	static float Median(Node &oNode, float fIn)
+	{
+		int iWindow = oNode.m_iWindow;
+		float *pfRing = oNode.m_pfWindow;
+		float *pfSorted = oNode.m_pfWindow + iWindow;
+
+		oNode.m_iIndex = (oNode.m_iIndex + 1) % iWindow;
+		float fOld = pfRing[oNode.m_iIndex];
+		pfRing[oNode.m_iIndex] = fIn;
+
+		int i = 0;
+		while(i < iWindow - 1 && pfSorted[i] != fOld)
+		{
+			i++;
+		}
+		pfSorted[i] = fIn;
+		while(i > 0 && pfSorted[i - 1] > pfSorted[i])
+		{
+			float f = pfSorted[i - 1];
+			pfSorted[i - 1] = pfSorted[i];
+			pfSorted[i] = f;
+			i--;
+		}
+		while(i < iWindow - 1 && pfSorted[i + 1] < pfSorted[i])
+		{
+			float f = pfSorted[i + 1];
+			pfSorted[i + 1] = pfSorted[i];
+			pfSorted[i] = f;
+			i++;
+		}
+		return pfSorted[iWindow / 2];
+	}
+
+	Node m_aoNodes[MAX_NODES];
+	int m_iNumNodes;
+	float m_afPool[POOL_FLOATS];
+};
+
+#endif // EA_SIGNAL_GRAPH_H
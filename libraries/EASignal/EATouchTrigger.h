@@ -0,0 +1,188 @@
+/**
+ * File: EATouchTrigger.h
+ *
+ * Description: Finds touches in the skin conductance input and keeps itself
+ * calibrated while it runs.  The sketches used to:
+ *
+ *   - take a fixed MIN_SENSOR_VALUE off every reading and treat anything
+ *     under a fixed MIN_INPUT_VALUE as no touch, both tuned by hand for the
+ *     room and the wiring on the day
+ *   - call it a touch whenever the smoothed derivative (ProcessingNode) went
+ *     over a single threshold, so noise around the threshold gave runs of
+ *     touches
+ *   - work out the touch velocity against the highest input ever seen,
+ *     which only ever went up, so after one strong touch every later one
+ *     was soft until a restart
+ *
+ * TouchTrigger does each of those adaptively, in constant time a sample:
+ *
+ *   Noise floor  The level follows the raw reading down quickly and up
+ *                slowly.  The noise is a moving average of how far readings
+ *                are from the level, kept between TOUCH_MIN_NOISE and a few
+ *                times the initial margin.  The floor taken off every reading
+ *                (MIN_SENSOR_VALUE) is the level plus a few times the noise,
+ *                and the noise itself is the margin for the touch input
+ *                (MIN_INPUT_VALUE).  A reading over the floor, or one taken
+ *                while a touch is on, is a hand on the sensor: the noise
+ *                stays where it is and the level only creeps up toward the
+ *                reading at TOUCH_HOLD_RISE_RATE.
+ *   Hysteresis   A touch starts when the derivative goes over the on
+ *                threshold and ends when it drops under the lower off one.
+ *   Peak         The peak is raised by touches and decays back toward the
+ *                minimum peak a little every sample.
+ *
+ *   TouchTrigger g_oTouchTrigger(MIN_SENSOR_VALUE, MIN_INPUT_VALUE, 0.4, 0.3);
+ *
+ *   g_iSensorValue = g_oTouchTrigger.RemoveNoiseFloor(analogRead(SENSOR_PIN));
+ *   ... g_oNode0 and g_oNode1 updated from g_iSensorValue ...
+ *   if(g_oTouchTrigger.Update(g_oNode0.GetOutput(), g_oNode1.GetOutput()))
+ *   {
+ *       ... touch with g_oTouchTrigger.GetVelocity() ...
+ *   }
+ *   if(g_iSensorValue > g_oTouchTrigger.GetNoiseMargin()) { ... }
+ *
+ * The floor and margin start at the old fixed values, so a freshly started
+ * sketch behaves like it used to.  A hand held on the sensor stays a touch
+ * for tens of seconds and only becomes the new floor after a minute or more
+ * (the level is 63% of the way there after 1 / TOUCH_HOLD_RISE_RATE
+ * samples), so a reading that really has moved up is followed in the end.
+ * When the hand comes off the level drops back at the fall rate.  The rates
+ * are per sample, so they need tuning if the sample rate changes a lot.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_TOUCH_TRIGGER_H
+#define EA_TOUCH_TRIGGER_H
+
+// Default rates, per sample
+#define TOUCH_FLOOR_FALL_RATE 0.05f   // Weight of a new reading under the level
+#define TOUCH_FLOOR_RISE_RATE 0.0005f // Weight of a new reading over the level
+#define TOUCH_HOLD_RISE_RATE 0.0001f  // Weight of a reading over the floor, a hand held on
+#define TOUCH_NOISE_RATE 0.01f        // Weight of a new reading in the noise average
+#define TOUCH_NOISE_GATE 3.0f         // Floor over the level in multiples of the noise
+#define TOUCH_MIN_NOISE 1.0f          // Lowest the noise goes
+#define TOUCH_MAX_NOISE_SCALE 4.0f    // Highest the noise goes, in multiples of the initial margin
+#define TOUCH_PEAK_DECAY 0.9999f      // Left of the peak (over the minimum) after a sample
+#define TOUCH_MIN_PEAK 0.1f           // Lowest the peak goes
+#define TOUCH_PEAK_HEADROOM 0.9f      // A touch at this much of the peak is full velocity
+
+class TouchTrigger
+{
+public:
+
+	// iInitialFloor and iInitialMargin are where the old fixed MIN_SENSOR_VALUE
+	// and MIN_INPUT_VALUE were.  The thresholds are for the derivative.
+	TouchTrigger(int iInitialFloor, int iInitialMargin, float fOnThreshold, float fOffThreshold) :
+		m_fLevel(iInitialFloor - iInitialMargin * TOUCH_NOISE_GATE),
+		m_fNoise(iInitialMargin),
+		m_fMaxNoise(iInitialMargin * TOUCH_MAX_NOISE_SCALE),
+		m_fOnThreshold(fOnThreshold),
+		m_fOffThreshold(fOffThreshold),
+		m_fPeak(TOUCH_MIN_PEAK),
+		m_fVelocity(0.0f),
+		m_bDetectOn(false)
+	{
+	}
+
+	void SetThresholds(float fOnThreshold, float fOffThreshold)
+	{
+		m_fOnThreshold = fOnThreshold;
+		m_fOffThreshold = fOffThreshold;
+	}
+
+	// Raw reading -> reading over the noise floor (0 at or under it)
+	int RemoveNoiseFloor(int iRaw)
+	{
+		float fRaw = iRaw;
+		float fFloor = m_fLevel + m_fNoise * TOUCH_NOISE_GATE;
+		if(fRaw > fFloor)
+		{
+			// Held on.  The touch derivative is back under the off threshold a
+			// few samples into a hold, so this can't wait for m_bDetectOn.
+			m_fLevel += (fRaw - m_fLevel) * TOUCH_HOLD_RISE_RATE;
+		}
+		else if(fRaw < m_fLevel || !m_bDetectOn)
+		{
+			// Under the level always comes down, the rest waits out a touch
+			float fRate = fRaw < m_fLevel ? TOUCH_FLOOR_FALL_RATE : TOUCH_FLOOR_RISE_RATE;
+			m_fLevel += (fRaw - m_fLevel) * fRate;
+
+			float fDist = fRaw > m_fLevel ? fRaw - m_fLevel : m_fLevel - fRaw;
+			m_fNoise += (fDist - m_fNoise) * TOUCH_NOISE_RATE;
+			m_fNoise = m_fNoise < TOUCH_MIN_NOISE ? TOUCH_MIN_NOISE : (m_fNoise > m_fMaxNoise ? m_fMaxNoise : m_fNoise);
+		}
+		fFloor = m_fLevel + m_fNoise * TOUCH_NOISE_GATE;
+		return fRaw > fFloor ? (int)(fRaw - fFloor) : 0;
+	}
+
+	// Readings over the floor by no more than this are still noise
+	int GetNoiseMargin() const
+	{
+		return (int)(m_fNoise + 0.5f);
+	}
+
+	int GetNoiseFloor() const
+	{
+		return (int)(m_fLevel + m_fNoise * TOUCH_NOISE_GATE + 0.5f);
+	}
+
+	// Call once a sample with the smoothed input and its smoothed derivative.
+	// True on the sample a touch starts.
+	bool Update(float fSmoothedInput, float fSmoothedDerivative)
+	{
+		m_fPeak = TOUCH_MIN_PEAK + (m_fPeak - TOUCH_MIN_PEAK) * TOUCH_PEAK_DECAY;
+
+		bool bOldDetectOn = m_bDetectOn;
+		if(fSmoothedDerivative > m_fOnThreshold)
+		{
+			m_bDetectOn = true;
+		}
+		else if(fSmoothedDerivative < m_fOffThreshold)
+		{
+			m_bDetectOn = false;
+		}
+		if(bOldDetectOn || !m_bDetectOn)
+		{
+			return false;
+		}
+
+		if(fSmoothedInput > m_fPeak)
+		{
+			m_fPeak = fSmoothedInput;
+		}
+		float fVelocity = fSmoothedInput / (m_fPeak * TOUCH_PEAK_HEADROOM);
+		m_fVelocity = fVelocity < 0.0f ? 0.0f : (fVelocity > 1.0f ? 1.0f : fVelocity);
+		return true;
+	}
+
+	// If a touch is going on.  This can be true for many samples in a row.
+	bool IsDetectOn() const
+	{
+		return m_bDetectOn;
+	}
+
+	// Velocity (0 to 1) of the last touch
+	float GetVelocity() const
+	{
+		return m_fVelocity;
+	}
+
+	float GetPeak() const
+	{
+		return m_fPeak;
+	}
+
+private:
+
+	float m_fLevel;
+	float m_fNoise;
+	float m_fMaxNoise;
+	float m_fOnThreshold;
+	float m_fOffThreshold;
+	float m_fPeak;
+	float m_fVelocity;
+	bool m_bDetectOn;
+};
+
+#endif // EA_TOUCH_TRIGGER_H
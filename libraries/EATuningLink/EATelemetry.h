@@ -0,0 +1,372 @@
+/**
+ * File: EATelemetry.h
+ *
+ * Description: Rate limited diagnostics.  Printing every value every frame
+ * used to take more of the loop than the rendering did and made the frame
+ * time depend on how busy the serial port was.  Instead the loop calls
+ * Add() once per frame, which only updates a running min, sum and max for
+ * each channel.  Every emit period the window is closed and its
+ * min/mean/max are put in a small ring.  Send() then writes out what is in
+ * the ring, but only as much as fits in the serial TX buffer right now, so
+ * it never waits.  A line or frame longer than the buffer (the USB serial
+ * on a Teensy++ 2.0 never has more than 64 bytes free) goes out in pieces
+ * over the next calls, so anything else written to the port in between
+ * lands in the middle of it.  If the ring fills up because the port can't
+ * keep up the newest window is dropped and counted.
+ *
+ *   Telemetry<3, 4> g_oTelemetry(100000, asTelemetryNames);
+ *
+ *   void loop()
+ *   {
+ *       ...
+ *       float afSample[3] = { fRaw, fSmoothed, fOut };
+ *       g_oTelemetry.Add(afSample);
+ *       g_oTelemetry.Update(micros());
+ *       g_oTelemetry.SendText(Serial);      // For a person on the serial monitor
+ *       // or g_oTelemetry.SendFrame(Serial); for the tuner (EATuningLink.h)
+ *   }
+ *
+ * PORT is anything with availableForWrite() and write(buf, len), like
+ * Serial.  Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_TELEMETRY_H
+#define EA_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "EATuningLink.h"
+
+// Longest line SendText() will write
+#define TELEMETRY_MAX_TEXT 256
+
+// Largest value SendText() prints.  Times 100 it still fits in 32 bits.
+#define TELEMETRY_MAX_TEXT_VALUE 40000000.0f
+
+static_assert(TELEMETRY_MAX_TEXT >= TUNING_MAX_FRAME, "SendFrame() writes frames through the text buffer");
+
+// NUM_CHANNELS values per sample, up to RING_SIZE finished windows waiting
+// to be sent
+template<int NUM_CHANNELS, int RING_SIZE>
+class Telemetry
+{
+public:
+
+	struct Window
+	{
+		float m_afMin[NUM_CHANNELS];
+		float m_afMean[NUM_CHANNELS];
+		float m_afMax[NUM_CHANNELS];
+		uint16_t m_iNumSamples;
+	};
+
+	// asNames is only needed for SendText() and must stay around
+	Telemetry(unsigned long iEmitPeriodMicro, const char* const asNames[] = NULL) :
+		m_iEmitPeriodMicro(iEmitPeriodMicro),
+		m_asNames(asNames),
+		m_iWindowStartMicro(0),
+		m_bStarted(false),
+		m_iHead(0),
+		m_iCount(0),
+		m_iDropped(0),
+		m_iPendingLength(0),
+		m_iPendingPos(0)
+	{
+		ResetWindow();
+	}
+
+	void SetEmitPeriodMicro(unsigned long iEmitPeriodMicro)
+	{
+		m_iEmitPeriodMicro = iEmitPeriodMicro;
+	}
+
+	// Add one sample (one value for every channel) to the current window
+	void Add(const float afValues[NUM_CHANNELS])
+	{
+		for(int i = 0; i < NUM_CHANNELS; ++i)
+		{
+			float fValue = afValues[i];
+			if(m_iNumSamples == 0 || fValue < m_afMin[i])
+			{
+				m_afMin[i] = fValue;
+			}
+			if(m_iNumSamples == 0 || fValue > m_afMax[i])
+			{
+				m_afMax[i] = fValue;
+			}
+			m_afSum[i] += fValue;
+		}
+		if(m_iNumSamples < 0xFFFF)
+		{
+			m_iNumSamples++;
+		}
+	}
+
+	// Closes the current window once the emit period has passed.  Returns
+	// true if it did.  Empty windows are skipped.
+	bool Update(unsigned long iNowMicro)
+	{
+		if(!m_bStarted)
+		{
+			m_iWindowStartMicro = iNowMicro;
+			m_bStarted = true;
+			return false;
+		}
+
+		unsigned long iElapsedMicro = iNowMicro - m_iWindowStartMicro;
+		if(iElapsedMicro < m_iEmitPeriodMicro)
+		{
+			return false;
+		}
+
+		// Stay on the same grid so the tuner sees a steady rate, unless we
+		// are more than a whole period behind (like after a long hitch)
+		if(iElapsedMicro < 2 * m_iEmitPeriodMicro)
+		{
+			m_iWindowStartMicro += m_iEmitPeriodMicro;
+		}
+		else
+		{
+			m_iWindowStartMicro = iNowMicro;
+		}
+
+		if(m_iNumSamples == 0)
+		{
+			return false;
+		}
+
+		if(m_iCount == RING_SIZE)
+		{
+			m_iDropped++;
+		}
+		else
+		{
+			Window &oWindow = m_aoRing[(m_iHead + m_iCount) % RING_SIZE];
+			for(int i = 0; i < NUM_CHANNELS; ++i)
+			{
+				oWindow.m_afMin[i] = m_afMin[i];
+				oWindow.m_afMean[i] = m_afSum[i] / m_iNumSamples;
+				oWindow.m_afMax[i] = m_afMax[i];
+			}
+			oWindow.m_iNumSamples = m_iNumSamples;
+			m_iCount++;
+		}
+		ResetWindow();
+		return true;
+	}
+
+	// Oldest finished window that hasn't been sent, or NULL
+	const Window *Peek() const
+	{
+		return m_iCount > 0 ? &m_aoRing[m_iHead] : NULL;
+	}
+
+	void Pop()
+	{
+		if(m_iCount > 0)
+		{
+			m_iHead = (m_iHead + 1) % RING_SIZE;
+			m_iCount--;
+		}
+	}
+
+	// Write waiting windows as TUNING_MSG_TELEMETRY frames, as much as fits
+	// in the TX buffer.  Returns the number finished.
+	template<class PORT>
+	int SendFrame(PORT &oPort)
+	{
+		int iNumSent = 0;
+		while(WritePending(oPort, iNumSent))
+		{
+			const Window *pWindow = Peek();
+			if(!pWindow)
+			{
+				break;
+			}
+			TuningMessage oMsg;
+			oMsg.Begin(TUNING_MSG_TELEMETRY);
+			oMsg.PutByte(NUM_CHANNELS);
+			oMsg.PutBytes(&pWindow->m_iNumSamples, 2);
+			for(int i = 0; i < NUM_CHANNELS; ++i)
+			{
+				oMsg.PutFloat(pWindow->m_afMin[i]);
+				oMsg.PutFloat(pWindow->m_afMean[i]);
+				oMsg.PutFloat(pWindow->m_afMax[i]);
+			}
+
+			m_iPendingLength = oMsg.Encode(m_ayPending);
+			m_iPendingPos = 0;
+			Pop();
+		}
+		return iNumSent;
+	}
+
+	// Write waiting windows as lines of "name=min/mean/max" text, as much as
+	// fits in the TX buffer.  Returns the number finished.
+	template<class PORT>
+	int SendText(PORT &oPort)
+	{
+		int iNumSent = 0;
+		while(WritePending(oPort, iNumSent))
+		{
+			const Window *pWindow = Peek();
+			if(!pWindow)
+			{
+				break;
+			}
+			m_iPendingLength = FormatText(*pWindow, (char *)m_ayPending, sizeof(m_ayPending));
+			m_iPendingPos = 0;
+			Pop();
+		}
+		return iNumSent;
+	}
+
+	// Windows thrown away because the ring was full
+	unsigned int GetDropped() const
+	{
+		return m_iDropped;
+	}
+
+private:
+
+	void ResetWindow()
+	{
+		for(int i = 0; i < NUM_CHANNELS; ++i)
+		{
+			m_afMin[i] = 0;
+			m_afSum[i] = 0;
+			m_afMax[i] = 0;
+		}
+		m_iNumSamples = 0;
+	}
+
+	// Write as much of the line or frame being sent as fits.  True once it
+	// has all gone, counting it in iNumSent.
+	template<class PORT>
+	bool WritePending(PORT &oPort, int &iNumSent)
+	{
+		if(m_iPendingPos == m_iPendingLength)
+		{
+			return true;
+		}
+		int iLength = m_iPendingLength - m_iPendingPos;
+		int iAvailable = oPort.availableForWrite();
+		if(iLength > iAvailable)
+		{
+			iLength = iAvailable;
+		}
+		if(iLength > 0)
+		{
+			oPort.write(m_ayPending + m_iPendingPos, iLength);
+			m_iPendingPos += iLength;
+		}
+		if(m_iPendingPos < m_iPendingLength)
+		{
+			return false;
+		}
+		iNumSent++;
+		return true;
+	}
+
+	static int Append(char *pLine, int iPos, int iSize, const char *sText)
+	{
+		while(*sText && iPos < iSize - 1)
+		{
+			pLine[iPos++] = *sText++;
+		}
+		return iPos;
+	}
+
+	// Fixed 2 decimal places, like Serial.print() does.  printf doesn't do
+	// floats on AVR.  Anything bigger than TELEMETRY_MAX_TEXT_VALUE prints
+	// as that.
+	static int AppendFloat(char *pLine, int iPos, int iSize, float fValue)
+	{
+		if(fValue != fValue)
+		{
+			return Append(pLine, iPos, iSize, "nan");
+		}
+
+		char acNum[16];
+		int iNumPos = sizeof(acNum) - 1;
+		acNum[iNumPos] = 0;
+
+		bool bNegative = fValue < 0;
+		if(bNegative)
+		{
+			fValue = -fValue;
+		}
+		if(fValue > TELEMETRY_MAX_TEXT_VALUE)
+		{
+			fValue = TELEMETRY_MAX_TEXT_VALUE;
+		}
+		unsigned long iValue = (unsigned long)(fValue * 100 + 0.5f);
+		for(int iDigit = 0; iDigit < 3 || iValue > 0; ++iDigit)
+		{
+			acNum[--iNumPos] = '0' + iValue % 10;
+			iValue /= 10;
+			if(iDigit == 1)
+			{
+				acNum[--iNumPos] = '.';
+			}
+		}
+		if(bNegative)
+		{
+			acNum[--iNumPos] = '-';
+		}
+		return Append(pLine, iPos, iSize, acNum + iNumPos);
+	}
+
+	int FormatText(const Window &oWindow, char *pLine, int iSize) const
+	{
+		char acCount[8];
+		int iCountPos = sizeof(acCount) - 1;
+		acCount[iCountPos] = 0;
+		unsigned int iNumSamples = oWindow.m_iNumSamples;
+		do
+		{
+			acCount[--iCountPos] = '0' + iNumSamples % 10;
+			iNumSamples /= 10;
+		} while(iNumSamples > 0);
+
+		int iPos = Append(pLine, 0, iSize, "TELEMETRY n=");
+		iPos = Append(pLine, iPos, iSize, acCount + iCountPos);
+		for(int i = 0; i < NUM_CHANNELS; ++i)
+		{
+			iPos = Append(pLine, iPos, iSize, " ");
+			iPos = Append(pLine, iPos, iSize, m_asNames ? m_asNames[i] : "?");
+			iPos = Append(pLine, iPos, iSize, "=");
+			iPos = AppendFloat(pLine, iPos, iSize, oWindow.m_afMin[i]);
+			iPos = Append(pLine, iPos, iSize, "/");
+			iPos = AppendFloat(pLine, iPos, iSize, oWindow.m_afMean[i]);
+			iPos = Append(pLine, iPos, iSize, "/");
+			iPos = AppendFloat(pLine, iPos, iSize, oWindow.m_afMax[i]);
+		}
+		return Append(pLine, iPos, iSize, "\r\n");
+	}
+
+	unsigned long m_iEmitPeriodMicro;
+	const char* const *m_asNames;
+	unsigned long m_iWindowStartMicro;
+	bool m_bStarted;
+
+	// Current window
+	float m_afMin[NUM_CHANNELS];
+	float m_afSum[NUM_CHANNELS];
+	float m_afMax[NUM_CHANNELS];
+	uint16_t m_iNumSamples;
+
+	// Finished windows waiting to be sent
+	Window m_aoRing[RING_SIZE];
+	int m_iHead;
+	int m_iCount;
+	unsigned int m_iDropped;
+
+	// The line or frame being sent and how much of it has gone
+	uint8_t m_ayPending[TELEMETRY_MAX_TEXT];
+	int m_iPendingLength;
+	int m_iPendingPos;
+};
+
+#endif // EA_TELEMETRY_H
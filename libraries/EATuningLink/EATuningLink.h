@@ -0,0 +1,307 @@
+/**
+ * File: EATuningLink.h
+ *
+ * Description: Small binary message protocol for tuning a node over a serial
+ * port (used by ScienceClouds and Python/cloud_tuner.py).  It replaces the
+ * old line based ASCII commands.
+ *
+ * Each message is a type byte and up to TUNING_MAX_PAYLOAD bytes of payload.
+ * On the wire it is:
+ *
+ *   0x00  COBS( type, payload..., crc16 low, crc16 high )  0x00
+ *
+ * COBS (Consistent Overhead Byte Stuffing) removes every 0x00 from the
+ * message so 0x00 can mark where frames start and end.  The leading 0x00
+ * means any stray text printed between frames ends up in its own (bad)
+ * frame instead of corrupting the next one.  The CRC is CRC-16/CCITT-FALSE
+ * over the type and payload.  Multi-byte values are little endian and floats
+ * are 4 byte IEEE 754, which is what both the Teensy and the PC use.
+ *
+ * The message types and payloads are listed below.  Python/tuning_link.py
+ * is the PC side of the same thing and has to be kept in step with this.
+ * test/host/test_tuning_link.py runs the two against each other.
+ *
+ * Nothing here touches hardware so it also builds on a PC.
+ */
+
+#ifndef EA_TUNING_LINK_H
+#define EA_TUNING_LINK_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Largest payload in a message (a TELEMETRY message with 7 channels)
+#define TUNING_MAX_PAYLOAD 96
+
+// Largest encoded frame: type + payload + CRC, one COBS overhead byte (good
+// up to 254 bytes) and the two 0x00 delimiters
+#define TUNING_MAX_FRAME (1 + TUNING_MAX_PAYLOAD + 2 + 1 + 2)
+
+// Message types.  PC to node:
+#define TUNING_MSG_REQUEST_TUNING    0x01 // u8 set (TUNING_SET_*)
+#define TUNING_MSG_REQUEST_COLORS    0x02 // u8 set
+#define TUNING_MSG_SAVE_CURRENT      0x03 // (empty)
+#define TUNING_MSG_LOAD_SAVED        0x04 // (empty) overwrite current with saved
+#define TUNING_MSG_RESTORE_DEFAULTS  0x05 // (empty)
+#define TUNING_MSG_SET_TUNING        0x06 // u8 param id, f32 value
+#define TUNING_MSG_SET_COLORS        0x07 // u8 gradient id, u8 count, u8 bytes[count]
+
+// Node to PC:
+#define TUNING_MSG_TUNING            0x81 // u8 set, u8 count, f32 values[count] (by param id)
+#define TUNING_MSG_COLORS            0x82 // u8 set, u8 gradient id, u8 count, u8 bytes[count]
+#define TUNING_MSG_STATUS            0x83 // u8 count, f32 values[count]
+#define TUNING_MSG_LOG               0x84 // text, not null terminated
+#define TUNING_MSG_TELEMETRY         0x85 // u8 count, u16 samples, {f32 min, f32 mean, f32 max}[count] (EATelemetry.h)
+
+// Which copy of the settings a TUNING or COLORS message is about
+#define TUNING_SET_CURRENT 0
+#define TUNING_SET_SAVED   1
+
+
+
+// CRC-16/CCITT-FALSE (poly 0x1021, start 0xFFFF)
+inline uint16_t TuningCrc16(const uint8_t *pData, int iLength, uint16_t iCrc = 0xFFFF)
+{
+	for(int i = 0; i < iLength; ++i)
+	{
+		iCrc ^= (uint16_t)pData[i] << 8;
+		for(int j = 0; j < 8; ++j)
+		{
+			iCrc = (iCrc & 0x8000) ? (iCrc << 1) ^ 0x1021 : (iCrc << 1);
+		}
+	}
+	return iCrc;
+}
+
+// COBS encode iLength bytes into pOut (no delimiters).  pOut needs
+// iLength + iLength / 254 + 1 bytes.  Returns the encoded length.
+inline int CobsEncode(const uint8_t *pIn, int iLength, uint8_t *pOut)
+{
+	int iCodePos = 0;
+	int iOutPos = 1;
+	uint8_t yCode = 1;
+	for(int i = 0; i < iLength; ++i)
+	{
+		if(pIn[i] == 0)
+		{
+			pOut[iCodePos] = yCode;
+			iCodePos = iOutPos++;
+			yCode = 1;
+		}
+		else
+		{
+			pOut[iOutPos++] = pIn[i];
+			if(++yCode == 0xFF)
+			{
+				pOut[iCodePos] = yCode;
+				iCodePos = iOutPos++;
+				yCode = 1;
+			}
+		}
+	}
+	pOut[iCodePos] = yCode;
+	return iOutPos;
+}
+
+// COBS decode iLength bytes (no delimiters) into pOut, which can be the same
+// buffer as pIn.  Returns the decoded length or -1 if the data is bad.
+inline int CobsDecode(const uint8_t *pIn, int iLength, uint8_t *pOut)
+{
+	int iInPos = 0;
+	int iOutPos = 0;
+	while(iInPos < iLength)
+	{
+		uint8_t yCode = pIn[iInPos++];
+		if(yCode == 0 || iInPos + yCode - 1 > iLength)
+		{
+			return -1;
+		}
+		for(int i = 1; i < yCode; ++i)
+		{
+			pOut[iOutPos++] = pIn[iInPos++];
+		}
+		if(yCode != 0xFF && iInPos < iLength)
+		{
+			pOut[iOutPos++] = 0;
+		}
+	}
+	return iOutPos;
+}
+
+
+
+// A message being built or one that was just read
+class TuningMessage
+{
+public:
+
+	TuningMessage() :
+		m_yType(0),
+		m_iLength(0),
+		m_iReadPos(0)
+	{
+	}
+
+	// Start a new message to send
+	void Begin(uint8_t yType)
+	{
+		m_yType = yType;
+		m_iLength = 0;
+		m_iReadPos = 0;
+	}
+
+	// The Put functions return false (and add nothing) if the value won't fit
+
+	bool PutByte(uint8_t yValue)
+	{
+		return PutBytes(&yValue, 1);
+	}
+
+	bool PutFloat(float fValue)
+	{
+		uint8_t ayValue[4];
+		memcpy(ayValue, &fValue, 4);
+		return PutBytes(ayValue, 4);
+	}
+
+	bool PutBytes(const void *pData, int iLength)
+	{
+		if(m_iLength + iLength > TUNING_MAX_PAYLOAD)
+		{
+			return false;
+		}
+		memcpy(m_ayPayload + m_iLength, pData, iLength);
+		m_iLength += iLength;
+		return true;
+	}
+
+	// The Get functions read the payload in order and return false once it
+	// runs out
+
+	bool GetByte(uint8_t &yValue)
+	{
+		return GetBytes(&yValue, 1);
+	}
+
+	bool GetFloat(float &fValue)
+	{
+		return GetBytes(&fValue, 4);
+	}
+
+	bool GetBytes(void *pData, int iLength)
+	{
+		if(m_iReadPos + iLength > m_iLength)
+		{
+			return false;
+		}
+		memcpy(pData, m_ayPayload + m_iReadPos, iLength);
+		m_iReadPos += iLength;
+		return true;
+	}
+
+	// Encode into a full frame (with delimiters) ready to write out.  ayFrame
+	// needs TUNING_MAX_FRAME bytes.  Returns the frame length.
+	int Encode(uint8_t ayFrame[]) const
+	{
+		uint8_t ayRaw[1 + TUNING_MAX_PAYLOAD + 2];
+		ayRaw[0] = m_yType;
+		memcpy(ayRaw + 1, m_ayPayload, m_iLength);
+		uint16_t iCrc = TuningCrc16(ayRaw, 1 + m_iLength);
+		ayRaw[1 + m_iLength] = iCrc & 0xFF;
+		ayRaw[2 + m_iLength] = iCrc >> 8;
+
+		ayFrame[0] = 0;
+		int iLength = 1 + CobsEncode(ayRaw, 3 + m_iLength, ayFrame + 1);
+		ayFrame[iLength++] = 0;
+		return iLength;
+	}
+
+	// Decode a frame without its delimiters.  Returns false if it is bad.
+	bool Decode(uint8_t ayFrame[], int iFrameLength)
+	{
+		int iLength = CobsDecode(ayFrame, iFrameLength, ayFrame);
+		if(iLength < 3 || iLength > 3 + TUNING_MAX_PAYLOAD)
+		{
+			return false;
+		}
+		uint16_t iCrc = ayFrame[iLength - 2] | ((uint16_t)ayFrame[iLength - 1] << 8);
+		if(iCrc != TuningCrc16(ayFrame, iLength - 2))
+		{
+			return false;
+		}
+		m_yType = ayFrame[0];
+		m_iLength = iLength - 3;
+		memcpy(m_ayPayload, ayFrame + 1, m_iLength);
+		m_iReadPos = 0;
+		return true;
+	}
+
+	uint8_t m_yType;
+	uint8_t m_ayPayload[TUNING_MAX_PAYLOAD];
+	int m_iLength;
+
+private:
+
+	int m_iReadPos;
+};
+
+
+
+// Collects bytes one at a time and hands back each good message.  Bad or
+// too long frames are dropped and counted.
+class TuningFrameReader
+{
+public:
+
+	TuningFrameReader() :
+		m_iLength(0),
+		m_bOverflow(false),
+		m_iBadFrames(0)
+	{
+	}
+
+	// Returns true when yByte finished a good message, which is put in oMsg
+	bool Feed(uint8_t yByte, TuningMessage &oMsg)
+	{
+		if(yByte != 0)
+		{
+			if(m_iLength < (int)sizeof(m_ayFrame))
+			{
+				m_ayFrame[m_iLength++] = yByte;
+			}
+			else
+			{
+				m_bOverflow = true;
+			}
+			return false;
+		}
+
+		// End of a frame.  Back to back delimiters are just empty frames.
+		bool bGood = false;
+		if(m_iLength > 0)
+		{
+			bGood = !m_bOverflow && oMsg.Decode(m_ayFrame, m_iLength);
+			if(!bGood)
+			{
+				m_iBadFrames++;
+			}
+		}
+		m_iLength = 0;
+		m_bOverflow = false;
+		return bGood;
+	}
+
+	unsigned int GetBadFrames() const
+	{
+		return m_iBadFrames;
+	}
+
+private:
+
+	uint8_t m_ayFrame[TUNING_MAX_FRAME];
+	int m_iLength;
+	bool m_bOverflow;
+	unsigned int m_iBadFrames;
+};
+
+#endif // EA_TUNING_LINK_H
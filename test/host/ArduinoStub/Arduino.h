@@ -0,0 +1,55 @@
+/**
+ * File: Arduino.h
+ *
+ * Description: PC stand-ins for the few Arduino core calls made by the
+ * libraries the host tests build as if for an Arduino (ARDUINO defined).
+ * Pins go nowhere and time only moves when a test moves it:
+ *
+ *   g_iStubMicros += 1000;
+ */
+
+#ifndef HOST_ARDUINO_STUB_H
+#define HOST_ARDUINO_STUB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+static uint32_t g_iStubMicros = 0;
+
+inline uint32_t micros()
+{
+	return g_iStubMicros;
+}
+
+inline uint32_t millis()
+{
+	return g_iStubMicros / 1000;
+}
+
+inline void pinMode(uint8_t, uint8_t)
+{
+}
+
+inline void digitalWrite(uint8_t, uint8_t)
+{
+}
+
+inline void noInterrupts()
+{
+}
+
+inline void interrupts()
+{
+}
+
+#endif // HOST_ARDUINO_STUB_H
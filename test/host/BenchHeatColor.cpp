@@ -0,0 +1,139 @@
+/**
+ * File: BenchHeatColor.cpp
+ *
+ * Description: Heat to LED colors for the ScienceClouds strip (1000 LEDs),
+ * the old way (lerp, scale, float multiply, clamp and ColorFromPalette() for
+ * every LED) against HeatColorMap (EAHeatColor.h), in ns per LED per frame.
+ * The heat comes from a running HeatField so the lerps see real frames.
+ * Both ways are checked to give the same colors.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "HostTest.h"
+#include "EAHeatField.h"
+#include "EAHeatColor.h"
+
+#define NUM_LEDS 1000
+#define MAX_HEAT 240
+
+static const int NUM_FRAMES = 5000;
+static const int NUM_RUNS = 7;
+
+static CRGBPalette256 s_oPal;
+static byte s_ayLastHeat[NUM_LEDS];
+static byte s_ayHeat[NUM_LEDS];
+static CRGB s_aOldLeds[NUM_LEDS];
+static CRGB s_aNewLeds[NUM_LEDS];
+
+static float Clamp(float fValue, float fMin, float fMax)
+{
+	return fValue < fMin ? fMin : (fValue > fMax ? fMax : fValue);
+}
+
+// The per LED loop ScienceClouds had before HeatColorMap
+static void RenderOld(fract8 fLerp, float fSpeedRatio, byte yBaseHeatMax, float fMotionHeadMult, byte yMotionHeatAdd)
+{
+	byte yLerpHeat;
+	for(int j = 0; j < NUM_LEDS; ++j)
+	{
+		yLerpHeat = lerp8by8(s_ayLastHeat[j], s_ayHeat[j], fLerp);
+		yLerpHeat = scale8(yLerpHeat, yBaseHeatMax);
+		yLerpHeat = byte(Clamp(yLerpHeat * (fSpeedRatio * (fMotionHeadMult-1.0) + 1.0), 0, 255));
+		yLerpHeat = qadd8(yLerpHeat, fSpeedRatio * yMotionHeatAdd);
+		yLerpHeat = scale8(yLerpHeat, MAX_HEAT);
+		s_aOldLeds[j] = ColorFromPalette(s_oPal, yLerpHeat);
+	}
+}
+
+// What ScienceClouds does now
+static void RenderNew(HeatColorMap &oHeatColor, fract8 fLerp, float fSpeedRatio, byte yBaseHeatMax, float fMotionHeadMult, byte yMotionHeatAdd)
+{
+	double fMotionMult = fSpeedRatio * (fMotionHeadMult-1.0) + 1.0;
+	byte yMotionAdd = fSpeedRatio * yMotionHeatAdd;
+	for(int i = 0; i < 256; ++i)
+	{
+		byte yHeat = scale8(i, yBaseHeatMax);
+		yHeat = byte(Clamp(yHeat * fMotionMult, 0, 255));
+		yHeat = qadd8(yHeat, yMotionAdd);
+		oHeatColor.m_ayHeatMap[i] = scale8(yHeat, MAX_HEAT);
+	}
+	oHeatColor.Render(s_ayLastHeat, s_ayHeat, fLerp, s_aNewLeds, NUM_LEDS);
+}
+
+int main()
+{
+	printf("BenchHeatColor\n");
+
+	for(int i = 0; i < 256; ++i)
+	{
+		s_oPal[i] = CRGB(i, (i * i) >> 8, 255 - i);
+	}
+	HeatColorMap oHeatColor(s_oPal);
+
+	// Render() does its own lerp, check it against lerp8by8() for every input
+	// (the heat map is still straight through here)
+	bool bSameLerp = true;
+	for(int f = 0; f < 256; ++f)
+	{
+		for(int a = 0; a < 256; ++a)
+		{
+			for(int b = 0; b < 256; ++b)
+			{
+				s_ayLastHeat[0] = a;
+				s_ayHeat[0] = b;
+				oHeatColor.Render(s_ayLastHeat, s_ayHeat, f, s_aNewLeds, 1);
+				bSameLerp &= s_aNewLeds[0].r == s_oPal[lerp8by8(a, b, f)].r;
+			}
+		}
+	}
+	CHECK(bSameLerp);
+
+	// A frame of heat from the ScienceClouds field
+	HeatField<NUM_LEDS, HeatKernel322, HeatSparksPer10> oField(0, 10, HeatSparksPer10(130, 50, 100, 2));
+	for(int i = 0; i < 500; ++i)
+	{
+		memcpy(s_ayLastHeat, s_ayHeat, NUM_LEDS);
+		oField.Update(s_ayHeat, 0.5f, 8);
+	}
+
+	// Same colors for a spread of lerps and speeds
+	bool bSame = true;
+	for(int f = 0; f < 256 && bSame; f += 15)
+	{
+		float fSpeedRatio = f / 255.0f;
+		RenderOld(f, fSpeedRatio, 200, 1.5f, 40);
+		RenderNew(oHeatColor, f, fSpeedRatio, 200, 1.5f, 40);
+		bSame = memcmp(s_aOldLeds, s_aNewLeds, sizeof(s_aOldLeds)) == 0;
+	}
+	CHECK(bSame);
+
+	// Best of a few runs, so the number isn't whatever else the PC was doing
+	double fOldNS = 1e9;
+	double fNewNS = 1e9;
+	for(int r = 0; r < NUM_RUNS; ++r)
+	{
+		double fStart = HostTestSeconds();
+		for(int i = 0; i < NUM_FRAMES; ++i)
+		{
+			RenderOld(i & 0xFF, (i & 0x3FF) / 1023.0f, 200, 1.5f, 40);
+			HostTestKeep(s_aOldLeds);
+		}
+		double fNS = (HostTestSeconds() - fStart) * 1e9 / NUM_FRAMES / NUM_LEDS;
+		fOldNS = fNS < fOldNS ? fNS : fOldNS;
+
+		fStart = HostTestSeconds();
+		for(int i = 0; i < NUM_FRAMES; ++i)
+		{
+			RenderNew(oHeatColor, i & 0xFF, (i & 0x3FF) / 1023.0f, 200, 1.5f, 40);
+			HostTestKeep(s_aNewLeds);
+		}
+		fNS = (HostTestSeconds() - fStart) * 1e9 / NUM_FRAMES / NUM_LEDS;
+		fNewNS = fNS < fNewNS ? fNS : fNewNS;
+	}
+
+	printf("  %d LEDs: per LED %.2f ns/LED, HeatColorMap %.2f ns/LED (%.2fx)\n",
+		NUM_LEDS, fOldNS, fNewNS, fOldNS / fNewNS);
+
+	return HostTestResult("BenchHeatColor");
+}
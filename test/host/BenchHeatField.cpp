@@ -0,0 +1,68 @@
+/**
+ * File: BenchHeatField.cpp
+ *
+ * Description: Time of one HeatField update (cool, diffuse, ignite) for each
+ * kernel and spark policy pair the sketches use, in ns per LED per frame at
+ * 98, 300 and 1000 LEDs.  At 120 FPS a frame is 8.3ms, so 1000 LEDs at
+ * 100 ns/LED would be 1.2% of it on this PC.
+ */
+
+#include <stdio.h>
+#include "HostTest.h"
+#include "EAHeatField.h"
+
+static const int NUM_FRAMES = 20000;
+
+template<int NUM_CELLS, class Kernel, class Sparks>
+static double TimeUpdate(HeatField<NUM_CELLS, Kernel, Sparks> &oField)
+{
+	static byte ayHeat[NUM_CELLS];
+	memset(ayHeat, 0, sizeof(ayHeat));
+
+	// Warm up so the field is in its steady state
+	for(int i = 0; i < 1000; ++i)
+	{
+		oField.Update(ayHeat, 0.5f, 8);
+	}
+
+	double fStart = HostTestSeconds();
+	for(int i = 0; i < NUM_FRAMES; ++i)
+	{
+		oField.Update(ayHeat, 0.5f, 8);
+		HostTestKeep(ayHeat);
+	}
+	double fSeconds = HostTestSeconds() - fStart;
+	return fSeconds * 1e9 / NUM_FRAMES / NUM_CELLS;
+}
+
+template<int NUM_CELLS>
+static void BenchStrip()
+{
+	HeatField<NUM_CELLS, HeatKernel322, HeatSparksPer10> oField322(
+		0, 10, HeatSparksPer10(130, 50, 100, 2));
+	HeatField<NUM_CELLS, HeatKernelBlur5, HeatSparksTimed> oFieldBlur5(
+		10, 15, HeatSparksTimed(20.0f, 40.0f, 2, 3));
+	HeatField<NUM_CELLS, HeatKernelFire2012, HeatSparksFire2012> oFieldFire2012(
+		0, 3, HeatSparksFire2012(120, 16, 32));
+	HeatField<NUM_CELLS, HeatKernelFirst3, HeatSparksSingle> oFieldFirst3(
+		2, 4, HeatSparksSingle(60, 100, 200));
+	HeatField<NUM_CELLS, HeatKernel322, HeatSparksNone> oFieldTouch(
+		2, 4, HeatSparksNone());
+
+	printf("%5d LEDs  322/Per10 %6.2f  Blur5/Timed %6.2f  Fire2012 %6.2f  First3/Single %6.2f  322/None %6.2f  ns/LED/frame\n",
+		NUM_CELLS,
+		TimeUpdate(oField322),
+		TimeUpdate(oFieldBlur5),
+		TimeUpdate(oFieldFire2012),
+		TimeUpdate(oFieldFirst3),
+		TimeUpdate(oFieldTouch));
+}
+
+int main()
+{
+	printf("BenchHeatField\n");
+	BenchStrip<98>();
+	BenchStrip<300>();
+	BenchStrip<1000>();
+	return 0;
+}
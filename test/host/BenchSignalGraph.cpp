@@ -0,0 +1,143 @@
+/**
+ * File: BenchSignalGraph.cpp
+ *
+ * Description: Time per input sample of the touch filtering, the
+ * ProcessingNode pair (EAProcessingNode.h) against the same math as a
+ * SignalGraph table (EASignalGraph.h) as BarLights runs it, and a bigger
+ * table with a median, a peak hold and a trigger on the end.  Reported in
+ * nanoseconds and in CPU clocks (from the time stamp counter where there is
+ * one).  Single precision float, as on the AVR and Teensy 3.2, and one
+ * sample per call, as the sketches call it.
+ *
+ * These are PC clocks, which do a float add in a few clocks where an AVR
+ * takes around a hundred, so they only compare the two versions.
+ */
+
+#include <stdio.h>
+#include "HostTest.h"
+#include "EAProcessingNode.h"
+#include "EASignalGraph.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+ #include <x86intrin.h>
+ #define HAVE_CLOCKS 1
+#else
+ #define HAVE_CLOCKS 0
+#endif
+
+static const int NUM_SAMPLES = 200000;
+static const int NUM_RUNS = 7;
+
+static const SignalNodeDesc s_aoTouchGraph[] =
+{
+	{ SIGNAL_NODE_BOX,        SIGNAL_GRAPH_INPUT, 2,   0 },
+	{ SIGNAL_NODE_DERIVATIVE, 0,                  0,   0 },
+	{ SIGNAL_NODE_EMA,        1,                  0.3, 0 },
+	{ SIGNAL_NODE_BOX,        2,                  10,  0 },
+	{ SIGNAL_NODE_SCALE,      3,                  0.6, 0 }
+};
+
+static const SignalNodeDesc s_aoBigGraph[] =
+{
+	{ SIGNAL_NODE_MEDIAN,     SIGNAL_GRAPH_INPUT, 9,     0    },
+	{ SIGNAL_NODE_BOX,        0,                  2,     0    },
+	{ SIGNAL_NODE_DERIVATIVE, 1,                  0,     0    },
+	{ SIGNAL_NODE_EMA,        2,                  0.3,   0    },
+	{ SIGNAL_NODE_BOX,        3,                  10,    0    },
+	{ SIGNAL_NODE_SCALE,      4,                  0.6,   0    },
+	{ SIGNAL_NODE_PEAK_HOLD,  1,                  0.999, 0.1  },
+	{ SIGNAL_NODE_TRIGGER,    5,                  0.4,   0.3  }
+};
+
+// A touch sensor reading, from 0 to 1
+static float s_afInput[1024];
+
+struct NodePair
+{
+	NodePair() :
+		m_oNode0(NULL, false, 0.0, 2, 1.0),
+		m_oNode1(&m_oNode0, true, 0.3, 10, 0.6)
+	{
+	}
+
+	float Run(float fInput)
+	{
+		m_oNode0.UpdateFromInput(10, fInput);
+		m_oNode1.Update(10);
+		return m_oNode1.GetOutput();
+	}
+
+	ProcessingNode<2> m_oNode0;
+	ProcessingNode<10> m_oNode1;
+};
+
+template<int MAX_NODES>
+struct Graph
+{
+	Graph(const SignalNodeDesc aoNodes[], int iNumNodes) :
+		m_iLast(iNumNodes - 1)
+	{
+		m_oGraph.Load(aoNodes, iNumNodes);
+	}
+
+	float Run(float fInput)
+	{
+		m_oGraph.Run(fInput, 10);
+		return m_oGraph.GetOutput(m_iLast);
+	}
+
+	SignalGraph<MAX_NODES> m_oGraph;
+	int m_iLast;
+};
+
+template<class FILTER>
+static void Time(const char *szName, FILTER &oFilter)
+{
+	double fBestNanos = 1e9;
+	double fBestClocks = 1e9;
+	for(int r = 0; r < NUM_RUNS; ++r)
+	{
+		double fStart = HostTestSeconds();
+#if HAVE_CLOCKS
+		unsigned long long iStartClocks = __rdtsc();
+#endif
+		for(int i = 0; i < NUM_SAMPLES; ++i)
+		{
+			float fOut = oFilter.Run(s_afInput[i & 1023]);
+			HostTestKeep(fOut);
+		}
+#if HAVE_CLOCKS
+		double fClocks = (double)(__rdtsc() - iStartClocks) / NUM_SAMPLES;
+		fBestClocks = fClocks < fBestClocks ? fClocks : fBestClocks;
+#endif
+		double fNanos = (HostTestSeconds() - fStart) * 1e9 / NUM_SAMPLES;
+		fBestNanos = fNanos < fBestNanos ? fNanos : fBestNanos;
+	}
+#if HAVE_CLOCKS
+	printf("  %-34s %6.1f ns %6.0f clocks a sample\n", szName, fBestNanos, fBestClocks);
+#else
+	printf("  %-34s %6.1f ns a sample\n", szName, fBestNanos);
+#endif
+}
+
+int main()
+{
+	// A slow wander with touches on it and a little noise
+	unsigned iSeed = 1;
+	for(int i = 0; i < 1024; ++i)
+	{
+		iSeed = iSeed * 1103515245 + 12345;
+		float fNoise = ((iSeed >> 16) & 0xFF) / 255.0f * 0.01f;
+		s_afInput[i] = 0.1f + ((i / 128) % 2 ? 0.3f : 0.0f) + fNoise;
+	}
+
+	static NodePair oPair;
+	static Graph<8> oTouchGraph(s_aoTouchGraph, 5);
+	static Graph<8> oBigGraph(s_aoBigGraph, 8);
+
+	printf("BenchSignalGraph\n");
+	Time("ProcessingNode pair", oPair);
+	Time("SignalGraph, the same 5 nodes", oTouchGraph);
+	Time("SignalGraph, 8 nodes with a median", oBigGraph);
+	return 0;
+}
@@ -0,0 +1,185 @@
+/**
+ * File: BenchSparkParticles.cpp
+ *
+ * Description: Time of one step of the FeatherLights mode 4 sparks, the old
+ * float loop against SparkParticles (EASparkParticles.h), with 1000 sparks
+ * on a 1000 cell strip, the same with only 50 of the 1000 alive, and the
+ * sketch's 20 on 300 cells.  Each draws with the flicker into a byte array
+ * and into a PackedHeat.
+ *
+ * The old loop wrote two whole cells a spark.  SparkParticles draws three,
+ * the two ends partly covered, and keeps the brighter of the cell and the
+ * spark, so with every spark alive it does more work and is slower.  The old
+ * loop is also timed drawing the same box so the two can be compared like
+ * for like.  The old loop goes through the dead sparks too and SparkParticles
+ * doesn't, which is where the 50 alive case comes out ahead.
+ *
+ * This times a PC, which has an FPU and a divider.  The old loop's float
+ * adds, compares and conversions are software on the AVR boards, which makes
+ * the old loop's cost there larger still.
+ */
+
+#include <stdio.h>
+#include "HostTest.h"
+#include "EASparkParticles.h"
+
+static const int NUM_STEPS = 20000;
+static const int NUM_RUNS = 5;
+
+static const uint16_t s_aiSpeeds[5] = {PARTICLE_CELL, PARTICLE_CELL * 3 / 2, PARTICLE_CELL * 2, PARTICLE_CELL * 5 / 2, PARTICLE_CELL * 3};
+static const float s_afSpeeds[5] = {1.0, 1.5, 2.0, 2.5, 3.0};
+
+// Stand in for the byte array the old sketch drew into, so both heats
+// take Set()
+template<int NUM_CELLS>
+struct ByteHeat
+{
+	void Set(int iCell, uint8_t yHeat)
+	{
+		m_ayData[iCell] = yHeat;
+	}
+
+	void Raise(int iCell, uint8_t yHeat)
+	{
+		uint8_t yOld = m_ayData[iCell];
+		m_ayData[iCell] = yHeat > yOld ? yHeat : yOld;
+	}
+
+	uint8_t m_ayData[NUM_CELLS];
+};
+
+// The UpdateHeat4 loop from before SparkParticles, without the fade or the
+// spawn countdown.  The first NUM_ALIVE sparks start again at the bottom
+// when they reach the end so they stay alive, the rest are dead and parked
+// at the end, and the iPos - 1 write is guarded.  With bBox it draws the same
+// box as SparkParticles instead of two whole cells.
+template<int NUM_SPARKS, int NUM_CELLS, int NUM_ALIVE, bool bBox = false>
+struct OldSparks
+{
+	OldSparks()
+	{
+		for(int i = 0; i < NUM_SPARKS; i++)
+		{
+			m_afPositions[i] = i < NUM_ALIVE ? (float)(i * NUM_CELLS / NUM_ALIVE) : (float)NUM_CELLS;
+			m_afSpeeds[i] = i < NUM_ALIVE ? s_afSpeeds[i % 5] : 0;
+		}
+	}
+
+	template<class HEAT>
+	void Step(HEAT &oHeat)
+	{
+		int iPos;
+		for(int i = 0; i < NUM_SPARKS; i++)
+		{
+			if(m_afPositions[i] < NUM_CELLS)
+			{
+				m_afPositions[i] = m_afPositions[i] + m_afSpeeds[i];
+			}
+			else if(m_afSpeeds[i] > 0)
+			{
+				m_afPositions[i] = 0;
+			}
+			iPos = (int)m_afPositions[i];
+			if(bBox)
+			{
+				uint8_t yHeat = scale8(240, random8(43, 255));
+				uint8_t yFrac = (uint8_t)((m_afPositions[i] - iPos) * 256);
+				DrawCell(oHeat, iPos - 1, scale8(yHeat, 255 - yFrac));
+				DrawCell(oHeat, iPos, yHeat);
+				DrawCell(oHeat, iPos + 1, scale8(yHeat, yFrac));
+			}
+			else if(iPos < NUM_CELLS)
+			{
+				byte yNewBrightness = random8(40,240);
+				oHeat.Set(iPos, yNewBrightness);
+				if(iPos > 0)
+				{
+					oHeat.Set(iPos-1, yNewBrightness);
+				}
+			}
+		}
+	}
+
+	template<class HEAT>
+	static void DrawCell(HEAT &oHeat, int iCell, uint8_t yHeat)
+	{
+		if(iCell >= 0 && iCell < NUM_CELLS)
+		{
+			oHeat.Raise(iCell, yHeat);
+		}
+	}
+
+	float m_afPositions[NUM_SPARKS];
+	float m_afSpeeds[NUM_SPARKS];
+};
+
+// Keeps NUM_ALIVE of the NUM_SPARKS in the pool alive
+template<int NUM_SPARKS, int NUM_CELLS, int NUM_ALIVE>
+struct NewSparks
+{
+	NewSparks()
+	{
+		for(int i = 0; i < NUM_ALIVE; i++)
+		{
+			m_oSparks.Spawn((uint32_t)i * NUM_CELLS / NUM_ALIVE * PARTICLE_CELL, s_aiSpeeds[i % 5], 240);
+		}
+	}
+
+	template<class HEAT>
+	void Step(HEAT &oHeat)
+	{
+		while(m_oSparks.GetNumActive() < NUM_ALIVE)
+		{
+			m_oSparks.Spawn(0, s_aiSpeeds[random8(5)], 240);
+		}
+		m_oSparks.Update(oHeat, NUM_CELLS, 43);
+	}
+
+	SparkParticles<NUM_SPARKS> m_oSparks;
+};
+
+// Best us per step over a few runs
+template<class SPARKS, class HEAT>
+static double TimeSteps(SPARKS &oSparks, HEAT &oHeat)
+{
+	double fBest = 1e9;
+	for(int r = 0; r < NUM_RUNS; ++r)
+	{
+		double fStart = HostTestSeconds();
+		for(int i = 0; i < NUM_STEPS; ++i)
+		{
+			oSparks.Step(oHeat);
+			HostTestKeep(oHeat);
+		}
+		double fMicro = (HostTestSeconds() - fStart) * 1e6 / NUM_STEPS;
+		fBest = fMicro < fBest ? fMicro : fBest;
+	}
+	return fBest;
+}
+
+template<int NUM_SPARKS, int NUM_CELLS, int NUM_ALIVE>
+static void BenchStrip()
+{
+	static OldSparks<NUM_SPARKS, NUM_CELLS, NUM_ALIVE> oOld;
+	static OldSparks<NUM_SPARKS, NUM_CELLS, NUM_ALIVE, true> oOldBox;
+	static NewSparks<NUM_SPARKS, NUM_CELLS, NUM_ALIVE> oNew;
+	static ByteHeat<NUM_CELLS> oOldByteHeat;
+	static PackedHeat<NUM_CELLS> oOldPackedHeat;
+	static uint8_t ayNewByteHeat[NUM_CELLS];
+	static PackedHeat<NUM_CELLS> oNewPackedHeat;
+
+	printf("  %d sparks (%d alive) on %d cells:\n", NUM_SPARKS, NUM_ALIVE, NUM_CELLS);
+	printf("    byte heat    old %6.2f us, old with the box %6.2f us, SparkParticles %6.2f us\n",
+		TimeSteps(oOld, oOldByteHeat), TimeSteps(oOldBox, oOldByteHeat), TimeSteps(oNew, ayNewByteHeat));
+	printf("    packed heat  old %6.2f us, old with the box %6.2f us, SparkParticles %6.2f us\n",
+		TimeSteps(oOld, oOldPackedHeat), TimeSteps(oOldBox, oOldPackedHeat), TimeSteps(oNew, oNewPackedHeat));
+}
+
+int main()
+{
+	printf("BenchSparkParticles\n");
+	BenchStrip<1000, 1000, 1000>();
+	BenchStrip<1000, 1000, 50>();
+	BenchStrip<20, 300, 20>();
+	return 0;
+}
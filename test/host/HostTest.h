@@ -0,0 +1,53 @@
+/**
+ * File: HostTest.h
+ *
+ * Description: The little bit of shared code the host tests and benchmarks
+ * in this directory use.  There is no test framework: a test is a program
+ * that prints what it checked and exits non zero if a CHECK failed, and a
+ * benchmark is a program that prints its timings.  See the Makefile.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <chrono>
+
+static int g_iHostTestFailures = 0;
+
+#define CHECK(bCondition) \
+	do \
+	{ \
+		if(!(bCondition)) \
+		{ \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #bCondition); \
+			++g_iHostTestFailures; \
+		} \
+	} while(0)
+
+// Call at the end of main()
+inline int HostTestResult(const char *szName)
+{
+	if(g_iHostTestFailures > 0)
+	{
+		printf("%s: %d failed\n", szName, g_iHostTestFailures);
+		return 1;
+	}
+	printf("%s: ok\n", szName);
+	return 0;
+}
+
+// Seconds since some fixed time, for timing
+inline double HostTestSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Keeps the compiler from throwing away work whose result isn't used
+template<class T>
+inline void HostTestKeep(const T &oValue)
+{
+	__asm__ __volatile__("" : : "g"(&oValue) : "memory");
+}
+
+#endif // HOST_TEST_H
@@ -0,0 +1,214 @@
+/**
+ * File: TestAdcDecimator.cpp
+ *
+ * Description: Checks SampleRing and AdcDecimator (EAAdcDecimator.h), the
+ * part of the ADC sampling that doesn't touch hardware.  Checks that:
+ *
+ *   - a steady input comes out exactly, from the first reading, up to a
+ *     16 bit ADC at the largest FACTOR
+ *   - a step takes two readings and lands exactly
+ *   - the ring keeps samples in order as its byte head and tail wrap, and
+ *     drops and counts them once it is full
+ *   - two pins mixed in the ring, as in BarLights, decimate the same as each
+ *     pin on its own
+ *   - anything repeating at the block rate or a multiple of it is nulled
+ *     completely, and close to it is cut hard, while slow changes go through
+ */
+
+#include <math.h>
+#include "HostTest.h"
+#include "EAAdcDecimator.h"
+
+#ifndef M_PI
+ #define M_PI 3.14159265358979323846
+#endif
+
+template<int FACTOR>
+static void TestDcGain()
+{
+	static const uint16_t aiValues[] = { 0, 1, 511, 1023, 4095, 65535 };
+	for(int v = 0; v < 6; ++v)
+	{
+		AdcDecimator<FACTOR> oDecimator;
+		uint16_t aiBlock[FACTOR];
+		for(int i = 0; i < FACTOR; ++i)
+		{
+			aiBlock[i] = aiValues[v];
+		}
+
+		// Long enough for the 32 bit sums to wrap many times
+		bool bExact = true;
+		for(int b = 0; b < 20000; ++b)
+		{
+			bExact = bExact && oDecimator.Decimate(aiBlock) == aiValues[v];
+		}
+		CHECK(bExact);
+	}
+}
+
+// A step shows up over two readings and then is exact
+static void TestStep()
+{
+	AdcDecimator<8> oDecimator;
+	uint16_t aiLow[8] = { 100, 100, 100, 100, 100, 100, 100, 100 };
+	uint16_t aiHigh[8] = { 500, 500, 500, 500, 500, 500, 500, 500 };
+	CHECK(oDecimator.Decimate(aiLow) == 100);
+	CHECK(oDecimator.Decimate(aiLow) == 100);
+	uint16_t iFirst = oDecimator.Decimate(aiHigh);
+	CHECK(iFirst > 100 && iFirst < 500);
+	CHECK(oDecimator.Decimate(aiHigh) == 500);
+
+	// Reset() starts again from the next block
+	oDecimator.Reset();
+	CHECK(oDecimator.Decimate(aiLow) == 100);
+}
+
+static void TestRing()
+{
+	SampleRing<64> oRing;
+	uint16_t iNextPush = 0;
+	uint16_t iNextPop = 0;
+	bool bInOrder = true;
+	for(int iRound = 0; iRound < 2000; ++iRound)
+	{
+		// Uneven amounts in, blocks of 5 out
+		int iNumPush = iRound % 13;
+		for(int i = 0; i < iNumPush && oRing.Free() > 0; ++i)
+		{
+			CHECK(oRing.Push(iNextPush++));
+		}
+		uint16_t aiBlock[5];
+		while(oRing.PopBlock(aiBlock, 5))
+		{
+			for(int i = 0; i < 5; ++i)
+			{
+				bInOrder = bInOrder && aiBlock[i] == iNextPop++;
+			}
+		}
+		CHECK(oRing.Count() < 5);
+		CHECK(oRing.Free() == 64 - oRing.Count());
+	}
+	CHECK(bInOrder);
+	CHECK(oRing.Dropped() == 0);
+
+	// Full: new samples are dropped and counted, the old ones kept
+	while(oRing.Free() > 0)
+	{
+		oRing.Push(iNextPush++);
+	}
+	CHECK(oRing.Count() == 64);
+	CHECK(!oRing.Push(9999));
+	oRing.AddDropped(2);
+	CHECK(oRing.Dropped() == 3);
+	uint16_t aiAll[64];
+	CHECK(oRing.PopBlock(aiAll, 64));
+	CHECK(aiAll[0] == iNextPop && aiAll[63] == (uint16_t)(iNextPop + 63));
+	CHECK(!oRing.PopBlock(aiAll, 1));
+}
+
+// Two pins take turns in the ring, as AdcSampler<8, 2> in BarLights pushes
+// them
+static void TestTwoPins()
+{
+	SampleRing<64> oRing;
+	AdcDecimator<8> aoMixed[2];
+	AdcDecimator<8> aoAlone[2];
+	uint16_t aaiAlone[2][8];
+	int iNumReadings = 0;
+	bool bSame = true;
+	for(int n = 0; n < 8 * 500; ++n)
+	{
+		uint16_t iSensor = (uint16_t)(300 + 200 * sin(n * 0.01) + (n * 37) % 11);
+		uint16_t iControl = (uint16_t)((n / 300) % 2 ? 900 : 20);
+		oRing.Push(iSensor);
+		oRing.Push(iControl);
+		aaiAlone[0][n % 8] = iSensor;
+		aaiAlone[1][n % 8] = iControl;
+
+		uint16_t aiBlock[16];
+		if(oRing.PopBlock(aiBlock, 16))
+		{
+			for(int p = 0; p < 2; ++p)
+			{
+				bSame = bSame && aoMixed[p].Decimate(aiBlock + p, 2) == aoAlone[p].Decimate(aaiAlone[p]);
+			}
+			iNumReadings++;
+		}
+	}
+	CHECK(bSame);
+	CHECK(iNumReadings == 500);
+}
+
+// Peak to peak of the readings once settled, for a sine at fCycles a block
+// around 400
+template<int FACTOR>
+static float Response(float fCyclesPerBlock)
+{
+	AdcDecimator<FACTOR> oDecimator;
+	int iMin = 65535;
+	int iMax = 0;
+	int n = 0;
+	for(int b = 0; b < 2000; ++b)
+	{
+		uint16_t aiBlock[FACTOR];
+		for(int i = 0; i < FACTOR; ++i, ++n)
+		{
+			aiBlock[i] = (uint16_t)lrint(400 + 300 * sin(2 * M_PI * fCyclesPerBlock * n / FACTOR + 0.3));
+		}
+		int iReading = oDecimator.Decimate(aiBlock);
+		if(b >= 10)
+		{
+			iMin = iReading < iMin ? iReading : iMin;
+			iMax = iReading > iMax ? iReading : iMax;
+		}
+	}
+	return (float)(iMax - iMin);
+}
+
+template<int FACTOR>
+static void TestNulls()
+{
+	// Exactly at the block rate and its multiples, any pattern that repeats
+	// every block sums the same in every block
+	for(int k = 1; k < FACTOR; ++k)
+	{
+		AdcDecimator<FACTOR> oDecimator;
+		uint16_t aiBlock[FACTOR];
+		for(int i = 0; i < FACTOR; ++i)
+		{
+			aiBlock[i] = (uint16_t)lrint(400 + 300 * sin(2 * M_PI * k * i / FACTOR + 0.3));
+		}
+		int iFirst = oDecimator.Decimate(aiBlock);
+		bool bSteady = true;
+		for(int b = 0; b < 100; ++b)
+		{
+			bSteady = bSteady && oDecimator.Decimate(aiBlock) == iFirst;
+		}
+		CHECK(bSteady);
+		CHECK(iFirst >= 398 && iFirst <= 402);
+	}
+
+	// Near the block rate is cut hard, well under the block rate goes
+	// through.  A second order CIC is down to under 1% within 5% of a null.
+	float fSlow = Response<FACTOR>(0.01f);
+	float fNear = Response<FACTOR>(1.05f);
+	float fNear2 = Response<FACTOR>(1.95f);
+	printf("  FACTOR %d: 600 peak to peak in, %.0f at 1/100 the block rate, %.0f at 1.05x, %.0f at 1.95x\n", FACTOR, fSlow, fNear, fNear2);
+	CHECK(fSlow > 590);
+	CHECK(fNear <= 600 * 0.01f + 2);
+	CHECK(fNear2 <= 600 * 0.01f + 2);
+}
+
+int main()
+{
+	TestDcGain<1>();
+	TestDcGain<5>();
+	TestDcGain<8>();
+	TestDcGain<255>();
+	TestStep();
+	TestRing();
+	TestTwoPins();
+	TestNulls<5>();
+	TestNulls<8>();
+	return HostTestResult("TestAdcDecimator");
+}
@@ -0,0 +1,93 @@
+/**
+ * File: TestFrameTracker.cpp
+ *
+ * Description: Checks that LedFrameTracker (EAFrameTracker.h) sends the
+ * first frame, skips frames that didn't change, returns the prefix up to
+ * the last changed block, sends everything when the brightness changes, and
+ * doesn't miss changes that the old rotate and xor hash cancelled out.
+ */
+
+#include "HostTest.h"
+#include "EAFrameTracker.h"
+
+#define NUM_LEDS 100
+
+static CRGB s_aLeds[NUM_LEDS];
+
+int main()
+{
+	printf("TestFrameTracker\n");
+
+	LedFrameTracker<NUM_LEDS> oTracker;
+
+	// First frame goes out whole, the same frame again doesn't
+	CHECK(oTracker.Update(s_aLeds, 255) == NUM_LEDS);
+	CHECK(oTracker.Update(s_aLeds, 255) == 0);
+	CHECK(oTracker.GetNumSkipped() == 1);
+
+	// Only up to the end of the changed block
+	s_aLeds[20].g = 7;
+	CHECK(oTracker.Update(s_aLeds, 255) == 32);
+	s_aLeds[99].b = 1;
+	CHECK(oTracker.Update(s_aLeds, 255) == NUM_LEDS);
+	CHECK(oTracker.Update(s_aLeds, 255) == 0);
+
+	// Brightness and Invalidate() send everything
+	CHECK(oTracker.Update(s_aLeds, 128) == NUM_LEDS);
+	CHECK(oTracker.Update(s_aLeds, 128) == 0);
+	oTracker.Invalidate();
+	CHECK(oTracker.Update(s_aLeds, 128) == NUM_LEDS);
+
+	// The old hash rotated by 5 over 32 bits so bytes 32 apart landed on the
+	// same bits and the same change to both cancelled out
+	for(int i = 0; i < NUM_LEDS; ++i)
+	{
+		s_aLeds[i] = CRGB();
+	}
+	oTracker.Invalidate();
+	oTracker.Update(s_aLeds, 255);
+	s_aLeds[0].r = 10;
+	s_aLeds[10].b = 10;
+	CHECK(oTracker.Update(s_aLeds, 255) == 16);
+
+	// Every single byte change in every position is caught
+	bool bAllCaught = true;
+	uint8_t *pData = (uint8_t *)s_aLeds;
+	for(int i = 0; i < NUM_LEDS * 3; ++i)
+	{
+		for(int v = 1; v < 256; ++v)
+		{
+			pData[i] ^= v;
+			int iNumToSend = oTracker.Update(s_aLeds, 255);
+			bAllCaught &= iNumToSend >= (i / 3 + 1);
+			pData[i] ^= v;
+			oTracker.Update(s_aLeds, 255);
+		}
+	}
+	CHECK(bAllCaught);
+
+	// Random changes to a few different bytes of one block, like the heat
+	// moving
+	uint32_t iRandom = 1;
+	int iMissed = 0;
+	for(int t = 0; t < 200000; ++t)
+	{
+		iRandom = iRandom * 1664525 + 1013904223;
+		int iBlockStart = (iRandom >> 16) % (NUM_LEDS / 16) * 48;
+		int iOffset = (iRandom >> 8) % 48;
+		int iNumBytes = 2 + t % 4;
+		for(int k = 0; k < iNumBytes; ++k)
+		{
+			iRandom = iRandom * 1664525 + 1013904223;
+			pData[iBlockStart + (iOffset + k * 7) % 48] += 1 + (iRandom >> 16) % 255;
+		}
+		if(oTracker.Update(s_aLeds, 255) == 0)
+		{
+			iMissed++;
+		}
+	}
+	printf("  %d of 200000 multi byte changes not sent\n", iMissed);
+	CHECK(iMissed == 0);
+
+	return HostTestResult("TestFrameTracker");
+}
@@ -0,0 +1,225 @@
+/**
+ * File: TestHeatMemory.cpp
+ *
+ * Description: Checks the RAM savings in EAHeatMemory.h and EAHeatField.h
+ * against what they replaced.  Checks that:
+ *
+ *   - HeatKernelBlur5, which blurs in place, gives the same bytes as the old
+ *     blur that copied the frame into a scratch buffer first, on random
+ *     fields of every length up to 40 and at 300, frame after frame, with
+ *     the two cells at each end left alone
+ *   - PackedHeat keeps the nearest 4 bit step of every heat, in odd and
+ *     even cells without touching the other half of the byte, and that
+ *     Raise() and Fade() saturate the same as a byte per cell array of steps
+ *   - UnpackHeat() gives the same as Get() from any starting cell
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "HostTest.h"
+#include "EAHeatField.h"
+#include "EAHeatMemory.h"
+
+// The blur from before HeatKernelBlur5 worked in place
+static void OldBlur5(byte ayHeat[], int iNumCells, byte ayScratch[])
+{
+	static const fract8 yBlurScale[] = {7, 30, 60, 100, 30};
+
+	memcpy(ayScratch, ayHeat, iNumCells);
+	for(int i = 2; i < iNumCells - 2; i++)
+	{
+		ayHeat[i] =
+			scale8(ayScratch[i-2], yBlurScale[0]) +
+			scale8(ayScratch[i-1], yBlurScale[1]) +
+			scale8(ayScratch[i-0], yBlurScale[2]) +
+			scale8(ayScratch[i+1], yBlurScale[3]) +
+			scale8(ayScratch[i+2], yBlurScale[4]);
+	}
+}
+
+// Random fields, some with only a few hot cells like sparks and some
+// with full heat, blurred for several frames each
+static bool SameBlur(int iNumCells, int iNumFields)
+{
+	byte ayOld[300];
+	byte ayNew[300];
+	byte ayScratch[300];
+	bool bSame = true;
+	for(int f = 0; f < iNumFields; ++f)
+	{
+		for(int i = 0; i < iNumCells; ++i)
+		{
+			switch(f % 3)
+			{
+			case 0: ayOld[i] = (byte)rand(); break;
+			case 1: ayOld[i] = (rand() % 8 == 0) ? 255 : 0; break;
+			default: ayOld[i] = 255; break;
+			}
+		}
+		memcpy(ayNew, ayOld, iNumCells);
+		byte yFirst0 = ayOld[0];
+		byte yFirst1 = ayOld[1];
+		for(int iFrame = 0; iFrame < 10; ++iFrame)
+		{
+			byte yLast0 = iNumCells > 1 ? ayOld[iNumCells - 1] : 0;
+			byte yLast1 = iNumCells > 1 ? ayOld[iNumCells - 2] : 0;
+			OldBlur5(ayOld, iNumCells, ayScratch);
+			HeatKernelBlur5::Apply(ayNew, iNumCells);
+			bSame = bSame && memcmp(ayOld, ayNew, iNumCells) == 0;
+
+			// The ends have no cells past them to blur with
+			if(iNumCells > 1)
+			{
+				bSame = bSame && ayNew[0] == yFirst0 && ayNew[1] == yFirst1;
+				bSame = bSame && ayNew[iNumCells - 1] == yLast0 && ayNew[iNumCells - 2] == yLast1;
+			}
+		}
+	}
+	return bSame;
+}
+
+static void TestBlur()
+{
+	srand(7);
+	int iNumWrong = 0;
+	for(int iNumCells = 0; iNumCells <= 40; ++iNumCells)
+	{
+		iNumWrong += SameBlur(iNumCells, 60) ? 0 : 1;
+	}
+	iNumWrong += SameBlur(300, 300) ? 0 : 1;
+	CHECK(iNumWrong == 0);
+}
+
+#define NUM_CELLS 37
+
+// A byte per cell of steps, what PackedHeat should hold
+struct StepCells
+{
+	uint8_t m_aySteps[NUM_CELLS];
+};
+
+static int Step(uint8_t yHeat)
+{
+	return (yHeat + PACKED_HEAT_STEP / 2) / PACKED_HEAT_STEP;
+}
+
+static bool Matches(const PackedHeat<NUM_CELLS> &oPacked, const StepCells &oCells)
+{
+	bool bSame = true;
+	for(int i = 0; i < NUM_CELLS; ++i)
+	{
+		bSame = bSame && oPacked.Get(i) == oCells.m_aySteps[i] * PACKED_HEAT_STEP;
+	}
+
+	// The unused half of the last byte stays 0
+	bSame = bSame && (NUM_CELLS % 2 == 0 || (oPacked.GetData()[PackedHeat<NUM_CELLS>::NUM_BYTES - 1] >> 4) == 0);
+	return bSame;
+}
+
+static void TestPacked()
+{
+	// The step without the divide is the nearest step for every heat
+	int iNumWrong = 0;
+	for(int h = 0; h < 256; ++h)
+	{
+		iNumWrong += PackedHeatStep((uint8_t)h) == Step((uint8_t)h) ? 0 : 1;
+	}
+	CHECK(iNumWrong == 0);
+	CHECK(PackedHeatStep(255) == 15);
+	CHECK(PackedHeatStep(8) == 0 && PackedHeatStep(9) == 1);
+	CHECK(PackedHeat<NUM_CELLS>::NUM_BYTES == (NUM_CELLS + 1) / 2);
+	CHECK(sizeof(PackedHeat<NUM_CELLS>) == (NUM_CELLS + 1) / 2);
+
+	// Every heat in every cell, with the neighbors kept
+	PackedHeat<NUM_CELLS> oPacked;
+	StepCells oCells;
+	memset(&oCells, 0, sizeof(oCells));
+	CHECK(Matches(oPacked, oCells));
+	for(int h = 0; h < 256; ++h)
+	{
+		for(int i = 0; i < NUM_CELLS; ++i)
+		{
+			int iCell = (i * 11 + h) % NUM_CELLS;
+			oPacked.Set(iCell, (uint8_t)h);
+			oCells.m_aySteps[iCell] = (uint8_t)Step((uint8_t)h);
+		}
+		iNumWrong += Matches(oPacked, oCells) ? 0 : 1;
+	}
+	CHECK(iNumWrong == 0);
+
+	// Random Raise, Fade and Set against the byte per cell steps
+	srand(11);
+	for(int n = 0; n < 100000; ++n)
+	{
+		int iCell = rand() % NUM_CELLS;
+		uint8_t yHeat = (uint8_t)rand();
+		switch(rand() % 8)
+		{
+		case 0:
+		{
+			// Fades are less common than the rest, as in the spark layer
+			oPacked.Fade(yHeat % 40);
+			int iSteps = Step(yHeat % 40);
+			for(int i = 0; i < NUM_CELLS; ++i)
+			{
+				oCells.m_aySteps[i] = (uint8_t)(oCells.m_aySteps[i] > iSteps ? oCells.m_aySteps[i] - iSteps : 0);
+			}
+			break;
+		}
+		case 1:
+			oPacked.Set(iCell, yHeat);
+			oCells.m_aySteps[iCell] = (uint8_t)Step(yHeat);
+			break;
+		default:
+			oPacked.Raise(iCell, yHeat);
+			oCells.m_aySteps[iCell] = (uint8_t)(Step(yHeat) > oCells.m_aySteps[iCell] ? Step(yHeat) : oCells.m_aySteps[iCell]);
+			break;
+		}
+		iNumWrong += Matches(oPacked, oCells) ? 0 : 1;
+	}
+	CHECK(iNumWrong == 0);
+
+	// Full heat fades out in 15 steps of 17, and a fade of 255 clears it all
+	for(int i = 0; i < NUM_CELLS; ++i)
+	{
+		oPacked.Raise(i, 255);
+	}
+	CHECK(oPacked.Get(0) == 255 && oPacked.Get(NUM_CELLS - 1) == 255);
+	for(int s = 0; s < 14; ++s)
+	{
+		oPacked.Fade(PACKED_HEAT_STEP);
+	}
+	CHECK(oPacked.Get(0) == PACKED_HEAT_STEP && oPacked.Get(NUM_CELLS - 1) == PACKED_HEAT_STEP);
+	oPacked.Fade(PACKED_HEAT_STEP);
+	CHECK(oPacked.Get(0) == 0);
+	oPacked.Raise(3, 200);
+	oPacked.Raise(3, 100);
+	CHECK(oPacked.Get(3) == Step(200) * PACKED_HEAT_STEP);
+	oPacked.Fade(255);
+	memset(&oCells, 0, sizeof(oCells));
+	CHECK(Matches(oPacked, oCells));
+
+	// Unpacking any run gives the same as Get()
+	for(int i = 0; i < NUM_CELLS; ++i)
+	{
+		oPacked.Set(i, (uint8_t)(i * 7));
+	}
+	uint8_t ayHeat[NUM_CELLS];
+	for(int iStart = 0; iStart < NUM_CELLS; ++iStart)
+	{
+		int iNum = NUM_CELLS - iStart;
+		UnpackHeat(oPacked.GetData(), iStart, iNum, ayHeat);
+		for(int i = 0; i < iNum; ++i)
+		{
+			iNumWrong += ayHeat[i] == oPacked.Get(iStart + i) ? 0 : 1;
+		}
+	}
+	CHECK(iNumWrong == 0);
+}
+
+int main()
+{
+	TestBlur();
+	TestPacked();
+	return HostTestResult("TestHeatMemory");
+}
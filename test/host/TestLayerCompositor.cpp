@@ -0,0 +1,116 @@
+/**
+ * File: TestLayerCompositor.cpp
+ *
+ * Description: Checks the LayerCompositor (EALayerCompositor.h) blend modes,
+ * the cross fade between two scenes and the fade through black that
+ * FeatherLights uses to change render modes.
+ */
+
+#include "HostTest.h"
+#include "EALayerCompositor.h"
+
+#define NUM_LEDS 40
+
+static CRGBPalette256 s_oPal;
+static uint8_t s_ayHeatA[NUM_LEDS];
+static uint8_t s_ayHeatB[NUM_LEDS];
+static CRGB s_aLeds[NUM_LEDS];
+
+// Every LED is oColor
+static bool AllAre(const CRGB &oColor)
+{
+	for(int i = 0; i < NUM_LEDS; ++i)
+	{
+		if(s_aLeds[i].r != oColor.r || s_aLeds[i].g != oColor.g || s_aLeds[i].b != oColor.b)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	printf("TestLayerCompositor\n");
+
+	// Grey ramp, heat h is (h, h, h)
+	for(int i = 0; i < 256; ++i)
+	{
+		s_oPal[i] = CRGB(i, i, i);
+	}
+	for(int i = 0; i < NUM_LEDS; ++i)
+	{
+		s_ayHeatA[i] = 100;
+		s_ayHeatB[i] = 200;
+	}
+
+	HeatLayer aoAdd[] =
+	{
+		HeatLayer(NULL, s_ayHeatA, s_oPal, LAYER_BLEND_ADD),
+		HeatLayer(NULL, s_ayHeatB, s_oPal, LAYER_BLEND_ADD, 128)
+	};
+	HeatLayer aoMax[] =
+	{
+		HeatLayer(NULL, s_ayHeatA, s_oPal, LAYER_BLEND_ADD),
+		HeatLayer(NULL, s_ayHeatB, s_oPal, LAYER_BLEND_MAX)
+	};
+	HeatLayer aoAlpha[] =
+	{
+		HeatLayer(NULL, s_ayHeatA, s_oPal, LAYER_BLEND_ADD),
+		HeatLayer(NULL, s_ayHeatB, s_oPal, LAYER_BLEND_ALPHA, 128)
+	};
+
+	LayerCompositor oCompositor;
+
+	// Blend modes, no fade for the first scene
+	oCompositor.SetScene(aoAdd, 2, 1000, 0);
+	CHECK(!oCompositor.IsFading(0));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 0);
+	CHECK(AllAre(CRGB(100 + scale8(200, 128), 100 + scale8(200, 128), 100 + scale8(200, 128))));
+	oCompositor.SetScene(aoMax, 2, 0, 0);
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 0);
+	CHECK(AllAre(CRGB(200, 200, 200)));
+
+	// Cross fade from max to alpha over 1s
+	oCompositor.SetScene(aoAlpha, 2, 1000, 1000);
+	CHECK(oCompositor.IsFading(1500));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 1000);
+	CHECK(AllAre(CRGB(200, 200, 200)));
+	uint8_t yAlpha = lerp8by8(100, 200, 128);
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 1500);
+	CHECK(AllAre(CRGB(lerp8by8(200, yAlpha, 128), lerp8by8(200, yAlpha, 128), lerp8by8(200, yAlpha, 128))));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 2000);
+	CHECK(!oCompositor.IsFading(2000));
+	CHECK(AllAre(CRGB(yAlpha, yAlpha, yAlpha)));
+
+	// Setting the scene on show again does nothing
+	oCompositor.SetScene(aoAlpha, 2, 1000, 3000);
+	CHECK(!oCompositor.IsFading(3000));
+
+	// Fade through black: down over the first half, back up over the second
+	CHECK(oCompositor.IsPastBlack(3000));
+	oCompositor.FadeThroughBlack(1000, 3000);
+	CHECK(!oCompositor.IsPastBlack(3000));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 3000);
+	CHECK(AllAre(CRGB(yAlpha, yAlpha, yAlpha)));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 3250);
+	uint8_t yHalf = scale8(yAlpha, 255 - 250 * 255 / 500);
+	CHECK(AllAre(CRGB(yHalf, yHalf, yHalf)));
+	CHECK(!oCompositor.IsPastBlack(3499));
+	CHECK(oCompositor.IsPastBlack(3500));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 3500);
+	CHECK(AllAre(CRGB(0, 0, 0)));
+
+	// The change is made in the dark and comes up from there
+	oCompositor.SetScene(aoMax, 2, 0, 3500);
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 3750);
+	yHalf = scale8(200, 250 * 255 / 500);
+	CHECK(AllAre(CRGB(yHalf, yHalf, yHalf)));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 4000);
+	CHECK(AllAre(CRGB(200, 200, 200)));
+	CHECK(oCompositor.IsPastBlack(5000));
+	oCompositor.Render(s_aLeds, NUM_LEDS, 255, 5000);
+	CHECK(AllAre(CRGB(200, 200, 200)));
+
+	return HostTestResult("TestLayerCompositor");
+}
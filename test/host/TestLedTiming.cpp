@@ -0,0 +1,68 @@
+/**
+ * File: TestLedTiming.cpp
+ *
+ * Description: Runs the shared frame time vectors (LedTimingVectors.txt)
+ * through LedTiming (EALedTiming.h).  test_led_timing.py runs the same
+ * vectors through Python/led_timing.py, so the two copies of the model
+ * can't drift apart.  Checks that:
+ *
+ *   - WireMicro() and FrameMicro() give every time in the vectors
+ *   - MaxFps() is one second over the frame time
+ */
+
+#include <math.h>
+#include <string.h>
+#include "HostTest.h"
+#include "EALedTiming.h"
+
+int main(int argc, char *argv[])
+{
+	const char *szPath = argc > 1 ? argv[1] : "LedTimingVectors.txt";
+	FILE *pFile = fopen(szPath, "r");
+	CHECK(pFile != NULL);
+	if(!pFile)
+	{
+		return HostTestResult("TestLedTiming");
+	}
+
+	char szLine[256];
+	int iLine = 0;
+	int iNumFrames = 0;
+	while(fgets(szLine, sizeof(szLine), pFile))
+	{
+		iLine++;
+		if(szLine[0] == '#' || strspn(szLine, " \t\r\n") == strlen(szLine))
+		{
+			continue;
+		}
+
+		int iNumLeds;
+		int iNumStrips;
+		unsigned long iRenderMicro;
+		char szDriver[16];
+		unsigned long iWireMicro;
+		unsigned long iFrameMicro;
+		if(sscanf(szLine, "frame %d %d %lu %15s %lu %lu", &iNumLeds, &iNumStrips, &iRenderMicro, szDriver, &iWireMicro, &iFrameMicro) != 6 ||
+		   (strcmp(szDriver, "dma") != 0 && strcmp(szDriver, "blocking") != 0))
+		{
+			printf("  line %d: can't read \"%s\"\n", iLine, szLine);
+			CHECK(false);
+			continue;
+		}
+		bool bDMA = strcmp(szDriver, "dma") == 0;
+		int iLedsPerStrip = (iNumLeds + iNumStrips - 1) / iNumStrips;
+		unsigned long iWire = LedTiming::WireMicro(iLedsPerStrip);
+		unsigned long iFrame = LedTiming::FrameMicro(iNumLeds, iNumStrips, iRenderMicro, bDMA);
+		if(iWire != iWireMicro || iFrame != iFrameMicro)
+		{
+			printf("  line %d: wire %lu frame %lu, expected %lu %lu\n", iLine, iWire, iFrame, iWireMicro, iFrameMicro);
+			CHECK(false);
+		}
+		CHECK(fabsf(LedTiming::MaxFps(iNumLeds, iNumStrips, iRenderMicro, bDMA) * iFrameMicro - 1000000.0f) < 1.0f);
+		iNumFrames++;
+	}
+	fclose(pFile);
+	printf("  %d frames\n", iNumFrames);
+	CHECK(iNumFrames > 0);
+	return HostTestResult("TestLedTiming");
+}
@@ -0,0 +1,129 @@
+/**
+ * File: TestNeoPixelAsync.cpp
+ *
+ * Description: Checks the async show() pieces in NeoPixelAsync.h: the UART
+ * encoding gives the right WS2812 pulse for every bit, with and without a
+ * table, show() waits out a busy transport before handing it the next
+ * frame, and Adafruit_NeoPixel::show() goes through the transport once one
+ * is set.  NeoPixelMockTransport stands in for the UART.
+ */
+
+#include "HostTest.h"
+#include "Adafruit_NeoPixel.h"
+
+#define NUM_LEDS 8
+#define NUM_BYTES (NUM_LEDS * 3)
+#define NUM_UART_BYTES (NUM_BYTES * NEO_UART_BYTES_PER_BYTE)
+
+// The pixel byte the strip sees from UART bytes ayUart[0..3].  The UART
+// sends a start bit (0), data bits 0 to 7 and a stop bit (1), and TX is
+// inverted.  Each half of the frame is one WS2812 bit of 5 UART bits: a 1
+// is 4 high then 1 low, a 0 is 1 high then 4 low.  -1 if any half is
+// neither.
+static int StripByte(const uint8_t ayUart[])
+{
+	int iByte = 0;
+	for(int i = 0; i < NEO_UART_BYTES_PER_BYTE; ++i)
+	{
+		bool abLine[10];
+		abLine[0] = true;
+		for(int b = 0; b < 8; ++b)
+		{
+			abLine[b + 1] = !(ayUart[i] & (1 << b));
+		}
+		abLine[9] = false;
+
+		for(int iHalf = 0; iHalf < 2; ++iHalf)
+		{
+			const bool *pHalf = &abLine[iHalf * 5];
+			int iHigh = 0;
+			while(iHigh < 5 && pHalf[iHigh])
+			{
+				++iHigh;
+			}
+			for(int j = iHigh; j < 5; ++j)
+			{
+				if(pHalf[j])
+				{
+					return -1;
+				}
+			}
+			if(iHigh != 1 && iHigh != 4)
+			{
+				return -1;
+			}
+			iByte = (iByte << 1) | (iHigh == 4 ? 1 : 0);
+		}
+	}
+	return iByte;
+}
+
+int main()
+{
+	printf("TestNeoPixelAsync\n");
+
+	// Every byte value comes out as the right pulses
+	uint8_t aySrc[256];
+	uint8_t ayUart[256 * NEO_UART_BYTES_PER_BYTE];
+	for(int i = 0; i < 256; ++i)
+	{
+		aySrc[i] = i;
+	}
+	neoPixelUartEncode(ayUart, aySrc, 256);
+	for(int i = 0; i < 256; ++i)
+	{
+		CHECK(StripByte(&ayUart[i * NEO_UART_BYTES_PER_BYTE]) == i);
+	}
+
+	// Through a table, as NEO_RENDER sends them
+	uint8_t ayLut[256];
+	for(int i = 0; i < 256; ++i)
+	{
+		ayLut[i] = (uint8_t)(i * 5 + 1);
+	}
+	neoPixelUartEncode(ayUart, aySrc, 256, ayLut);
+	for(int i = 0; i < 256; ++i)
+	{
+		CHECK(StripByte(&ayUart[i * NEO_UART_BYTES_PER_BYTE]) == ayLut[i]);
+	}
+
+	// show() through a strip.  Nothing goes to the transport until one is
+	// set, and nothing after it is taken away.
+	NeoPixelMockTransport oStripTransport;
+	Adafruit_NeoPixel oStrip(NUM_LEDS, 6, NEO_GRB + NEO_KHZ800);
+	oStrip.setPixelColor(0, 0x123456);
+	oStrip.show();
+	CHECK(oStripTransport.writes == 0);
+
+	oStrip.setTransport(&oStripTransport);
+	oStrip.show();
+	CHECK(oStripTransport.writes == 1);
+	CHECK(oStripTransport.lastLen == NUM_UART_BYTES);
+	CHECK(StripByte(&oStripTransport.lastBuf[0]) == 0x34);
+	CHECK(StripByte(&oStripTransport.lastBuf[4]) == 0x12);
+	CHECK(StripByte(&oStripTransport.lastBuf[8]) == 0x56);
+
+	// The pixels can change as soon as show() returns
+	oStrip.setPixelColor(0, 0);
+	CHECK(StripByte(&oStripTransport.lastBuf[4]) == 0x12);
+
+	oStrip.setTransport(NULL);
+	oStrip.show();
+	CHECK(oStripTransport.writes == 1);
+
+	// Back to back frames wait out the busy transport, and nothing is
+	// written while it is busy
+	NeoPixelMockTransport oBusyTransport(3);
+	oStrip.setTransport(&oBusyTransport);
+	oStrip.show();
+	CHECK(oBusyTransport.writes == 1);
+	CHECK(oBusyTransport.busyCalls == 1);
+	oStrip.setPixelColor(1, 0xF0F0F0);
+	oStrip.show();
+	CHECK(oBusyTransport.writes == 2);
+	CHECK(oBusyTransport.busyCalls == 1 + 3 + 1);
+	CHECK(oBusyTransport.busyWrites == 0);
+	CHECK(StripByte(&oBusyTransport.lastBuf[12]) == 0xF0);
+
+	return HostTestResult("TestNeoPixelAsync");
+}
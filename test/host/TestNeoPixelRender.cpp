@@ -0,0 +1,145 @@
+/**
+ * File: TestNeoPixelRender.cpp
+ *
+ * Description: Checks the bytes Adafruit_NeoPixel sends in NEO_RENDER mode:
+ * the brightness and gamma table, the color order, that the pixels
+ * themselves are never scaled, and that at the same brightness the wire
+ * bytes match what the old scale-on-set mode keeps in its buffer.  The
+ * frames are caught with NeoPixelMockTransport and decoded back from the
+ * UART encoding.
+ */
+
+#include "HostTest.h"
+#include "Adafruit_NeoPixel.h"
+
+#define NUM_LEDS 16
+
+// Undo neoPixelUartEncode().  False if a UART byte isn't one the encoder
+// makes.
+static bool UartDecode(uint8_t ayOut[], const uint8_t ayUart[], int iNumBytes)
+{
+	for(int i = 0; i < iNumBytes; ++i)
+	{
+		uint8_t y = 0;
+		for(int j = 0; j < NEO_UART_BYTES_PER_BYTE; ++j)
+		{
+			uint8_t x = ayUart[i * NEO_UART_BYTES_PER_BYTE + j];
+			if((x & 0x18) != 0x08 || ((x & 0x07) != 0 && (x & 0x07) != 0x07) || ((x & 0xE0) != 0 && (x & 0xE0) != 0xE0))
+			{
+				return false;
+			}
+			y = (y << 2) | ((x & 0x07) ? 0 : 2) | ((x & 0xE0) ? 0 : 1);
+		}
+		ayOut[i] = y;
+	}
+	return true;
+}
+
+// show() and decode what went out
+static bool Send(Adafruit_NeoPixel &oStrip, NeoPixelMockTransport &oTransport, uint8_t ayWire[])
+{
+	uint32_t iWrites = oTransport.writes;
+	oStrip.show();
+	return oTransport.writes == iWrites + 1 &&
+		oTransport.lastLen == NUM_LEDS * 3 * NEO_UART_BYTES_PER_BYTE &&
+		UartDecode(ayWire, oTransport.lastBuf, NUM_LEDS * 3);
+}
+
+static uint32_t TestColor(int i)
+{
+	return Adafruit_NeoPixel::Color(i * 16, 255 - i * 13, (i * 71) & 0xFF);
+}
+
+int main()
+{
+	printf("TestNeoPixelRender\n");
+
+	uint8_t ayWire[NUM_LEDS * 3];
+	uint8_t ayLut[256];
+	uint8_t aySrc[256];
+
+	// buildWireBytes() is a plain table lookup
+	for(int i = 0; i < 256; ++i)
+	{
+		aySrc[i] = 255 - i;
+		ayLut[i] = (uint8_t)(i * 7 + 3);
+	}
+	uint8_t ayDst[256];
+	Adafruit_NeoPixel::buildWireBytes(ayDst, aySrc, 256, ayLut);
+	for(int i = 0; i < 256; ++i)
+	{
+		CHECK(ayDst[i] == ayLut[255 - i]);
+	}
+
+	NeoPixelMockTransport oTransport;
+	Adafruit_NeoPixel oStrip(NUM_LEDS, 6, NEO_GRB + NEO_KHZ800 + NEO_RENDER);
+	Adafruit_NeoPixel oOldStrip(NUM_LEDS, 6, NEO_GRB + NEO_KHZ800);
+	oStrip.setTransport(&oTransport);
+	oOldStrip.setTransport(&oTransport);
+
+	for(int i = 0; i < NUM_LEDS; ++i)
+	{
+		oStrip.setPixelColor(i, TestColor(i));
+	}
+
+	// Never set is full brightness and linear, GRB on the wire
+	CHECK(Send(oStrip, oTransport, ayWire));
+	for(int i = 0; i < NUM_LEDS; ++i)
+	{
+		uint32_t c = TestColor(i);
+		CHECK(ayWire[i * 3 + 0] == (uint8_t)(c >> 8));
+		CHECK(ayWire[i * 3 + 1] == (uint8_t)(c >> 16));
+		CHECK(ayWire[i * 3 + 2] == (uint8_t)c);
+	}
+
+	// Every brightness: the wire bytes match the old mode, where the pixels
+	// are scaled as they are set, and the pixels themselves keep their value
+	for(int iBrightness = 0; iBrightness < 256; ++iBrightness)
+	{
+		oStrip.setBrightness(iBrightness);
+		oOldStrip.setBrightness(iBrightness);
+		for(int i = 0; i < NUM_LEDS; ++i)
+		{
+			oOldStrip.setPixelColor(i, TestColor(i));
+		}
+		uint8_t ayOldWire[NUM_LEDS * 3];
+		CHECK(Send(oStrip, oTransport, ayWire));
+		CHECK(Send(oOldStrip, oTransport, ayOldWire));
+		CHECK(memcmp(ayWire, ayOldWire, sizeof(ayWire)) == 0);
+		CHECK(oStrip.getPixelColor(NUM_LEDS - 1) == TestColor(NUM_LEDS - 1));
+		CHECK(oStrip.getBrightness() == iBrightness);
+	}
+
+	// Dimming all the way down and back up loses nothing
+	oStrip.setBrightness(1);
+	CHECK(Send(oStrip, oTransport, ayWire));
+	oStrip.setBrightness(255);
+	CHECK(Send(oStrip, oTransport, ayWire));
+	CHECK(ayWire[1] == (uint8_t)(TestColor(0) >> 16));
+
+	// Gamma then brightness
+	oStrip.setGamma(2.2f);
+	oStrip.setBrightness(100);
+	CHECK(Send(oStrip, oTransport, ayWire));
+	for(int i = 0; i < NUM_LEDS; ++i)
+	{
+		uint8_t yRed = (uint8_t)(TestColor(i) >> 16);
+		uint8_t yGamma = (uint8_t)(pow(yRed / 255.0, 2.2f) * 255.0 + 0.5);
+		CHECK(ayWire[i * 3 + 1] == (uint8_t)((yGamma * 101) >> 8));
+	}
+
+	// Back to linear
+	oStrip.setGamma(1.0f);
+	oStrip.setBrightness(255);
+	CHECK(Send(oStrip, oTransport, ayWire));
+	CHECK(ayWire[1] == (uint8_t)(TestColor(0) >> 16));
+
+	// setGamma() does nothing outside of NEO_RENDER
+	oOldStrip.setBrightness(255);
+	oOldStrip.setPixelColor(0, 0x808080);
+	oOldStrip.setGamma(2.2f);
+	CHECK(Send(oOldStrip, oTransport, ayWire));
+	CHECK(ayWire[0] == 0x80 && ayWire[1] == 0x80 && ayWire[2] == 0x80);
+
+	return HostTestResult("TestNeoPixelRender");
+}
@@ -0,0 +1,365 @@
+/**
+ * File: TestNodeFrame.cpp
+ *
+ * Description: Checks NodeFrame and NodeFrameReader (EANodeFrame.h), the
+ * frames on the RS-485 node bus.  Checks that:
+ *
+ *   - MOTION, BEACON and a TUNING frame for all 7 nodes come back the same
+ *     through the reader a byte at a time, and are the lengths the slot
+ *     timing assumes (NODE_MOTION_FRAME_BYTES, NODE_BEACON_FRAME_BYTES)
+ *   - a bad CRC, a flipped bit anywhere and a different version are dropped
+ *     and counted
+ *   - a frame too long for the payload, a run of bytes longer than the
+ *     reader holds and input that never ends are dropped without touching
+ *     anything past the buffers
+ *   - after garbage the reader picks up again at the next delimiter, so
+ *     at most the frame right after the garbage is lost
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "HostTest.h"
+#include "EANodeFrame.h"
+#include "EATdmaScheduler.h"
+
+static bool Same(const NodeFrame &oA, const NodeFrame &oB)
+{
+	return oA.m_yType == oB.m_yType && oA.m_ySender == oB.m_ySender && oA.m_ySequence == oB.m_ySequence &&
+		oA.m_iLength == oB.m_iLength && memcmp(oA.m_ayPayload, oB.m_ayPayload, oA.m_iLength) == 0;
+}
+
+// Feed a byte at a time.  The frames that come out go in aoFrames.
+static void FeedAll(NodeFrameReader &oReader, const uint8_t *pBytes, int iLength, std::vector<NodeFrame> &aoFrames)
+{
+	for(int i = 0; i < iLength; ++i)
+	{
+		NodeFrame oFrame;
+		if(oReader.Feed(pBytes[i], oFrame))
+		{
+			aoFrames.push_back(oFrame);
+		}
+	}
+}
+
+// Encode oSent and read it back, which has to give the same frame on the
+// last byte and no other
+static bool RoundTrip(const NodeFrame &oSent, int iExpectedLength)
+{
+	uint8_t ayWire[NODE_FRAME_MAX_WIRE];
+	int iLength = oSent.Encode(ayWire);
+	bool bGood = iLength <= NODE_FRAME_MAX_WIRE && (iExpectedLength < 0 || iLength == iExpectedLength);
+	bGood = bGood && ayWire[iLength - 1] == 0 && memchr(ayWire, 0, iLength - 1) == NULL;
+
+	NodeFrameReader oReader;
+	for(int i = 0; i < iLength; ++i)
+	{
+		NodeFrame oFrame;
+		bool bDone = oReader.Feed(ayWire[i], oFrame);
+		bGood = bGood && bDone == (i == iLength - 1);
+		if(bDone)
+		{
+			bGood = bGood && Same(oFrame, oSent);
+		}
+	}
+	return bGood && oReader.GetBadFrames() == 0;
+}
+
+static void TestMotion()
+{
+	// Every motion value, and times and sequences with and without zero bytes
+	int iNumWrong = 0;
+	for(int iMotion = 0; iMotion <= NODE_MOTION_MAX; ++iMotion)
+	{
+		NodeFrame oSent;
+		oSent.Begin(NODE_FRAME_MOTION, iMotion % 7, (uint8_t)iMotion);
+		oSent.PutWord(iMotion);
+		oSent.PutWord((uint16_t)(iMotion * 97));
+		iNumWrong += RoundTrip(oSent, NODE_MOTION_FRAME_BYTES) ? 0 : 1;
+	}
+	CHECK(iNumWrong == 0);
+
+	// And the values read back in order
+	NodeFrame oSent;
+	oSent.Begin(NODE_FRAME_MOTION, 6, 255);
+	oSent.PutWord(NODE_MOTION_MAX);
+	oSent.PutWord(0xBE00);
+	uint8_t ayWire[NODE_FRAME_MAX_WIRE];
+	int iLength = oSent.Encode(ayWire);
+	NodeFrame oFrame;
+	CHECK(oFrame.Decode(ayWire, iLength - 1));
+	uint16_t iMotion = 0;
+	uint16_t iTime = 0;
+	uint8_t yExtra;
+	CHECK(oFrame.GetWord(iMotion) && iMotion == NODE_MOTION_MAX);
+	CHECK(oFrame.GetWord(iTime) && iTime == 0xBE00);
+	CHECK(!oFrame.GetByte(yExtra));
+	CHECK(oFrame.m_yType == NODE_FRAME_MOTION && oFrame.m_ySender == 6 && oFrame.m_ySequence == 255);
+}
+
+static void TestBeacon()
+{
+	int iNumWrong = 0;
+	for(int iRound = 1; iRound <= TDMA_NUM_ROUND_IDS; ++iRound)
+	{
+		NodeFrame oSent;
+		oSent.Begin(NODE_FRAME_BEACON, 7, (uint8_t)(iRound * 3));
+		oSent.PutByte(iRound);
+		iNumWrong += RoundTrip(oSent, NODE_BEACON_FRAME_BYTES) ? 0 : 1;
+	}
+	CHECK(iNumWrong == 0);
+}
+
+// The TUNING frame the PC sends, for all 7 nodes.  Each node reads its own
+// values the way ReceiveTuningMessage() does.
+static void TestTuning()
+{
+	srand(2);
+	for(int n = 0; n < 200; ++n)
+	{
+		uint16_t aiValues[7][NODE_NUM_TUNING_VARS];
+		NodeFrame oSent;
+		oSent.Begin(NODE_FRAME_TUNING, 7, (uint8_t)n);
+		CHECK(oSent.PutByte(7));
+		for(int iNode = 0; iNode < 7; ++iNode)
+		{
+			for(int v = 0; v < NODE_NUM_TUNING_VARS; ++v)
+			{
+				// Plenty of zero bytes, which COBS has to get rid of
+				aiValues[iNode][v] = (n % 2) ? (uint16_t)(rand() & 0xFF00) : (uint16_t)rand();
+				CHECK(oSent.PutWord(aiValues[iNode][v]));
+			}
+		}
+		CHECK(oSent.m_iLength == NODE_FRAME_MAX_PAYLOAD);
+		CHECK(RoundTrip(oSent, -1));
+
+		uint8_t ayWire[NODE_FRAME_MAX_WIRE];
+		int iLength = oSent.Encode(ayWire);
+		for(int iNode = 0; iNode < 7; ++iNode)
+		{
+			NodeFrame oFrame;
+			uint8_t ayCopy[NODE_FRAME_MAX_WIRE];
+			memcpy(ayCopy, ayWire, iLength);
+			CHECK(oFrame.Decode(ayCopy, iLength - 1));
+			uint8_t yNumNodes = 0;
+			CHECK(oFrame.GetByte(yNumNodes) && yNumNodes == 7);
+			uint16_t iValue;
+			for(int i = 0; i < iNode * NODE_NUM_TUNING_VARS; ++i)
+			{
+				oFrame.GetWord(iValue);
+			}
+			for(int v = 0; v < NODE_NUM_TUNING_VARS; ++v)
+			{
+				CHECK(oFrame.GetWord(iValue) && iValue == aiValues[iNode][v]);
+			}
+		}
+	}
+
+	// A full payload takes nothing more
+	NodeFrame oFull;
+	oFull.Begin(NODE_FRAME_TUNING, 7, 0);
+	for(int i = 0; i < NODE_FRAME_MAX_PAYLOAD; ++i)
+	{
+		CHECK(oFull.PutByte(0x55));
+	}
+	CHECK(!oFull.PutByte(1));
+	CHECK(!oFull.PutWord(1));
+	CHECK(oFull.m_iLength == NODE_FRAME_MAX_PAYLOAD);
+}
+
+// A frame encoded by hand, so the CRC, version and length can be wrong.
+// Returns the wire length with the delimiter.
+static int HandFrame(uint8_t yVersion, uint8_t yType, int iPayloadLength, int iCrcOffset, uint8_t ayWire[])
+{
+	uint8_t ayRaw[NODE_FRAME_MAX_RAW + 16];
+	ayRaw[0] = (uint8_t)(yVersion << 4 | yType);
+	ayRaw[1] = 2;
+	ayRaw[2] = 9;
+	for(int i = 0; i < iPayloadLength; ++i)
+	{
+		ayRaw[3 + i] = (uint8_t)(i * 13 + 1);
+	}
+	ayRaw[3 + iPayloadLength] = (uint8_t)(NodeCrc8(ayRaw, 3 + iPayloadLength) + iCrcOffset);
+	int iLength = CobsEncode(ayRaw, 4 + iPayloadLength, ayWire);
+	ayWire[iLength++] = 0;
+	return iLength;
+}
+
+static void TestRejected()
+{
+	uint8_t ayWire[NODE_FRAME_MAX_WIRE + 16];
+	std::vector<NodeFrame> aoFrames;
+
+	// Made by hand right, so the ones below only differ in what is wrong
+	NodeFrameReader oReader;
+	FeedAll(oReader, ayWire, HandFrame(NODE_FRAME_VERSION, NODE_FRAME_MOTION, 4, 0, ayWire), aoFrames);
+	CHECK(aoFrames.size() == 1 && oReader.GetBadFrames() == 0);
+
+	// Bad CRC
+	for(int iOffset = 1; iOffset < 256; ++iOffset)
+	{
+		FeedAll(oReader, ayWire, HandFrame(NODE_FRAME_VERSION, NODE_FRAME_MOTION, 4, iOffset, ayWire), aoFrames);
+	}
+	CHECK(aoFrames.size() == 1 && oReader.GetBadFrames() == 255);
+
+	// Any other version, with a good CRC
+	for(int iVersion = 0; iVersion < 16; ++iVersion)
+	{
+		if(iVersion != NODE_FRAME_VERSION)
+		{
+			FeedAll(oReader, ayWire, HandFrame(iVersion, NODE_FRAME_MOTION, 4, 0, ayWire), aoFrames);
+		}
+	}
+	CHECK(aoFrames.size() == 1 && oReader.GetBadFrames() == 255 + 15);
+
+	// Too short to hold a header and CRC
+	static const uint8_t ayShort[] = { 0x01, 0x00, 0x02, 0x11, 0x00, 0x03, 0x11, 0x02, 0x00 };
+	FeedAll(oReader, ayShort, sizeof(ayShort), aoFrames);
+	CHECK(aoFrames.size() == 1 && oReader.GetBadFrames() == 255 + 15 + 3);
+
+	// Broken COBS: a code byte running past the end
+	static const uint8_t ayBadCobs[] = { 0x09, 0x11, 0x02, 0x00 };
+	FeedAll(oReader, ayBadCobs, sizeof(ayBadCobs), aoFrames);
+	CHECK(aoFrames.size() == 1 && oReader.GetBadFrames() == 255 + 15 + 4);
+
+	// Every single bit flip of a good frame is caught.  A flip to 0x00 splits
+	// the frame in two, and both halves have to be dropped.
+	NodeFrame oSent;
+	oSent.Begin(NODE_FRAME_MOTION, 4, 17);
+	oSent.PutWord(1234);
+	oSent.PutWord(0);
+	uint8_t ayGood[NODE_FRAME_MAX_WIRE];
+	int iLength = oSent.Encode(ayGood);
+	int iNumFlips = 0;
+	int iNumAccepted = 0;
+	for(int i = 0; i < iLength - 1; ++i)
+	{
+		for(int b = 0; b < 8; ++b)
+		{
+			memcpy(ayWire, ayGood, iLength);
+			ayWire[i] ^= (uint8_t)(1 << b);
+			NodeFrameReader oFlipReader;
+			std::vector<NodeFrame> aoFlipped;
+			FeedAll(oFlipReader, ayWire, iLength, aoFlipped);
+			iNumAccepted += (int)aoFlipped.size();
+			iNumFlips++;
+		}
+	}
+	printf("  %d single bit flips of a MOTION frame, %d got through\n", iNumFlips, iNumAccepted);
+	CHECK(iNumAccepted == 0);
+}
+
+static void TestTooLong()
+{
+	uint8_t ayWire[NODE_FRAME_MAX_WIRE + 16];
+	std::vector<NodeFrame> aoFrames;
+	NodeFrameReader oReader;
+
+	// A payload one byte over, with a good CRC, still fits in the reader
+	// but is too long to decode
+	int iLength = HandFrame(NODE_FRAME_VERSION, NODE_FRAME_TUNING, NODE_FRAME_MAX_PAYLOAD + 1, 0, ayWire);
+	CHECK(iLength - 1 <= NODE_FRAME_MAX_WIRE);
+	FeedAll(oReader, ayWire, iLength, aoFrames);
+	CHECK(aoFrames.empty() && oReader.GetBadFrames() == 1);
+
+	// Far more bytes than the reader holds, then a delimiter: one bad frame
+	std::vector<uint8_t> ayLong(5000, 0x42);
+	ayLong.push_back(0);
+	FeedAll(oReader, &ayLong[0], (int)ayLong.size(), aoFrames);
+	CHECK(aoFrames.empty() && oReader.GetBadFrames() == 2);
+
+	// A long run that happens to end with a whole good frame is still
+	// dropped, since the start of it was lost
+	NodeFrame oSent;
+	oSent.Begin(NODE_FRAME_BEACON, 7, 1);
+	oSent.PutByte(3);
+	iLength = oSent.Encode(ayWire);
+	ayLong.assign(300, 0x42);
+	ayLong.insert(ayLong.end(), ayWire, ayWire + iLength);
+	FeedAll(oReader, &ayLong[0], (int)ayLong.size(), aoFrames);
+	CHECK(aoFrames.empty() && oReader.GetBadFrames() == 3);
+
+	// Input that never ends never gives a frame, and the reader is fine at
+	// the next delimiter
+	ayLong.assign(1000, 0x42);
+	FeedAll(oReader, &ayLong[0], (int)ayLong.size(), aoFrames);
+	CHECK(aoFrames.empty() && oReader.GetBadFrames() == 3);
+	uint8_t yEnd = 0;
+	FeedAll(oReader, &yEnd, 1, aoFrames);
+	FeedAll(oReader, ayWire, iLength, aoFrames);
+	CHECK(aoFrames.size() == 1 && Same(aoFrames[0], oSent));
+
+	// Delimiters on their own are not frames
+	static const uint8_t ayEmpty[] = { 0, 0, 0 };
+	FeedAll(oReader, ayEmpty, 3, aoFrames);
+	CHECK(aoFrames.size() == 1 && oReader.GetBadFrames() == 4);
+}
+
+// Random garbage, then 3 frames.  The first frame is lost unless the garbage
+// happens to end with a delimiter, the other two always come through.
+static void TestResync()
+{
+	srand(5);
+	NodeFrameReader oReader;
+	int iNumGarbageFrames = 0;
+	int iNumChunks = 0;
+	int iNumWrong = 0;
+	for(int n = 0; n < 5000; ++n)
+	{
+		std::vector<uint8_t> ayBytes;
+		int iGarbage = rand() % 80;
+		for(int i = 0; i < iGarbage; ++i)
+		{
+			// Zeros now and then, like a frame cut up by noise
+			uint8_t yByte = (rand() % 10 == 0) ? 0 : (uint8_t)rand();
+			ayBytes.push_back(yByte);
+			iNumChunks += yByte == 0 ? 1 : 0;
+		}
+		bool bFirstKept = iGarbage == 0 || ayBytes.back() == 0;
+
+		NodeFrame aoSent[3];
+		for(int f = 0; f < 3; ++f)
+		{
+			aoSent[f].Begin(NODE_FRAME_MOTION, f, (uint8_t)n);
+			aoSent[f].PutWord((uint16_t)(n + f));
+			aoSent[f].PutWord((uint16_t)rand());
+			uint8_t ayWire[NODE_FRAME_MAX_WIRE];
+			int iLength = aoSent[f].Encode(ayWire);
+			ayBytes.insert(ayBytes.end(), ayWire, ayWire + iLength);
+		}
+
+		std::vector<NodeFrame> aoFrames;
+		FeedAll(oReader, &ayBytes[0], (int)ayBytes.size(), aoFrames);
+
+		// Anything before the sent frames came from the garbage
+		int iNumReal = bFirstKept ? 3 : 2;
+		int iNumExtra = (int)aoFrames.size() - iNumReal;
+		iNumGarbageFrames += iNumExtra > 0 ? iNumExtra : 0;
+		if(iNumExtra < 0)
+		{
+			iNumWrong++;
+			continue;
+		}
+		for(int f = 0; f < iNumReal; ++f)
+		{
+			iNumWrong += Same(aoFrames[iNumExtra + f], aoSent[3 - iNumReal + f]) ? 0 : 1;
+		}
+	}
+
+	// An 8 bit CRC and the version let about 1 in 4096 random chunks through
+	printf("  5000 bursts of garbage: %d frames lost or wrong after it, %d of %d garbage chunks taken as frames\n",
+		iNumWrong, iNumGarbageFrames, iNumChunks);
+	CHECK(iNumWrong == 0);
+	CHECK(iNumGarbageFrames <= iNumChunks / 1000 + 1);
+}
+
+int main()
+{
+	TestMotion();
+	TestBeacon();
+	TestTuning();
+	TestRejected();
+	TestTooLong();
+	TestResync();
+	return HostTestResult("TestNodeFrame");
+}
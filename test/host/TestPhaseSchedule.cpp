@@ -0,0 +1,237 @@
+/**
+ * File: TestPhaseSchedule.cpp
+ *
+ * Description: Checks PhaseSchedule and MainsPeriod (EAPhaseSchedule.h)
+ * against the 66 microsecond dimmer interrupt TouchtoneArduino and
+ * SkinConductance used to have.  Checks that:
+ *
+ *   - at every brightness, and for random sets of 8 channels on 2 ports,
+ *     each channel fires on the same 128th of the half cycle the old
+ *     interrupt fired it on, with the schedule in microseconds and in 64us
+ *     Timer2 ticks (to within one tick there)
+ *   - nothing fires at or after DIMMER_CUTOFF, which is when the gates go low
+ *   - channels at the same brightness share one event, and the events are
+ *     in time order with no two at the same time
+ *   - MainsPeriod settles on 50 and 60 Hz, follows a change from one to the
+ *     other, and leaves out missed and doubled zero crosses
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "HostTest.h"
+#include "EAPhaseSchedule.h"
+
+#define NUM_CHANNELS 8
+#define NUM_PORTS 2
+
+typedef PhaseSchedule<NUM_CHANNELS, NUM_PORTS> Schedule;
+
+// The old interrupt: 128 ticks a half cycle, counting from the zero cross.
+// The 128th the channel went high on, or -1 for never.
+static int OldFireTick(int iBrightness)
+{
+	for(int iCounter = 0; iCounter < 128; ++iCounter)
+	{
+		if(iCounter < 120 && iCounter >= 127 - iBrightness)
+		{
+			return iCounter;
+		}
+	}
+	return -1;
+}
+
+// Channel c is bit c % 4 of port c / 4
+static void SetChannels(Schedule &oSchedule)
+{
+	for(int c = 0; c < NUM_CHANNELS; ++c)
+	{
+		oSchedule.SetChannel(c, c / 4, 1 << (c % 4));
+	}
+}
+
+// The time oSchedule fires channel c, or -1 for never
+static int FireTime(const Schedule &oSchedule, int c)
+{
+	for(int e = 0; e < oSchedule.GetNumEvents(); ++e)
+	{
+		if(oSchedule.GetEvent(e).m_ayMask[c / 4] & (1 << (c % 4)))
+		{
+			return oSchedule.GetEvent(e).m_iTime;
+		}
+	}
+	return -1;
+}
+
+// Checks one set of brightnesses against the old interrupt.  iHalfPeriod
+// is in whatever units, iTolerance in 128ths.
+static bool Matches(Schedule &oSchedule, const uint8_t ayBrightness[], uint16_t iHalfPeriod, int iTolerance)
+{
+	oSchedule.Build(ayBrightness, iHalfPeriod);
+	bool bGood = true;
+
+	// Events in time order, no two at once, all before the cut off
+	for(int e = 0; e < oSchedule.GetNumEvents(); ++e)
+	{
+		bGood = bGood && (e == 0 || oSchedule.GetEvent(e).m_iTime > oSchedule.GetEvent(e-1).m_iTime);
+		bGood = bGood && oSchedule.GetEvent(e).m_iTime < oSchedule.GetOffTime();
+	}
+	bGood = bGood && oSchedule.GetOffTime() == ((uint32_t)DIMMER_CUTOFF * iHalfPeriod) >> 7;
+
+	for(int c = 0; c < NUM_CHANNELS; ++c)
+	{
+		int iOldTick = OldFireTick(ayBrightness[c] > DIMMER_MAX_BRIGHTNESS ? DIMMER_MAX_BRIGHTNESS : ayBrightness[c]);
+		int iTime = FireTime(oSchedule, c);
+		if(iOldTick < 0 || iTime < 0)
+		{
+			bGood = bGood && iOldTick == iTime;
+			continue;
+		}
+
+		// Back to 128ths of the half cycle
+		int iTick = (int)(((long)iTime * 128 + iHalfPeriod / 2) / iHalfPeriod);
+		bGood = bGood && abs(iTick - iOldTick) <= iTolerance;
+	}
+	return bGood;
+}
+
+static void TestEveryBrightness()
+{
+	Schedule oSchedule;
+	SetChannels(oSchedule);
+
+	// 60 and 50 Hz in microseconds, and 60 Hz in 64us Timer2 ticks
+	static const uint16_t aiHalfPeriods[] = { 8333, 10000, (8333 * 16) >> 10 };
+	static const int aiTolerance[] = { 0, 0, 1 };
+	for(int h = 0; h < 3; ++h)
+	{
+		int iNumWrong = 0;
+		for(int b = 0; b <= 255; ++b)
+		{
+			uint8_t ayBrightness[NUM_CHANNELS];
+			for(int c = 0; c < NUM_CHANNELS; ++c)
+			{
+				ayBrightness[c] = (uint8_t)b;
+			}
+			iNumWrong += Matches(oSchedule, ayBrightness, aiHalfPeriods[h], aiTolerance[h]) ? 0 : 1;
+
+			// All at one brightness is one event, or none past the cut off
+			int iNumExpected = OldFireTick(b > DIMMER_MAX_BRIGHTNESS ? DIMMER_MAX_BRIGHTNESS : b) < 0 ? 0 : 1;
+			iNumWrong += oSchedule.GetNumEvents() == iNumExpected ? 0 : 1;
+		}
+		CHECK(iNumWrong == 0);
+	}
+
+	// Brightness 7 and under never fires
+	CHECK(OldFireTick(7) == -1);
+	CHECK(OldFireTick(8) == 119);
+	CHECK(OldFireTick(DIMMER_MAX_BRIGHTNESS) == 0);
+}
+
+static void TestRandomSets()
+{
+	Schedule oSchedule;
+	SetChannels(oSchedule);
+	srand(1);
+	int iNumWrong = 0;
+	for(int n = 0; n < 100000; ++n)
+	{
+		uint8_t ayBrightness[NUM_CHANNELS];
+		for(int c = 0; c < NUM_CHANNELS; ++c)
+		{
+			// Often the same as another channel so events are shared
+			ayBrightness[c] = (n % 3 == 0) ? (uint8_t)((rand() % 4) * 40) : (uint8_t)(rand() % 130);
+		}
+		iNumWrong += Matches(oSchedule, ayBrightness, 8333, 0) ? 0 : 1;
+		iNumWrong += Matches(oSchedule, ayBrightness, (10000 * 16) >> 10, 1) ? 0 : 1;
+	}
+	printf("  100000 random sets of %d channels: %d wrong\n", NUM_CHANNELS, iNumWrong);
+	CHECK(iNumWrong == 0);
+}
+
+static void TestSharedEvents()
+{
+	Schedule oSchedule;
+	SetChannels(oSchedule);
+
+	// Two brightnesses across both ports, and two channels too dim to fire
+	static const uint8_t ayBrightness[NUM_CHANNELS] = { 64, 100, 64, 3, 100, 64, 0, 100 };
+	oSchedule.Build(ayBrightness, 8333);
+	CHECK(oSchedule.GetNumEvents() == 2);
+
+	// Brightest first: channels 1, 4 and 7, then 0, 2 and 5
+	const Schedule::Event &oFirst = oSchedule.GetEvent(0);
+	const Schedule::Event &oSecond = oSchedule.GetEvent(1);
+	CHECK(oFirst.m_iTime == ((127 - 100) * 8333) >> 7);
+	CHECK(oFirst.m_ayMask[0] == 0x02);
+	CHECK(oFirst.m_ayMask[1] == 0x09);
+	CHECK(oSecond.m_iTime == ((127 - 64) * 8333) >> 7);
+	CHECK(oSecond.m_ayMask[0] == 0x05);
+	CHECK(oSecond.m_ayMask[1] == 0x02);
+
+	// The cut off clears every channel, firing or not
+	CHECK(oSchedule.GetOffTime() == (DIMMER_CUTOFF * 8333) >> 7);
+	CHECK(oSchedule.GetAllMask()[0] == 0x0F);
+	CHECK(oSchedule.GetAllMask()[1] == 0x0F);
+	CHECK(oSchedule.GetNumPorts() == 2);
+}
+
+// Zero crosses with a little jitter, iHalfMicro apart
+static void Feed(MainsPeriod &oMains, uint32_t iHalfMicro, int iNum, unsigned &iSeed)
+{
+	for(int i = 0; i < iNum; ++i)
+	{
+		iSeed = iSeed * 1103515245 + 12345;
+		CHECK(oMains.Update(iHalfMicro + (int)((iSeed >> 16) % 41) - 20));
+	}
+}
+
+static void TestMains()
+{
+	unsigned iSeed = 1;
+
+	MainsPeriod o60;
+	CHECK(!o60.IsMeasured());
+	CHECK(o60.GetHalfPeriodMicro() == MAINS_DEFAULT_HALF_MICRO);
+	Feed(o60, 8333, 200, iSeed);
+	CHECK(o60.IsMeasured());
+	CHECK(abs(o60.GetHalfPeriodMicro() - 8333) <= 5);
+	CHECK(fabsf(o60.GetMainsHz() - 60.0f) < 0.05f);
+
+	// The first good time is taken as is
+	MainsPeriod o50;
+	CHECK(o50.Update(10000));
+	CHECK(o50.GetHalfPeriodMicro() == 10000);
+	Feed(o50, 10000, 200, iSeed);
+	CHECK(abs(o50.GetHalfPeriodMicro() - 10000) <= 5);
+	CHECK(fabsf(o50.GetMainsHz() - 50.0f) < 0.05f);
+
+	// 60 to 50 Hz is followed within a second or so
+	Feed(o60, 10000, 100, iSeed);
+	CHECK(abs(o60.GetHalfPeriodMicro() - 10000) <= 10);
+
+	// A missed zero cross (a whole cycle) and a doubled one (two pieces of a
+	// half cycle) are both left out
+	uint16_t iBefore = o50.GetHalfPeriodMicro();
+	CHECK(!o50.Update(20000));
+	CHECK(!o50.Update(3000));
+	CHECK(!o50.Update(7000));
+	CHECK(!o50.Update(0));
+	CHECK(!o50.Update(MAINS_MAX_HALF_MICRO + 1));
+	CHECK(!o50.Update(MAINS_MIN_HALF_MICRO - 1));
+	CHECK(o50.GetHalfPeriodMicro() == iBefore);
+
+	// Nothing good yet leaves the default
+	MainsPeriod oNone;
+	CHECK(!oNone.Update(16666));
+	CHECK(!oNone.IsMeasured());
+	CHECK(oNone.GetHalfPeriodMicro() == MAINS_DEFAULT_HALF_MICRO);
+}
+
+int main()
+{
+	TestEveryBrightness();
+	TestRandomSets();
+	TestSharedEvents();
+	TestMains();
+	return HostTestResult("TestPhaseSchedule");
+}
@@ -0,0 +1,383 @@
+/**
+ * File: TestProcessingNode.cpp
+ *
+ * Description: Runs the shared ProcessingNode test vectors
+ * (ProcessingNodeVectors.txt) through ProcessingNode (EAProcessingNode.h)
+ * and checks every output to the bit.  test_processing_node.py runs the same
+ * vectors through the Processing copies of the node.
+ *
+ * Also runs each chain through the node from before the running sum, which
+ * summed the whole window every sample, up to the first AdjustSmoothing() in
+ * a case.  The outputs have to stay close to it, and the first node's have
+ * to be the same to the bit at the end of each pass through its window,
+ * where the running sum is replaced by a fresh one.
+ *
+ * Built with USE_PROCESSING_NODE_FIXED_POINT (TestProcessingNodeFixed) it
+ * runs the same vectors through the 16.16 fixed point node, which has to
+ * stay within FIXED_POINT_MAX_ERROR of the float outputs.
+ *
+ *   ./TestProcessingNode [vectors]           check
+ *   ./TestProcessingNode --write [vectors]   fill in the outputs
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "HostTest.h"
+#include "EAProcessingNode.h"
+
+#define MAX_NODES 8
+
+// Same as MAX_NUM_SAMPLES in the Processing programs, so AdjustSmoothing()
+// caps the window at the same length
+#define MAX_NUM_SAMPLES 30
+
+// Largest difference from the old node, relative to the biggest output the
+// node has had so far
+#define OLD_NODE_MAX_ERROR 1e-5
+
+// Largest difference of the fixed point node from the float outputs, the
+// same way
+#define FIXED_POINT_MAX_ERROR 1e-3
+
+#if defined(USE_PROCESSING_NODE_FIXED_POINT)
+ #define TEST_NAME "TestProcessingNodeFixed"
+#else
+ #define TEST_NAME "TestProcessingNode"
+#endif
+
+// The ProcessingNode the sketches had before EAProcessingNode.h, in float
+// like the AVR and the Processing programs
+class OldProcessingNode
+{
+public:
+
+	OldProcessingNode(OldProcessingNode *pNodeInput, bool bDerivative, float fExponentialSmoothingWeight, int iAvgSmoothingNumSamples, float fScalingFactor) :
+		m_pNodeInput(pNodeInput),
+		m_bDerivative(bDerivative),
+		m_fExponentialSmoothingWeight(fExponentialSmoothingWeight),
+		m_iAvgSmoothingNumSamples(iAvgSmoothingNumSamples),
+		m_fScalingFactor(fScalingFactor),
+		m_fInput(0),
+		m_fExponentialSmoothedInput(0),
+		m_iBufferIndex(0),
+		m_fOutput(0)
+	{
+		memset(m_afAvgBuffer, 0, sizeof(m_afAvgBuffer));
+	}
+
+	void UpdateFromInput(int iDeltaTimeMS, float fInput)
+	{
+		float fProcessingVar;
+		if(m_bDerivative)
+		{
+			float fOldInput = m_fInput;
+			m_fInput = fInput;
+			fProcessingVar = (m_fInput - fOldInput) / iDeltaTimeMS * 1000.0f;
+		}
+		else
+		{
+			fProcessingVar = fInput;
+		}
+
+		if(m_fExponentialSmoothingWeight > 0)
+		{
+			m_fExponentialSmoothedInput = fProcessingVar * (1.0f - m_fExponentialSmoothingWeight) + m_fExponentialSmoothedInput * m_fExponentialSmoothingWeight;
+		}
+		else
+		{
+			m_fExponentialSmoothedInput = fProcessingVar;
+		}
+
+		float fAvgSmoothedInput;
+		if(m_iAvgSmoothingNumSamples > 1)
+		{
+			m_iBufferIndex = (m_iBufferIndex + 1) % m_iAvgSmoothingNumSamples;
+			m_afAvgBuffer[m_iBufferIndex] = m_fExponentialSmoothedInput;
+			fAvgSmoothedInput = 0;
+			for(int i = 0; i < m_iAvgSmoothingNumSamples; ++i)
+			{
+				fAvgSmoothedInput += m_afAvgBuffer[i];
+			}
+			fAvgSmoothedInput /= m_iAvgSmoothingNumSamples;
+		}
+		else
+		{
+			fAvgSmoothedInput = m_fExponentialSmoothedInput;
+		}
+
+		m_fOutput = fAvgSmoothedInput * m_fScalingFactor;
+	}
+
+	void Update(int iDeltaMS)
+	{
+		UpdateFromInput(iDeltaMS, m_pNodeInput->GetOutput());
+	}
+
+	float GetOutput() const
+	{
+		return m_fOutput;
+	}
+
+	int GetAvgSmoothingNumSamples() const
+	{
+		return m_iAvgSmoothingNumSamples;
+	}
+
+private:
+
+	OldProcessingNode *m_pNodeInput;
+	bool m_bDerivative;
+	float m_fExponentialSmoothingWeight;
+	int m_iAvgSmoothingNumSamples;
+	float m_fScalingFactor;
+
+	float m_fInput;
+	float m_fExponentialSmoothedInput;
+
+	float m_afAvgBuffer[MAX_NUM_SAMPLES];
+	int m_iBufferIndex;
+	float m_fOutput;
+};
+
+static uint32_t FloatBits(float f)
+{
+	uint32_t iBits;
+	memcpy(&iBits, &f, sizeof(iBits));
+	return iBits;
+}
+
+// One case from the vectors, as the new and the old chains
+struct Chain
+{
+	Chain() :
+		m_iNumNodes(0),
+		m_bAdjusted(false),
+		m_iNumSteps(0)
+	{
+	}
+
+	~Chain()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		for(int i = 0; i < m_iNumNodes; ++i)
+		{
+			delete m_apNodes[i];
+			delete m_apOldNodes[i];
+		}
+		m_iNumNodes = 0;
+		m_bAdjusted = false;
+		m_iNumSteps = 0;
+	}
+
+	void AddNode(bool bDerivative, float fExponentialSmoothingWeight, int iAvgSmoothingNumSamples, float fScalingFactor)
+	{
+		ProcessingNodeBase *pInput = m_iNumNodes > 0 ? m_apNodes[m_iNumNodes-1] : NULL;
+		OldProcessingNode *pOldInput = m_iNumNodes > 0 ? m_apOldNodes[m_iNumNodes-1] : NULL;
+		m_apNodes[m_iNumNodes] = new ProcessingNode<MAX_NUM_SAMPLES>(pInput, bDerivative, fExponentialSmoothingWeight, iAvgSmoothingNumSamples, fScalingFactor);
+		m_apOldNodes[m_iNumNodes] = new OldProcessingNode(pOldInput, bDerivative, fExponentialSmoothingWeight, iAvgSmoothingNumSamples, fScalingFactor);
+		m_afMaxOutput[m_iNumNodes] = 0;
+		m_iNumNodes++;
+	}
+
+	void Step(int iDeltaTimeMS, float fInput)
+	{
+		m_apNodes[0]->UpdateFromInput(iDeltaTimeMS, fInput);
+		m_apOldNodes[0]->UpdateFromInput(iDeltaTimeMS, fInput);
+		for(int i = 1; i < m_iNumNodes; ++i)
+		{
+			m_apNodes[i]->Update(iDeltaTimeMS);
+			m_apOldNodes[i]->Update(iDeltaTimeMS);
+		}
+		m_iNumSteps++;
+	}
+
+	int m_iNumNodes;
+	ProcessingNode<MAX_NUM_SAMPLES> *m_apNodes[MAX_NODES];
+	OldProcessingNode *m_apOldNodes[MAX_NODES];
+	float m_afMaxOutput[MAX_NODES];
+	bool m_bAdjusted;
+	int m_iNumSteps;
+};
+
+#if !defined(USE_PROCESSING_NODE_FIXED_POINT)
+
+// Compare a step's outputs with the old node's
+static void CheckOldNode(Chain &oChain, const char *szCase, int iLine, int &iNumExact)
+{
+	if(oChain.m_bAdjusted)
+	{
+		return; // The old node had no AdjustSmoothing()
+	}
+	for(int i = 0; i < oChain.m_iNumNodes; ++i)
+	{
+		float fNew = oChain.m_apNodes[i]->GetOutput();
+		float fOld = oChain.m_apOldNodes[i]->GetOutput();
+		float fMax = fabsf(fOld) > oChain.m_afMaxOutput[i] ? fabsf(fOld) : oChain.m_afMaxOutput[i];
+		oChain.m_afMaxOutput[i] = fMax;
+		if(fabsf(fNew - fOld) > OLD_NODE_MAX_ERROR * fMax)
+		{
+			printf("  %s line %d node %d: %.9g, old node %.9g\n", szCase, iLine, i, fNew, fOld);
+			CHECK(fabsf(fNew - fOld) <= OLD_NODE_MAX_ERROR * fMax);
+		}
+	}
+
+	// The first sample went in slot 1, so a pass ends every iNum samples
+	// starting with sample iNum - 1 (step iNum - 2 from 0)
+	int iNum = oChain.m_apOldNodes[0]->GetAvgSmoothingNumSamples();
+	if(iNum > 1 && (oChain.m_iNumSteps - 1) % iNum == iNum - 2)
+	{
+		CHECK(FloatBits(oChain.m_apNodes[0]->GetOutput()) == FloatBits(oChain.m_apOldNodes[0]->GetOutput()));
+		iNumExact++;
+	}
+}
+
+#endif
+
+int main(int argc, char *argv[])
+{
+	bool bWrite = argc > 1 && strcmp(argv[1], "--write") == 0;
+#if defined(USE_PROCESSING_NODE_FIXED_POINT)
+	if(bWrite)
+	{
+		printf(TEST_NAME ": the outputs are written from the float node\n");
+		return 1;
+	}
+#endif
+	const char *szPath = argc > (bWrite ? 2 : 1) ? argv[bWrite ? 2 : 1] : "ProcessingNodeVectors.txt";
+
+	FILE *pFile = fopen(szPath, "r");
+	if(!pFile)
+	{
+		printf(TEST_NAME ": can't open %s\n", szPath);
+		return 1;
+	}
+	std::vector<std::string> asLines;
+	char szLine[512];
+	while(fgets(szLine, sizeof(szLine), pFile))
+	{
+		szLine[strcspn(szLine, "\r\n")] = 0;
+		asLines.push_back(szLine);
+	}
+	fclose(pFile);
+
+	Chain oChain;
+	char szCase[64] = "";
+	int iNumSteps = 0;
+	int iNumOutputs = 0;
+#if defined(USE_PROCESSING_NODE_FIXED_POINT)
+	float afMaxExpected[MAX_NODES];
+	float fWorstError = 0;
+#else
+	int iNumExact = 0;
+#endif
+	for(size_t l = 0; l < asLines.size(); ++l)
+	{
+		const char *szText = asLines[l].c_str();
+		int iLine = (int)l + 1;
+		int iDerivative;
+		int iNode;
+		int iAvg;
+		int iDeltaTimeMS;
+		float fExp;
+		float fScale;
+		char szInput[64];
+		int iUsed;
+		if(sscanf(szText, "case %63s", szCase) == 1)
+		{
+			oChain.Clear();
+#if defined(USE_PROCESSING_NODE_FIXED_POINT)
+			memset(afMaxExpected, 0, sizeof(afMaxExpected));
+#endif
+		}
+		else if(sscanf(szText, "node %d %f %d %f", &iDerivative, &fExp, &iAvg, &fScale) == 4)
+		{
+			CHECK(oChain.m_iNumNodes < MAX_NODES);
+			oChain.AddNode(iDerivative != 0, fExp, iAvg, fScale);
+		}
+		else if(sscanf(szText, "adjust %d %f %d", &iNode, &fExp, &iAvg) == 3)
+		{
+			oChain.m_apNodes[iNode]->AdjustSmoothing(fExp, iAvg);
+			oChain.m_bAdjusted = true;
+		}
+		else if(sscanf(szText, "step %d %63s%n", &iDeltaTimeMS, szInput, &iUsed) == 2)
+		{
+			oChain.Step(iDeltaTimeMS, strtof(szInput, NULL));
+			iNumSteps++;
+			if(bWrite)
+			{
+				std::string sStep = "step " + std::to_string(iDeltaTimeMS) + " " + szInput;
+				for(int i = 0; i < oChain.m_iNumNodes; ++i)
+				{
+					char szBits[16];
+					snprintf(szBits, sizeof(szBits), " %08x", (unsigned)FloatBits(oChain.m_apNodes[i]->GetOutput()));
+					sStep += szBits;
+				}
+				asLines[l] = sStep;
+				continue;
+			}
+
+			const char *szOutputs = szText + iUsed;
+			for(int i = 0; i < oChain.m_iNumNodes; ++i)
+			{
+				char *szEnd;
+				uint32_t iExpected = (uint32_t)strtoul(szOutputs, &szEnd, 16);
+				CHECK(szEnd != szOutputs);
+				szOutputs = szEnd;
+#if defined(USE_PROCESSING_NODE_FIXED_POINT)
+				float fExpected;
+				memcpy(&fExpected, &iExpected, sizeof(fExpected));
+				afMaxExpected[i] = fabsf(fExpected) > afMaxExpected[i] ? fabsf(fExpected) : afMaxExpected[i];
+				float fError = fabsf(oChain.m_apNodes[i]->GetOutput() - fExpected) / afMaxExpected[i];
+				fWorstError = fError > fWorstError ? fError : fWorstError;
+				if(fError > FIXED_POINT_MAX_ERROR)
+				{
+					printf("  %s line %d node %d: %.9g, expected %.9g\n", szCase, iLine, i, oChain.m_apNodes[i]->GetOutput(), fExpected);
+					CHECK(fError <= FIXED_POINT_MAX_ERROR);
+				}
+#else
+				uint32_t iBits = FloatBits(oChain.m_apNodes[i]->GetOutput());
+				if(iBits != iExpected)
+				{
+					printf("  %s line %d node %d: %08x, expected %08x\n", szCase, iLine, i, (unsigned)iBits, (unsigned)iExpected);
+					CHECK(iBits == iExpected);
+				}
+#endif
+				iNumOutputs++;
+			}
+#if !defined(USE_PROCESSING_NODE_FIXED_POINT)
+			CheckOldNode(oChain, szCase, iLine, iNumExact);
+#endif
+		}
+	}
+
+	if(bWrite)
+	{
+		pFile = fopen(szPath, "w");
+		for(size_t l = 0; l < asLines.size(); ++l)
+		{
+			fprintf(pFile, "%s\n", asLines[l].c_str());
+		}
+		fclose(pFile);
+		printf("TestProcessingNode: wrote the outputs of %d steps to %s\n", iNumSteps, szPath);
+		return 0;
+	}
+
+#if defined(USE_PROCESSING_NODE_FIXED_POINT)
+	printf("  %d steps, %d outputs within %.2g of the float ones\n", iNumSteps, iNumOutputs, fWorstError);
+	CHECK(iNumSteps > 0);
+#else
+	printf("  %d steps, %d outputs the same to the bit\n", iNumSteps, iNumOutputs);
+	printf("  old node: within %g, %d pass ends the same to the bit\n", OLD_NODE_MAX_ERROR, iNumExact);
+	CHECK(iNumSteps > 0);
+	CHECK(iNumExact > 0);
+#endif
+	return HostTestResult(TEST_NAME);
+}
@@ -0,0 +1,158 @@
+/**
+ * File: TestPulseRing.cpp
+ *
+ * Description: Checks PulseRing and PulsePeriodEstimator (EAPulseRing.h).
+ * The ring has to keep pulses in order as its byte head and tail wrap, drop
+ * and count pulses once it is full (at the largest size too), and the
+ * estimator has to give the mean or median of the periods in a frame, skip
+ * double pulses, keep only the newest MAX_PERIODS and get through micros()
+ * wrapping.
+ */
+
+#include "HostTest.h"
+#include "EAPulseRing.h"
+
+// Pushed and popped in uneven batches so the head and tail wrap many times
+static void TestWrap()
+{
+	PulseRing<8> oRing;
+	uint32_t iNextPush = 0;
+	uint32_t iNextPop = 0;
+	bool bInOrder = true;
+	for(int iBatch = 0; iBatch < 500; ++iBatch)
+	{
+		int iNumPush = 1 + iBatch % 8;
+		for(int i = 0; i < iNumPush; ++i)
+		{
+			oRing.Push(iNextPush++);
+		}
+		CHECK(oRing.Count() == iNumPush);
+		uint32_t iTime;
+		while(oRing.Pop(iTime))
+		{
+			bInOrder = bInOrder && iTime == iNextPop;
+			iNextPop++;
+		}
+		CHECK(oRing.Count() == 0);
+	}
+	CHECK(bInOrder);
+	CHECK(iNextPop == iNextPush);
+	CHECK(oRing.Dropped() == 0);
+}
+
+// A full ring drops new pulses and keeps the old ones
+template<int SIZE>
+static void TestFull()
+{
+	PulseRing<SIZE> oRing;
+
+	// Move the head and tail off 0 first
+	uint32_t iTime;
+	for(int i = 0; i < 77; ++i)
+	{
+		oRing.Push(0);
+		oRing.Pop(iTime);
+	}
+
+	for(int i = 0; i < SIZE; ++i)
+	{
+		oRing.Push(i);
+	}
+	CHECK(oRing.Count() == SIZE);
+	oRing.Push(1000);
+	oRing.Push(1001);
+	CHECK(oRing.Count() == SIZE);
+	CHECK(oRing.Dropped() == 2);
+
+	int iNumPopped = 0;
+	bool bInOrder = true;
+	while(oRing.Pop(iTime))
+	{
+		bInOrder = bInOrder && iTime == (uint32_t)iNumPopped;
+		iNumPopped++;
+	}
+	CHECK(bInOrder);
+	CHECK(iNumPopped == SIZE);
+
+	// The drop count is a byte
+	for(int i = 0; i < SIZE + 256; ++i)
+	{
+		oRing.Push(i);
+	}
+	CHECK(oRing.Dropped() == 2);
+}
+
+template<int SIZE>
+static void PushAll(PulseRing<SIZE> &oRing, const uint32_t aiTimes[], int iNum)
+{
+	for(int i = 0; i < iNum; ++i)
+	{
+		oRing.Push(aiTimes[i]);
+	}
+}
+
+static void TestEstimator()
+{
+	// A missed pulse: periods 1000, 1000, 1000, 2000
+	static const uint32_t aiMissed[] = { 0, 1000, 2000, 3000, 5000 };
+	PulseRing<32> oRing;
+	PulsePeriodEstimator oMean(PulsePeriodEstimator::MEAN);
+	PulseRing<32> oMedianRing;
+	PulsePeriodEstimator oMedian(PulsePeriodEstimator::MEDIAN);
+	PushAll(oRing, aiMissed, 5);
+	PushAll(oMedianRing, aiMissed, 5);
+	CHECK(oMean.Update(oRing, 5100) == 1250);
+	CHECK(oMedian.Update(oMedianRing, 5100) == 1000);
+	CHECK(oMean.GetNumPeriods() == 4);
+
+	// No pulses this frame keeps the estimate, until the time since the last
+	// pulse is longer
+	CHECK(oMedian.Update(oMedianRing, 5900) == 1000);
+	CHECK(oMedian.GetNumPeriods() == 0);
+	CHECK(oMedian.Update(oMedianRing, 8000) == 3000);
+	CHECK(oMedian.GetPeriodMicro() == 1000);
+
+	// An even number of periods gives the middle two averaged.  Following on
+	// from the pulse at 5000: 1100, 300, 400, 600.
+	static const uint32_t aiEven[] = { 6100, 6400, 6800, 7400 };
+	PushAll(oMedianRing, aiEven, 4);
+	CHECK(oMedian.Update(oMedianRing, 7400) == 500);
+
+	// Double pulses under the minimum period are the same pulse
+	static const uint32_t aiDouble[] = { 0, 50, 1000, 1030, 2000, 2099, 3000 };
+	PulseRing<32> oDoubleRing;
+	PulsePeriodEstimator oDouble(PulsePeriodEstimator::MEAN, 100);
+	PushAll(oDoubleRing, aiDouble, 7);
+	CHECK(oDouble.Update(oDoubleRing, 3000) == 1000);
+	CHECK(oDouble.GetNumPeriods() == 3);
+
+	// Only the newest MAX_PERIODS are used
+	PulseRing<64> oBigRing;
+	PulsePeriodEstimator oNewest(PulsePeriodEstimator::MEAN);
+	uint32_t iTime = 0;
+	oBigRing.Push(iTime);
+	for(int i = 1; i <= 40; ++i)
+	{
+		iTime += i * 10;
+		oBigRing.Push(iTime);
+	}
+	CHECK(oNewest.Update(oBigRing, iTime) == (90 + 400) / 2);
+	CHECK(oNewest.GetNumPeriods() == PulsePeriodEstimator::MAX_PERIODS);
+
+	// Through micros() wrapping
+	static const uint32_t aiWrap[] = { 0xFFFFF000u, 0xFFFFF800u, 0x00000000u, 0x00000800u };
+	PulseRing<32> oWrapRing;
+	PulsePeriodEstimator oWrap(PulsePeriodEstimator::MEDIAN);
+	PushAll(oWrapRing, aiWrap, 4);
+	CHECK(oWrap.Update(oWrapRing, 0x00000900u) == 0x800);
+}
+
+int main()
+{
+	TestWrap();
+	TestFull<1>();
+	TestFull<8>();
+	TestFull<128>();
+	TestEstimator();
+	return HostTestResult("TestPulseRing");
+}
@@ -0,0 +1,280 @@
+/**
+ * File: TestSettingsStore.cpp
+ *
+ * Description: Checks SettingsStore (EASettingsStore.h) on a FakeEeprom
+ * (EAFakeEeprom.h).  Checks that:
+ *
+ *   - a saved record loads back, in a fresh store as after a restart
+ *   - the power going out after any byte of a commit leaves either the old
+ *     or the new record, never a mix, and the store carries on from there
+ *   - a corrupt or wrong version newest slot falls back to the older one
+ *   - the sequence number wrapping still picks the newest slot
+ *   - commits move around the slots, write only the bytes that changed and
+ *     write nothing for a record that is already saved
+ *   - an area too small for 2 slots is turned down, not divided by
+ */
+
+#include <string.h>
+#include "HostTest.h"
+#include "EAFakeEeprom.h"
+#include "EASettingsStore.h"
+
+#define EEPROM_BYTES 512
+#define BASE_ADDR 32
+#define SCHEMA_VERSION 3
+
+struct Settings
+{
+	uint16_t m_iMinSpeed;
+	float m_fGain;
+	uint8_t m_ayColors[9];
+};
+
+typedef FakeEeprom<EEPROM_BYTES> Eeprom;
+typedef SettingsStore<Settings, Eeprom> Store;
+
+// Filled with memset() first, as the store needs
+static Settings MakeSettings(int iSeed)
+{
+	Settings oSettings;
+	memset(&oSettings, 0, sizeof(oSettings));
+	oSettings.m_iMinSpeed = (uint16_t)(iSeed * 7);
+	oSettings.m_fGain = iSeed * 0.5f;
+	for(int i = 0; i < 9; ++i)
+	{
+		oSettings.m_ayColors[i] = (uint8_t)(iSeed + i * 31);
+	}
+	return oSettings;
+}
+
+static bool Same(const Settings &oA, const Settings &oB)
+{
+	return memcmp(&oA, &oB, sizeof(Settings)) == 0;
+}
+
+// What a restart would load, or -1 for nothing, -2 for something that is
+// neither of the two
+static int LoadAfterRestart(Eeprom &oEeprom, int iAreaBytes, const Settings &oOld, const Settings &oNew)
+{
+	Store oStore(oEeprom, BASE_ADDR, iAreaBytes, SCHEMA_VERSION);
+	Settings oLoaded;
+	if(!oStore.Load(oLoaded))
+	{
+		return -1;
+	}
+	return Same(oLoaded, oOld) ? 0 : (Same(oLoaded, oNew) ? 1 : -2);
+}
+
+static void TestLoadAndCommit()
+{
+	Eeprom oEeprom;
+	Settings oSettings = MakeSettings(1);
+	{
+		Store oStore(oEeprom, BASE_ADDR, 4 * Store::SLOT_BYTES, SCHEMA_VERSION);
+		CHECK(!oStore.Load(oSettings));
+		CHECK(oStore.GetSlot() == -1);
+		CHECK(oStore.Commit(oSettings));
+		CHECK(oStore.GetSlot() == 0);
+
+		// The same record again writes nothing
+		unsigned long iNumWrites = oEeprom.GetTotalWrites();
+		CHECK(!oStore.Commit(oSettings));
+		CHECK(oEeprom.GetTotalWrites() == iNumWrites);
+	}
+
+	Store oStore(oEeprom, BASE_ADDR, 4 * Store::SLOT_BYTES, SCHEMA_VERSION);
+	Settings oLoaded;
+	CHECK(oStore.Load(oLoaded));
+	CHECK(Same(oLoaded, oSettings));
+	CHECK(!oStore.Commit(oSettings));
+
+	// Nothing outside the area is touched
+	for(int i = 0; i < EEPROM_BYTES; ++i)
+	{
+		if(i < BASE_ADDR || i >= BASE_ADDR + 4 * Store::SLOT_BYTES)
+		{
+			CHECK(oEeprom.GetWrites(i) == 0);
+		}
+	}
+
+	// Update() writes a byte at a time
+	Settings oNew = MakeSettings(2);
+	CHECK(oStore.BeginCommit(oNew));
+	int iNumUpdates = 0;
+	unsigned long iLastWrites = oEeprom.GetTotalWrites();
+	bool bOneByte = true;
+	while(oStore.Update())
+	{
+		bOneByte = bOneByte && oEeprom.GetTotalWrites() - iLastWrites <= 1;
+		iLastWrites = oEeprom.GetTotalWrites();
+		iNumUpdates++;
+	}
+	CHECK(bOneByte);
+	CHECK(iNumUpdates > 0);
+	CHECK(!oStore.IsCommitting());
+	CHECK(oStore.GetSlot() == 1);
+	CHECK(LoadAfterRestart(oEeprom, 4 * Store::SLOT_BYTES, oSettings, oNew) == 1);
+}
+
+// The power goes out after every possible number of writes in a commit.
+// Run over several commits so the slot being written already holds an old
+// copy as well as when it is still erased.
+static void TestPowerCut(int iNumSlots)
+{
+	int iAreaBytes = iNumSlots * Store::SLOT_BYTES;
+	Eeprom oEeprom;
+	Settings oOld = MakeSettings(100);
+	{
+		Store oStore(oEeprom, BASE_ADDR, iAreaBytes, SCHEMA_VERSION);
+		oStore.Commit(oOld);
+	}
+
+	int iNumCuts = 0;
+	int iNumWrong = 0;
+	for(int c = 0; c < 3 * iNumSlots; ++c)
+	{
+		Settings oNew = MakeSettings(101 + c);
+
+		// How many writes a whole commit takes
+		Eeprom oWhole = oEeprom;
+		{
+			Store oStore(oWhole, BASE_ADDR, iAreaBytes, SCHEMA_VERSION);
+			Settings oLoaded;
+			CHECK(oStore.Load(oLoaded));
+			CHECK(oStore.Commit(oNew));
+		}
+		long iNumWrites = (long)(oWhole.GetTotalWrites() - oEeprom.GetTotalWrites());
+		CHECK(iNumWrites > 0);
+
+		for(long iCut = 0; iCut <= iNumWrites; ++iCut)
+		{
+			Eeprom oCut = oEeprom;
+			{
+				Store oStore(oCut, BASE_ADDR, iAreaBytes, SCHEMA_VERSION);
+				Settings oLoaded;
+				oStore.Load(oLoaded);
+				oCut.FailAfter(iCut);
+				oStore.Commit(oNew);
+				oCut.FailAfter(-1);
+			}
+			int iExpected = iCut < iNumWrites ? 0 : 1;
+			int iLoaded = LoadAfterRestart(oCut, iAreaBytes, oOld, oNew);
+			iNumWrong += iLoaded != iExpected ? 1 : 0;
+
+			// And after the restart the next commit still works
+			Settings oNext = MakeSettings(200 + c);
+			{
+				Store oStore(oCut, BASE_ADDR, iAreaBytes, SCHEMA_VERSION);
+				Settings oLoaded;
+				oStore.Load(oLoaded);
+				CHECK(oStore.Commit(oNext));
+			}
+			iNumWrong += LoadAfterRestart(oCut, iAreaBytes, oNext, oNext) != 0 ? 1 : 0;
+			iNumCuts++;
+		}
+
+		oEeprom = oWhole;
+		oOld = oNew;
+	}
+	printf("  %d slots: power cut at %d places, %d wrong\n", iNumSlots, iNumCuts, iNumWrong);
+	CHECK(iNumWrong == 0);
+}
+
+static void TestFallback()
+{
+	int iAreaBytes = 3 * Store::SLOT_BYTES;
+	Settings oOld = MakeSettings(5);
+	Settings oNew = MakeSettings(6);
+	Eeprom oEeprom;
+	{
+		Store oStore(oEeprom, BASE_ADDR, iAreaBytes, SCHEMA_VERSION);
+		oStore.Commit(oOld);
+		oStore.Commit(oNew);
+		CHECK(oStore.GetSlot() == 1);
+	}
+	CHECK(LoadAfterRestart(oEeprom, iAreaBytes, oOld, oNew) == 1);
+
+	// Any byte of the newest slot going bad, the sequence and version too,
+	// loses only that copy
+	int iNewSlotAddr = BASE_ADDR + Store::SLOT_BYTES;
+	int iNumWrong = 0;
+	for(int i = 0; i < Store::SLOT_BYTES; ++i)
+	{
+		Eeprom oBad = oEeprom;
+		oBad.write(iNewSlotAddr + i, oBad.read(iNewSlotAddr + i) ^ 0x10);
+		iNumWrong += LoadAfterRestart(oBad, iAreaBytes, oOld, oNew) != 0 ? 1 : 0;
+	}
+	CHECK(iNumWrong == 0);
+
+	// An older schema version in the newest slot
+	Eeprom oVersion = oEeprom;
+	oVersion.write(iNewSlotAddr + 2, SCHEMA_VERSION - 1);
+	CHECK(LoadAfterRestart(oVersion, iAreaBytes, oOld, oNew) == 0);
+
+	// Both bad is nothing
+	Eeprom oBoth = oEeprom;
+	oBoth.write(BASE_ADDR + 5, oBoth.read(BASE_ADDR + 5) ^ 1);
+	oBoth.write(iNewSlotAddr + 5, oBoth.read(iNewSlotAddr + 5) ^ 1);
+	CHECK(LoadAfterRestart(oBoth, iAreaBytes, oOld, oNew) == -1);
+
+	// A different version altogether is nothing
+	Store oOther(oEeprom, BASE_ADDR, iAreaBytes, SCHEMA_VERSION + 1);
+	Settings oLoaded;
+	CHECK(!oOther.Load(oLoaded));
+}
+
+// 70000 commits takes the 16 bit sequence round past 0 once
+static void TestSequenceWrap()
+{
+	int iAreaBytes = 3 * Store::SLOT_BYTES;
+	Eeprom oEeprom;
+	Store oStore(oEeprom, BASE_ADDR, iAreaBytes, SCHEMA_VERSION);
+	int iNumWrong = 0;
+	int iNumChecked = 0;
+	for(long i = 0; i < 70000; ++i)
+	{
+		Settings oSettings = MakeSettings((int)(i % 1000));
+		oStore.Commit(oSettings);
+		if((i > 65530 && i < 65545) || i % 5000 == 0)
+		{
+			iNumWrong += LoadAfterRestart(oEeprom, iAreaBytes, oSettings, oSettings) != 0 ? 1 : 0;
+			iNumChecked++;
+		}
+	}
+	CHECK(iNumWrong == 0);
+
+	// Commits go round the slots, so each byte takes about a third of them
+	printf("  70000 commits on 3 slots: %d restarts checked, at most %lu writes to a byte\n", iNumChecked, oEeprom.GetMaxWrites());
+	CHECK(oEeprom.GetMaxWrites() <= 70000 / 3 + 1);
+}
+
+static void TestTooSmall()
+{
+	Eeprom oEeprom;
+	Settings oSettings = MakeSettings(1);
+	Store oNone(oEeprom, BASE_ADDR, 2 * Store::SLOT_BYTES - 1, SCHEMA_VERSION);
+	CHECK(oNone.GetNumSlots() == 0);
+	CHECK(!oNone.Commit(oSettings));
+	CHECK(!oNone.BeginCommit(oSettings));
+	CHECK(!oNone.Update());
+	CHECK(!oNone.Load(oSettings));
+	CHECK(oEeprom.GetTotalWrites() == 0);
+
+	Store oZero(oEeprom, BASE_ADDR, 0, SCHEMA_VERSION);
+	CHECK(!oZero.Commit(oSettings));
+
+	Store oTwo(oEeprom, BASE_ADDR, 2 * Store::SLOT_BYTES, SCHEMA_VERSION);
+	CHECK(oTwo.GetNumSlots() == 2);
+	CHECK(oTwo.Commit(oSettings));
+}
+
+int main()
+{
+	TestLoadAndCommit();
+	TestPowerCut(2);
+	TestPowerCut(5);
+	TestFallback();
+	TestSequenceWrap();
+	TestTooSmall();
+	return HostTestResult("TestSettingsStore");
+}
@@ -0,0 +1,215 @@
+/**
+ * File: TestSignalGraph.cpp
+ *
+ * Description: Checks SignalGraph (EASignalGraph.h).  The BarLights touch
+ * table has to give the same outputs to the bit as the ProcessingNode pair
+ * it replaced, so it is run on the touchtone case of the shared
+ * ProcessingNode vectors (ProcessingNodeVectors.txt).  Then each of the
+ * other node types against a simple version of what it does, and Load()
+ * turning down bad tables.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "HostTest.h"
+#include "EASignalGraph.h"
+
+// The BarLights table: ProcessingNode node 0 (2 sample box) then node 1
+// (derivative, 0.3 EMA, 10 sample box, 0.6 scale)
+static const SignalNodeDesc s_aoTouchGraph[] =
+{
+	{ SIGNAL_NODE_BOX,        SIGNAL_GRAPH_INPUT, 2,   0 }, // 0 Smoothed input
+	{ SIGNAL_NODE_DERIVATIVE, 0,                  0,   0 },
+	{ SIGNAL_NODE_EMA,        1,                  0.3, 0 },
+	{ SIGNAL_NODE_BOX,        2,                  10,  0 },
+	{ SIGNAL_NODE_SCALE,      3,                  0.6, 0 }  // 4 Smoothed 1st derivative
+};
+
+static uint32_t FloatBits(float f)
+{
+	uint32_t iBits;
+	memcpy(&iBits, &f, sizeof(iBits));
+	return iBits;
+}
+
+// Runs the touchtone case of the vectors through the table
+static void TestTouchGraph()
+{
+	FILE *pFile = fopen("ProcessingNodeVectors.txt", "r");
+	CHECK(pFile != NULL);
+	if(!pFile)
+	{
+		return;
+	}
+
+	SignalGraph<8> oGraph;
+	CHECK(oGraph.Load(s_aoTouchGraph, 5));
+
+	char szLine[256];
+	bool bInCase = false;
+	int iNumSteps = 0;
+	while(fgets(szLine, sizeof(szLine), pFile))
+	{
+		char szCase[64];
+		if(sscanf(szLine, "case %63s", szCase) == 1)
+		{
+			bInCase = strcmp(szCase, "touchtone") == 0;
+			continue;
+		}
+
+		int iDeltaTimeMS;
+		char szInput[64];
+		unsigned iInputBits;
+		unsigned iDerivBits;
+		if(bInCase && sscanf(szLine, "step %d %63s %x %x", &iDeltaTimeMS, szInput, &iInputBits, &iDerivBits) == 4)
+		{
+			oGraph.Run(strtof(szInput, NULL), iDeltaTimeMS);
+			CHECK(FloatBits(oGraph.GetOutput(0)) == iInputBits);
+			CHECK(FloatBits(oGraph.GetOutput(4)) == iDerivBits);
+			iNumSteps++;
+		}
+	}
+	fclose(pFile);
+	printf("  touch table: %d steps the same to the bit as ProcessingNode\n", iNumSteps);
+	CHECK(iNumSteps > 0);
+}
+
+static float Noise()
+{
+	return (float)rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+// The median against sorting the window every sample, the rest against
+// what they say they do
+static void TestNodes()
+{
+	static const SignalNodeDesc aoNodes[] =
+	{
+		{ SIGNAL_NODE_MEDIAN,     SIGNAL_GRAPH_INPUT, 7,     0    }, // 0
+		{ SIGNAL_NODE_HYSTERESIS, SIGNAL_GRAPH_INPUT, 0.5,   -0.5 }, // 1
+		{ SIGNAL_NODE_PEAK_HOLD,  SIGNAL_GRAPH_INPUT, 0.99f, 0.1  }, // 2
+		{ SIGNAL_NODE_TRIGGER,    SIGNAL_GRAPH_INPUT, 0.5,   -0.5 }, // 3
+		{ SIGNAL_NODE_SCALE,      SIGNAL_GRAPH_INPUT, 2,     1    }, // 4
+		{ SIGNAL_NODE_MEDIAN,     SIGNAL_GRAPH_INPUT, 1,     0    }  // 5
+	};
+	SignalGraph<8> oGraph;
+	CHECK(oGraph.Load(aoNodes, 6));
+
+	float afWindow[7] = {0};
+	bool bOn = false;
+	bool bArmed = true;
+	float fPeak = 0;
+	int iNumTriggers = 0;
+	for(int i = 0; i < 20000; ++i)
+	{
+		// Repeats now and then so the median sees equal values
+		float fIn = (i % 13 == 0) ? afWindow[(i + 3) % 7] : Noise();
+		oGraph.Run(fIn, 10);
+
+		afWindow[(i + 1) % 7] = fIn;
+		float afSorted[7];
+		memcpy(afSorted, afWindow, sizeof(afSorted));
+		for(int j = 1; j < 7; ++j)
+		{
+			for(int k = j; k > 0 && afSorted[k-1] > afSorted[k]; --k)
+			{
+				float f = afSorted[k];
+				afSorted[k] = afSorted[k-1];
+				afSorted[k-1] = f;
+			}
+		}
+		CHECK(oGraph.GetOutput(0) == afSorted[3]);
+
+		bOn = fIn > 0.5f ? true : (fIn < -0.5f ? false : bOn);
+		CHECK(oGraph.GetOutput(1) == (bOn ? 1.0f : 0.0f));
+
+		fPeak = fPeak * 0.99f;
+		fPeak = fIn > fPeak ? fIn : fPeak;
+		fPeak = fPeak < 0.1f ? 0.1f : fPeak;
+		CHECK(oGraph.GetOutput(2) == (fIn > 0 ? fIn / fPeak : 0.0f));
+
+		bool bTrigger = bArmed && fIn > 0.5f;
+		if(bTrigger)
+		{
+			bArmed = false;
+			iNumTriggers++;
+		}
+		else if(!bArmed && fIn < -0.5f)
+		{
+			bArmed = true;
+		}
+		CHECK(oGraph.GetOutput(3) == (bTrigger ? 1.0f : 0.0f));
+
+		CHECK(oGraph.GetOutput(4) == fIn * 2 + 1);
+		CHECK(oGraph.GetOutput(5) == fIn);
+	}
+	CHECK(iNumTriggers > 100);
+}
+
+static void TestLoad()
+{
+	SignalGraph<4, 16> oGraph;
+
+	// Reads itself, reads a later node, unknown type
+	SignalNodeDesc aoSelf[] = {{ SIGNAL_NODE_EMA, 0, 0.5, 0 }};
+	SignalNodeDesc aoLater[] = {{ SIGNAL_NODE_EMA, 1, 0.5, 0 }, { SIGNAL_NODE_EMA, SIGNAL_GRAPH_INPUT, 0.5, 0 }};
+	SignalNodeDesc aoType[] = {{ NUM_SIGNAL_NODE_TYPES, SIGNAL_GRAPH_INPUT, 0, 0 }};
+	CHECK(!oGraph.Load(aoSelf, 1));
+	CHECK(!oGraph.Load(aoLater, 2));
+	CHECK(!oGraph.Load(aoType, 1));
+
+	// Windows that are too small, too big or don't fit in the pool
+	SignalNodeDesc aoBox0[] = {{ SIGNAL_NODE_BOX, SIGNAL_GRAPH_INPUT, 0, 0 }};
+	SignalNodeDesc aoMedian[] = {{ SIGNAL_NODE_MEDIAN, SIGNAL_GRAPH_INPUT, SIGNAL_MAX_MEDIAN + 1, 0 }};
+	SignalNodeDesc aoPool[] = {{ SIGNAL_NODE_BOX, SIGNAL_GRAPH_INPUT, 10, 0 }, { SIGNAL_NODE_MEDIAN, 0, 4, 0 }};
+	CHECK(!oGraph.Load(aoBox0, 1));
+	CHECK(!oGraph.Load(aoMedian, 1));
+	CHECK(!oGraph.Load(aoPool, 2));
+	CHECK(oGraph.GetNumNodes() == 0);
+
+	// Windows too big for an int, NaN or infinite, and a NaN anywhere else,
+	// as a corrupt EEPROM or a bad message could give
+	static const float afBadWindows[] = { NAN, INFINITY, -INFINITY, 1e30f, -1e30f, 3e9f, -3e9f, 256.0f, 0.5f, -0.5f };
+	for(int w = 0; w < (int)(sizeof(afBadWindows) / sizeof(afBadWindows[0])); ++w)
+	{
+		SignalNodeDesc aoBox[] = {{ SIGNAL_NODE_BOX, SIGNAL_GRAPH_INPUT, afBadWindows[w], 0 }};
+		SignalNodeDesc aoWindowMedian[] = {{ SIGNAL_NODE_MEDIAN, SIGNAL_GRAPH_INPUT, afBadWindows[w], 0 }};
+		CHECK(!oGraph.Load(aoBox, 1));
+		CHECK(!oGraph.Load(aoWindowMedian, 1));
+	}
+	SignalNodeDesc aoNanEma[] = {{ SIGNAL_NODE_EMA, SIGNAL_GRAPH_INPUT, NAN, 0 }};
+	SignalNodeDesc aoInfScale[] = {{ SIGNAL_NODE_SCALE, SIGNAL_GRAPH_INPUT, 1, INFINITY }};
+	CHECK(!oGraph.Load(aoNanEma, 1));
+	CHECK(!oGraph.Load(aoInfScale, 1));
+
+	// The biggest window that fits, and a fraction that rounds down
+	SignalGraph<1, 255> oBigGraph;
+	SignalNodeDesc aoBox255[] = {{ SIGNAL_NODE_BOX, SIGNAL_GRAPH_INPUT, 255.9f, 0 }};
+	SignalNodeDesc aoBox1[] = {{ SIGNAL_NODE_BOX, SIGNAL_GRAPH_INPUT, 1.5f, 0 }};
+	CHECK(oBigGraph.Load(aoBox255, 1));
+	CHECK(oBigGraph.Load(aoBox1, 1));
+
+	// Too many nodes, from a table that says it has more than it holds
+	SignalGraphTable<2> oTable;
+	memset(&oTable, 0, sizeof(oTable));
+	oTable.m_yNumNodes = 3;
+	CHECK(!oGraph.Load(oTable));
+	oTable.m_yNumNodes = 2;
+	oTable.m_aoNodes[0].m_yInput = SIGNAL_GRAPH_INPUT;
+	CHECK(oGraph.Load(oTable));
+	CHECK(oGraph.GetNumNodes() == 2);
+
+	// An EEPROM that was never written reads back as all 0xFF
+	memset(&oTable, 0xFF, sizeof(oTable));
+	CHECK(!oGraph.Load(oTable));
+}
+
+int main()
+{
+	TestTouchGraph();
+	TestNodes();
+	TestLoad();
+	return HostTestResult("TestSignalGraph");
+}
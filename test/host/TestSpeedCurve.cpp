@@ -0,0 +1,114 @@
+/**
+ * File: TestSpeedCurve.cpp
+ *
+ * Description: Holds SpeedCurve and SpeedRatioMap (EASpeedCurve.h) to the
+ * error bounds quoted in that header, against the float math the sketches
+ * used to do, for every Q16 ratio.  Also checks the curve never goes down.
+ */
+
+#include <math.h>
+#include "HostTest.h"
+#include "EASpeedCurve.h"
+
+// The bounds quoted in EASpeedCurve.h
+#define CURVE16_MAX_ERROR 0.0024
+#define CURVE16_MAX_ERROR_TO_2 0.00026
+#define CURVE4_MAX_ERROR_TO_2 0.004
+#define RATIO_MAX_ERROR 0.0015
+
+static float Clamp(float fValue, float fMin, float fMax)
+{
+	return fValue < fMin ? fMin : (fValue > fMax ? fMax : fValue);
+}
+
+// Worst error over every ratio, and false if the curve ever goes down
+template<int STEPS>
+static double CurveError(SpeedCurve<STEPS> &oCurve, float fExponent, bool &bMonotonic)
+{
+	oCurve.SetExponent(fExponent);
+	double fWorst = 0.0;
+	q16_t iLast = 0;
+	for(q16_t iRatio = 0; iRatio <= Q16_ONE; ++iRatio)
+	{
+		double fReference = iRatio == 0 ? (fExponent == 0.0 ? 1.0 : 0.0) : pow(Q16ToFloat(iRatio), fExponent);
+		q16_t iValue = oCurve.Apply(iRatio);
+		double fError = fabs(Q16ToFloat(iValue) - fReference);
+		fWorst = fError > fWorst ? fError : fWorst;
+		// 0^0 is taken as 1 and the table tops out a step under, so start
+		// from the first ratio above 0
+		if(iRatio > 1 && iValue < iLast)
+		{
+			bMonotonic = false;
+		}
+		iLast = iValue;
+	}
+	return fWorst;
+}
+
+int main()
+{
+	printf("TestSpeedCurve\n");
+
+	bool bMonotonic = true;
+	double fWorst16 = 0.0;
+	double fWorst16To2 = 0.0;
+	double fWorst4To2 = 0.0;
+	SpeedCurve<16> oCurve16;
+	SpeedCurve<4> oCurve4;
+	for(int e = 0; e <= 100; ++e)
+	{
+		float fExponent = e * 0.05;
+		double fError = CurveError(oCurve16, fExponent, bMonotonic);
+		fWorst16 = fError > fWorst16 ? fError : fWorst16;
+		if(fExponent <= 2.0)
+		{
+			fWorst16To2 = fError > fWorst16To2 ? fError : fWorst16To2;
+			fError = CurveError(oCurve4, fExponent, bMonotonic);
+			fWorst4To2 = fError > fWorst4To2 ? fError : fWorst4To2;
+		}
+	}
+	printf("  SpeedCurve<16> max error %.5f for exponents 0 to 5, %.5f to 2\n", fWorst16, fWorst16To2);
+	printf("  SpeedCurve<4> max error %.5f for exponents 0 to 2\n", fWorst4To2);
+	CHECK(fWorst16 <= CURVE16_MAX_ERROR);
+	CHECK(fWorst16To2 <= CURVE16_MAX_ERROR_TO_2);
+	CHECK(fWorst4To2 <= CURVE4_MAX_ERROR_TO_2);
+	CHECK(bMonotonic);
+
+	// The ends
+	oCurve16.SetExponent(0.35);
+	CHECK(oCurve16.Apply(0) == 0);
+	CHECK(oCurve16.Apply(Q16_ONE) == Q16_ONE);
+	CHECK(oCurve16.Apply(2 * Q16_ONE) == Q16_ONE);
+	oCurve16.SetExponent(0.0);
+	CHECK(oCurve16.Apply(0) == Q16_ONE);
+
+	// Periods from 1us to 4s over ranges the sketches use and some narrow ones
+	static const float aafRanges[][2] =
+	{
+		{ 0.02, 0.22 }, { 0.1, 0.45 }, { 0.0, 2.0 }, { 0.5, 0.51 }, { 0.0, 0.01 }
+	};
+	SpeedRatioMap oMap;
+	double fWorstRatio = 0.0;
+	for(unsigned int r = 0; r < sizeof(aafRanges) / sizeof(aafRanges[0]); ++r)
+	{
+		float fMinSpeed = aafRanges[r][0];
+		float fMaxSpeed = aafRanges[r][1];
+		oMap.SetRange(fMinSpeed, fMaxSpeed);
+		for(unsigned long iPeriod = 1; iPeriod < 4000000; iPeriod += iPeriod < 2000 ? 1 : iPeriod / 500)
+		{
+			float fSpeed = (1.0 / (iPeriod / 1000000.0)) / XBAND_HZ_PER_METER_PER_SEC;
+			float fReference = (Clamp(fSpeed, fMinSpeed, fMaxSpeed) - fMinSpeed) / (fMaxSpeed - fMinSpeed);
+			double fError = fabs(Q16ToFloat(oMap.GetRatio(iPeriod)) - fReference);
+			fWorstRatio = fError > fWorstRatio ? fError : fWorstRatio;
+		}
+	}
+	printf("  SpeedRatioMap max error %.5f\n", fWorstRatio);
+	CHECK(fWorstRatio <= RATIO_MAX_ERROR);
+
+	// An empty range doesn't divide by zero
+	oMap.SetRange(0.3, 0.3);
+	CHECK(oMap.GetRatio(1000) == Q16_ONE);
+	CHECK(oMap.GetRatio(1000000) == 0);
+
+	return HostTestResult("TestSpeedCurve");
+}
@@ -0,0 +1,196 @@
+/**
+ * File: TestSpeedSmoother.cpp
+ *
+ * Description: Feeds SpeedSmoother (EASpeedSmoother.h) the same synthetic
+ * radar pulse timelines at different loop rates, steady and jittery, and
+ * checks the smoothed curves all match the old fixed 8ms frame EMA.  Also
+ * checks the edge cases that used to give NaN.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "HostTest.h"
+#include "EASpeedSmoother.h"
+
+#define REF_FRAME_MICRO 8000
+#define TIMELINE_MICRO 6000000L
+#define MAX_PULSES 20000
+
+// A timeline of pulse times.  The speed ratio at any time comes from the
+// last pulse period, the way the sketches get it from the radar.
+struct PulseTimeline
+{
+	long m_aiPulseMicro[MAX_PULSES];
+	int m_iNumPulses;
+
+	// Pulses at a rate that follows fRatio(t) * 200 Hz, with no pulses while
+	// the rate is under 5 Hz
+	template<class Profile>
+	void Make(Profile fnProfile)
+	{
+		m_iNumPulses = 0;
+		long iTime = 0;
+		while(iTime < TIMELINE_MICRO && m_iNumPulses < MAX_PULSES)
+		{
+			float fHz = fnProfile(iTime) * 200.0f;
+			if(fHz < 5.0f)
+			{
+				iTime += 1000;
+				continue;
+			}
+			m_aiPulseMicro[m_iNumPulses++] = iTime;
+			iTime += (long)(1000000.0f / fHz);
+		}
+	}
+
+	float GetSpeedRatio(long iTimeMicro) const
+	{
+		int i = 0;
+		while(i < m_iNumPulses && m_aiPulseMicro[i] <= iTimeMicro)
+		{
+			++i;
+		}
+		if(i < 2 || iTimeMicro - m_aiPulseMicro[i-1] > 200000)
+		{
+			return 0.0f;
+		}
+		float fHz = 1000000.0f / (m_aiPulseMicro[i-1] - m_aiPulseMicro[i-2]);
+		float fRatio = fHz / 200.0f;
+		return fRatio > 1.0f ? 1.0f : fRatio;
+	}
+};
+
+static float RampProfile(long iTimeMicro)
+{
+	// Up over 2s, hold for 1s, down over 2s
+	float t = iTimeMicro / 1000000.0f;
+	if(t < 2.0f) return t / 2.0f;
+	if(t < 3.0f) return 1.0f;
+	if(t < 5.0f) return (5.0f - t) / 2.0f;
+	return 0.0f;
+}
+
+static float WalkProfile(long iTimeMicro)
+{
+	// Someone walking by twice
+	float t = iTimeMicro / 1000000.0f;
+	float a = t - 1.5f;
+	float b = t - 4.0f;
+	return 0.8f * expf(-a * a * 4.0f) + 0.5f * expf(-b * b * 8.0f);
+}
+
+static float StepProfile(long iTimeMicro)
+{
+	return (iTimeMicro > 1000000 && iTimeMicro < 3000000) ? 0.7f : 0.0f;
+}
+
+// The old code: one EMA step every REF_FRAME_MICRO, sampled at 1ms steps
+static void RunOld(const PulseTimeline &oTimeline, float fNewWeight, float afOut[])
+{
+	float fValue = 0.0f;
+	for(long iTime = 0; iTime < TIMELINE_MICRO; iTime += 1000)
+	{
+		if(iTime % REF_FRAME_MICRO == 0)
+		{
+			fValue = oTimeline.GetSpeedRatio(iTime) * fNewWeight + fValue * (1.0f - fNewWeight);
+		}
+		afOut[iTime / 1000] = fValue;
+	}
+}
+
+// SpeedSmoother with loop times from iMinLoopMicro to iMaxLoopMicro, sampled
+// at 1ms steps by holding the last output
+static void RunNew(const PulseTimeline &oTimeline, float fNewWeight, long iMinLoopMicro, long iMaxLoopMicro, float afOut[])
+{
+	SpeedSmoother oSmoother(REF_FRAME_MICRO / 1000.0);
+	oSmoother.Update(0.0f, fNewWeight, 0);
+
+	long iLoopTime = 0;
+	long iLastLoopTime = 0;
+	for(long iTime = 0; iTime < TIMELINE_MICRO; iTime += 1000)
+	{
+		while(iLoopTime <= iTime)
+		{
+			oSmoother.Update(oTimeline.GetSpeedRatio(iLoopTime), fNewWeight, iLoopTime - iLastLoopTime);
+			iLastLoopTime = iLoopTime;
+			iLoopTime += iMinLoopMicro + (iMaxLoopMicro > iMinLoopMicro ? rand() % (iMaxLoopMicro - iMinLoopMicro) : 0);
+		}
+		afOut[iTime / 1000] = oSmoother.Get();
+	}
+}
+
+static float MaxDifference(const float afA[], const float afB[])
+{
+	float fMax = 0.0f;
+	for(int i = 0; i < TIMELINE_MICRO / 1000; ++i)
+	{
+		float fDiff = fabsf(afA[i] - afB[i]);
+		if(fDiff > fMax)
+		{
+			fMax = fDiff;
+		}
+	}
+	return fMax;
+}
+
+static float s_afOld[TIMELINE_MICRO / 1000];
+static float s_afNew[TIMELINE_MICRO / 1000];
+static PulseTimeline s_oTimeline;
+
+static void CheckTimeline(const char *szName, float (*fnProfile)(long), float fNewWeight)
+{
+	s_oTimeline.Make(fnProfile);
+	RunOld(s_oTimeline, fNewWeight, s_afOld);
+
+	// Loop times: the old padded frame, much faster, slower, and jittery
+	static const long aiLoops[][2] = {{8000, 8000}, {1000, 1000}, {2500, 2500}, {16000, 16000}, {500, 12000}};
+	for(unsigned i = 0; i < sizeof(aiLoops) / sizeof(aiLoops[0]); ++i)
+	{
+		RunNew(s_oTimeline, fNewWeight, aiLoops[i][0], aiLoops[i][1], s_afNew);
+		float fDiff = MaxDifference(s_afOld, s_afNew);
+		printf("  %-5s weight %.2f loop %5ld-%5ldus: max difference from the 8ms EMA %.4f\n",
+			szName, fNewWeight, aiLoops[i][0], aiLoops[i][1], fDiff);
+
+		// The 8ms loop is the old code exactly.  The others can only be off
+		// by how much the curve moves in a loop or two, which is worst on
+		// the step.
+		if(aiLoops[i][0] == REF_FRAME_MICRO && aiLoops[i][1] == REF_FRAME_MICRO)
+		{
+			CHECK(fDiff < 1e-5f);
+		}
+		else
+		{
+			CHECK(fDiff < (fnProfile == StepProfile ? 0.7f * fNewWeight * 2.0f : 0.02f));
+		}
+	}
+}
+
+int main()
+{
+	printf("TestSpeedSmoother\n");
+	srand(1);
+
+	CheckTimeline("ramp", RampProfile, 0.05f);
+	CheckTimeline("ramp", RampProfile, 0.15f);
+	CheckTimeline("walk", WalkProfile, 0.05f);
+	CheckTimeline("step", StepProfile, 0.05f);
+
+	// A weight of 1 takes every value as is, whatever the time
+	SpeedSmoother oSmoother(8.0);
+	oSmoother.Update(0.5f, 1.0f, 8000);
+	CHECK(oSmoother.Update(0.25f, 1.0f, 8000) == 0.25f);
+	CHECK(oSmoother.Update(0.75f, 1.0f, 0) == 0.75f);
+	CHECK(oSmoother.Update(0.5f, 1.5f, 0) == 0.5f);
+
+	// No time keeps the old value, and nothing sticks at NaN afterwards
+	CHECK(oSmoother.Update(1.0f, 0.05f, 0) == 0.5f);
+	CHECK(oSmoother.Update(1.0f, 1.0f, 0) == 1.0f);
+	CHECK(oSmoother.Update(0.0f, 0.05f, 0) == 1.0f);
+	float fValue = oSmoother.Update(0.0f, 0.05f, 8000);
+	CHECK(!isnan(fValue) && fabsf(fValue - 0.95f) < 1e-5f);
+
+	// A weight of 0 never moves
+	CHECK(oSmoother.Update(0.0f, 0.0f, 1000000) == fValue);
+
+	return HostTestResult("TestSpeedSmoother");
+}
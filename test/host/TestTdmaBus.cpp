@@ -0,0 +1,533 @@
+/**
+ * File: TestTdmaBus.cpp
+ *
+ * Description: Runs 7 EaMidiNodesNeoPixel nodes and the EaMidiPC beacon on a
+ * simulated 9600 baud RS-485 bus, with the real TdmaScheduler
+ * (EATdmaScheduler.h) and frames (EANodeFrame.h), and checks that nobody
+ * ever talks over anybody else and no node misses its slot.  Node 3 is
+ * powered off for a while and has to drop out and get back in.
+ *
+ * Each node runs the same steps as its loop(), with random times for the
+ * parts that vary: drawing the LEDs, show() (3ms for 100 LEDs), padding the
+ * LED time out to ALLOTTED_LED_TIME_MICRO, and now and then writing a
+ * settings byte to EEPROM (3.4ms).  The old loop (bus looked at once a loop,
+ * beacon stamped when read, 4ms guard) is run too for comparison, but only
+ * the current one has to pass.  The PC runs at 60 frames a second with 1 to
+ * 3ms of USB latency.
+ *
+ * Not simulated: bytes lost to the UART while show() has interrupts off,
+ * and clock drift between the nodes.
+ */
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include "HostTest.h"
+#include "EATdmaScheduler.h"
+#include "EANodeFrame.h"
+
+#define NUM_NODES 7
+#define BAUD_RATE 9600
+#define ALLOTTED_LED_TIME_MICRO 4000
+#define EEPROM_WRITE_MICRO 3400
+#define SHOW_MICRO 3000
+#define PC_FRAME_MICRO 16667
+#define PC_BEACON_MARGIN_MICRO 5000
+#define SIM_MICRO 60000000L
+#define NODE_OFF_MICRO 20000000L
+#define NODE_ON_MICRO 35000000L
+#define OFF_NODE 3
+
+static const long BYTE_MICRO = TdmaScheduler::ByteTimeMicro(BAUD_RATE);
+
+static uint32_t s_iRandom = 12345;
+
+// Random number in [iMin, iMax]
+static long Random(long iMin, long iMax)
+{
+	s_iRandom = s_iRandom * 1664525 + 1013904223;
+	return iMin + (long)((s_iRandom >> 8) % (uint32_t)(iMax - iMin + 1));
+}
+
+
+
+struct Transmission
+{
+	long m_iStart;
+	long m_iEnd;
+	int m_iSender; // NUM_NODES for the PC
+	std::vector<uint8_t> m_ayBytes;
+	int m_iNextByte;
+	bool m_bCollided;
+};
+
+struct Bus
+{
+	std::vector<Transmission> m_aoSent;
+	std::deque<uint8_t> m_aayRx[NUM_NODES + 1];
+	int m_iCollisions;
+
+	Bus() : m_iCollisions(0) {}
+
+	void Send(long iNow, int iSender, const uint8_t ayBytes[], int iLength)
+	{
+		Transmission oSend;
+		oSend.m_iStart = iNow;
+		oSend.m_iEnd = iNow + iLength * BYTE_MICRO;
+		oSend.m_iSender = iSender;
+		oSend.m_ayBytes.assign(ayBytes, ayBytes + iLength);
+		oSend.m_iNextByte = 0;
+		oSend.m_bCollided = false;
+		for(size_t i = 0; i < m_aoSent.size(); ++i)
+		{
+			Transmission &oOther = m_aoSent[i];
+			if(oOther.m_iEnd > iNow)
+			{
+				oOther.m_bCollided = true;
+				oSend.m_bCollided = true;
+				m_iCollisions++;
+			}
+		}
+		m_aoSent.push_back(oSend);
+	}
+
+	// Hand every byte that has finished arriving to everyone but the sender.
+	// Bytes of collided frames arrive damaged.
+	void Deliver(long iNow)
+	{
+		for(size_t i = 0; i < m_aoSent.size(); ++i)
+		{
+			Transmission &oSend = m_aoSent[i];
+			while(oSend.m_iNextByte < (int)oSend.m_ayBytes.size() &&
+				  oSend.m_iStart + (oSend.m_iNextByte + 1) * BYTE_MICRO <= iNow)
+			{
+				uint8_t yByte = oSend.m_ayBytes[oSend.m_iNextByte++];
+				if(oSend.m_bCollided && yByte != 0)
+				{
+					yByte ^= 0x55;
+				}
+				for(int r = 0; r <= NUM_NODES; ++r)
+				{
+					if(r != oSend.m_iSender)
+					{
+						m_aayRx[r].push_back(yByte);
+					}
+				}
+			}
+		}
+
+		// Forget what is over
+		while(!m_aoSent.empty() && m_aoSent.front().m_iNextByte == (int)m_aoSent.front().m_ayBytes.size())
+		{
+			m_aoSent.erase(m_aoSent.begin());
+		}
+	}
+};
+
+
+
+// One node.  bNewLoop picks the current loop() (bus serviced between each
+// slow part and through the LED padding, beacons stamped less the bytes
+// waiting behind them) or the old one.
+struct Node
+{
+	int m_iIndex;
+	bool m_bNewLoop;
+	bool m_bOn;
+	TdmaScheduler m_oTdma;
+	NodeFrameReader m_oReader;
+	uint8_t m_ySequence;
+
+	long m_iBusyUntil;
+	int m_iStep;
+	long m_iLedStart;
+	long m_iLastService;
+
+	long m_iLongestGap;
+	long m_iWorstStampError;
+	long m_iLastBeaconArrival;
+	int m_iSent;
+
+	Node(int iIndex, bool bNewLoop, unsigned long iGuardMicro) :
+		m_iIndex(iIndex),
+		m_bNewLoop(bNewLoop),
+		m_bOn(true),
+		m_oTdma(iIndex, NUM_NODES, BAUD_RATE, NODE_MOTION_FRAME_BYTES, iGuardMicro),
+		m_ySequence(0),
+		m_iBusyUntil(Random(0, 500000)),
+		m_iStep(0),
+		m_iLedStart(0),
+		m_iLastService(-1),
+		m_iLongestGap(0),
+		m_iWorstStampError(0),
+		m_iLastBeaconArrival(0),
+		m_iSent(0)
+	{
+	}
+
+	void PowerOn(long iNow)
+	{
+		m_bOn = true;
+		m_oTdma.Reset();
+		m_oReader = NodeFrameReader();
+		m_iBusyUntil = iNow + Random(100000, 300000);
+		m_iStep = 0;
+		m_iLastService = -1;
+	}
+
+	void ReadBus(Bus &oBus, long iNow, bool bStampLessWaiting)
+	{
+		std::deque<uint8_t> &ayRx = oBus.m_aayRx[m_iIndex];
+		while(!ayRx.empty())
+		{
+			uint8_t yByte = ayRx.front();
+			ayRx.pop_front();
+			NodeFrame oFrame;
+			if(!m_oReader.Feed(yByte, oFrame))
+			{
+				continue;
+			}
+			uint8_t yRound;
+			if(oFrame.m_yType == NODE_FRAME_BEACON && oFrame.GetByte(yRound))
+			{
+				long iStamp = bStampLessWaiting ? iNow - (long)ayRx.size() * BYTE_MICRO : iNow;
+				m_oTdma.OnBeacon(yRound, iStamp);
+				m_iWorstStampError = std::max(m_iWorstStampError, iStamp - m_iLastBeaconArrival);
+			}
+			else if(oFrame.m_yType == NODE_FRAME_MOTION)
+			{
+				m_oTdma.OnNodeFrame(oFrame.m_ySender);
+			}
+		}
+	}
+
+	// Returns how long the send blocks
+	long TrySend(Bus &oBus, long iNow)
+	{
+		if(!m_oTdma.ShouldSend(iNow))
+		{
+			return 0;
+		}
+		NodeFrame oFrame;
+		oFrame.Begin(NODE_FRAME_MOTION, m_iIndex, m_ySequence++);
+		oFrame.PutWord(1000);
+		oFrame.PutWord(0);
+		uint8_t ayWire[NODE_FRAME_MAX_WIRE];
+		int iLength = oFrame.Encode(ayWire);
+		oBus.Send(iNow, m_iIndex, ayWire, iLength);
+		m_iSent++;
+		return iLength * BYTE_MICRO + 50; // Uart.flush()
+	}
+
+	// ServiceBus() in the sketch
+	long Service(Bus &oBus, long iNow)
+	{
+		if(m_iLastService >= 0)
+		{
+			m_iLongestGap = std::max(m_iLongestGap, iNow - m_iLastService);
+		}
+		ReadBus(oBus, iNow, true);
+		long iBusy = TrySend(oBus, iNow);
+		m_iLastService = iNow + iBusy;
+		return iBusy;
+	}
+
+	void Run(Bus &oBus, long iNow)
+	{
+		// Nothing is received while off or before setup() has started the UART
+		if(!m_bOn || (m_iLastService < 0 && m_iStep == 0 && iNow < m_iBusyUntil))
+		{
+			oBus.m_aayRx[m_iIndex].clear();
+			return;
+		}
+		if(iNow < m_iBusyUntil)
+		{
+			return;
+		}
+
+		long iBusy = 0;
+		if(m_bNewLoop)
+		{
+			switch(m_iStep++)
+			{
+			case 0: // Speed and drawing the LEDs
+				m_iLedStart = iNow;
+				iBusy = Random(600, 2600);
+				break;
+			case 1:
+				iBusy = Service(oBus, iNow);
+				break;
+			case 2:
+				iBusy = SHOW_MICRO;
+				break;
+			case 3: // Padding, servicing the bus all the time
+				if(iNow - m_iLedStart < ALLOTTED_LED_TIME_MICRO)
+				{
+					iBusy = Service(oBus, iNow) + 30;
+					m_iStep = 3;
+				}
+				break;
+			case 4:
+				iBusy = Service(oBus, iNow);
+				break;
+			case 5: // Settings byte
+				iBusy = Random(0, 9) == 0 ? EEPROM_WRITE_MICRO : 40;
+				break;
+			case 6:
+				iBusy = Service(oBus, iNow);
+				m_iStep = 0;
+				break;
+			}
+		}
+		else
+		{
+			switch(m_iStep++)
+			{
+			case 0: // Speed, drawing, show() and padding
+				iBusy = std::max((long)ALLOTTED_LED_TIME_MICRO, Random(600, 2600) + SHOW_MICRO);
+				break;
+			case 1: // Read the bus, then save settings
+				if(m_iLastService >= 0)
+				{
+					m_iLongestGap = std::max(m_iLongestGap, iNow - m_iLastService);
+				}
+				ReadBus(oBus, iNow, false);
+				iBusy = Random(0, 9) == 0 ? EEPROM_WRITE_MICRO : 40;
+				break;
+			case 2:
+				iBusy = TrySend(oBus, iNow);
+				m_iLastService = iNow + iBusy;
+				m_iStep = 0;
+				break;
+			}
+		}
+		m_iBusyUntil = iNow + iBusy;
+	}
+};
+
+
+
+// The PC side (EaMidiPC.pde): looks at the bus once a frame and sends the
+// next beacon once the round is over
+struct PC
+{
+	TdmaScheduler m_oTdma;
+	NodeFrameReader m_oReader;
+	long m_iNextFrame;
+	long m_iLastBeaconWrite;
+	long m_iBeaconOnWire;
+	bool m_bBeaconPending;
+	bool m_bAddBeaconTime;
+	std::vector<long> m_aiRoundMicro;
+	std::vector<uint8_t> m_ayPresentAtBeacon;
+	std::vector<uint8_t> m_ayHeardInRound;
+	uint8_t m_yHeard;
+
+	PC(unsigned long iGuardMicro, bool bAddBeaconTime) :
+		m_oTdma(NUM_NODES, NUM_NODES, BAUD_RATE, NODE_MOTION_FRAME_BYTES, iGuardMicro),
+		m_iNextFrame(0),
+		m_iLastBeaconWrite(-1000000),
+		m_iBeaconOnWire(0),
+		m_bBeaconPending(false),
+		m_bAddBeaconTime(bAddBeaconTime),
+		m_yHeard(0)
+	{
+	}
+
+	void Run(Bus &oBus, Node aoNodes[], long iNow)
+	{
+		if(m_bBeaconPending && iNow >= m_iBeaconOnWire)
+		{
+			NodeFrame oFrame;
+			uint8_t yRound = m_oTdma.GetNextRound();
+			oFrame.Begin(NODE_FRAME_BEACON, NUM_NODES, 0);
+			oFrame.PutByte(yRound);
+			uint8_t ayWire[NODE_FRAME_MAX_WIRE];
+			int iLength = oFrame.Encode(ayWire);
+			oBus.Send(iNow, NUM_NODES, ayWire, iLength);
+			m_bBeaconPending = false;
+			for(int i = 0; i < NUM_NODES; ++i)
+			{
+				aoNodes[i].m_iLastBeaconArrival = iNow + iLength * BYTE_MICRO;
+			}
+		}
+
+		if(iNow < m_iNextFrame)
+		{
+			return;
+		}
+		m_iNextFrame = iNow + PC_FRAME_MICRO + Random(-2000, 2000);
+
+		std::deque<uint8_t> &ayRx = oBus.m_aayRx[NUM_NODES];
+		while(!ayRx.empty())
+		{
+			NodeFrame oFrame;
+			uint8_t yByte = ayRx.front();
+			ayRx.pop_front();
+			if(m_oReader.Feed(yByte, oFrame) && oFrame.m_yType == NODE_FRAME_MOTION)
+			{
+				m_oTdma.OnNodeFrame(oFrame.m_ySender);
+				m_yHeard |= 1 << oFrame.m_ySender;
+			}
+		}
+
+		long iBeaconMicro = m_bAddBeaconTime ? NODE_BEACON_FRAME_BYTES * BYTE_MICRO : 0;
+		if(!m_bBeaconPending && iNow - m_iLastBeaconWrite >= iBeaconMicro + (long)m_oTdma.GetRoundMicro() + PC_BEACON_MARGIN_MICRO)
+		{
+			// Close out the round
+			if(m_iLastBeaconWrite >= 0)
+			{
+				m_aiRoundMicro.push_back(iNow - m_iLastBeaconWrite);
+				m_ayPresentAtBeacon.push_back(m_oTdma.GetPresentMask());
+				m_ayHeardInRound.push_back(m_yHeard);
+			}
+			m_yHeard = 0;
+
+			m_oTdma.OnBeacon(m_oTdma.GetNextRound(), iNow);
+			m_iLastBeaconWrite = iNow;
+			m_iBeaconOnWire = iNow + Random(1000, 3000);
+			m_bBeaconPending = true;
+		}
+	}
+};
+
+
+
+struct Result
+{
+	int m_iCollisions;
+	int m_iMissedSlots;
+	long m_iMedianRound;
+	long m_iMaxRound;
+	long m_iMedianRoundOneMissing;
+	long m_iLongestGap;
+	long m_iWorstStampError;
+	long m_iRejoinMicro;
+};
+
+static long Median(std::vector<long> aiValues)
+{
+	if(aiValues.empty())
+	{
+		return 0;
+	}
+	std::sort(aiValues.begin(), aiValues.end());
+	return aiValues[aiValues.size() / 2];
+}
+
+static Result RunBus(bool bNewLoop, unsigned long iGuardMicro)
+{
+	s_iRandom = 12345;
+	Bus oBus;
+	std::vector<Node> aoNodes;
+	for(int i = 0; i < NUM_NODES; ++i)
+	{
+		aoNodes.push_back(Node(i, bNewLoop, iGuardMicro));
+	}
+	PC oPC(iGuardMicro, bNewLoop);
+
+	const long TICK = 5;
+	long iRejoin = -1;
+	for(long iNow = 0; iNow < SIM_MICRO; iNow += TICK)
+	{
+		if(iNow == NODE_OFF_MICRO)
+		{
+			aoNodes[OFF_NODE].m_bOn = false;
+		}
+		if(iNow == NODE_ON_MICRO)
+		{
+			aoNodes[OFF_NODE].PowerOn(iNow);
+		}
+		if(iNow > NODE_ON_MICRO && iRejoin < 0 && oPC.m_oTdma.IsPresent(OFF_NODE))
+		{
+			iRejoin = iNow - NODE_ON_MICRO;
+		}
+
+		oBus.Deliver(iNow);
+		oPC.Run(oBus, &aoNodes[0], iNow);
+		for(int i = 0; i < NUM_NODES; ++i)
+		{
+			aoNodes[i].Run(oBus, iNow);
+		}
+	}
+
+	Result oResult;
+	oResult.m_iCollisions = oBus.m_iCollisions;
+	oResult.m_iRejoinMicro = iRejoin;
+
+	// A slot is missed when a node the PC thinks is present isn't heard in
+	// the round, apart from the node that was switched off
+	std::vector<long> aiAllPresent;
+	std::vector<long> aiOneMissing;
+	oResult.m_iMissedSlots = 0;
+	for(size_t r = 0; r < oPC.m_aiRoundMicro.size(); ++r)
+	{
+		uint8_t yPresent = oPC.m_ayPresentAtBeacon[r];
+		uint8_t yMissed = yPresent & ~oPC.m_ayHeardInRound[r] & ~(1 << OFF_NODE);
+		for(int i = 0; i < NUM_NODES; ++i)
+		{
+			oResult.m_iMissedSlots += (yMissed >> i) & 1;
+		}
+		if(yPresent == (1 << NUM_NODES) - 1)
+		{
+			aiAllPresent.push_back(oPC.m_aiRoundMicro[r]);
+		}
+		else if(yPresent == (((1 << NUM_NODES) - 1) & ~(1 << OFF_NODE)))
+		{
+			aiOneMissing.push_back(oPC.m_aiRoundMicro[r]);
+		}
+	}
+	oResult.m_iMedianRound = Median(aiAllPresent);
+	oResult.m_iMaxRound = aiAllPresent.empty() ? 0 : *std::max_element(aiAllPresent.begin(), aiAllPresent.end());
+	oResult.m_iMedianRoundOneMissing = Median(aiOneMissing);
+
+	oResult.m_iLongestGap = 0;
+	oResult.m_iWorstStampError = 0;
+	for(int i = 0; i < NUM_NODES; ++i)
+	{
+		oResult.m_iLongestGap = std::max(oResult.m_iLongestGap, aoNodes[i].m_iLongestGap);
+		oResult.m_iWorstStampError = std::max(oResult.m_iWorstStampError, aoNodes[i].m_iWorstStampError);
+	}
+	return oResult;
+}
+
+static void Print(const char *szName, unsigned long iGuardMicro, const Result &oResult)
+{
+	printf("  %s, %lu us guard:\n", szName, iGuardMicro);
+	printf("    collisions %d, missed slots %d\n", oResult.m_iCollisions, oResult.m_iMissedSlots);
+	printf("    longest time without looking at the bus %ld us, worst beacon stamp error %ld us\n",
+		oResult.m_iLongestGap, oResult.m_iWorstStampError);
+	if(oResult.m_iMedianRound > 0)
+	{
+		printf("    round %.1f ms median, %.1f ms max with all 7, %.1f ms median with one missing\n",
+			oResult.m_iMedianRound / 1000.0, oResult.m_iMaxRound / 1000.0, oResult.m_iMedianRoundOneMissing / 1000.0);
+	}
+	else
+	{
+		printf("    never had all 7 in a round, %.1f ms median with one missing\n", oResult.m_iMedianRoundOneMissing / 1000.0);
+	}
+	printf("    switched off node back in after %.2f s\n", oResult.m_iRejoinMicro / 1000000.0);
+}
+
+int main()
+{
+	printf("TestTdmaBus\n");
+
+	Result oOld = RunBus(false, 4000);
+	Print("old loop", 4000, oOld);
+
+	// Same as COM_SLOT_GUARD_MICRO in EaMidiNodesNeoPixel
+	const unsigned long GUARD_MICRO = 7000;
+	Result oNew = RunBus(true, GUARD_MICRO);
+	Print("current loop", GUARD_MICRO, oNew);
+
+	CHECK(oNew.m_iCollisions == 0);
+	CHECK(oNew.m_iMissedSlots == 0);
+	CHECK(oNew.m_iLongestGap <= (long)GUARD_MICRO / 2);
+	CHECK(oNew.m_iWorstStampError <= (long)GUARD_MICRO / 2);
+	CHECK(oNew.m_iMedianRound > 0);
+	CHECK(oNew.m_iMedianRoundOneMissing < oNew.m_iMedianRound);
+	CHECK(oNew.m_iRejoinMicro > 0 && oNew.m_iRejoinMicro < 3000000);
+
+	return HostTestResult("TestTdmaBus");
+}
@@ -0,0 +1,203 @@
+/**
+ * File: TestTelemetry.cpp
+ *
+ * Description: Checks Telemetry (EATelemetry.h) against a serial port with
+ * a small TX buffer, like the 64 byte USB serial on a Teensy++ 2.0.  A
+ * FeatherLights sized line is longer than the buffer, so it has to go out
+ * in pieces over several calls without ever writing more than there is
+ * room for.  Also the number formatting at the edges (NaN, infinity, values
+ * too big for 32 bits) and the frames for the tuner.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include "HostTest.h"
+#include "EATelemetry.h"
+
+// A TX buffer of iSize bytes that the host empties with Drain()
+struct MockPort
+{
+	MockPort(int iSize) :
+		m_iSize(iSize),
+		m_iOverWrites(0)
+	{
+	}
+
+	int availableForWrite()
+	{
+		return m_iSize - (int)m_sQueued.size();
+	}
+
+	size_t write(const uint8_t *pData, size_t iLength)
+	{
+		if((int)iLength > availableForWrite())
+		{
+			m_iOverWrites++;
+		}
+		m_sQueued.append((const char *)pData, iLength);
+		return iLength;
+	}
+
+	void Drain()
+	{
+		m_sSent += m_sQueued;
+		m_sQueued.clear();
+	}
+
+	int m_iSize;
+	int m_iOverWrites;
+	std::string m_sQueued;
+	std::string m_sSent;
+};
+
+// As in FeatherLights
+static const char* const s_asNames[4] =
+{
+	"fNewSpeedRatio",
+	"g_fSpeedRatio",
+	"fDisplaySpeedRatio",
+	"LoopTimeMicro"
+};
+
+static const char *s_sLine =
+	"TELEMETRY n=2 fNewSpeedRatio=0.25/0.50/0.75 g_fSpeedRatio=1.00/1.50/2.00"
+	" fDisplaySpeedRatio=-3.50/-2.50/-1.50 LoopTimeMicro=12000.00/13000.00/14000.00\r\n";
+
+// One window of two samples, closed
+template<class TELEMETRY>
+static void AddWindow(TELEMETRY &oTelemetry, unsigned long &iNowMicro)
+{
+	static const float afSample0[4] = { 0.25f, 1.0f, -3.5f, 12000.0f };
+	static const float afSample1[4] = { 0.75f, 2.0f, -1.5f, 14000.0f };
+	oTelemetry.Add(afSample0);
+	oTelemetry.Add(afSample1);
+	iNowMicro += 1000;
+	CHECK(oTelemetry.Update(iNowMicro));
+}
+
+// Lines longer than the buffer, sent a piece at a time
+static void TestSmallBuffer(int iBufferSize)
+{
+	Telemetry<4, 4> oTelemetry(1000, s_asNames);
+	MockPort oPort(iBufferSize);
+	unsigned long iNowMicro = 0;
+	oTelemetry.Update(iNowMicro);
+	AddWindow(oTelemetry, iNowMicro);
+	AddWindow(oTelemetry, iNowMicro);
+	CHECK(strlen(s_sLine) > 64);
+
+	int iNumSent = 0;
+	int iNumCalls = 0;
+	while(iNumSent < 2 && iNumCalls < 1000)
+	{
+		iNumSent += oTelemetry.SendText(oPort);
+		oPort.Drain();
+		iNumCalls++;
+	}
+	printf("  %d byte buffer: 2 lines of %d in %d calls\n", iBufferSize, (int)strlen(s_sLine), iNumCalls);
+	CHECK(iNumSent == 2);
+	CHECK(oPort.m_iOverWrites == 0);
+	CHECK(oPort.m_sSent == std::string(s_sLine) + s_sLine);
+
+	// Nothing left
+	CHECK(oTelemetry.SendText(oPort) == 0);
+	CHECK(oPort.m_sQueued.empty());
+	CHECK(oTelemetry.GetDropped() == 0);
+}
+
+// A full buffer writes nothing, and a window is only dropped when the ring
+// and the line being sent are full
+static void TestFullBuffer()
+{
+	Telemetry<4, 2> oTelemetry(1000, s_asNames);
+	MockPort oPort(0);
+	unsigned long iNowMicro = 0;
+	oTelemetry.Update(iNowMicro);
+	for(int i = 0; i < 5; ++i)
+	{
+		AddWindow(oTelemetry, iNowMicro);
+		CHECK(oTelemetry.SendText(oPort) == 0);
+	}
+	CHECK(oPort.m_sQueued.empty());
+	CHECK(oTelemetry.GetDropped() == 2);
+
+	oPort.m_iSize = 1000;
+	CHECK(oTelemetry.SendText(oPort) == 3);
+	CHECK(oPort.m_sQueued == std::string(s_sLine) + s_sLine + s_sLine);
+}
+
+static std::string TextOf(float fValue)
+{
+	static const char* const asNames[1] = { "x" };
+	Telemetry<1, 1> oTelemetry(1000, asNames);
+	MockPort oPort(TELEMETRY_MAX_TEXT);
+	oTelemetry.Update(0);
+	oTelemetry.Add(&fValue);
+	oTelemetry.Update(1000);
+	CHECK(oTelemetry.SendText(oPort) == 1);
+	return oPort.m_sQueued;
+}
+
+static void TestNumbers()
+{
+	CHECK(TextOf(0.0f) == "TELEMETRY n=1 x=0.00/0.00/0.00\r\n");
+	CHECK(TextOf(0.005f) == "TELEMETRY n=1 x=0.01/0.01/0.01\r\n");
+	CHECK(TextOf(-12.345f) == "TELEMETRY n=1 x=-12.35/-12.35/-12.35\r\n");
+	CHECK(TextOf(NAN) == "TELEMETRY n=1 x=nan/nan/nan\r\n");
+	CHECK(TextOf(INFINITY) == "TELEMETRY n=1 x=40000000.00/40000000.00/40000000.00\r\n");
+	CHECK(TextOf(-INFINITY) == "TELEMETRY n=1 x=-40000000.00/-40000000.00/-40000000.00\r\n");
+	CHECK(TextOf(1e20f) == "TELEMETRY n=1 x=40000000.00/40000000.00/40000000.00\r\n");
+	CHECK(TextOf(42949672.0f) == "TELEMETRY n=1 x=40000000.00/40000000.00/40000000.00\r\n");
+	CHECK(TextOf(65536.25f) == "TELEMETRY n=1 x=65536.25/65536.25/65536.25\r\n");
+}
+
+// Frames are bigger than a 16 byte buffer too, and have to come back whole
+static void TestFrames()
+{
+	Telemetry<4, 4> oTelemetry(1000);
+	MockPort oPort(16);
+	unsigned long iNowMicro = 0;
+	oTelemetry.Update(iNowMicro);
+	AddWindow(oTelemetry, iNowMicro);
+	AddWindow(oTelemetry, iNowMicro);
+
+	int iNumSent = 0;
+	for(int i = 0; i < 100 && iNumSent < 2; ++i)
+	{
+		iNumSent += oTelemetry.SendFrame(oPort);
+		oPort.Drain();
+	}
+	CHECK(iNumSent == 2);
+	CHECK(oPort.m_iOverWrites == 0);
+
+	TuningFrameReader oReader;
+	TuningMessage oMsg;
+	int iNumMessages = 0;
+	for(size_t i = 0; i < oPort.m_sSent.size(); ++i)
+	{
+		if(oReader.Feed((uint8_t)oPort.m_sSent[i], oMsg))
+		{
+			CHECK(oMsg.m_yType == TUNING_MSG_TELEMETRY);
+			CHECK(oMsg.m_iLength == 3 + 4 * 12);
+			CHECK(oMsg.m_ayPayload[0] == 4);
+			float fMean;
+			memcpy(&fMean, oMsg.m_ayPayload + 3 + 3 * 12 + 4, 4);
+			CHECK(fMean == 13000.0f);
+			iNumMessages++;
+		}
+	}
+	CHECK(iNumMessages == 2);
+	CHECK(oReader.GetBadFrames() == 0);
+}
+
+int main()
+{
+	TestSmallBuffer(64);
+	TestSmallBuffer(7);
+	TestSmallBuffer(1);
+	TestFullBuffer();
+	TestNumbers();
+	TestFrames();
+	return HostTestResult("TestTelemetry");
+}
@@ -0,0 +1,193 @@
+/**
+ * File: TestTouchTrigger.cpp
+ *
+ * Description: Runs TouchTrigger (EATouchTrigger.h) the way TouchtoneArduino
+ * does, at 195 readings a second through the same ProcessingNode pair, on a
+ * sensor sitting at about 85 with a little noise.  Checks that:
+ *
+ *   - the resting input is all floor and gives no touches, and the floor
+ *     settles just over it
+ *   - a hand held on at 500 counts over the rest is one touch and stays
+ *     well over the floor for the ten seconds it is held, with the floor
+ *     never going over the ADC range
+ *   - the floor is back where it was soon after the hand comes off, and the
+ *     next touch is as strong as the first
+ *   - a hand left on for minutes does become the new floor in the end
+ *   - the noise stays between its limits however noisy the input is
+ */
+
+#include <stdio.h>
+#include "HostTest.h"
+#include "EAProcessingNode.h"
+#include "EATouchTrigger.h"
+
+#define READINGS_PER_SECOND 195
+#define REST_VALUE 85
+#define HOLD_VALUE (REST_VALUE + 500)
+#define ADC_MAX 1023
+
+// As in TouchtoneArduino
+#define MIN_SENSOR_VALUE 90
+#define MIN_INPUT_VALUE 10
+
+struct Touchtone
+{
+	Touchtone() :
+		m_oTrigger(MIN_SENSOR_VALUE, MIN_INPUT_VALUE, 0.4, 0.3),
+		m_oNode0(NULL, false, 0.0, 2, 1.0),
+		m_oNode1(&m_oNode0, true, 0.3, 10, 0.6),
+		m_iSensorValue(0),
+		m_iNumTouches(0),
+		m_iSeed(1)
+	{
+	}
+
+	// One reading of iValue plus up to iNoise either way
+	void Read(int iValue, int iNoise = 3)
+	{
+		m_iSeed = m_iSeed * 1103515245 + 12345;
+		int iRaw = iValue + (int)((m_iSeed >> 16) % (2 * iNoise + 1)) - iNoise;
+		m_iSensorValue = m_oTrigger.RemoveNoiseFloor(iRaw);
+		m_oNode0.UpdateFromInput(10, m_iSensorValue / 1024.0f);
+		m_oNode1.Update(10);
+		if(m_oTrigger.Update(m_oNode0.GetOutput(), m_oNode1.GetOutput()))
+		{
+			m_iNumTouches++;
+		}
+	}
+
+	// What the sketch lights the main dimmer from
+	bool IsInput() const
+	{
+		return m_iSensorValue > m_oTrigger.GetNoiseMargin();
+	}
+
+	TouchTrigger m_oTrigger;
+	ProcessingNode<2> m_oNode0;
+	ProcessingNode<10> m_oNode1;
+	int m_iSensorValue;
+	int m_iNumTouches;
+	unsigned m_iSeed;
+};
+
+static void TestHeldTouch()
+{
+	Touchtone oTouch;
+
+	// Two seconds at rest
+	int iNumInputs = 0;
+	for(int i = 0; i < 2 * READINGS_PER_SECOND; ++i)
+	{
+		oTouch.Read(REST_VALUE);
+		iNumInputs += oTouch.IsInput() ? 1 : 0;
+	}
+	int iRestFloor = oTouch.m_oTrigger.GetNoiseFloor();
+	printf("  at rest: floor %d, margin %d\n", iRestFloor, oTouch.m_oTrigger.GetNoiseMargin());
+	CHECK(iNumInputs == 0);
+	CHECK(oTouch.m_iNumTouches == 0);
+	CHECK(iRestFloor > REST_VALUE);
+
+	// Held on for ten seconds
+	int iMinValue = ADC_MAX;
+	int iMaxFloor = 0;
+	for(int i = 0; i < 10 * READINGS_PER_SECOND; ++i)
+	{
+		oTouch.Read(HOLD_VALUE);
+		if(i >= 2)
+		{
+			iMinValue = oTouch.m_iSensorValue < iMinValue ? oTouch.m_iSensorValue : iMinValue;
+		}
+		iMaxFloor = oTouch.m_oTrigger.GetNoiseFloor() > iMaxFloor ? oTouch.m_oTrigger.GetNoiseFloor() : iMaxFloor;
+		if(i == READINGS_PER_SECOND / 2 || i == 10 * READINGS_PER_SECOND - 1)
+		{
+			printf("  held %.1fs: g_iSensorValue %d, floor %d\n", (float)i / READINGS_PER_SECOND, oTouch.m_iSensorValue, oTouch.m_oTrigger.GetNoiseFloor());
+		}
+	}
+	CHECK(oTouch.m_iNumTouches == 1);
+	CHECK(iMinValue > 350);
+	CHECK(iMaxFloor < HOLD_VALUE);
+	CHECK(oTouch.IsInput());
+	float fFirstVelocity = oTouch.m_oTrigger.GetVelocity();
+
+	// Let go, and the floor is back within half a second
+	for(int i = 0; i < READINGS_PER_SECOND / 2; ++i)
+	{
+		oTouch.Read(REST_VALUE);
+	}
+	printf("  let go 0.5s: floor %d\n", oTouch.m_oTrigger.GetNoiseFloor());
+	CHECK(oTouch.m_oTrigger.GetNoiseFloor() <= iRestFloor + 5);
+	CHECK(!oTouch.IsInput());
+	for(int i = 0; i < 3 * READINGS_PER_SECOND; ++i)
+	{
+		oTouch.Read(REST_VALUE);
+	}
+
+	// The next touch is the same
+	for(int i = 0; i < READINGS_PER_SECOND; ++i)
+	{
+		oTouch.Read(HOLD_VALUE);
+	}
+	CHECK(oTouch.m_iNumTouches == 2);
+	CHECK(oTouch.m_iSensorValue > 450);
+	CHECK(oTouch.m_oTrigger.GetVelocity() > fFirstVelocity * 0.9f);
+}
+
+static void TestLongHold()
+{
+	// The level starts under the rest value and takes a while to come up to it
+	Touchtone oTouch;
+	for(int i = 0; i < 30 * READINGS_PER_SECOND; ++i)
+	{
+		oTouch.Read(REST_VALUE);
+	}
+	printf("  at rest 30s: floor %d, margin %d\n", oTouch.m_oTrigger.GetNoiseFloor(), oTouch.m_oTrigger.GetNoiseMargin());
+	CHECK(oTouch.m_oTrigger.GetNoiseFloor() > REST_VALUE);
+	CHECK(oTouch.m_oTrigger.GetNoiseFloor() < REST_VALUE + 10);
+	CHECK(oTouch.m_iNumTouches == 0);
+
+	// Left on until it is floor
+	int iSeconds = 0;
+	while(iSeconds < 600 && (iSeconds == 0 || oTouch.IsInput()))
+	{
+		for(int i = 0; i < READINGS_PER_SECOND; ++i)
+		{
+			oTouch.Read(HOLD_VALUE);
+		}
+		iSeconds++;
+	}
+	printf("  long hold: floor after %ds, floor %d\n", iSeconds, oTouch.m_oTrigger.GetNoiseFloor());
+	CHECK(iSeconds > 60);
+	CHECK(iSeconds < 600);
+	CHECK(oTouch.m_iNumTouches == 1);
+}
+
+static void TestNoiseLimits()
+{
+	// A wildly noisy input can't push the floor past the initial margin
+	// times TOUCH_MAX_NOISE_SCALE
+	Touchtone oNoisy;
+	for(int i = 0; i < 30 * READINGS_PER_SECOND; ++i)
+	{
+		oNoisy.Read(300, 250);
+		CHECK(oNoisy.m_oTrigger.GetNoiseMargin() <= (int)(MIN_INPUT_VALUE * TOUCH_MAX_NOISE_SCALE + 0.5f));
+		CHECK(oNoisy.m_oTrigger.GetNoiseFloor() <= ADC_MAX);
+	}
+
+	// And a dead steady one can't take it to nothing
+	Touchtone oSteady;
+	for(int i = 0; i < 30 * READINGS_PER_SECOND; ++i)
+	{
+		oSteady.Read(REST_VALUE, 0);
+	}
+	CHECK(oSteady.m_oTrigger.GetNoiseMargin() >= (int)TOUCH_MIN_NOISE);
+	CHECK(oSteady.m_oTrigger.GetNoiseFloor() > REST_VALUE);
+	CHECK(!oSteady.IsInput());
+}
+
+int main()
+{
+	TestHeldTouch();
+	TestLongHold();
+	TestNoiseLimits();
+	return HostTestResult("TestTouchTrigger");
+}
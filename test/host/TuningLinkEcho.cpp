@@ -0,0 +1,39 @@
+/**
+ * File: TuningLinkEcho.cpp
+ *
+ * Description: The C++ end of the tuning link loopback test
+ * (test_tuning_link.py).  Reads frames from stdin with TuningFrameReader
+ * and sends every good message straight back on stdout with
+ * TuningMessage::Encode().  At the end of the input it sends a STATUS
+ * message with the number of bad frames it saw.
+ */
+
+#include <stdio.h>
+#include "EATuningLink.h"
+
+static void Send(const TuningMessage &oMsg)
+{
+	uint8_t ayFrame[TUNING_MAX_FRAME];
+	int iLength = oMsg.Encode(ayFrame);
+	fwrite(ayFrame, 1, iLength, stdout);
+}
+
+int main()
+{
+	TuningFrameReader oReader;
+	TuningMessage oMsg;
+	int c;
+	while((c = getchar()) != EOF)
+	{
+		if(oReader.Feed((uint8_t)c, oMsg))
+		{
+			Send(oMsg);
+		}
+	}
+
+	oMsg.Begin(TUNING_MSG_STATUS);
+	oMsg.PutByte(1);
+	oMsg.PutFloat((float)oReader.GetBadFrames());
+	Send(oMsg);
+	return 0;
+}
@@ -0,0 +1,55 @@
+# test_led_timing.py
+#
+# Runs the shared frame time vectors (LedTimingVectors.txt) through
+# Python/led_timing.py, the other side of TestLedTiming.  Checks that
+# wire_micro() and frame_micro() give every time in the vectors, so the
+# Python copy of the model stays the same as EALedTiming.h.
+#
+# Run from the Makefile ("make test").
+
+import os
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+VECTORS = os.path.join(HERE, 'LedTimingVectors.txt')
+sys.dont_write_bytecode = True
+sys.path.insert(0, os.path.join(HERE, '..', '..', 'Python'))
+
+import led_timing
+
+
+def main():
+    num_frames = 0
+    num_failures = 0
+    with open(VECTORS) as f:
+        for line_number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            words = line.split()
+            if len(words) != 7 or words[0] != 'frame' or words[4] not in ('dma', 'blocking'):
+                print('test_led_timing: line %d: can\'t read "%s"' % (line_number, line))
+                num_failures += 1
+                continue
+            num_leds, num_strips, render_micro = int(words[1]), int(words[2]), int(words[3])
+            dma = words[4] == 'dma'
+            expected_wire, expected_frame = int(words[5]), int(words[6])
+            leds_per_strip = (num_leds + num_strips - 1) // num_strips
+            wire = led_timing.wire_micro(leds_per_strip)
+            frame = led_timing.frame_micro(num_leds, num_strips, render_micro, dma)
+            if wire != expected_wire or frame != expected_frame:
+                print('test_led_timing: line %d: wire %d frame %d, expected %d %d' %
+                      (line_number, wire, frame, expected_wire, expected_frame))
+                num_failures += 1
+            num_frames += 1
+
+    print('test_led_timing: %d frames' % num_frames)
+    if num_failures or not num_frames:
+        print('test_led_timing: %d failed' % num_failures)
+        return 1
+    print('test_led_timing: ok')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
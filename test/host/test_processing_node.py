@@ -0,0 +1,160 @@
+# test_processing_node.py
+#
+# Runs the shared ProcessingNode test vectors (ProcessingNodeVectors.txt)
+# through the Processing copies of the node, the other side of
+# TestProcessingNode.  Checks that:
+#
+#   - InputGraph/InputGraph.pde and TouchtonePC/TouchtonePC.pde have the
+#     same ProcessingNode class
+#   - that class gives every output in the vectors to the bit
+#
+# The class is taken out of the .pde as is and built as plain Java, with
+# the two things Processing would give it: float literals (Processing adds
+# the f to 1.0 and so on) and the MAX_NUM_SAMPLES and min() from the
+# sketch.  This needs a JDK (javac and java on the path).  Without one only
+# the first check is done, and it says so.
+#
+# Run from the Makefile ("make test").
+
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, '..', '..')
+VECTORS = os.path.join(HERE, 'ProcessingNodeVectors.txt')
+SKETCHES = [
+    os.path.join(ROOT, 'InputGraph', 'InputGraph.pde'),
+    os.path.join(ROOT, 'TouchtonePC', 'TouchtonePC.pde'),
+]
+
+RUNNER = r'''
+import java.io.*;
+import java.util.*;
+
+public class ProcessingNodeRunner
+{
+	static int MAX_NUM_SAMPLES = %(max_num_samples)s;
+
+	static int min(int a, int b)
+	{
+		return Math.min(a, b);
+	}
+
+%(node_class)s
+
+	int Run(String sPath) throws IOException
+	{
+		BufferedReader oReader = new BufferedReader(new FileReader(sPath));
+		ArrayList<ProcessingNode> aoNodes = new ArrayList<ProcessingNode>();
+		String sCase = "";
+		int iLine = 0;
+		int iNumSteps = 0;
+		int iNumFailures = 0;
+		String sLine;
+		while((sLine = oReader.readLine()) != null)
+		{
+			iLine++;
+			String[] as = sLine.trim().split("\\s+");
+			if(as[0].equals("case"))
+			{
+				sCase = as[1];
+				aoNodes.clear();
+			}
+			else if(as[0].equals("node"))
+			{
+				ProcessingNode oInput = aoNodes.isEmpty() ? null : aoNodes.get(aoNodes.size() - 1);
+				aoNodes.add(new ProcessingNode(oInput, as[1].equals("1"), Float.parseFloat(as[2]), Integer.parseInt(as[3]), Float.parseFloat(as[4])));
+			}
+			else if(as[0].equals("adjust"))
+			{
+				aoNodes.get(Integer.parseInt(as[1])).AdjustSmoothing(Float.parseFloat(as[2]), Integer.parseInt(as[3]));
+			}
+			else if(as[0].equals("step"))
+			{
+				int iDeltaMS = Integer.parseInt(as[1]);
+				aoNodes.get(0).UpdateFromInput(iDeltaMS, Float.parseFloat(as[2]));
+				for(int i = 1; i < aoNodes.size(); ++i)
+				{
+					aoNodes.get(i).Update(iDeltaMS);
+				}
+				for(int i = 0; i < aoNodes.size(); ++i)
+				{
+					int iExpected = (int)Long.parseLong(as[3 + i], 16);
+					int iBits = Float.floatToRawIntBits(aoNodes.get(i).GetOutput());
+					if(iBits != iExpected)
+					{
+						if(iNumFailures < 10)
+						{
+							System.out.printf("  %%s line %%d node %%d: %%08x, expected %%08x\n", sCase, iLine, i, iBits, iExpected);
+						}
+						iNumFailures++;
+					}
+				}
+				iNumSteps++;
+			}
+		}
+		oReader.close();
+		System.out.printf("  %%d steps, %%d outputs wrong\n", iNumSteps, iNumFailures);
+		return iNumFailures;
+	}
+
+	public static void main(String[] args) throws IOException
+	{
+		System.exit(new ProcessingNodeRunner().Run(args[0]) > 0 ? 1 : 0);
+	}
+}
+'''
+
+
+def node_class(path):
+    text = open(path).read()
+    match = re.search(r'^class ProcessingNode\b.*?^}', text, re.M | re.S)
+    if not match:
+        sys.exit('test_processing_node: no ProcessingNode class in %s' % path)
+    max_match = re.search(r'^static int MAX_NUM_SAMPLES\s*=\s*(\d+);', text, re.M)
+    if not max_match:
+        sys.exit('test_processing_node: no MAX_NUM_SAMPLES in %s' % path)
+    return match.group(0), max_match.group(1)
+
+
+def as_java(source):
+    # What Processing does to decimal literals before handing them to Java
+    return re.sub(r'(?<![\w.])(\d+\.\d*|\.\d+)(?![\w.])', r'\1f', source)
+
+
+def main():
+    classes = [node_class(path) for path in SKETCHES]
+    if classes[0] != classes[1]:
+        print('test_processing_node: the ProcessingNode in %s and %s are different' % tuple(SKETCHES))
+        return 1
+    print('test_processing_node: InputGraph and TouchtonePC have the same ProcessingNode')
+
+    javac = shutil.which('javac')
+    java = shutil.which('java')
+    if not javac or not java:
+        print('test_processing_node: no JDK on the path, the vectors were not run through it')
+        return 0
+
+    source, max_num_samples = classes[0]
+    node = '\n'.join('\t' + line if line else line for line in as_java(source).split('\n'))
+    work = tempfile.mkdtemp()
+    try:
+        with open(os.path.join(work, 'ProcessingNodeRunner.java'), 'w') as f:
+            f.write(RUNNER % {'max_num_samples': max_num_samples, 'node_class': node})
+        subprocess.check_call([javac, '-d', work, os.path.join(work, 'ProcessingNodeRunner.java')])
+        result = subprocess.call([java, '-cp', work, 'ProcessingNodeRunner', VECTORS])
+    finally:
+        shutil.rmtree(work)
+    if result != 0:
+        print('test_processing_node: failed')
+        return 1
+    print('test_processing_node: ok')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,120 @@
+# test_tuning_link.py
+#
+# Loopback test between the two sides of the tuning link:
+# libraries/EATuningLink/EATuningLink.h (through TuningLinkEcho) and
+# Python/tuning_link.py.  Python encodes a stream of messages, with stray
+# text and damaged frames mixed in, and pipes it through TuningLinkEcho,
+# which decodes each frame and encodes it again.  Checks that:
+#
+#   - every good message comes back with the same type and payload
+#   - the C++ frames are byte for byte the frames Python makes
+#   - C++ drops exactly the damaged frames and the stray text
+#   - Python drops a damaged C++ frame
+#
+# Run from the Makefile ("make test"), which builds TuningLinkEcho first.
+
+import os
+import random
+import struct
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'Python'))
+import tuning_link as tl
+
+ECHO = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'TuningLinkEcho')
+
+
+def make_messages(rng):
+    messages = [
+        (tl.MSG_SAVE_CURRENT, b''),
+        (tl.MSG_SET_TUNING, struct.pack('<Bf', 3, 0.05)),
+        (tl.MSG_SET_COLORS, bytes([1, 4, 0, 0, 255, 0])),
+        (tl.MSG_LOG, b'hello'),
+        (tl.MSG_STATUS, bytes(tl.MAX_PAYLOAD)),               # all zeros
+        (tl.MSG_STATUS, bytes([0xFF] * tl.MAX_PAYLOAD)),      # no zeros at all
+        (0x00, b'\x00\x00'),
+    ]
+    for _ in range(500):
+        length = rng.randint(0, tl.MAX_PAYLOAD)
+        zero_chance = rng.choice([0.0, 0.1, 0.5, 0.9])
+        payload = bytes(0 if rng.random() < zero_chance else rng.randint(1, 255) for _ in range(length))
+        messages.append((rng.randint(0, 255), payload))
+    return messages
+
+
+def damage(frame, rng):
+    # Flip a bit somewhere between the delimiters, without making a 0x00
+    # (that would just split the frame in two)
+    data = bytearray(frame)
+    while True:
+        pos = rng.randint(1, len(data) - 2)
+        bit = 1 << rng.randint(0, 7)
+        if data[pos] ^ bit != 0:
+            data[pos] ^= bit
+            return bytes(data)
+
+
+def main():
+    rng = random.Random(1)
+    messages = make_messages(rng)
+
+    stream = bytearray()
+    num_bad = 0
+    for i, (msg_type, payload) in enumerate(messages):
+        stream += tl.encode_frame(msg_type, payload)
+        if i % 7 == 3:
+            stream += b'stray debug text\r\n'
+            num_bad += 1
+        if i % 11 == 5:
+            stream += damage(tl.encode_frame(msg_type, payload), rng)
+            num_bad += 1
+    # Too long to be a frame
+    stream += b'\x00' + bytes([1] * (tl.MAX_PAYLOAD + 20)) + b'\x00'
+    num_bad += 1
+
+    result = subprocess.run([ECHO], input=bytes(stream), stdout=subprocess.PIPE, check=True)
+    echoed = result.stdout
+
+    failures = 0
+
+    def check(condition, what):
+        nonlocal failures
+        if not condition:
+            print('  failed: ' + what)
+            failures += 1
+
+    reader = tl.FrameReader()
+    replies = reader.feed(echoed)
+    check(reader.bad_frames == 0, 'Python found %d bad C++ frames' % reader.bad_frames)
+    check(len(replies) == len(messages) + 1, '%d replies for %d messages' % (len(replies), len(messages)))
+
+    for (msg_type, payload), reply in zip(messages, replies):
+        check(reply == (msg_type, payload), 'message 0x%02x of %d bytes came back different' % (msg_type, len(payload)))
+
+    # C++ frames are the same bytes as Python frames
+    expected = b''.join(tl.encode_frame(t, p) for t, p in messages)
+    check(echoed.startswith(expected), 'C++ and Python encode differently')
+
+    status_type, status_payload = replies[-1]
+    check(status_type == tl.MSG_STATUS, 'no STATUS at the end')
+    check(tl.parse_status(status_payload) == [float(num_bad)],
+          'C++ counted %s bad frames, expected %d' % (tl.parse_status(status_payload), num_bad))
+
+    # Python drops a damaged C++ frame and keeps the next one
+    first = len(tl.encode_frame(*messages[0]))
+    reader = tl.FrameReader()
+    check(reader.feed(damage(echoed[:first], rng) + tl.encode_frame(*messages[1])) == [messages[1]],
+          'Python kept a damaged frame')
+    check(reader.bad_frames == 1, 'Python did not count the damaged frame')
+
+    print('test_tuning_link: %d messages, %d bad frames' % (len(messages), num_bad))
+    if failures:
+        print('test_tuning_link: %d failed' % failures)
+        return 1
+    print('test_tuning_link: ok')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())